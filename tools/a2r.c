@@ -7,15 +7,10 @@
 #include "hardware.h"
 #include "a2r.h"
 
-struct a2r_header a2rheader;
-int a2r_is525=0; // Is the capture from a 5.25" disk in SS 40t 0.25 step
-
 void a2r_processtiming(struct a2r_strm *stream, FILE *a2rfile, unsigned char *buf, const uint32_t buflen)
 {
   uint8_t *buff;
 
-  hw_samplerate=A2R_SAMPLE_RATE;
-
   buff=malloc(stream->size);
 
   if (buff!=NULL)
@@ -65,7 +60,7 @@ void a2r_processtiming(struct a2r_strm *stream, FILE *a2rfile, unsigned char *bu
     fseek(a2rfile, stream->size, SEEK_CUR);
 }
 
-int a2r_processstream(struct a2r_chunkheader *chunkheader, FILE *a2rfile, const int track, const int side, unsigned char *buf, const uint32_t buflen)
+int a2r_processstream(A2R_Reader *a2r, struct a2r_chunkheader *chunkheader, FILE *a2rfile, const int track, const int side, unsigned char *buf, const uint32_t buflen)
 {
   struct a2r_strm stream;
   uint32_t done;
@@ -86,7 +81,7 @@ int a2r_processstream(struct a2r_chunkheader *chunkheader, FILE *a2rfile, const
     }
 
     // Check if this is the track/side we want
-    if (((a2r_is525==1) && (stream.location==track) && (side==0)) ||
+    if (((a2r->is525==1) && (stream.location==track) && (side==0)) ||
         (((stream.location>>1)==track) && ((stream.location&1)==side)))
     {
       switch (stream.type)
@@ -110,16 +105,16 @@ int a2r_processstream(struct a2r_chunkheader *chunkheader, FILE *a2rfile, const
   return 0;
 }
 
-long a2r_readtrack(FILE *a2rfile, const int track, const int side, unsigned char *buf, const uint32_t buflen)
+long a2r_readtrack(FILE *a2rfile, A2R_Reader *a2r, const int track, const int side, unsigned char *buf, const uint32_t buflen)
 {
-  // set RPM if available to hw_rpm
+  // set RPM if available
   // set resolution/bitrate if available
 
   // Clear out buffer incase we don't find the right track
   bzero(buf, buflen);
 
   // Seek to start of chunks
-  fseek(a2rfile, sizeof(a2rheader), SEEK_SET);
+  fseek(a2rfile, sizeof(a2r->header), SEEK_SET);
 
   // Loop through chunks
   while (!feof(a2rfile))
@@ -131,7 +126,7 @@ long a2r_readtrack(FILE *a2rfile, const int track, const int side, unsigned char
 
     if (strncmp((char *)&chunkheader.id, A2R_CHUNK_STRM, 4)==0)
     {
-      if (a2r_processstream(&chunkheader, a2rfile, track, side, buf, buflen)!=0)
+      if (a2r_processstream(a2r, &chunkheader, a2rfile, track, side, buf, buflen)!=0)
         return -1;
       else
         return 0;
@@ -143,7 +138,7 @@ long a2r_readtrack(FILE *a2rfile, const int track, const int side, unsigned char
   return 0;
 }
 
-int a2r_processinfo(struct a2r_chunkheader *chunkheader, FILE *a2rfile)
+int a2r_processinfo(A2R_Reader *a2r, struct a2r_chunkheader *chunkheader, FILE *a2rfile)
 {
   struct a2r_info *info;
   info=malloc(chunkheader->size);
@@ -159,30 +154,30 @@ int a2r_processinfo(struct a2r_chunkheader *chunkheader, FILE *a2rfile)
   }
 
   if (info->disktype==1)
-    a2r_is525=1;
+    a2r->is525=1;
 
   free(info);
 
   return 0;
 }
 
-int a2r_readheader(FILE *a2rfile)
+int a2r_readheader(FILE *a2rfile, A2R_Reader *a2r)
 {
   if (a2rfile==NULL) return -1;
 
-  if (fread(&a2rheader, sizeof(a2rheader), 1, a2rfile)==0)
+  if (fread(&a2r->header, sizeof(a2r->header), 1, a2rfile)==0)
     return -1;
 
-  if (strncmp((char *)&a2rheader.id, A2R_MAGIC2, strlen(A2R_MAGIC2))!=0)
+  if (strncmp((char *)&a2r->header.id, A2R_MAGIC2, strlen(A2R_MAGIC2))!=0)
   {
-    if (strncmp((char *)&a2rheader.id, A2R_MAGIC3, strlen(A2R_MAGIC3))!=0)
+    if (strncmp((char *)&a2r->header.id, A2R_MAGIC3, strlen(A2R_MAGIC3))!=0)
       return -1;
   }
 
-  if (a2rheader.ff!=0xff)
+  if (a2r->header.ff!=0xff)
     return -1;
 
-  if ((a2rheader.lfcrlf[0]!=0x0a) || (a2rheader.lfcrlf[1]!=0x0d) || (a2rheader.lfcrlf[2]!=0x0a))
+  if ((a2r->header.lfcrlf[0]!=0x0a) || (a2r->header.lfcrlf[1]!=0x0d) || (a2r->header.lfcrlf[2]!=0x0a))
     return -1;
 
   // Looks ok so far, now look for and process INFO chunk
@@ -195,7 +190,7 @@ int a2r_readheader(FILE *a2rfile)
 
     if (strncmp((char *)&chunkheader.id, A2R_CHUNK_INFO, 4)==0)
     {
-      if (a2r_processinfo(&chunkheader, a2rfile)!=0)
+      if (a2r_processinfo(a2r, &chunkheader, a2rfile)!=0)
         return -1;
       else
         return 0;
@@ -137,8 +137,15 @@ struct a2r_slvd_track
 
 #pragma pack(pop)
 
-extern long a2r_readtrack(FILE *a2rfile, const int track, const int side, unsigned char *buf, const uint32_t buflen);
+// State for reading an A2R file, samples are always at A2R_SAMPLE_RATE
+typedef struct A2RReader
+{
+  struct a2r_header header;
+  int is525; // Is the capture from a 5.25" disk in SS 40t 0.25 step
+} A2R_Reader;
+
+extern long a2r_readtrack(FILE *a2rfile, A2R_Reader *a2r, const int track, const int side, unsigned char *buf, const uint32_t buflen);
 
-extern int a2r_readheader(FILE *a2rfile);
+extern int a2r_readheader(FILE *a2rfile, A2R_Reader *a2r);
 
 #endif
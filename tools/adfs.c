@@ -113,7 +113,7 @@ unsigned char map_zone_valid_byte(void const * const map, const unsigned char lo
   return (unsigned char) ((sum_vector0^sum_vector1^sum_vector2^sum_vector3) & 0xff);
 }
 
-void adfs_gettitle(const int adfs_format, char *title, const int titlelen)
+void adfs_gettitle(Disk_Store *store, const int adfs_format, char *title, const int titlelen)
 {
   int map, dir;
   unsigned int adfs_sectorsize;
@@ -152,8 +152,8 @@ void adfs_gettitle(const int adfs_format, char *title, const int titlelen)
   }
 
   // Search for sectors
-  sector0=diskstore_findhybridsector(0, 0, 0);
-  sector1=diskstore_findhybridsector(0, 0, 1);
+  sector0=diskstore_findhybridsector(store, 0, 0, 0);
+  sector1=diskstore_findhybridsector(store, 0, 0, 1);
 
   // Check we have both sectors
   if ((sector0==NULL) || (sector1==NULL))
@@ -308,7 +308,7 @@ char *adfs_filetype(const unsigned int filetype)
   }
 }
 
-void adfs_readdir(const int level, const char *folder, const int maptype, const int dirtype, const unsigned long offset, const unsigned int adfs_sectorsize, const unsigned char sectorspertrack)
+void adfs_readdir(Disk_Store *store, const int level, const char *folder, const int maptype, const int dirtype, const unsigned long offset, const unsigned int adfs_sectorsize, const unsigned char sectorspertrack)
 {
   struct adfs_dirheader dh;
   struct adfs_direntry de;
@@ -321,8 +321,8 @@ void adfs_readdir(const int level, const char *folder, const int maptype, const
   if (offset>(4*1024*1024))
     return;
 
-  diskstore_absoluteseek(offset, dirtype==ADFS_OLDDIR?SEQUENCED:INTERLEAVED, 80);
-  if (diskstore_absoluteread((char *)&dh, sizeof(dh), dirtype==ADFS_OLDDIR?SEQUENCED:INTERLEAVED, 80)<sizeof(dh))
+  diskstore_absoluteseek(store, offset, dirtype==ADFS_OLDDIR?SEQUENCED:INTERLEAVED, 80);
+  if (diskstore_absoluteread(store, (char *)&dh, sizeof(dh), dirtype==ADFS_OLDDIR?SEQUENCED:INTERLEAVED, 80)<sizeof(dh))
     return;
 
   if (adfs_debug)
@@ -353,7 +353,7 @@ void adfs_readdir(const int level, const char *folder, const int maptype, const
     struct timeval tv;
     uint32_t indirectaddr;
 
-    if (diskstore_absoluteread((char *)&de, sizeof(de), dirtype==ADFS_OLDDIR?SEQUENCED:INTERLEAVED, 80)<sizeof(de))
+    if (diskstore_absoluteread(store, (char *)&de, sizeof(de), dirtype==ADFS_OLDDIR?SEQUENCED:INTERLEAVED, 80)<sizeof(de))
       return;
 
     // Check for last entry, as per RiscOS PRM 2-211
@@ -497,19 +497,19 @@ void adfs_readdir(const int level, const char *folder, const int maptype, const
 
       if (maptype==ADFS_OLDMAP)
       {
-        curdiskoffs=diskstore_absoffset;
+        curdiskoffs=store->absoffset;
 
-        adfs_readdir(level+1, newfolder, maptype, dirtype, indirectaddr*ADFS_8BITSECTORSIZE, adfs_sectorsize, sectorspertrack);
+        adfs_readdir(store, level+1, newfolder, maptype, dirtype, indirectaddr*ADFS_8BITSECTORSIZE, adfs_sectorsize, sectorspertrack);
 
-        diskstore_absoluteseek(curdiskoffs, dirtype==ADFS_OLDDIR?SEQUENCED:INTERLEAVED, 80);
+        diskstore_absoluteseek(store, curdiskoffs, dirtype==ADFS_OLDDIR?SEQUENCED:INTERLEAVED, 80);
       }
       else
       {
-        curdiskoffs=diskstore_absoffset;
+        curdiskoffs=store->absoffset;
 
-        adfs_readdir(level+1, newfolder, maptype, dirtype, fragstart[(indirectaddr&0x7fff00)>>8]*adfs_sectorsize, adfs_sectorsize, sectorspertrack);
+        adfs_readdir(store, level+1, newfolder, maptype, dirtype, fragstart[(indirectaddr&0x7fff00)>>8]*adfs_sectorsize, adfs_sectorsize, sectorspertrack);
 
-        diskstore_absoluteseek(curdiskoffs, dirtype==ADFS_OLDDIR?SEQUENCED:INTERLEAVED, 80);
+        diskstore_absoluteseek(store, curdiskoffs, dirtype==ADFS_OLDDIR?SEQUENCED:INTERLEAVED, 80);
       }
     }
 
@@ -520,7 +520,7 @@ void adfs_readdir(const int level, const char *folder, const int maptype, const
   // Skip over unused entries
   while ((entry+1)<entries)
   {
-    if (diskstore_absoluteread((char *)&de, sizeof(de), dirtype==ADFS_OLDDIR?SEQUENCED:INTERLEAVED, 80)<sizeof(de))
+    if (diskstore_absoluteread(store, (char *)&de, sizeof(de), dirtype==ADFS_OLDDIR?SEQUENCED:INTERLEAVED, 80)<sizeof(de))
       return;
 
     entry++;
@@ -531,7 +531,7 @@ void adfs_readdir(const int level, const char *folder, const int maptype, const
   {
     struct adfs_newdirtail ndt;
 
-    if (diskstore_absoluteread((char *)&ndt, sizeof(ndt), dirtype==ADFS_OLDDIR?SEQUENCED:INTERLEAVED, 80)<sizeof(ndt))
+    if (diskstore_absoluteread(store, (char *)&ndt, sizeof(ndt), dirtype==ADFS_OLDDIR?SEQUENCED:INTERLEAVED, 80)<sizeof(ndt))
       return;
 
     if (adfs_debug)
@@ -569,7 +569,7 @@ void adfs_readdir(const int level, const char *folder, const int maptype, const
   {
     struct adfs_olddirtail odt;
 
-    if (diskstore_absoluteread((char *)&odt, sizeof(odt), dirtype==ADFS_OLDDIR?SEQUENCED:INTERLEAVED, 80)<sizeof(odt))
+    if (diskstore_absoluteread(store, (char *)&odt, sizeof(odt), dirtype==ADFS_OLDDIR?SEQUENCED:INTERLEAVED, 80)<sizeof(odt))
       return;
 
     if (adfs_debug)
@@ -671,7 +671,7 @@ void adfs_dumpdiscrecord(struct adfs_discrecord *dr)
   printf("\n");
 }
 
-int adfs_readnewmap(const unsigned char idlen, const unsigned int bytespermapbit, const unsigned char nzones, const unsigned long discsize, const unsigned long sectorsize, const unsigned long zonespare)
+int adfs_readnewmap(Disk_Store *store, const unsigned char idlen, const unsigned int bytespermapbit, const unsigned char nzones, const unsigned long discsize, const unsigned long sectorsize, const unsigned long zonespare)
 {
   unsigned int fragid;
   unsigned char fragbits;
@@ -685,7 +685,7 @@ int adfs_readnewmap(const unsigned char idlen, const unsigned int bytespermapbit
   unsigned int mapbytes;
 
   if (adfs_debug)
-    printf("New Map @%lx (%d, %u, %d) %lu :\n", diskstore_absoffset, idlen, bytespermapbit, nzones, sectorsize);
+    printf("New Map @%lx (%d, %u, %d) %lu :\n", store->absoffset, idlen, bytespermapbit, nzones, sectorsize);
 
   pos=0;
 
@@ -698,7 +698,7 @@ int adfs_readnewmap(const unsigned char idlen, const unsigned int bytespermapbit
   {
     printf("Granularity: %ld, map bytes %u\n", (sectorsize>bytespermapbit)?sectorsize:bytespermapbit, mapbytes);
 
-    printf("Zone %u/%d @ %lx, %u allocation bytes\n", zone, nzones, diskstore_absoffset, zoneread);
+    printf("Zone %u/%d @ %lx, %u allocation bytes\n", zone, nzones, store->absoffset, zoneread);
   }
 
   fragstart=malloc(ADFS_MAXFRAG*sizeof(long));
@@ -706,7 +706,7 @@ int adfs_readnewmap(const unsigned char idlen, const unsigned int bytespermapbit
 
   do
   {
-    if (diskstore_absoluteread((char *)&mapdata, 1, INTERLEAVED, 80)<1)
+    if (diskstore_absoluteread(store, (char *)&mapdata, 1, INTERLEAVED, 80)<1)
       return 1;
 
     zoneread--;
@@ -716,10 +716,10 @@ int adfs_readnewmap(const unsigned char idlen, const unsigned int bytespermapbit
       zoneread=sectorsize-(zonespare/8);
 
       // Skip bit between map data
-      diskstore_absoluteseek(diskstore_absoffset+(zonespare/8), INTERLEAVED, 80);
+      diskstore_absoluteseek(store, store->absoffset+(zonespare/8), INTERLEAVED, 80);
 
       if (adfs_debug)
-        printf("Zone %u @ %lx, %u allocation bytes\n", zone, diskstore_absoffset, zoneread);
+        printf("Zone %u @ %lx, %u allocation bytes\n", zone, store->absoffset, zoneread);
     }
 
     for (bit=0; bit<8; bit++)
@@ -773,7 +773,7 @@ int adfs_readnewmap(const unsigned char idlen, const unsigned int bytespermapbit
   return 0;
 }
 
-void adfs_showinfo(const int adfs_format, const unsigned int disktracks, const int debug)
+void adfs_showinfo(Disk_Store *store, const int adfs_format, const unsigned int disktracks, const int debug)
 {
   int map, dir;
   unsigned int adfs_sectorsize;
@@ -830,8 +830,8 @@ void adfs_showinfo(const int adfs_format, const unsigned int disktracks, const i
     Disk_Sector *sector1;
 
     // Search for sectors
-    sector0=diskstore_findhybridsector(0, 0, 0);
-    sector1=diskstore_findhybridsector(0, 0, 1);
+    sector0=diskstore_findhybridsector(store, 0, 0, 0);
+    sector1=diskstore_findhybridsector(store, 0, 0, 1);
 
     // Check we have both sectors
     if ((sector0==NULL) || (sector1==NULL))
@@ -914,9 +914,9 @@ void adfs_showinfo(const int adfs_format, const unsigned int disktracks, const i
     // Do a directory listing, using root at start of 1st sector after 512 bytes of old map
     //   as per RiscOS PRM 2-200
     if (dir==ADFS_NEWDIR)
-      adfs_readdir(0, "", map, dir, ADFS_16BITSECTORSIZE, adfs_sectorsize, sectorspertrack);
+      adfs_readdir(store, 0, "", map, dir, ADFS_16BITSECTORSIZE, adfs_sectorsize, sectorspertrack);
     else
-      adfs_readdir(0, "", map, dir, ADFS_8BITSECTORSIZE*2, adfs_sectorsize, sectorspertrack);
+      adfs_readdir(store, 0, "", map, dir, ADFS_8BITSECTORSIZE*2, adfs_sectorsize, sectorspertrack);
   }
   else
   {
@@ -929,28 +929,28 @@ void adfs_showinfo(const int adfs_format, const unsigned int disktracks, const i
     // If this is a format with a boot sector, look for that
     if (adfs_format==ADFS_F)
     {
-      diskstore_absoluteseek(ADFS_BOOTBLOCKOFFSET+ADFS_BOOTDROFFSET, dir==ADFS_OLDDIR?SEQUENCED:INTERLEAVED, disktracks);
-      if (diskstore_absoluteread((char *)&dr, sizeof(dr), dir==ADFS_OLDDIR?SEQUENCED:INTERLEAVED, disktracks)<sizeof(dr))
+      diskstore_absoluteseek(store, ADFS_BOOTBLOCKOFFSET+ADFS_BOOTDROFFSET, dir==ADFS_OLDDIR?SEQUENCED:INTERLEAVED, disktracks);
+      if (diskstore_absoluteread(store, (char *)&dr, sizeof(dr), dir==ADFS_OLDDIR?SEQUENCED:INTERLEAVED, disktracks)<sizeof(dr))
         return;
 
-      diskstore_absoluteseek((dr.disc_size/2)-(adfs_sectorsize*2), dir==ADFS_OLDDIR?SEQUENCED:INTERLEAVED, disktracks);
+      diskstore_absoluteseek(store, (dr.disc_size/2)-(adfs_sectorsize*2), dir==ADFS_OLDDIR?SEQUENCED:INTERLEAVED, disktracks);
     }
     else
-      diskstore_absoluteseek(0, dir==ADFS_OLDDIR?SEQUENCED:INTERLEAVED, disktracks);
+      diskstore_absoluteseek(store, 0, dir==ADFS_OLDDIR?SEQUENCED:INTERLEAVED, disktracks);
 
-    if (diskstore_absoluteread((char *)&zh, sizeof(zh), dir==ADFS_OLDDIR?SEQUENCED:INTERLEAVED, disktracks)<sizeof(zh))
+    if (diskstore_absoluteread(store, (char *)&zh, sizeof(zh), dir==ADFS_OLDDIR?SEQUENCED:INTERLEAVED, disktracks)<sizeof(zh))
       return;
 
     printf("ZoneCheck: %.2x\n", zh.zonecheck);
     printf("FreeLink: %.4x\n", zh.freelink);
     printf("CrossCheck: %.2x\n", zh.crosscheck);
 
-    if (diskstore_absoluteread((char *)&dr, sizeof(dr), dir==ADFS_OLDDIR?SEQUENCED:INTERLEAVED, disktracks)<sizeof(dr))
+    if (diskstore_absoluteread(store, (char *)&dr, sizeof(dr), dir==ADFS_OLDDIR?SEQUENCED:INTERLEAVED, disktracks)<sizeof(dr))
       return;
 
     adfs_dumpdiscrecord(&dr);
 
-    if (adfs_readnewmap(dr.idlen, rev_log2(dr.log2bpmb), dr.nzones, dr.disc_size, rev_log2(dr.log2secsize), dr.zone_spare)!=0)
+    if (adfs_readnewmap(store, dr.idlen, rev_log2(dr.log2bpmb), dr.nzones, dr.disc_size, rev_log2(dr.log2secsize), dr.zone_spare)!=0)
       return;
 
     if (fragstart==NULL) return;
@@ -961,7 +961,7 @@ void adfs_showinfo(const int adfs_format, const unsigned int disktracks, const i
     else
       secoffset=0;
 
-    adfs_readdir(0, "", map, dir, (fragstart[(dr.root&0x7fff00)>>8]+secoffset)*adfs_sectorsize, adfs_sectorsize, sectorspertrack);
+    adfs_readdir(store, 0, "", map, dir, (fragstart[(dr.root&0x7fff00)>>8]+secoffset)*adfs_sectorsize, adfs_sectorsize, sectorspertrack);
   }
 
   if (fragstart!=NULL)
@@ -971,7 +971,7 @@ void adfs_showinfo(const int adfs_format, const unsigned int disktracks, const i
   }
 }
 
-int adfs_validate()
+int adfs_validate(Disk_Store *store)
 {
   int format;
   unsigned char sniff[ADFS_16BITSECTORSIZE];
@@ -979,8 +979,8 @@ int adfs_validate()
   Disk_Sector *sector1;
 
   // Search for first two sectors
-  sector0=diskstore_findhybridsector(0, 0, 0);
-  sector1=diskstore_findhybridsector(0, 0, 1);
+  sector0=diskstore_findhybridsector(store, 0, 0, 0);
+  sector1=diskstore_findhybridsector(store, 0, 0, 1);
 
   format=ADFS_UNKNOWN;
 
@@ -1092,7 +1092,7 @@ int adfs_validate()
       if (format==ADFS_UNKNOWN)
       {
         // On a floppy disk with 1024 byte sectors (which all new map are), 0xc00 is at C0 H0 S3
-        sector0=diskstore_findhybridsector(0, 0, 3);
+        sector0=diskstore_findhybridsector(store, 0, 0, 3);
 
         if ((sector0!=NULL) && (sector0->data!=NULL))
         {
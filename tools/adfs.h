@@ -246,8 +246,8 @@ struct adfs_discrecord
 
 #pragma pack(pop)
 
-extern void adfs_gettitle(const int adfs_format, char *title, const int titlelen);
-extern void adfs_showinfo(const int adfs_format, const unsigned int disktracks, const int debug);
-extern int adfs_validate();
+extern void adfs_gettitle(Disk_Store *store, const int adfs_format, char *title, const int titlelen);
+extern void adfs_showinfo(Disk_Store *store, const int adfs_format, const unsigned int disktracks, const int debug);
+extern int adfs_validate(Disk_Store *store);
 
 #endif
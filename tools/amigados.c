@@ -8,8 +8,6 @@
 #include "amigamfm.h"
 #include "amigados.h"
 
-uint32_t amigados_rootblock=0;
-
 int amigados_debug=0;
 
 void amigados_decodedate(const uint32_t days, const uint32_t mins, const uint32_t ticks, struct tm *tim)
@@ -32,16 +30,40 @@ uint16_t amigados_readshort(const uint32_t offset, const uint8_t *data)
   return ((data[offset+0]<<8) | (data[offset+1]));
 }
 
-void amigados_gettitle(const unsigned int disktracks, char *title, const int titlelen)
+// Find the rootblock named in the bootblock of a DOS disk, 0 if there isn't one
+uint32_t amigados_getrootblock(Disk_Store *store)
+{
+  Disk_Sector *sector0;
+  uint32_t rootblock;
+
+  sector0=diskstore_findhybridsector(store, 0, 0, 0);
+
+  if ((sector0==NULL) || (sector0->data==NULL) || (sector0->datasize!=AMIGA_DATASIZE))
+    return 0;
+
+  if ((sector0->data[0]!='D') || (sector0->data[1]!='O') || (sector0->data[2]!='S'))
+    return 0;
+
+  rootblock=sector0->data[8];
+  rootblock=(rootblock<<8)|sector0->data[9];
+  rootblock=(rootblock<<8)|sector0->data[10];
+  rootblock=(rootblock<<8)|sector0->data[11];
+
+  return rootblock;
+}
+
+void amigados_gettitle(Disk_Store *store, const unsigned int disktracks, char *title, const int titlelen)
 {
   uint8_t tmpbuff[AMIGA_DATASIZE];
+  uint32_t rootblock;
 
-  if (amigados_rootblock==0) return;
+  rootblock=amigados_getrootblock(store);
+  if (rootblock==0) return;
 
   // Absolute seek and read
-  diskstore_absoluteseek(amigados_rootblock*AMIGA_DATASIZE, INTERLEAVED, disktracks);
+  diskstore_absoluteseek(store, rootblock*AMIGA_DATASIZE, INTERLEAVED, disktracks);
 
-  if (diskstore_absoluteread((char *)tmpbuff, AMIGA_DATASIZE, INTERLEAVED, disktracks)<AMIGA_DATASIZE)
+  if (diskstore_absoluteread(store, (char *)tmpbuff, AMIGA_DATASIZE, INTERLEAVED, disktracks)<AMIGA_DATASIZE)
     return;
 
   if (titlelen>tmpbuff[AMIGA_DATASIZE-0x50])
@@ -55,7 +77,7 @@ void amigados_gettitle(const unsigned int disktracks, char *title, const int tit
   }
 }
 
-void amigados_readfsentry(const unsigned int level, const unsigned int disktracks, const uint32_t fsblock)
+void amigados_readfsentry(Disk_Store *store, const unsigned int level, const unsigned int disktracks, const uint32_t fsblock)
 {
   uint32_t i;
   uint32_t prot;
@@ -63,9 +85,9 @@ void amigados_readfsentry(const unsigned int level, const unsigned int disktrack
   struct tm tim;
 
   // Absolute seek and read
-  diskstore_absoluteseek(fsblock*AMIGA_DATASIZE, INTERLEAVED, disktracks);
+  diskstore_absoluteseek(store, fsblock*AMIGA_DATASIZE, INTERLEAVED, disktracks);
 
-  if (diskstore_absoluteread((char *)fsbuff, AMIGA_DATASIZE, INTERLEAVED, disktracks)<AMIGA_DATASIZE)
+  if (diskstore_absoluteread(store, (char *)fsbuff, AMIGA_DATASIZE, INTERLEAVED, disktracks)<AMIGA_DATASIZE)
     return;
 
   // Check type
@@ -139,31 +161,33 @@ void amigados_readfsentry(const unsigned int level, const unsigned int disktrack
       if (amigados_debug)
         printf("  HT[%u] %.8x\n", i, fsdblock);
 
-      amigados_readfsentry(level+1, disktracks, fsdblock);
+      amigados_readfsentry(store, level+1, disktracks, fsdblock);
     }
   }
 
   // Check for fs entries which share the same hash by following hash chain
   if (amigados_readlong(AMIGA_DATASIZE-0x10, fsbuff)!=0)
-    amigados_readfsentry(level, disktracks, amigados_readlong(AMIGA_DATASIZE-0x10, fsbuff));
+    amigados_readfsentry(store, level, disktracks, amigados_readlong(AMIGA_DATASIZE-0x10, fsbuff));
 }
 
 // http://lclevy.free.fr/adflib/adf_info.html
-void amigados_showinfo(const unsigned int disktracks, const int debug)
+void amigados_showinfo(Disk_Store *store, const unsigned int disktracks, const int debug)
 {
   uint32_t i;
   uint8_t tmpbuff[AMIGA_DATASIZE];
   struct tm tim;
+  uint32_t rootblock;
   (void) debug;
 
-  if (amigados_rootblock==0) return;
+  rootblock=amigados_getrootblock(store);
+  if (rootblock==0) return;
 
-  printf("Rootblock @ %u\n", amigados_rootblock);
+  printf("Rootblock @ %u\n", rootblock);
 
   // Absolute seek and read
-  diskstore_absoluteseek(amigados_rootblock*AMIGA_DATASIZE, INTERLEAVED, disktracks);
+  diskstore_absoluteseek(store, rootblock*AMIGA_DATASIZE, INTERLEAVED, disktracks);
 
-  if (diskstore_absoluteread((char *)tmpbuff, AMIGA_DATASIZE, INTERLEAVED, disktracks)<AMIGA_DATASIZE)
+  if (diskstore_absoluteread(store, (char *)tmpbuff, AMIGA_DATASIZE, INTERLEAVED, disktracks)<AMIGA_DATASIZE)
     return;
 
   printf("Rootblock\n");
@@ -185,7 +209,7 @@ void amigados_showinfo(const unsigned int disktracks, const int debug)
       if (amigados_debug)
         printf("  HT[%u] %.8x\n", i, fsblock);
 
-      amigados_readfsentry(0, disktracks, fsblock);
+      amigados_readfsentry(store, 0, disktracks, fsblock);
     }
   }
 
@@ -233,9 +257,10 @@ uint32_t amigados_calcbootchecksum(const uint8_t *bootblock)
   return ~(checksum);
 }
 
-int amigados_validate()
+int amigados_validate(Disk_Store *store)
 {
   int format;
+  uint32_t rootblock;
   uint8_t sniff[AMIGA_SECTOR_SIZE];
   Disk_Sector *sector0;
   Disk_Sector *sector1;
@@ -243,8 +268,8 @@ int amigados_validate()
   format=AMIGADOS_UNKNOWN;
 
   // Search for sectors
-  sector0=diskstore_findhybridsector(0, 0, 0);
-  sector1=diskstore_findhybridsector(0, 0, 1);
+  sector0=diskstore_findhybridsector(store, 0, 0, 0);
+  sector1=diskstore_findhybridsector(store, 0, 0, 1);
 
   // Check we have sectors
   if ((sector0==NULL) || (sector1==NULL))
@@ -275,12 +300,9 @@ int amigados_validate()
       checksum=(checksum<<8)|sniff[6];
       checksum=(checksum<<8)|sniff[7];
 
-      amigados_rootblock=sniff[8];
-      amigados_rootblock=(amigados_rootblock<<8)|sniff[9];
-      amigados_rootblock=(amigados_rootblock<<8)|sniff[10];
-      amigados_rootblock=(amigados_rootblock<<8)|sniff[11];
+      rootblock=amigados_getrootblock(store);
 
-      if (amigados_rootblock==AMIGADOS_DD_ROOTBLOCK)
+      if (rootblock==AMIGADOS_DD_ROOTBLOCK)
       {
         format=AMIGADOS_DOS_FORMAT;
 
@@ -307,7 +329,7 @@ int amigados_validate()
           memset(&sniff[4], 0, 4);
 
           printf("Checksum : %x, calculated %x\n", checksum, amigados_calcbootchecksum((uint8_t *)&sniff));
-          printf("Rootblock : %u\n", amigados_rootblock);
+          printf("Rootblock : %u\n", rootblock);
         }
       }
     }
@@ -327,5 +349,4 @@ int amigados_validate()
 void amigados_init(const int debug)
 {
   amigados_debug=debug;
-  amigados_rootblock=0;
 }
@@ -1,6 +1,8 @@
 #ifndef _AMIGADOS_H_
 #define _AMIGADOS_H_
 
+#include "diskstore.h"
+
 /*
 
 From : http://lclevy.free.fr/adflib/adf_info.html
@@ -22,11 +24,11 @@ From : http://lclevy.free.fr/adflib/adf_info.html
 #define AMIGADOS_FILE 0xfffffffd
 #define AMIGADOS_DIR  2
 
-extern void amigados_gettitle(const unsigned int disktracks, char *title, const int titlelen);
+extern void amigados_gettitle(Disk_Store *store, const unsigned int disktracks, char *title, const int titlelen);
 
-extern void amigados_showinfo(const unsigned int disktracks, const int debug);
+extern void amigados_showinfo(Disk_Store *store, const unsigned int disktracks, const int debug);
 
-extern int amigados_validate();
+extern int amigados_validate(Disk_Store *store);
 
 extern void amigados_init(const int debug);
 
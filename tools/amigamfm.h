@@ -1,6 +1,10 @@
 #ifndef _AMIGAMFM_H_
 #define _AMIGAMFM_H_
 
+#include "diskstore.h"
+#include "mfm.h"
+#include "pll.h"
+
 /*
 
 From : http://lclevy.free.fr/adflib/adf_info.html
@@ -109,8 +113,39 @@ A DD disk has 11*2*80=1760 (0 to 1759) blocks, a HD disk has 22*2*80=3520 blocks
 
 #define AMIGA_MFM_MASK 0x55555555
 
-extern void amigamfm_addsample(const unsigned long samples, const unsigned long datapos, const int usepll);
+typedef struct AmigaMFMContext
+{
+  int debug;
+
+  // Where to store found sectors, and which track they came from
+  Disk_Store *store;
+  uint8_t physical_track;
+  uint8_t physical_head;
+  unsigned int sectorsfound;
+
+  int state; // state machine
+  unsigned int datacells; // 16 bit sliding buffer
+  int bits; // Number of used bits within sliding buffer
+  unsigned int p1, p2, p3; // bit history
+
+  unsigned long blockpos;
+  int idamtrack, idamhead, idamsector, idamlength; // IDAM values
+  int lasttrack, lasthead, lastsector, lastlength;
+
+  // Output block data buffer, for a single sector
+  unsigned char bitstream[MFM_BLOCKSIZE];
+  unsigned int bitlen;
+
+  // MFM timings
+  float defaultwindow;
+  float bucket01, bucket001, bucket0001;
+
+  struct PLL pll;
+} AmigaMFM_Context;
+
+extern void amigamfm_addsample(AmigaMFM_Context *amigamfm, const unsigned long samples, const unsigned long datapos, const int usepll);
 
-extern void amigamfm_init(const int debug, const char density);
+extern void amigamfm_init(AmigaMFM_Context *amigamfm, const int debug, const char density, Disk_Store *store, const uint8_t physical_track, const uint8_t physical_head, const float rpm, const unsigned long samplerate);
+extern unsigned int amigamfm_finish(AmigaMFM_Context *amigamfm);
 
 #endif
@@ -12,17 +12,17 @@
 #include "applegcr.h"
 #include "appledos.h"
 
-void appledos_showinfo(const int debug)
+void appledos_showinfo(Disk_Store *store, const int debug)
 {
   Disk_Sector *sector0;
   Disk_Sector *sector1;
 
   // First check sectors are in Apple format
-  if (diskstore_countsectormod(MODAPPLEGCR)==0)
+  if (diskstore_countsectormod(store, MODAPPLEGCR)==0)
     return;
 
   // Search for VTOC sector
-  sector0=diskstore_findhybridsector(17, 0, 0);
+  sector0=diskstore_findhybridsector(store, 17, 0, 0);
 
   // Check we have VTOC sector
   if (sector0==NULL)
@@ -72,7 +72,7 @@ void appledos_showinfo(const int debug)
     }
 
     // Search for catalog sector
-    sector1=diskstore_findhybridsector(vtoc->firstcattrack, 0, vtoc->firstcatsector);
+    sector1=diskstore_findhybridsector(store, vtoc->firstcattrack, 0, vtoc->firstcatsector);
 
     // Check we have catalog sector
     if (sector1==NULL)
@@ -152,7 +152,7 @@ void appledos_showinfo(const int debug)
         }
 
         // Search for next catalog sector
-        sector1=diskstore_findhybridsector(cat->nextcattrack, 0, cat->nextcatsector);
+        sector1=diskstore_findhybridsector(store, cat->nextcattrack, 0, cat->nextcatsector);
       }
     }
   }
@@ -160,7 +160,7 @@ void appledos_showinfo(const int debug)
   return;
 }
 
-int appledos_validate()
+int appledos_validate(Disk_Store *store)
 {
   int format;
   Disk_Sector *sector0;
@@ -168,15 +168,15 @@ int appledos_validate()
   format=APPLEDOS_UNKNOWN;
 
   // First check sectors are in Apple format
-  if (diskstore_countsectormod(MODAPPLEGCR)==0)
+  if (diskstore_countsectormod(store, MODAPPLEGCR)==0)
     return format;
 
   // Validate we have either 13 or 16 sectors/track
-  if ((diskstore_maxsectorid!=12) && (diskstore_maxsectorid!=15))
+  if ((store->maxsectorid!=12) && (store->maxsectorid!=15))
     return format;
 
   // Search for VTOC sector
-  sector0=diskstore_findhybridsector(17, 0, 0);
+  sector0=diskstore_findhybridsector(store, 17, 0, 0);
 
   // Check we have VTOC sector
   if (sector0==NULL)
@@ -184,16 +184,16 @@ int appledos_validate()
     char tmpbuff[APPLEGCR_SECTORLEN];
 
     // We may not have read it yet, so have a go
-    diskstore_abstrack=17;
-    diskstore_abshead=0;
-    diskstore_abssector=0;
-    diskstore_abssecoffs=0;
+    store->abstrack=17;
+    store->abshead=0;
+    store->abssector=0;
+    store->abssecoffs=0;
 
-    diskstore_absoluteread(tmpbuff, APPLEGCR_SECTORLEN, 0, APPLEDOS_MAXTRACK);
+    diskstore_absoluteread(store, tmpbuff, APPLEGCR_SECTORLEN, 0, APPLEDOS_MAXTRACK);
   }
 
   // Search for VTOC sector
-  sector0=diskstore_findhybridsector(17, 0, 0);
+  sector0=diskstore_findhybridsector(store, 17, 0, 0);
 
   // Check we have VTOC sector
   if (sector0==NULL)
@@ -1,6 +1,8 @@
 #ifndef _APPLEDOS_H_
 #define _APPLEDOS_H_
 
+#include "diskstore.h"
+
 #pragma pack(push,1)
 
 #define APPLEDOS_UNKNOWN -1
@@ -85,7 +87,7 @@ struct appledos_ts
 
 #pragma pack(pop)
 
-extern int appledos_validate();
-extern void appledos_showinfo(const int debug);
+extern int appledos_validate(Disk_Store *store);
+extern void appledos_showinfo(Disk_Store *store, const int debug);
 
 #endif
@@ -50,20 +50,6 @@
 //    E          8          7         A
 //    F          F          F         5
 
-int applegcr_state=APPLEGCR_IDLE; // state machine
-uint32_t applegcr_datacells; // 32 bit sliding buffer
-int applegcr_bits=0; // Number of used bits within sliding buffer
-float applegcr_defaultwindow; // Number of samples in window
-float applegcr_threshold01; // Number of samples for an 01
-float applegcr_threshold001; // Number of samples for an 001
-
-// Most recent address mark
-unsigned long applegcr_idpos, applegcr_blockpos;
-int applegcr_idamtrack, applegcr_idamsector; // IDAM values
-int applegcr_lasttrack, applegcr_lastsector; // last known good IDAM values
-unsigned int applegcr_idblockcrc, applegcr_datablockcrc;
-
-unsigned int applegcr_datamode;
 const uint8_t applegcr_gcr53encodemap[]=
 {
   0xab, 0xad, 0xae, 0xaf, 0xb5, 0xb6, 0xb7, 0xba, // 0x00
@@ -84,18 +70,10 @@ const uint8_t applegcr_gcr62encodemap[]=
 };
 unsigned char applegcr_gcr53decodemap[0x100];
 unsigned char applegcr_gcr62decodemap[0x100];
+int applegcr_decodemapsbuilt=0;
 
 const uint8_t applegcr_bit_reverse[] = {0, 2, 1, 3};
 
-unsigned char applegcr_bytebuff[1024];
-unsigned int applegcr_bytelen;
-
-unsigned char applegcr_decodebuff[1024];
-
-struct PLL *applegcr_pll;
-
-int applegcr_debug=0;
-
 void applegcr_buildgcrdecodemaps()
 {
   unsigned int i;
@@ -107,6 +85,8 @@ void applegcr_buildgcrdecodemaps()
   bzero(applegcr_gcr62decodemap, sizeof(applegcr_gcr62decodemap));
   for (i=0; i<sizeof(applegcr_gcr62encodemap); i++)
     applegcr_gcr62decodemap[applegcr_gcr62encodemap[i]]=i;
+
+  applegcr_decodemapsbuilt=1;
 }
 
 // Odd-Even encoded (this is basically like standard FM)
@@ -139,29 +119,29 @@ unsigned char applegcr_calc_eor(unsigned char *buff, unsigned int len)
 // * the first 86 bytes of the encoded sector are used to keep the lowest two bits of all bytes;
 // * the remaining portions of six bits fill the final 256 on-disk bytes of the sector;
 // * an exclusive OR checksum is used, but to reduce decoding time it is applied within the six-bit data
-void applegcr_process_data62()
+void applegcr_process_data62(AppleGCR_Context *applegcr, const unsigned long datapos)
 {
   int i;
   unsigned char buff[512];
   unsigned char cx;
 
   bzero(buff, sizeof(buff));
-  bzero(applegcr_decodebuff, sizeof(applegcr_decodebuff));
+  bzero(applegcr->decodebuff, sizeof(applegcr->decodebuff));
 
   // Convert 342+1 disk bytes into 342+1 6-bit GCR
   for (i=0; i<(APPLEGCR_DATA_62+1); i++)
-    applegcr_decodebuff[i]=applegcr_gcr62decodemap[applegcr_bytebuff[i]];
+    applegcr->decodebuff[i]=applegcr_gcr62decodemap[applegcr->bytebuff[i]];
 
   // XOR 342+1 GCR bytes to undo checksum process
   for (i=0; i<(APPLEGCR_DATA_62+1); i++)
   {
     if (i==0)
-      applegcr_decodebuff[i]^=0;
+      applegcr->decodebuff[i]^=0;
     else
-      applegcr_decodebuff[i]^=applegcr_decodebuff[i-1];
+      applegcr->decodebuff[i]^=applegcr->decodebuff[i-1];
   }
 
-  cx=applegcr_decodebuff[APPLEGCR_DATA_62];
+  cx=applegcr->decodebuff[APPLEGCR_DATA_62];
 
   if (cx==0)
   {
@@ -170,7 +150,7 @@ void applegcr_process_data62()
     {
       unsigned char value;
 
-      value=applegcr_decodebuff[i];
+      value=applegcr->decodebuff[i];
 
       if (i<(APPLEGCR_DATA_62-APPLEGCR_SECTORLEN-2))
         buff[i+((APPLEGCR_DATA_62-APPLEGCR_SECTORLEN)*2)]|=applegcr_bit_reverse[(value>>4) & 0x3];
@@ -180,20 +160,21 @@ void applegcr_process_data62()
     }
 
     for (i=(APPLEGCR_DATA_62-APPLEGCR_SECTORLEN); i<(APPLEGCR_DATA_62+1); i++)
-      buff[i-(APPLEGCR_DATA_62-APPLEGCR_SECTORLEN)]|=(applegcr_decodebuff[i]<<2);
+      buff[i-(APPLEGCR_DATA_62-APPLEGCR_SECTORLEN)]|=(applegcr->decodebuff[i]<<2);
 
     // Check we have an ID
-    if ((applegcr_idamtrack!=-1) && (applegcr_idamsector!=-1))
+    if ((applegcr->idamtrack!=-1) && (applegcr->idamsector!=-1))
     {
-      diskstore_addsector(MODAPPLEGCR, hw_currenttrack, hw_currenthead, applegcr_idamtrack, hw_currenthead, applegcr_idamsector, 1, applegcr_idpos, applegcr_idblockcrc, applegcr_blockpos, applegcr_datamode, APPLEGCR_SECTORLEN, &buff[0], applegcr_decodebuff[APPLEGCR_DATA_62]);
+      if (diskstore_addsector(applegcr->store, MODAPPLEGCR, applegcr->physical_track, applegcr->physical_head, applegcr->idamtrack, applegcr->physical_head, applegcr->idamsector, 1, applegcr->idpos, applegcr->idblockcrc, applegcr->blockpos, applegcr->datamode, APPLEGCR_SECTORLEN, &buff[0], applegcr->decodebuff[APPLEGCR_DATA_62], datapos)==1)
+        applegcr->sectorsfound++;
     }
     else
     {
-      if (applegcr_debug)
+      if (applegcr->debug)
       {
         fprintf(stderr, "** VALID DATA BUT INVALID ID");
-        if ((applegcr_lasttrack!=-1) && (applegcr_lastsector!=-1))
-          fprintf(stderr, ", last found ID was T%d S%d", applegcr_lasttrack, applegcr_lastsector);
+        if ((applegcr->lasttrack!=-1) && (applegcr->lastsector!=-1))
+          fprintf(stderr, ", last found ID was T%d S%d", applegcr->lasttrack, applegcr->lastsector);
 
         fprintf(stderr, " **\n");
       }
@@ -201,45 +182,45 @@ void applegcr_process_data62()
   }
   else
   {
-    if (applegcr_debug)
+    if (applegcr->debug)
     {
-      fprintf(stderr, "** INVALID DATA EORSUM [%.2x] (%.2x)", applegcr_decodebuff[341], applegcr_decodebuff[APPLEGCR_DATA_62]);
-      if ((applegcr_idamtrack!=-1) && (applegcr_idamsector!=-1))
-        fprintf(stderr, ", possibly for T%d S%d", applegcr_idamtrack, applegcr_idamsector);
+      fprintf(stderr, "** INVALID DATA EORSUM [%.2x] (%.2x)", applegcr->decodebuff[341], applegcr->decodebuff[APPLEGCR_DATA_62]);
+      if ((applegcr->idamtrack!=-1) && (applegcr->idamsector!=-1))
+        fprintf(stderr, ", possibly for T%d S%d", applegcr->idamtrack, applegcr->idamsector);
 
       fprintf(stderr, " **\n");
     }
   }
 
   // Clear IDAM cache
-  applegcr_idamtrack=-1;
-  applegcr_idamsector=-1;
+  applegcr->idamtrack=-1;
+  applegcr->idamsector=-1;
 }
 
 // Process data block stored using 5 data bits, 3 extra bits per byte format
-void applegcr_process_data53()
+void applegcr_process_data53(AppleGCR_Context *applegcr, const unsigned long datapos)
 {
   int i;
   unsigned char buff[512];
   unsigned char cx;
 
   bzero(buff, sizeof(buff));
-  bzero(applegcr_decodebuff, sizeof(applegcr_decodebuff));
+  bzero(applegcr->decodebuff, sizeof(applegcr->decodebuff));
 
   // Convert 410+1 disk bytes into 410+1 5-bit GCR
   for (i=0; i<(APPLEGCR_DATA_53+1); i++)
-    applegcr_decodebuff[i]=applegcr_gcr53decodemap[applegcr_bytebuff[i]];
+    applegcr->decodebuff[i]=applegcr_gcr53decodemap[applegcr->bytebuff[i]];
 
   // XOR 410+1 GCR bytes to undo checksum process
   for (i=0; i<(APPLEGCR_DATA_53+1); i++)
   {
     if (i==0)
-      applegcr_decodebuff[i]^=0;
+      applegcr->decodebuff[i]^=0;
     else
-      applegcr_decodebuff[i]^=applegcr_decodebuff[i-1];
+      applegcr->decodebuff[i]^=applegcr->decodebuff[i-1];
   }
 
-  cx=applegcr_decodebuff[APPLEGCR_DATA_53];
+  cx=applegcr->decodebuff[APPLEGCR_DATA_53];
 
   if (cx==0)
   {
@@ -247,11 +228,11 @@ void applegcr_process_data53()
     int j;
     int k=0; // input stream pos
 
-    buff[APPLEGCR_SECTORLEN-1]=applegcr_decodebuff[k++];
+    buff[APPLEGCR_SECTORLEN-1]=applegcr->decodebuff[k++];
 
     for (i=0; i<(APPLEGCR_SECTORLEN/5); i++)
     {
-      cx=applegcr_decodebuff[k++];
+      cx=applegcr->decodebuff[k++];
 
       buff[(i*5)+2]=(cx>>2);
       buff[(i*5)+3]|=(cx>>1) & 0x1;
@@ -260,7 +241,7 @@ void applegcr_process_data53()
 
     for (i=0; i<(APPLEGCR_SECTORLEN/5); i++)
     {
-      cx=applegcr_decodebuff[k++];
+      cx=applegcr->decodebuff[k++];
 
       buff[(i*5)+1]=(cx>>2);
       buff[(i*5)+3]|=cx & 0x2;
@@ -269,7 +250,7 @@ void applegcr_process_data53()
 
     for (i=0; i<(APPLEGCR_SECTORLEN/5); i++)
     {
-      cx=applegcr_decodebuff[k++];
+      cx=applegcr->decodebuff[k++];
 
       buff[i*5]=(cx>>2);
       buff[(i*5)+3]|=(cx<<1) & 0x4;
@@ -281,24 +262,25 @@ void applegcr_process_data53()
       for (i=((APPLEGCR_SECTORLEN/5)-1); i>=0; i--)
       {
         buff[(i*5)+j] &= 0x07;
-        buff[(i*5)+j] |= (applegcr_decodebuff[k++] << 3);
+        buff[(i*5)+j] |= (applegcr->decodebuff[k++] << 3);
       }
     }
 
-    buff[APPLEGCR_SECTORLEN-1]|=(applegcr_decodebuff[k++]<<3);
+    buff[APPLEGCR_SECTORLEN-1]|=(applegcr->decodebuff[k++]<<3);
 
     // Check we have an ID
-    if ((applegcr_idamtrack!=-1) && (applegcr_idamsector!=-1))
+    if ((applegcr->idamtrack!=-1) && (applegcr->idamsector!=-1))
     {
-      diskstore_addsector(MODAPPLEGCR, hw_currenttrack, hw_currenthead, applegcr_idamtrack, hw_currenthead, applegcr_idamsector, 1, applegcr_idpos, applegcr_idblockcrc, applegcr_blockpos, applegcr_datamode, APPLEGCR_SECTORLEN, &buff[0], applegcr_decodebuff[APPLEGCR_DATA_53]);
+      if (diskstore_addsector(applegcr->store, MODAPPLEGCR, applegcr->physical_track, applegcr->physical_head, applegcr->idamtrack, applegcr->physical_head, applegcr->idamsector, 1, applegcr->idpos, applegcr->idblockcrc, applegcr->blockpos, applegcr->datamode, APPLEGCR_SECTORLEN, &buff[0], applegcr->decodebuff[APPLEGCR_DATA_53], datapos)==1)
+        applegcr->sectorsfound++;
     }
     else
     {
-      if (applegcr_debug)
+      if (applegcr->debug)
       {
         fprintf(stderr, "** VALID DATA BUT INVALID ID");
-        if ((applegcr_lasttrack!=-1) && (applegcr_lastsector!=-1))
-          fprintf(stderr, ", last found ID was T%d S%d", applegcr_lasttrack, applegcr_lastsector);
+        if ((applegcr->lasttrack!=-1) && (applegcr->lastsector!=-1))
+          fprintf(stderr, ", last found ID was T%d S%d", applegcr->lasttrack, applegcr->lastsector);
 
         fprintf(stderr, " **\n");
       }
@@ -306,95 +288,95 @@ void applegcr_process_data53()
   }
   else
   {
-    if (applegcr_debug)
+    if (applegcr->debug)
     {
-      fprintf(stderr, "** INVALID DATA EORSUM [%.2x] (%.2x)", applegcr_decodebuff[341], applegcr_decodebuff[APPLEGCR_DATA_53]);
-      if ((applegcr_idamtrack!=-1) && (applegcr_idamsector!=-1))
-        fprintf(stderr, ", possibly for T%d S%d", applegcr_idamtrack, applegcr_idamsector);
+      fprintf(stderr, "** INVALID DATA EORSUM [%.2x] (%.2x)", applegcr->decodebuff[341], applegcr->decodebuff[APPLEGCR_DATA_53]);
+      if ((applegcr->idamtrack!=-1) && (applegcr->idamsector!=-1))
+        fprintf(stderr, ", possibly for T%d S%d", applegcr->idamtrack, applegcr->idamsector);
 
       fprintf(stderr, " **\n");
     }
   }
 
   // Clear IDAM cache
-  applegcr_idamtrack=-1;
-  applegcr_idamsector=-1;
+  applegcr->idamtrack=-1;
+  applegcr->idamsector=-1;
 }
 
-void applegcr_addbit(const unsigned char bit, const unsigned long datapos)
+void applegcr_addbit(AppleGCR_Context *applegcr, const unsigned char bit, const unsigned long datapos)
 {
-  applegcr_datacells=(applegcr_datacells<<1)|bit;
-  applegcr_bits++;
+  applegcr->datacells=(applegcr->datacells<<1)|bit;
+  applegcr->bits++;
 
-  switch (applegcr_state)
+  switch (applegcr->state)
   {
     case APPLEGCR_IDLE:
-      if (applegcr_bits>=24)
+      if (applegcr->bits>=24)
       {
-        switch (applegcr_datacells&0xffffff)
+        switch (applegcr->datacells&0xffffff)
         {
           case 0xd5aab5: // Address field / DOS 3.2
-            if (applegcr_debug)
-              fprintf(stderr, "[%lx] Found a [%.2X] D5 AA B5, DOS 3.2 (5/3) ID\n", datapos, (applegcr_datacells&0xff000000)>>24);
+            if (applegcr->debug)
+              fprintf(stderr, "[%lx] Found a [%.2X] D5 AA B5, DOS 3.2 (5/3) ID\n", datapos, (applegcr->datacells&0xff000000)>>24);
 
-            applegcr_datamode=APPLEGCR_DATA_53;
-            applegcr_state=APPLEGCR_ID;
-            applegcr_bytelen=0; applegcr_bits=0;
+            applegcr->datamode=APPLEGCR_DATA_53;
+            applegcr->state=APPLEGCR_ID;
+            applegcr->bytelen=0; applegcr->bits=0;
 
-            applegcr_idpos=datapos;
+            applegcr->idpos=datapos;
 
             // Clear IDAM cache
-            applegcr_idamtrack=-1;
-            applegcr_idamsector=-1;
+            applegcr->idamtrack=-1;
+            applegcr->idamsector=-1;
             break;
 
           case 0xd5aa96: // Address field / DOS 3.3
-            if (applegcr_debug)
-              fprintf(stderr, "[%lx] Found a [%.2X] D5 AA 96, DOS 3.3 (6/2) ID\n", datapos, (applegcr_datacells&0xff000000)>>24);
+            if (applegcr->debug)
+              fprintf(stderr, "[%lx] Found a [%.2X] D5 AA 96, DOS 3.3 (6/2) ID\n", datapos, (applegcr->datacells&0xff000000)>>24);
 
-            applegcr_datamode=APPLEGCR_DATA_62;
-            applegcr_state=APPLEGCR_ID;
-            applegcr_bytelen=0; applegcr_bits=0;
+            applegcr->datamode=APPLEGCR_DATA_62;
+            applegcr->state=APPLEGCR_ID;
+            applegcr->bytelen=0; applegcr->bits=0;
 
-            applegcr_idpos=datapos;
+            applegcr->idpos=datapos;
 
             // Clear IDAM cache
-            applegcr_idamtrack=-1;
-            applegcr_idamsector=-1;
+            applegcr->idamtrack=-1;
+            applegcr->idamsector=-1;
             break;
 
           case 0xd5aaad: // Data field / 342+1 bytes encoded as 6 and 2
-            if (applegcr_debug)
-              fprintf(stderr, "[%lx] Found a [%.2X] D5 AA AD, DATA\n", datapos, (applegcr_datacells&0xff000000)>>24);
+            if (applegcr->debug)
+              fprintf(stderr, "[%lx] Found a [%.2X] D5 AA AD, DATA\n", datapos, (applegcr->datacells&0xff000000)>>24);
 
-            applegcr_state=APPLEGCR_DATA;
-            applegcr_bytelen=0; applegcr_bits=0;
+            applegcr->state=APPLEGCR_DATA;
+            applegcr->bytelen=0; applegcr->bits=0;
 
-            applegcr_blockpos=datapos;
+            applegcr->blockpos=datapos;
             break;
 
           case 0xdeaaeb: // Epilogue
-            if (applegcr_debug)
-              fprintf(stderr, "[%lx] Found a [%.2X] DE AA EB, EPILOGUE\n", datapos, (applegcr_datacells&0xff000000)>>24);
+            if (applegcr->debug)
+              fprintf(stderr, "[%lx] Found a [%.2X] DE AA EB, EPILOGUE\n", datapos, (applegcr->datacells&0xff000000)>>24);
             break;
 
           case 0xd4aab7: // Address field / 13 sector / non-standard
-            if (applegcr_debug)
-              fprintf(stderr, "[%lx] Found a [%.2X] D4 AA B7, non-standard ID\n", datapos, (applegcr_datacells&0xff000000)>>24);
+            if (applegcr->debug)
+              fprintf(stderr, "[%lx] Found a [%.2X] D4 AA B7, non-standard ID\n", datapos, (applegcr->datacells&0xff000000)>>24);
             break;
 
           case 0xd4aa96: // Address field / 16 sector / non-standard
-            if (applegcr_debug)
-              fprintf(stderr, "[%lx] Found a [%.2X] D4 AA 96, non-standard ID\n", datapos, (applegcr_datacells&0xff000000)>>24);
+            if (applegcr->debug)
+              fprintf(stderr, "[%lx] Found a [%.2X] D4 AA 96, non-standard ID\n", datapos, (applegcr->datacells&0xff000000)>>24);
             break;
 
           case 0xd5bbcf: // Data field non-standard
-            if (applegcr_debug)
-              fprintf(stderr, "[%lx] Found a [%.2X] D5 BB CF, non-standard DATA\n", datapos, (applegcr_datacells&0xff000000)>>24);
+            if (applegcr->debug)
+              fprintf(stderr, "[%lx] Found a [%.2X] D5 BB CF, non-standard DATA\n", datapos, (applegcr->datacells&0xff000000)>>24);
             break;
 
           case 0xdaaaeb: // Epilogue non-standard
-            if (applegcr_debug)
+            if (applegcr->debug)
               fprintf(stderr, "[%lx] Found a DA AA EB, non-standard EPILOGUE\n", datapos);
             break;
 
@@ -412,44 +394,44 @@ void applegcr_addbit(const unsigned char bit, const unsigned long datapos)
       // SUM SUM - Checksum (XOR of previous 6 bytes comprising volume/track/sector)
       // DE AA EB - Epilogue
 
-      if (applegcr_bits==8)
+      if (applegcr->bits==8)
       {
-        applegcr_bytebuff[applegcr_bytelen++]=applegcr_datacells&0xff;
-        applegcr_bits=0;
+        applegcr->bytebuff[applegcr->bytelen++]=applegcr->datacells&0xff;
+        applegcr->bits=0;
       }
 
-      if (applegcr_bytelen>=8)
+      if (applegcr->bytelen>=8)
       {
-        if (applegcr_debug)
+        if (applegcr->debug)
         {
-          fprintf(stderr, " Vol : %d", applegcr_decode4and4(applegcr_bytebuff[0], applegcr_bytebuff[1])); // Defaults to 254
-          fprintf(stderr, " Trk : %d", applegcr_decode4and4(applegcr_bytebuff[2], applegcr_bytebuff[3]));
-          fprintf(stderr, " Sct : %d", applegcr_decode4and4(applegcr_bytebuff[4], applegcr_bytebuff[5]));
-          fprintf(stderr, " Sum : %d", applegcr_decode4and4(applegcr_bytebuff[6], applegcr_bytebuff[7]));
-          fprintf(stderr, " EOR : %d\n", applegcr_calc_eor(&applegcr_bytebuff[0], 6));
+          fprintf(stderr, " Vol : %d", applegcr_decode4and4(applegcr->bytebuff[0], applegcr->bytebuff[1])); // Defaults to 254
+          fprintf(stderr, " Trk : %d", applegcr_decode4and4(applegcr->bytebuff[2], applegcr->bytebuff[3]));
+          fprintf(stderr, " Sct : %d", applegcr_decode4and4(applegcr->bytebuff[4], applegcr->bytebuff[5]));
+          fprintf(stderr, " Sum : %d", applegcr_decode4and4(applegcr->bytebuff[6], applegcr->bytebuff[7]));
+          fprintf(stderr, " EOR : %d\n", applegcr_calc_eor(&applegcr->bytebuff[0], 6));
         }
 
-        if (applegcr_decode4and4(applegcr_bytebuff[6], applegcr_bytebuff[7]) == applegcr_calc_eor(&applegcr_bytebuff[0], 6))
+        if (applegcr_decode4and4(applegcr->bytebuff[6], applegcr->bytebuff[7]) == applegcr_calc_eor(&applegcr->bytebuff[0], 6))
         {
-          applegcr_idamtrack=applegcr_decode4and4(applegcr_bytebuff[2], applegcr_bytebuff[3]);
-          applegcr_idamsector=applegcr_decode4and4(applegcr_bytebuff[4], applegcr_bytebuff[5]);
+          applegcr->idamtrack=applegcr_decode4and4(applegcr->bytebuff[2], applegcr->bytebuff[3]);
+          applegcr->idamsector=applegcr_decode4and4(applegcr->bytebuff[4], applegcr->bytebuff[5]);
 
           // Record last known good IDAM values for this track
-          applegcr_lasttrack=applegcr_idamtrack;
-          applegcr_lastsector=applegcr_idamsector;
+          applegcr->lasttrack=applegcr->idamtrack;
+          applegcr->lastsector=applegcr->idamsector;
 
-          applegcr_idblockcrc=applegcr_decode4and4(applegcr_bytebuff[6], applegcr_bytebuff[7]);
+          applegcr->idblockcrc=applegcr_decode4and4(applegcr->bytebuff[6], applegcr->bytebuff[7]);
         }
         else
         {
           // IDAM failed CRC, ignore following data block (for now)
-          applegcr_idpos=0;
-          applegcr_idamtrack=-1;
-          applegcr_idamsector=-1;
+          applegcr->idpos=0;
+          applegcr->idamtrack=-1;
+          applegcr->idamsector=-1;
         }
 
-        applegcr_bits=0;
-        applegcr_state=APPLEGCR_IDLE;
+        applegcr->bits=0;
+        applegcr->state=APPLEGCR_IDLE;
       }
       break;
 
@@ -468,29 +450,29 @@ void applegcr_addbit(const unsigned char bit, const unsigned long datapos)
       // SUM - Checksum (XOR)
       // DE AA EB - Epilogue
 
-      if (applegcr_bits==8)
+      if (applegcr->bits==8)
       {
-        applegcr_bytebuff[applegcr_bytelen++]=applegcr_datacells&0xff;
-        applegcr_bits=0;
+        applegcr->bytebuff[applegcr->bytelen++]=applegcr->datacells&0xff;
+        applegcr->bits=0;
       }
 
-      if (applegcr_bytelen>=(applegcr_datamode+1))
+      if (applegcr->bytelen>=(applegcr->datamode+1))
       {
-        if (applegcr_debug)
-          fprintf(stderr, "Processing data block [%u]\n", applegcr_datamode);
+        if (applegcr->debug)
+          fprintf(stderr, "Processing data block [%u]\n", applegcr->datamode);
 
-        if (applegcr_datamode==APPLEGCR_DATA_62)
-          applegcr_process_data62();
+        if (applegcr->datamode==APPLEGCR_DATA_62)
+          applegcr_process_data62(applegcr, datapos);
         else
-          applegcr_process_data53();
+          applegcr_process_data53(applegcr, datapos);
 
         // Require subsequent data blocks to have a valid ID block first
-        applegcr_idpos=0;
-        applegcr_idamtrack=-1;
-        applegcr_idamsector=-1;
+        applegcr->idpos=0;
+        applegcr->idamtrack=-1;
+        applegcr->idamsector=-1;
 
-        applegcr_bits=0;
-        applegcr_state=APPLEGCR_IDLE;
+        applegcr->bits=0;
+        applegcr->state=APPLEGCR_IDLE;
       }
 
       break;
@@ -500,11 +482,17 @@ void applegcr_addbit(const unsigned char bit, const unsigned long datapos)
   }
 
   // Limit bits used to 32
-  if (applegcr_bits>=32)
-    applegcr_bits=32;
+  if (applegcr->bits>=32)
+    applegcr->bits=32;
 }
 
-void applegcr_addsample(const unsigned long samples, const unsigned long datapos, const int usepll)
+// Receive a bit recovered by the PLL
+static void applegcr_pllbit(void *context, const unsigned char bit, const unsigned long datapos)
+{
+  applegcr_addbit((AppleGCR_Context *)context, bit, datapos);
+}
+
+void applegcr_addsample(AppleGCR_Context *applegcr, const unsigned long samples, const unsigned long datapos, const int usepll)
 {
   // 50,100,150
   //   4us, 8us and 12us
@@ -512,52 +500,66 @@ void applegcr_addsample(const unsigned long samples, const unsigned long datapos
 
   if (usepll)
   {
-    PLL_addsample(applegcr_pll, samples, datapos);
+    PLL_addsample(&applegcr->pll, samples, datapos);
 
     return;
   }
 
-  if (samples>applegcr_threshold001)
-    applegcr_addbit(0, datapos);
+  if (samples>applegcr->threshold001)
+    applegcr_addbit(applegcr, 0, datapos);
 
-  if (samples>applegcr_threshold01)
-    applegcr_addbit(0, datapos);
+  if (samples>applegcr->threshold01)
+    applegcr_addbit(applegcr, 0, datapos);
 
-  applegcr_addbit(1, datapos);
+  applegcr_addbit(applegcr, 1, datapos);
 }
 
-void applegcr_init(const int debug, const char density)
+void applegcr_init(AppleGCR_Context *applegcr, const int debug, const char density, Disk_Store *store, const uint8_t physical_track, const uint8_t physical_head, const float rpm, const unsigned long samplerate)
 {
   float bitcell=APPLEGCR_BITCELL;
   (void) density;
 
-  applegcr_debug=debug;
+  applegcr->debug=debug;
+
+  applegcr->store=store;
+  applegcr->physical_track=physical_track;
+  applegcr->physical_head=physical_head;
+  applegcr->sectorsfound=0;
 
   // Adjust bitcell for RPM
-  bitcell=(bitcell/hw_rpm)*(float)HW_DEFAULTRPM;
+  bitcell=(bitcell/rpm)*(float)HW_DEFAULTRPM;
 
-  applegcr_defaultwindow=((float)hw_samplerate/(float)USINSECOND)*bitcell;
-  applegcr_threshold01=applegcr_defaultwindow*1.5;
-  applegcr_threshold001=applegcr_defaultwindow*2.5;
+  applegcr->defaultwindow=((float)samplerate/(float)USINSECOND)*bitcell;
+  applegcr->threshold01=applegcr->defaultwindow*1.5;
+  applegcr->threshold001=applegcr->defaultwindow*2.5;
 
-  if (applegcr_pll!=NULL)
-    PLL_reset(applegcr_pll, applegcr_defaultwindow);
-  else
-    applegcr_pll=PLL_create(applegcr_defaultwindow, applegcr_addbit);
+  PLL_init(&applegcr->pll, applegcr->defaultwindow, applegcr_pllbit, applegcr);
 
   // Set up Apple GCR parser
-  applegcr_state=APPLEGCR_IDLE;
+  applegcr->state=APPLEGCR_IDLE;
+  applegcr->datacells=0;
+  applegcr->bits=0;
+  applegcr->datamode=0;
+  applegcr->bytelen=0;
 
-  applegcr_buildgcrdecodemaps();
+  // Decode maps are shared between all contexts
+  if (!applegcr_decodemapsbuilt)
+    applegcr_buildgcrdecodemaps();
 
-  applegcr_idpos=0;
-  applegcr_blockpos=0;
+  applegcr->idpos=0;
+  applegcr->blockpos=0;
 
   // Initialise last found sector IDAM to invalid
-  applegcr_idamtrack=-1;
-  applegcr_idamsector=-1;
+  applegcr->idamtrack=-1;
+  applegcr->idamsector=-1;
 
   // Initialise last known good sector IDAM to invalid
-  applegcr_lasttrack=-1;
-  applegcr_lastsector=-1;
+  applegcr->lasttrack=-1;
+  applegcr->lastsector=-1;
+}
+
+// Finish processing, returning how many new sectors were stored
+unsigned int applegcr_finish(AppleGCR_Context *applegcr)
+{
+  return applegcr->sectorsfound;
 }
@@ -1,6 +1,9 @@
 #ifndef _APPLEGCR_H_
 #define _APPLEGCR_H_
 
+#include "diskstore.h"
+#include "pll.h"
+
 // State machine
 #define APPLEGCR_IDLE 0
 #define APPLEGCR_ID 1
@@ -15,11 +18,44 @@
 // Ideal bitcell width at 300 RPM
 #define APPLEGCR_BITCELL 4
 
-extern int applegcr_idamtrack, applegcr_idamsector;
-extern int applegcr_lasttrack, applegcr_lastsector;
+typedef struct AppleGCRContext
+{
+  int debug;
+
+  // Where to store found sectors, and which track they came from
+  Disk_Store *store;
+  uint8_t physical_track;
+  uint8_t physical_head;
+  unsigned int sectorsfound;
+
+  int state; // state machine
+  uint32_t datacells; // 32 bit sliding buffer
+  int bits; // Number of used bits within sliding buffer
+  float defaultwindow; // Number of samples in window
+  float threshold01; // Number of samples for an 01
+  float threshold001; // Number of samples for an 001
+
+  // Most recent address mark
+  unsigned long idpos, blockpos;
+  int idamtrack, idamsector; // IDAM values
+  int lasttrack, lastsector; // last known good IDAM values
+  unsigned int idblockcrc, datablockcrc;
+
+  unsigned int datamode;
+
+  unsigned char bytebuff[1024];
+  unsigned int bytelen;
+
+  unsigned char decodebuff[1024];
+
+  struct PLL pll;
+} AppleGCR_Context;
+
+extern void applegcr_buildgcrdecodemaps();
 
-extern void applegcr_addsample(const unsigned long samples, const unsigned long datapos, const int usepll);
+extern void applegcr_addsample(AppleGCR_Context *applegcr, const unsigned long samples, const unsigned long datapos, const int usepll);
 
-extern void applegcr_init(const int debug, const char density);
+extern void applegcr_init(AppleGCR_Context *applegcr, const int debug, const char density, Disk_Store *store, const uint8_t physical_track, const uint8_t physical_head, const float rpm, const unsigned long samplerate);
+extern unsigned int applegcr_finish(AppleGCR_Context *applegcr);
 
 #endif
@@ -19,19 +19,19 @@ unsigned long atarist_clustertoabsolute(const unsigned long clusterid, const uns
   return (dataregion+(((clusterid-ATARIST_MINCLUSTER)*sectorspercluster)*bytespersector));
 }
 
-void atarist_readdir(const int level, const unsigned long offset, const unsigned int entries, const unsigned long sectorspercluster, const unsigned long bytespersector, const unsigned long dataregion, const unsigned long parent, const unsigned int disktracks, const uint16_t totalsectors)
+void atarist_readdir(Disk_Store *store, const int level, const unsigned long offset, const unsigned int entries, const unsigned long sectorspercluster, const unsigned long bytespersector, const unsigned long dataregion, const unsigned long parent, const unsigned int disktracks, const uint16_t totalsectors)
 {
   struct atarist_direntry de;
   unsigned int i;
   unsigned int e;
   int j;
 
-  diskstore_absoluteseek(offset, INTERLEAVED, 80);
+  diskstore_absoluteseek(store, offset, INTERLEAVED, 80);
 
   // Loop through entries - TODO add sanity checks
   for (e=0; e<entries; e++)
   {
-    if (diskstore_absoluteread((char *)&de, sizeof(de), INTERLEAVED, 80)<sizeof(de))
+    if (diskstore_absoluteread(store, (char *)&de, sizeof(de), INTERLEAVED, 80)<sizeof(de))
       return;
 
     // Check for end of directory
@@ -106,24 +106,24 @@ void atarist_readdir(const int level, const unsigned long offset, const unsigned
       // Don't recurse into "." and ".."
       if ((subdir!=parent) && (subdir!=offset))
       {
-        unsigned long curdiskoffs=diskstore_absoffset;
+        unsigned long curdiskoffs=store->absoffset;
 
-        atarist_readdir(level+1, subdir, entries, sectorspercluster, bytespersector, dataregion, offset, disktracks, totalsectors);
+        atarist_readdir(store, level+1, subdir, entries, sectorspercluster, bytespersector, dataregion, offset, disktracks, totalsectors);
 
-        diskstore_absoluteseek(curdiskoffs, INTERLEAVED, disktracks);
+        diskstore_absoluteseek(store, curdiskoffs, INTERLEAVED, disktracks);
       }
     }
   }
 }
 
-void atarist_showinfo(const int debug)
+void atarist_showinfo(Disk_Store *store, const int debug)
 {
   Disk_Sector *sector1;
 
   atarist_debug=debug;
 
   // Search for boot sectors
-  sector1=diskstore_findhybridsector(0, 0, 1);
+  sector1=diskstore_findhybridsector(store, 0, 0, 1);
 
   // Check we have the boot sector
   if (sector1==NULL)
@@ -219,18 +219,18 @@ void atarist_showinfo(const int debug)
 
     // Catalogue disk from root directory
     offset=bootsector->bpb.bps*rootsector;
-    atarist_readdir(0, offset, bootsector->bpb.ndirs, bootsector->bpb.spc, bootsector->bpb.bps, dataregion, 0, 80, bootsector->bpb.nsects);
+    atarist_readdir(store, 0, offset, bootsector->bpb.ndirs, bootsector->bpb.spc, bootsector->bpb.bps, dataregion, 0, 80, bootsector->bpb.nsects);
   }
 }
 
-int atarist_validate()
+int atarist_validate(Disk_Store *store)
 {
   int format;
 
   Disk_Sector *sector1;
 
   // Search for boot sectors
-  sector1=diskstore_findhybridsector(0, 0, 1);
+  sector1=diskstore_findhybridsector(store, 0, 0, 1);
 
   format=ATARIST_UNKNOWN;
 
@@ -94,7 +94,7 @@ struct atarist_direntry
 
 #pragma pack(pop)
 
-extern int atarist_validate();
-extern void atarist_showinfo(const int debug);
+extern int atarist_validate(Disk_Store *store);
+extern void atarist_showinfo(Disk_Store *store, const int debug);
 
 #endif
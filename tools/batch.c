@@ -0,0 +1,541 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "common.h"
+#include "diskstore.h"
+#include "image.h"
+#include "convert.h"
+
+// Sample file formats which are picked up when given a directory
+const char *batch_extensions[] = {".rfi", ".scp", ".hfe", ".a2r", ".woz", ".raw", NULL};
+
+typedef struct BatchImage
+{
+  char *input;
+  char *output;
+
+  off_t size;
+
+  // Set by worker once converted
+  int converted;
+  double elapsed;
+  uint32_t crc;
+  unsigned int sectors;
+  int missing;
+  const char *error;
+} Batch_Image;
+
+Batch_Image *batch_images=NULL;
+unsigned int batch_count=0;
+unsigned int batch_allocated=0;
+
+// Next image for a worker to pick up, and how many are done
+unsigned int batch_next=0;
+unsigned int batch_done=0;
+
+pthread_mutex_t batch_lock=PTHREAD_MUTEX_INITIALIZER;
+
+const char *batch_outdir=".";
+const char *batch_ext="ssd";
+
+// Conversion settings shared by all the images
+Convert_Options batch_options;
+
+// Time in seconds from an arbitrary point, for measuring durations
+double batch_now()
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return ts.tv_sec+((double)ts.tv_nsec/1000000000);
+}
+
+// Output is named after the input, in the output directory with the requested extension
+char *batch_outputname(const char *input, const int keepext)
+{
+  const char *base;
+  const char *dot;
+  char *output;
+  size_t len;
+
+  base=strrchr(input, '/');
+  base=(base==NULL)?input:base+1;
+
+  dot=strrchr(base, '.');
+  len=((dot==NULL) || (keepext))?strlen(base):(size_t)(dot-base);
+
+  output=malloc(strlen(batch_outdir)+1+len+1+strlen(batch_ext)+1);
+  if (output==NULL) return NULL;
+
+  sprintf(output, "%s/%.*s.%s", batch_outdir, (int)len, base, batch_ext);
+
+  return output;
+}
+
+// Add sample file to list of images to convert
+int batch_add(const char *input)
+{
+  struct stat st;
+
+  if (stat(input, &st)!=0)
+  {
+    fprintf(stderr, "Unable to find \"%s\"\n", input);
+    return 0;
+  }
+
+  if (batch_count==batch_allocated)
+  {
+    Batch_Image *newimages;
+
+    batch_allocated=(batch_allocated==0)?64:batch_allocated*2;
+
+    newimages=realloc(batch_images, batch_allocated*sizeof(Batch_Image));
+    if (newimages==NULL) return 0;
+
+    batch_images=newimages;
+  }
+
+  bzero(&batch_images[batch_count], sizeof(Batch_Image));
+
+  batch_images[batch_count].input=strdup(input);
+  batch_images[batch_count].output=batch_outputname(input, 0);
+
+  if ((batch_images[batch_count].input==NULL) || (batch_images[batch_count].output==NULL))
+    return 0;
+
+  batch_images[batch_count].size=st.st_size;
+
+  batch_count++;
+
+  return 1;
+}
+
+// Order images by input name, so reports are repeatable
+int batch_compare(const void *a, const void *b)
+{
+  return strcmp(((const Batch_Image *)a)->input, ((const Batch_Image *)b)->input);
+}
+
+// Add all the sample files found in a directory
+int batch_readdir(const char *dirname)
+{
+  DIR *dir;
+  struct dirent *entry;
+  char *path;
+  int i;
+
+  dir=opendir(dirname);
+  if (dir==NULL) return 0;
+
+  while ((entry=readdir(dir))!=NULL)
+  {
+    for (i=0; batch_extensions[i]!=NULL; i++)
+      if (compare_extension(entry->d_name, batch_extensions[i]))
+        break;
+
+    if (batch_extensions[i]==NULL)
+      continue;
+
+    path=malloc(strlen(dirname)+1+strlen(entry->d_name)+1);
+    if (path==NULL)
+    {
+      closedir(dir);
+      return 0;
+    }
+
+    sprintf(path, "%s/%s", dirname, entry->d_name);
+
+    if (!batch_add(path))
+    {
+      free(path);
+      closedir(dir);
+      return 0;
+    }
+
+    free(path);
+  }
+
+  closedir(dir);
+
+  qsort(batch_images, batch_count, sizeof(Batch_Image), batch_compare);
+
+  return 1;
+}
+
+// Add sample files listed in a manifest, one per line, ignoring blank lines and # comments
+int batch_readmanifest(const char *filename)
+{
+  FILE *fp;
+  char line[1024];
+  size_t len;
+
+  fp=fopen(filename, "r");
+  if (fp==NULL) return 0;
+
+  while (fgets(line, sizeof(line), fp)!=NULL)
+  {
+    len=strlen(line);
+    while ((len>0) && ((line[len-1]=='\n') || (line[len-1]=='\r') || (line[len-1]==' ')))
+      line[--len]=0;
+
+    if ((len==0) || (line[0]=='#'))
+      continue;
+
+    if (!batch_add(line))
+    {
+      fclose(fp);
+      return 0;
+    }
+  }
+
+  fclose(fp);
+
+  return 1;
+}
+
+// Stop images overwriting each other's output, e.g. disk1.scp and disk1.rfi
+int batch_checkoutputs()
+{
+  unsigned int i, j;
+  char *clashes;
+
+  clashes=calloc(batch_count, 1);
+  if ((clashes==NULL) && (batch_count>0)) return 0;
+
+  for (i=0; i<batch_count; i++)
+    for (j=i+1; j<batch_count; j++)
+      if (strcmp(batch_images[i].output, batch_images[j].output)==0)
+        clashes[i]=clashes[j]=1;
+
+  // Keep the source extension for all those which clash, so the choice doesn't depend on order
+  for (i=0; i<batch_count; i++)
+  {
+    if (clashes[i])
+    {
+      char *output;
+
+      output=batch_outputname(batch_images[i].input, 1);
+      if (output==NULL)
+      {
+        free(clashes);
+        return 0;
+      }
+
+      free(batch_images[i].output);
+      batch_images[i].output=output;
+    }
+  }
+
+  free(clashes);
+
+  // Any which still clash have the same filename in different directories, only the first is converted
+  for (i=0; i<batch_count; i++)
+    for (j=0; j<i; j++)
+      if ((batch_images[j].error==NULL) && (strcmp(batch_images[i].output, batch_images[j].output)==0))
+      {
+        batch_images[i].error="Output clashes with another image";
+        break;
+      }
+
+  return 1;
+}
+
+// Convert an image, keeping the results needed for the report
+void batch_convert(Convert_Context *conv, Batch_Image *image)
+{
+  // Rejected before starting
+  if (image->error!=NULL)
+    return;
+
+  image->converted=convert_image(conv, &batch_options, image->input, image->output);
+
+  if (image->converted)
+  {
+    image->crc=conv->crc;
+    image->missing=conv->missingsectors;
+    image->sectors=diskstore_countsectormod(&conv->store, MODFM)+diskstore_countsectormod(&conv->store, MODMFM)+
+                   diskstore_countsectormod(&conv->store, MODGCR)+diskstore_countsectormod(&conv->store, MODAPPLEGCR);
+  }
+  else
+    image->error=conv->error;
+
+  convert_free(conv);
+}
+
+// Worker thread, converts images until there are none left
+void *batch_worker(void *arg)
+{
+  Batch_Image *image;
+  Convert_Context *conv;
+  double start;
+
+  (void) arg;
+
+  // Each worker has its own decoders and store
+  conv=malloc(sizeof(Convert_Context));
+  if (conv==NULL) return NULL;
+
+  while (1)
+  {
+    pthread_mutex_lock(&batch_lock);
+    image=(batch_next<batch_count)?&batch_images[batch_next++]:NULL;
+    pthread_mutex_unlock(&batch_lock);
+
+    if (image==NULL) break;
+
+    start=batch_now();
+    batch_convert(conv, image);
+    image->elapsed=batch_now()-start;
+
+    pthread_mutex_lock(&batch_lock);
+    batch_done++;
+    printf("[%u/%u] %s %s (%.2fs)\n", batch_done, batch_count, image->converted?"OK    ":"FAILED", image->input, image->elapsed);
+    fflush(stdout);
+    pthread_mutex_unlock(&batch_lock);
+  }
+
+  free(conv);
+
+  return NULL;
+}
+
+void batch_free()
+{
+  unsigned int i;
+
+  for (i=0; i<batch_count; i++)
+  {
+    free(batch_images[i].input);
+    free(batch_images[i].output);
+  }
+
+  free(batch_images);
+  batch_images=NULL;
+  batch_count=0;
+  batch_allocated=0;
+}
+
+void showargs(const char *exename)
+{
+  fprintf(stderr, "%s - Convert many flux images in parallel\n\n", exename);
+  fprintf(stderr, "Syntax : %s [-j jobs] [-d output_dir] [-e extension] [[-ss [0|1]]|[-ds]] [-sort] [-sectors sectors_per_track] [-pll] [-tmax maxtracks] [-rpm rpm] [-dblstep] input_dir|manifest\n", exename);
+}
+
+int main(int argc, char **argv)
+{
+  int argn;
+  int jobs=0;
+  int i;
+  unsigned int n;
+  unsigned int failed=0;
+  unsigned long long totalsize=0;
+  double start, elapsed, busy=0;
+  const char *source=NULL;
+  pthread_t *workers;
+  struct stat st;
+
+  convert_defaults(&batch_options);
+
+  for (argn=1; argn<argc; argn++)
+  {
+    if ((strcmp(argv[argn], "-j")==0) && ((argn+1)<argc))
+    {
+      jobs=atoi(argv[++argn]);
+
+      if (jobs<1)
+      {
+        fprintf(stderr, "Invalid number of jobs\n");
+        return 1;
+      }
+    }
+    else
+    if ((strcmp(argv[argn], "-d")==0) && ((argn+1)<argc))
+      batch_outdir=argv[++argn];
+    else
+    if ((strcmp(argv[argn], "-e")==0) && ((argn+1)<argc))
+    {
+      batch_ext=argv[++argn];
+
+      if (batch_ext[0]=='.')
+        batch_ext++;
+    }
+    else
+    if (strcmp(argv[argn], "-ss")==0)
+    {
+      batch_options.sides=1;
+      batch_options.sidetoread=0;
+
+      // Optional side to read, anything above 1 is side 1
+      if (((argn+1)<argc) && (sscanf(argv[argn+1], "%3d", &i)==1))
+      {
+        batch_options.sidetoread=(i>1)?1:i;
+        argn++;
+      }
+    }
+    else
+    if (strcmp(argv[argn], "-ds")==0)
+      batch_options.sides=2;
+    else
+    if (strcmp(argv[argn], "-sort")==0)
+      batch_options.sortsectors=1;
+    else
+    if ((strcmp(argv[argn], "-sectors")==0) && ((argn+1)<argc))
+    {
+      if (sscanf(argv[++argn], "%3d", &i)==1)
+        batch_options.sectorspertrack=i;
+    }
+    else
+    if (strcmp(argv[argn], "-pll")==0)
+      batch_options.usepll=1;
+    else
+    if ((strcmp(argv[argn], "-tmax")==0) && ((argn+1)<argc))
+    {
+      if (sscanf(argv[++argn], "%3d", &i)==1)
+        batch_options.maxtracks=i;
+    }
+    else
+    if ((strcmp(argv[argn], "-rpm")==0) && ((argn+1)<argc))
+    {
+      float rpm;
+
+      if (sscanf(argv[++argn], "%f", &rpm)==1)
+        batch_options.rpm=rpm;
+    }
+    else
+    if (strcmp(argv[argn], "-dblstep")==0)
+      batch_options.doublestep=1;
+    else
+    if ((argv[argn][0]!='-') && (source==NULL))
+      source=argv[argn];
+    else
+    {
+      showargs(argv[0]);
+      return 1;
+    }
+  }
+
+  if (source==NULL)
+  {
+    showargs(argv[0]);
+    return 1;
+  }
+
+  // Only sector based images can be converted to
+  {
+    char probe[32];
+
+    snprintf(probe, sizeof(probe), "x.%s", batch_ext);
+    if (image_findtype(probe)==IMAGENONE)
+    {
+      fprintf(stderr, "Unsupported output format \".%s\"\n", batch_ext);
+      return 1;
+    }
+  }
+
+  if ((stat(batch_outdir, &st)!=0) || (!S_ISDIR(st.st_mode)))
+  {
+    fprintf(stderr, "Output directory \"%s\" not found\n", batch_outdir);
+    return 3;
+  }
+
+  // Build list of images from a directory or manifest
+  if ((stat(source, &st)==0) && (S_ISDIR(st.st_mode)))
+    n=batch_readdir(source);
+  else
+    n=batch_readmanifest(source);
+
+  if (n==0)
+  {
+    fprintf(stderr, "Unable to read images from \"%s\"\n", source);
+    batch_free();
+    return 2;
+  }
+
+  if (!batch_checkoutputs())
+  {
+    batch_free();
+    return 2;
+  }
+
+  if (jobs==0)
+    jobs=sysconf(_SC_NPROCESSORS_ONLN);
+
+  if (jobs<1)
+    jobs=1;
+
+  if ((unsigned int)jobs>batch_count)
+    jobs=(batch_count==0)?1:batch_count;
+
+  workers=malloc(jobs*sizeof(pthread_t));
+  if (workers==NULL)
+  {
+    batch_free();
+    return 2;
+  }
+
+  printf("Converting %u images to .%s with %d jobs\n", batch_count, batch_ext, jobs);
+
+  // Build lookup tables before any workers can use them
+  convert_init();
+
+  start=batch_now();
+
+  for (i=0; i<jobs; i++)
+  {
+    if (pthread_create(&workers[i], NULL, batch_worker, NULL)!=0)
+      break;
+  }
+
+  // Carry on with however many workers started
+  if (i==0)
+  {
+    fprintf(stderr, "Unable to start workers\n");
+    free(workers);
+    batch_free();
+    return 2;
+  }
+
+  while (i>0)
+    pthread_join(workers[--i], NULL);
+
+  elapsed=batch_now()-start;
+
+  free(workers);
+
+  // Per image results
+  printf("\nStatus Time      CRC32    Sectors Missing Input -> Output\n");
+
+  for (n=0; n<batch_count; n++)
+  {
+    Batch_Image *image=&batch_images[n];
+
+    if (image->converted)
+      printf("OK     %8.2fs %.8X %7u %7d %s -> %s\n", image->elapsed, image->crc, image->sectors, image->missing, image->input, image->output);
+    else
+    {
+      printf("ERR    %8.2fs %-8s %7s %7s %s (%s)\n", image->elapsed, "-", "-", "-", image->input, (image->error!=NULL)?image->error:"Not converted");
+      failed++;
+    }
+
+    totalsize+=image->size;
+    busy+=image->elapsed;
+  }
+
+  // Throughput summary
+  printf("\n%u images, %u converted, %u failed\n", batch_count, batch_count-failed, failed);
+  printf("Elapsed %.2fs, %.2f images/s, %.2f MB/s of flux input\n", elapsed, (elapsed>0)?batch_count/elapsed:0, (elapsed>0)?(totalsize/(1024.0*1024.0))/elapsed:0);
+  printf("Average %.2fs per image, %.1fx parallel speedup\n", (batch_count>0)?busy/batch_count:0, (elapsed>0)?busy/elapsed:0);
+
+  batch_free();
+
+  return (failed>0)?4:0;
+}
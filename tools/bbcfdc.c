@@ -4,6 +4,7 @@
 #include <sys/types.h>
 #include <signal.h>
 #include <string.h>
+#include <pthread.h>
 
 #include "common.h"
 #include "hardware.h"
@@ -20,12 +21,14 @@
 #include "dos.h"
 #include "fsd.h"
 #include "teledisk.h"
+#include "image.h"
 #include "rfi.h"
 #include "mod.h"
 #include "fm.h"
 #include "mfm.h"
 #include "gcr.h"
 #include "pll.h"
+#include "pipeline.h"
 
 // For type of capture
 #define DISKNONE 0
@@ -33,28 +36,9 @@
 #define DISKIMG 2
 #define DISKRAW 3
 
-// For type of output
-#define IMAGENONE 0
-#define IMAGERAW 1
-#define IMAGESSD 2
-#define IMAGEDSD 3
-#define IMAGEFSD 4
-#define IMAGEDFI 5
-#define IMAGEIMG 6
-#define IMAGETD0 7
-#define IMAGESCP 8
-#define IMAGESDD 9
-#define IMAGEDDD 10
-
-// Used for values which can be overriden
-#define AUTODETECT -1
-
 // Capture retries when not in raw mode
 #define RETRIES 5
 
-// Number of rotations to cature per track
-#define ROTATIONS 3
-
 int debug=0;
 int summary=0;
 int catalogue=0;
@@ -66,45 +50,45 @@ int outputtype=IMAGENONE; // Default to no image
 
 unsigned char *samplebuffer=NULL;
 unsigned char *flippybuffer=NULL;
+unsigned char *rawflippybuffer=NULL;
 unsigned long samplebuffsize;
 int flippy=0;
 int info=0;
 int layout=0;
 int sidetoread=AUTODETECT;
 int usepll=0;
+int threads=0;
+unsigned char retries=RETRIES;
+
+// Encoding used for track data in .rfi output
+const char *rfiencoding="rle";
+
+// How much to sample for tracks not being retried
+unsigned long capturelen;
 
 // Processing position within the SPI buffer
 unsigned long datapos=0;
 
 // File handles
 FILE *diskimage=NULL;
-FILE *rawdata=NULL;
 FILE *csvhandle=NULL;
 
+// Flux images, any of which can be written alongside a decoded disk image
+#define MAXRAWOUTPUTS 3
+FILE *rawdata[MAXRAWOUTPUTS];
+int rawtype[MAXRAWOUTPUTS];
+int rawoutputs=0;
+
 int sectorspertrack=AUTODETECT;
 int totalsectors=0;
 
-// Used for reversing bit order within a byte
-static unsigned char revlookup[16] = {0x0, 0x8, 0x4, 0xc, 0x2, 0xa, 0x6, 0xe, 0x1, 0x9, 0x5, 0xd, 0x3, 0xb, 0x7, 0xf};
-unsigned char reverse(unsigned char n)
-{
-   // Reverse the top and bottom nibble then swap them.
-   return (revlookup[n&0x0f]<<4) | revlookup[n>>4];
-}
+// Sectors found on the disk, and the decoders which find them
+Disk_Store store;
+Mod_Context mod;
 
-// Used for flipping the bits in a raw sample buffer
 void fillflippybuffer(const unsigned char *rawdata, const unsigned long rawlen)
 {
-  if (flippybuffer==NULL)
-    flippybuffer=malloc(rawlen);
-
-  if (flippybuffer!=NULL)
-  {
-    unsigned long em;
-
-    for (em=0; em<rawlen; em++)
-      flippybuffer[rawlen-em]=reverse(rawdata[em]);
-  }
+  flipsamples(&flippybuffer, rawdata, rawlen);
 }
 
 // Stop the motor and tidy up upon exit
@@ -125,11 +109,20 @@ void exitFunction()
     flippybuffer=NULL;
   }
 
+  if (rawflippybuffer!=NULL)
+  {
+    free(rawflippybuffer);
+    rawflippybuffer=NULL;
+  }
+
   if (scp_trackoffsets!=NULL)
   {
     free(scp_trackoffsets);
     scp_trackoffsets=NULL;
   }
+
+  mod_done(&mod);
+  diskstore_freestore(&store);
 }
 
 // Handle signals by stopping motor and tidying up
@@ -142,6 +135,500 @@ void sig_handler(const int sig)
   exit(0);
 }
 
+// Sample a track which hasn't been read yet, when a catalogue needs sectors from it
+void fetchtrack(void *fetchdata, const int physical_track, const int physical_head)
+{
+  unsigned char *fetchbuffer;
+  unsigned long fetchbuffsize;
+
+  (void) fetchdata;
+
+  fetchbuffsize=((hw_samplerate/HW_ROTATIONSPERSEC)/BITSPERBYTE)*3;
+  fetchbuffer=malloc(fetchbuffsize);
+
+  if (fetchbuffer==NULL)
+    return;
+
+  hw_seektotrack(physical_track);
+  hw_sideselect(physical_head);
+  hw_waitforsettle();
+  hw_samplerawtrackdata(fetchbuffer, fetchbuffsize);
+  mod_processtrack(&mod, fetchbuffer, fetchbuffsize, 99, 0, hw_currenttrack, hw_currenthead, hw_rpm);
+
+  if (usepll)
+    mod_processtrack(&mod, fetchbuffer, fetchbuffsize, 99, usepll, hw_currenttrack, hw_currenthead, hw_rpm);
+
+  free(fetchbuffer);
+}
+
+// Check if any logical disk format can be found, and show its catalogue
+void showcatalogue(const unsigned int track, const unsigned char head)
+{
+    // Check if catalogue has been done
+    if ((info<sides) && (catalogue==1))
+    {
+      if (dfs_validcatalogue(&store, head, &totalsectors))
+      {
+        printf("\nDetected DFS, side : %d\n", head);
+        dfs_showinfo(&store, head, disktracks, sectorspertrack==-1?DFS_SECTORSPERTRACK:sectorspertrack);
+        info++;
+        printf("\n");
+      }
+      else
+      if ((track==0) && (head==0))
+      {
+        int adfs_format;
+
+        adfs_format=adfs_validate(&store);
+
+        if (adfs_format!=ADFS_UNKNOWN)
+        {
+          printf("\nDetected ADFS-");
+          switch (adfs_format)
+          {
+            case ADFS_S:
+              printf("S");
+              break;
+
+            case ADFS_M:
+              printf("M");
+              break;
+
+            case ADFS_L:
+              printf("L");
+              break;
+
+            case ADFS_D:
+              printf("D");
+              break;
+
+            case ADFS_E:
+              printf("E");
+              break;
+
+            case ADFS_F:
+              printf("F");
+              break;
+
+            case ADFS_EX:
+              printf("E+");
+              break;
+
+            case ADFS_FX:
+              printf("F+");
+              break;
+
+            case ADFS_G:
+              printf("G");
+              break;
+
+            default:
+              break;
+          }
+          printf("\n");
+          adfs_showinfo(&store, adfs_format, disktracks, debug);
+          info++;
+          printf("\n");
+        }
+        else
+        {
+          if (dos_validate(&store)!=DOS_UNKNOWN)
+          {
+            printf("\nDetected DOS\n\n");
+            dos_showinfo(&store, disktracks, debug);
+            info++;
+          }
+          else
+          {
+            if (amigados_validate(&store)!=AMIGADOS_UNKNOWN)
+            {
+              printf("\nDetected Amiga DOS\n\n");
+              amigados_showinfo(&store, disktracks, debug);
+              info++;
+            }
+            else
+              if (appledos_validate(&store)!=APPLEDOS_UNKNOWN)
+              {
+                printf("\nDetected Apple DOS\n\n");
+                appledos_showinfo(&store, debug);
+                info++;
+              }
+              else
+              {
+                if (atarist_validate(&store)!=ATARIST_UNKNOWN)
+                {
+                  printf("\nDetected Atari ST format\n\n");
+                  atarist_showinfo(&store, debug);
+                  info++;
+                }
+                else
+                  if (diskstore_countsectormod(&store, MODAPPLEGCR)>0)
+                    printf("\nDetected Apple format\n\n");
+                  else
+                    printf("\nUnknown logical disk format\n\n");
+              }
+          }
+        }
+      }
+    }
+}
+
+// Open a flux image for writing, only one of each type can be written
+int addrawoutput(const char *filename, const int type)
+{
+  int i;
+
+  if (rawoutputs>=MAXRAWOUTPUTS)
+    return 0;
+
+  for (i=0; i<rawoutputs; i++)
+    if (rawtype[i]==type)
+      return 0;
+
+  rawdata[rawoutputs]=fopen(filename, "w+");
+  if (rawdata[rawoutputs]==NULL)
+    return 0;
+
+  rawtype[rawoutputs++]=type;
+
+  return 1;
+}
+
+// Write the header for each flux image
+void writerawheaders()
+{
+  int i;
+
+  for (i=0; i<rawoutputs; i++)
+  {
+    switch (rawtype[i])
+    {
+      case IMAGERAW:
+        rfi_writeheader(rawdata[i], drivetracks, sides, hw_samplerate, hw_writeprotected());
+        break;
+
+      case IMAGEDFI:
+        dfi_writeheader(rawdata[i]);
+        break;
+
+      case IMAGESCP:
+        scp_writeheader(rawdata[i], ROTATIONS, 0, (drivetracks/hw_stepping)*sides, hw_measurerpm(), sides, sidetoread==AUTODETECT?0:sidetoread);
+        break;
+
+      default:
+        break;
+    }
+
+    // Flush raw header data before moving on to capture
+    fflush(rawdata[i]);
+  }
+}
+
+// Write a captured track to each flux image
+void writerawtrack(const unsigned char *samples, const unsigned long samplelen, const unsigned int track, const unsigned char side, const float rpm)
+{
+  const unsigned char *rawbuffer=samples;
+  int i;
+
+  // Handle flippy data, this has its own buffer as the decoder may be flipping another track
+  if ((flippy==1) && (side==1))
+  {
+    flipsamples(&rawflippybuffer, samples, samplelen);
+
+    if (rawflippybuffer!=NULL)
+      rawbuffer=rawflippybuffer;
+  }
+
+  for (i=0; i<rawoutputs; i++)
+  {
+    switch (rawtype[i])
+    {
+      case IMAGERAW:
+        rfi_writetrack(rawdata[i], track, side, rpm, rfiencoding, samples, samplelen);
+        break;
+
+      case IMAGEDFI:
+        dfi_writetrack(rawdata[i], track, side, rawbuffer, samplelen, ROTATIONS);
+        break;
+
+      case IMAGESCP:
+        scp_writetrack(rawdata[i], ((track/hw_stepping)*sides)+side, rawbuffer, samplelen, ROTATIONS, rpm, hw_samplerate);
+        break;
+
+      default:
+        break;
+    }
+
+    // Flush raw track data before moving on to any further tracks
+    fflush(rawdata[i]);
+  }
+}
+
+// Sample a track into a pipeline buffer, then queue it for writing and/or decoding
+void capturetrack(Pipeline_Buffer *buffer, const unsigned int track, const unsigned char side, const unsigned char retry, const unsigned long samplelen)
+{
+  hw_seektotrack(track);
+
+  // Select the correct side
+  hw_sideselect(side);
+
+  // Wait for drive speed to settle after seek/head select, this also measures the RPM
+  hw_waitforsettle();
+
+  if (retry==0)
+    printf("Sampling data for track %.2X head %.2x\n", track, side);
+
+  // Sampling data, straight to intervals when the source allows it, flippy data needs reversing first
+  buffer->samplelen=(samplelen<buffer->len)?samplelen:buffer->len;
+  buffer->intervals=0;
+
+  if (((flippy==0) || (side==0)) && (rawoutputs==0))
+    buffer->intervals=hw_samplerawintervals(&buffer->flux, buffer->samplelen);
+
+  if (!buffer->intervals)
+    hw_samplerawtrackdata(buffer->data, buffer->samplelen);
+
+  // Record where it came from, as the drive will have moved on by the time it's written or decoded
+  buffer->track=track;
+  buffer->side=side;
+  buffer->physical_track=hw_currenttrack;
+  buffer->physical_head=hw_currenthead;
+  buffer->rpm=hw_rpm;
+  buffer->retry=retry;
+  buffer->complete=0;
+  buffer->decode=(capturetype!=DISKRAW);
+
+  // Flux images get the first capture of each track
+  if ((retry==0) && (rawoutputs>0))
+    pipeline_write(buffer);
+  else
+    pipeline_queue(buffer);
+}
+
+// Writer thread, writes sampled tracks to the flux images as they are queued
+void *writethread(void *arg)
+{
+  Pipeline_Buffer *buffer;
+
+  (void) arg;
+
+  while ((buffer=pipeline_getwrite())!=NULL)
+  {
+    writerawtrack(buffer->data, buffer->samplelen, buffer->track, buffer->side, buffer->rpm);
+
+    pipeline_written(buffer);
+  }
+
+  return NULL;
+}
+
+// Retries are only worthwhile when imaging DFS disks from real hardware
+int canretry()
+{
+#ifdef NOPI
+  return 0;
+#else
+  return ((outputtype==IMAGEDSD) || (outputtype==IMAGESSD) ||
+          (outputtype==IMAGEDDD) || (outputtype==IMAGESDD));
+#endif
+}
+
+// See if we have successfully read a full track
+int checktrack(Pipeline_Buffer *buffer)
+{
+  unsigned long samplesperrotation;
+  int j;
+
+  if (!canretry())
+    return 1;
+
+  if (diskstore_trackcomplete(&store, buffer->physical_track, buffer->physical_head, sectorspertrack))
+    return 1;
+
+  printf("Retry attempt %d, sectors ", buffer->retry+1);
+  for (j=0; j<sectorspertrack; j++)
+    if (diskstore_findhybridsector(&store, buffer->physical_track, buffer->physical_head, j)==NULL) printf("%.2u ", j);
+  printf("\n");
+
+  // Only sample far enough to see the missing sectors twice, flippy data is reversed so needs it all
+  samplesperrotation=buffer->len/ROTATIONS;
+  buffer->retrylen=samplesperrotation+diskstore_missingextent(&store, buffer->physical_track, buffer->physical_head, sectorspertrack, samplesperrotation);
+
+  if ((flippy==1) && (buffer->side==1))
+    buffer->retrylen=buffer->len;
+
+  return 0;
+}
+
+// Decoder thread, processes sampled tracks as they are queued
+void *decodethread(void *arg)
+{
+  Pipeline_Buffer *buffer;
+
+  (void) arg;
+
+  while ((buffer=pipeline_getqueued())!=NULL)
+  {
+    // Process the raw sample data to extract encoded data
+    if (buffer->intervals)
+    {
+      mod_processintervals(&mod, &buffer->flux, buffer->retry, usepll, buffer->physical_track, buffer->physical_head, buffer->rpm);
+    }
+    else
+    if ((flippy==0) || (buffer->side==0))
+    {
+      mod_processtrack(&mod, buffer->data, buffer->samplelen, buffer->retry, usepll, buffer->physical_track, buffer->physical_head, buffer->rpm);
+    }
+    else
+    {
+      fillflippybuffer(buffer->data, buffer->samplelen);
+
+      if (flippybuffer!=NULL)
+        mod_processtrack(&mod, flippybuffer, buffer->samplelen, buffer->retry, usepll, buffer->physical_track, buffer->physical_head, buffer->rpm);
+    }
+
+    buffer->completedpos=mod.completedpos;
+
+    buffer->complete=checktrack(buffer);
+
+    pipeline_complete(buffer);
+  }
+
+  return NULL;
+}
+
+// Act on a decoded track, either sampling it again or reporting on it
+void finishtrack(Pipeline_Buffer *buffer)
+{
+  // When a track decodes within the first rotation, sample just over a rotation of following tracks, unless writing flux images
+  if ((canretry()) && (buffer->retry==0) && (rawoutputs==0))
+  {
+    unsigned long samplesperrotation;
+
+    samplesperrotation=buffer->len/ROTATIONS;
+
+    if ((buffer->complete) && (buffer->completedpos>0) && (buffer->completedpos<(samplesperrotation+(samplesperrotation/4))))
+      capturelen=samplesperrotation+(samplesperrotation/4);
+    else
+      capturelen=buffer->len;
+  }
+
+  // Retry the capture if any sectors are missing, results are merged with earlier attempts
+  if ((!buffer->complete) && ((buffer->retry+1)<retries))
+  {
+    capturetrack(buffer, buffer->track, buffer->side, buffer->retry+1, buffer->retrylen);
+    return;
+  }
+
+  // Check if catalogue has been done
+  if ((info<sides) && (catalogue==1))
+  {
+    // Catalogue may need to read from the drive, so wait for decoder to go idle
+    pipeline_waitidle();
+
+    showcatalogue(buffer->track, buffer->physical_head);
+  }
+
+  if (!buffer->complete)
+    printf("I/O error reading head %d track %u\n", buffer->physical_head, buffer->track);
+
+  pipeline_release(buffer);
+}
+
+// Wait for a free buffer, acting on decoded tracks in the meantime
+Pipeline_Buffer *getcapturebuffer()
+{
+  Pipeline_Buffer *buffer;
+
+  // Deal with anything which has already been decoded
+  while ((buffer=pipeline_getcompleted(PIPELINE_NOWAIT))!=NULL)
+    finishtrack(buffer);
+
+  while ((buffer=pipeline_getfree())==NULL)
+  {
+    buffer=pipeline_getcompleted(PIPELINE_WAITFREE);
+
+    if (buffer!=NULL)
+      finishtrack(buffer);
+  }
+
+  return buffer;
+}
+
+// Sample all the tracks, overlapping writing and decoding with sampling of the next track
+int capturetracks()
+{
+  pthread_t decoder, writer;
+  Pipeline_Buffer *buffer;
+  unsigned int i;
+  unsigned char side;
+
+  if (!pipeline_init(PIPELINE_BUFFERS, samplebuffsize))
+    return 0;
+
+  capturelen=samplebuffsize;
+
+  // Decoding of each track can stop once all the sectors are found
+  mod_setexpectedsectors(&mod, sectorspertrack);
+
+  if ((capturetype!=DISKRAW) && (pthread_create(&decoder, NULL, decodethread, NULL)!=0))
+  {
+    pipeline_done();
+    return 0;
+  }
+
+  if ((rawoutputs>0) && (pthread_create(&writer, NULL, writethread, NULL)!=0))
+  {
+    if (capturetype!=DISKRAW)
+    {
+      pipeline_stop();
+      pthread_join(decoder, NULL);
+    }
+
+    pipeline_done();
+    return 0;
+  }
+
+  // Loop through the tracks
+  for (i=0; i<(drivetracks/hw_stepping); i++)
+  {
+    // Process all available disk sides (heads)
+    for (side=0; side<sides; side++)
+    {
+      // Read the specified side if in single side read mode
+      if ((sides==1) && (sidetoread!=AUTODETECT))
+        side=sidetoread;
+
+      // Flippy data is reversed, so needs a full capture
+      capturetrack(getcapturebuffer(), i, side, 0, ((flippy==1) && (side==1))?samplebuffsize:capturelen);
+    } // side loop
+
+    // If we're only doing a catalogue, then don't read any more tracks
+    if (capturetype==DISKCAT)
+      break;
+
+    // If this is an 80 track disk in a 40 track drive, then don't go any further
+    if ((drivetracks==40) && (disktracks==80))
+      break;
+  } // track loop
+
+  // Wait for remaining tracks to be written and decoded, including any retries they need
+  while ((buffer=pipeline_getcompleted(PIPELINE_WAITIDLE))!=NULL)
+    finishtrack(buffer);
+
+  pipeline_stop();
+
+  if (capturetype!=DISKRAW)
+    pthread_join(decoder, NULL);
+
+  if (rawoutputs>0)
+    pthread_join(writer, NULL);
+
+  pipeline_done();
+
+  return 1;
+}
+
 void showargs(const char *exename)
 {
   fprintf(stderr, "%s - Floppy disk raw flux capture and processor\n\n", exename);
@@ -149,14 +636,14 @@ void showargs(const char *exename)
 #ifdef NOPI
   fprintf(stderr, "[-i input_file] ");
 #endif
-  fprintf(stderr, "[-c] [[-ss [0|1]]|[-ds]] [-o output_file] [-spidiv spi_divider] [-r retries] [-sort] [-summary] [-l] [-sectors sectors_per_track] [-csv] [-tmax maxtracks] [-rpm rpm] [-dblstep] [-title \"Title\"] [-v]\n");
+  fprintf(stderr, "[-c] [[-ss [0|1]]|[-ds]] [-o output_file]... [-spidiv spi_divider] [-r retries] [-sort] [-summary] [-l] [-sectors sectors_per_track] [-csv] [-tmax maxtracks] [-rpm rpm] [-dblstep] [-title \"Title\"] [-rfienc encoding] [-threads threads] [-v]\n");
 }
 
 int main(int argc,char **argv)
 {
   int argn=0;
-  unsigned int i, j, rate;
-  unsigned char retry, retries, side, drivestatus;
+  unsigned int i, rate;
+  unsigned char drivestatus;
   int sortsectors=0;
   int missingsectors=0;
   int csv=0;
@@ -333,6 +820,37 @@ int main(int argc,char **argv)
       printf("  PLL phase adjustment %.0f%%\n", pll_phaseadjust*100);
     }
     else
+    if ((strcmp(argv[argn], "-threads")==0) && ((argn+1)<argc))
+    {
+      int retval;
+
+      ++argn;
+
+      // Run decoders in parallel on a pool of worker threads
+      if (sscanf(argv[argn], "%3d", &retval)==1)
+      {
+        threads=retval;
+        printf("Decoding with %d threads\n", threads);
+      }
+    }
+    else
+    if ((strcmp(argv[argn], "-rfienc")==0) && ((argn+1)<argc))
+    {
+      ++argn;
+
+      // Select how track data is stored in .rfi output
+      if ((strcmp(argv[argn], "raw")==0) || (strcmp(argv[argn], "rle")==0) || (strcmp(argv[argn], "varint")==0))
+      {
+        rfiencoding=argv[argn];
+        printf("Using \"%s\" encoding for .rfi track data\n", rfiencoding);
+      }
+      else
+      {
+        fprintf(stderr, "Invalid .rfi encoding\n");
+        return 1;
+      }
+    }
+    else
     if ((strcmp(argv[argn], "-r")==0) && ((argn+1)<argc))
     {
       int retval;
@@ -410,8 +928,22 @@ int main(int argc,char **argv)
     else
     if ((strcmp(argv[argn], "-o")==0) && ((argn+1)<argc))
     {
+      int rawoutput;
+
       ++argn;
-      outputfilename=argv[argn];
+
+      // Flux images can be written alongside one decoded disk image
+      rawoutput=((compare_extension(argv[argn], ".rfi")) || (compare_extension(argv[argn], ".dfi")) || (compare_extension(argv[argn], ".scp")));
+
+      if ((!rawoutput) && (diskimage!=NULL))
+      {
+        fprintf(stderr, "Only one disk image can be output\n");
+        return 1;
+      }
+
+      // Name csv after the disk image when there is one
+      if ((outputfilename==NULL) || (!rawoutput))
+        outputfilename=argv[argn];
 
       if (compare_extension(argv[argn], ".ssd"))
       {
@@ -536,11 +1068,11 @@ int main(int argc,char **argv)
       else
       if (compare_extension(argv[argn], ".rfi"))
       {
-        rawdata=fopen(argv[argn], "w+");
-        if (rawdata!=NULL)
+        if (addrawoutput(argv[argn], IMAGERAW))
         {
-          capturetype=DISKRAW;
-          outputtype=IMAGERAW;
+          // Only sample without decoding when there's no disk image
+          if (capturetype!=DISKIMG)
+            capturetype=DISKRAW;
         }
         else
           printf("Unable to save rawdata\n");
@@ -548,11 +1080,11 @@ int main(int argc,char **argv)
       else
       if (compare_extension(argv[argn], ".dfi"))
       {
-        rawdata=fopen(argv[argn], "w+");
-        if (rawdata!=NULL)
+        if (addrawoutput(argv[argn], IMAGEDFI))
         {
-          capturetype=DISKRAW;
-          outputtype=IMAGEDFI;
+          // Only sample without decoding when there's no disk image
+          if (capturetype!=DISKIMG)
+            capturetype=DISKRAW;
         }
         else
           printf("Unable to save dfi image\n");
@@ -560,11 +1092,11 @@ int main(int argc,char **argv)
       else
       if (compare_extension(argv[argn], ".scp"))
       {
-        rawdata=fopen(argv[argn], "w+");
-        if (rawdata!=NULL)
+        if (addrawoutput(argv[argn], IMAGESCP))
         {
-          capturetype=DISKRAW;
-          outputtype=IMAGESCP;
+          // Only sample without decoding when there's no disk image
+          if (capturetype!=DISKIMG)
+            capturetype=DISKRAW;
         }
         else
           printf("Unable to save scp image\n");
@@ -624,11 +1156,8 @@ int main(int argc,char **argv)
     return 1;
   }
 
-  diskstore_init(debug, usepll);
-
-  mod_init(debug);
-
-  PLL_init();
+  diskstore_init(debug);
+  diskstore_initstore(&store);
 
 #ifndef NOPI
   if (geteuid() != 0)
@@ -654,7 +1183,13 @@ int main(int argc,char **argv)
   }
 
   printf("Start with %lu byte sample buffer\n", samplebuffsize);
-  mod_samplesize=samplebuffsize;
+
+  // Tracks missing when reading a catalogue are sampled again from the drive
+  store.stepping=hw_stepping;
+  store.samplesize=samplebuffsize;
+  store.fetchtrack=fetchtrack;
+
+  mod_init(&mod, debug, threads, hw_samplerate, &store);
 
   // Install signal handlers to make sure motor is stopped
   atexit(exitFunction);
@@ -717,30 +1252,30 @@ int main(int argc,char **argv)
   else
     hw_sideselect(sidetoread);
 
-  // Wait for a bit after seek to allow drive speed to settle
-  hw_sleep(1);
+  // Wait for drive speed to settle after seek
+  hw_waitforsettle();
 
   // Sample track
   hw_samplerawtrackdata(samplebuffer, samplebuffsize);
-  mod_process(samplebuffer, samplebuffsize, 99, usepll);
+  mod_processtrack(&mod, samplebuffer, samplebuffsize, 99, usepll, hw_currenttrack, hw_currenthead, hw_rpm);
 
   // Check readability
-  if ((fm_lasttrack==-1) && (fm_lasthead==-1) && (fm_lastsector==-1) && (fm_lastlength==-1))
+  if ((mod.fm.lasttrack==-1) && (mod.fm.lasthead==-1) && (mod.fm.lastsector==-1) && (mod.fm.lastlength==-1))
     printf("No FM sector IDs found\n");
   else
     modulation=MODFM;
 
-  if ((mfm_lasttrack==-1) && (mfm_lasthead==-1) && (mfm_lastsector==-1) && (mfm_lastlength==-1))
+  if ((mod.mfm.lasttrack==-1) && (mod.mfm.lasthead==-1) && (mod.mfm.lastsector==-1) && (mod.mfm.lastlength==-1))
     printf("No MFM sector IDs found\n");
   else
     modulation=MODMFM;
 
-  if ((gcr_lasttrack==-1) && (gcr_lastsector==-1))
+  if ((mod.gcr.lasttrack==-1) && (mod.gcr.lastsector==-1))
     printf("No C64 GCR sector IDs found\n");
   else
     modulation=MODGCR;
 
-  if ((applegcr_lasttrack==-1) && (applegcr_lastsector==-1))
+  if ((mod.applegcr.lasttrack==-1) && (mod.applegcr.lastsector==-1))
     printf("No Apple GCR sector IDs found\n");
   else
     modulation=MODAPPLEGCR;
@@ -752,33 +1287,33 @@ int main(int argc,char **argv)
     int othersector=-1;
 
     // Check if it was FM sectors found
-    if ((fm_lasttrack!=-1) && (fm_lasthead!=-1) && (fm_lastsector!=-1) && (fm_lastlength!=-1))
+    if ((mod.fm.lasttrack!=-1) && (mod.fm.lasthead!=-1) && (mod.fm.lastsector!=-1) && (mod.fm.lastlength!=-1))
     {
-      othertrack=fm_lasttrack;
-      otherhead=fm_lasthead;
-      othersector=fm_lastsector;
+      othertrack=mod.fm.lasttrack;
+      otherhead=mod.fm.lasthead;
+      othersector=mod.fm.lastsector;
     }
 
     // Check if it was MFM sectors found
-    if ((mfm_lasttrack!=-1) && (mfm_lasthead!=-1) && (mfm_lastsector!=-1) && (mfm_lastlength!=-1))
+    if ((mod.mfm.lasttrack!=-1) && (mod.mfm.lasthead!=-1) && (mod.mfm.lastsector!=-1) && (mod.mfm.lastlength!=-1))
     {
-      othertrack=mfm_lasttrack;
-      otherhead=mfm_lasthead;
-      othersector=mfm_lastsector;
+      othertrack=mod.mfm.lasttrack;
+      otherhead=mod.mfm.lasthead;
+      othersector=mod.mfm.lastsector;
     }
 
     // Check if it was C64 GCR sectors found
-    if ((gcr_lasttrack!=-1) && (gcr_lastsector!=-1))
+    if ((mod.gcr.lasttrack!=-1) && (mod.gcr.lastsector!=-1))
     {
-      othertrack=gcr_lasttrack;
-      othersector=gcr_lastsector;
+      othertrack=mod.gcr.lasttrack;
+      othersector=mod.gcr.lastsector;
     }
 
     // Check if it was Apple GCR sectors found
-    if ((applegcr_lasttrack!=-1) && (applegcr_lastsector!=-1))
+    if ((mod.applegcr.lasttrack!=-1) && (mod.applegcr.lastsector!=-1))
     {
-      othertrack=applegcr_lasttrack;
-      othersector=applegcr_lastsector;
+      othertrack=mod.applegcr.lasttrack;
+      othersector=mod.applegcr.lastsector;
     }
 
     // Only look for data on other side if user hasn't specified number of sides to capture
@@ -787,28 +1322,22 @@ int main(int argc,char **argv)
       // Select upper side
       hw_sideselect(1);
 
-      // Wait for a bit after head switch to allow drive to settle
-      hw_sleep(1);
+      // Wait for drive to settle after head switch
+      hw_waitforsettle();
 
       // Sample track
       hw_samplerawtrackdata(samplebuffer, samplebuffsize);
-      mod_process(samplebuffer, samplebuffsize, 99, usepll);
+      mod_processtrack(&mod, samplebuffer, samplebuffsize, 99, usepll, hw_currenttrack, hw_currenthead, hw_rpm);
 
       // Check for flippy disk
-      if ((fm_lasttrack==-1) && (fm_lasthead==-1) && (fm_lastsector==-1) && (fm_lastlength==-1)
-         && (mfm_lasttrack==-1) && (mfm_lasthead==-1) && (mfm_lastsector==-1) && (mfm_lastlength==-1)
-         && (gcr_lasttrack==-1) && (gcr_lastsector==-1)
-         && (applegcr_lasttrack==-1) && (applegcr_lastsector==-1))
+      if (!mod_foundids(&mod))
       {
         fillflippybuffer(samplebuffer, samplebuffsize);
 
         if (flippybuffer!=NULL)
-          mod_process(flippybuffer, samplebuffsize, 99, usepll);
+          mod_processtrack(&mod, flippybuffer, samplebuffsize, 99, usepll, hw_currenttrack, hw_currenthead, hw_rpm);
 
-        if ((fm_lasttrack!=-1) || (fm_lasthead!=-1) || (fm_lastsector!=-1) || (fm_lastlength!=-1)
-           || (mfm_lasttrack!=-1) || (mfm_lasthead!=-1) || (mfm_lastsector!=-1) || (mfm_lastlength!=-1)
-           || (gcr_lasttrack!=-1) || (gcr_lastsector!=-1)
-           || (applegcr_lasttrack!=-1) || (applegcr_lastsector!=-1))
+        if (mod_foundids(&mod))
         {
           printf("Flippy disk detected\n");
           flippy=1;
@@ -816,10 +1345,7 @@ int main(int argc,char **argv)
       }
 
       // Check readability
-      if ((fm_lasttrack==-1) && (fm_lasthead==-1) && (fm_lastsector==-1) && (fm_lastlength==-1)
-         && (mfm_lasttrack==-1) && (mfm_lasthead==-1) && (mfm_lastsector==-1) && (mfm_lastlength==-1)
-         && (gcr_lasttrack==-1) && (gcr_lastsector==-1)
-         && (applegcr_lasttrack==-1) && (applegcr_lastsector==-1))
+      if (!mod_foundids(&mod))
       {
         // Only lower side was readable
         printf("Single-sided disk assumed, only found data on side 0\n");
@@ -829,7 +1355,7 @@ int main(int argc,char **argv)
       else
       {
         // If IDAM shows same head, then double-sided separate
-        if ((fm_lasthead==otherhead) || (mfm_lasthead==otherhead))
+        if ((mod.fm.lasthead==otherhead) || (mod.mfm.lasthead==otherhead))
           printf("Double-sided with separate sides disk detected\n");
         else
           printf("Double-sided disk detected\n");
@@ -853,6 +1379,7 @@ int main(int argc,char **argv)
 
           // Enable double stepping
           hw_stepping=HW_DOUBLESTEPPING;
+          store.stepping=hw_stepping;
 
           disktracks=40;
           drivetracks=80;
@@ -887,452 +1414,76 @@ int main(int argc,char **argv)
     sides=2;
   }
 
-  // Write header when doing raw capture
-  if (capturetype==DISKRAW)
-  {
-    switch (outputtype)
-    {
-      case IMAGERAW:
-        rfi_writeheader(rawdata, drivetracks, sides, hw_samplerate, hw_writeprotected());
-        break;
-
-      case IMAGEDFI:
-        dfi_writeheader(rawdata);
-        break;
-
-      case IMAGESCP:
-        scp_writeheader(rawdata, ROTATIONS, 0, (drivetracks/hw_stepping)*sides, hw_measurerpm(), sides, sidetoread==AUTODETECT?0:sidetoread);
-        break;
-
-      default:
-        break;
-    }
-
-    // Flush raw header data before moving on to capture
-    fflush(rawdata);
-  }
+  // Write header for any flux images
+  writerawheaders();
 
   // Start at track 0
   hw_seektotrackzero();
 
-  // Loop through the tracks
-  for (i=0; i<(drivetracks/hw_stepping); i++)
+  // Write and decode each track whilst the next one is being sampled
+  if (!capturetracks())
   {
-    hw_seektotrack(i);
-
-    // Process all available disk sides (heads)
-    for (side=0; side<sides; side++)
-    {
-      // Read the specified side if in single side read mode
-      if ((sides==1) && (sidetoread!=AUTODETECT))
-        side=sidetoread;
-
-      // Select the correct side
-      hw_sideselect(side);
-
-      // Measure the RPM for the current track/side
-      hw_measurerpm();
-
-      // Retry the capture if any sectors are missing
-      for (retry=0; retry<retries; retry++)
-      {
-        // Wait for a bit after seek/head select to allow drive speed to settle
-        hw_sleep(1);
-
-        if (retry==0)
-          printf("Sampling data for track %.2X head %.2x\n", i, side);
-
-        // Sampling data
-        hw_samplerawtrackdata(samplebuffer, samplebuffsize);
-
-        // Process the raw sample data to extract encoded data
-        if (capturetype!=DISKRAW)
-        {
-          if ((flippy==0) || (side==0))
-          {
-            mod_process(samplebuffer, samplebuffsize, retry, usepll);
-          }
-          else
-          {
-            fillflippybuffer(samplebuffer, samplebuffsize);
-
-            if (flippybuffer!=NULL)
-              mod_process(flippybuffer, samplebuffsize, retry, usepll);
-          }
-
-#ifdef NOPI
-          // No point in retrying when not using real hardware
-          break;
-#endif
-
-          // Don't retry unless imaging DFS disks
-          if ((outputtype!=IMAGEDSD) && (outputtype!=IMAGESSD) &&
-              (outputtype!=IMAGEDDD) && (outputtype!=IMAGESDD) )
-            break;
-	
-          // See if we have successfully read a full track
-          int trackstatus=1;
-
-          for (j=0; j<sectorspertrack; j++)
-	  {
-            if (diskstore_findhybridsector(hw_currenttrack, hw_currenthead, j)==NULL)
-	    {
-              // Failed to read at least one track
-              trackstatus=0;
-            }
-	  }
-
-	  if(trackstatus==1) break;
-
-          printf("Retry attempt %d, sectors ", retry+1);
-          for (j=0; j<sectorspertrack; j++)
-            if (diskstore_findhybridsector(hw_currenttrack, hw_currenthead, j)==NULL) printf("%.2u ", j);
-          printf("\n");
-        }
-        else
-          break; // No retries in RAW mode
-      } // retry loop
-
-      if (capturetype!=DISKRAW)
-      {
-        // Check if catalogue has been done
-        if ((info<sides) && (catalogue==1))
-        {
-          if (dfs_validcatalogue(hw_currenthead, &totalsectors))
-          {
-            printf("\nDetected DFS, side : %d\n", hw_currenthead);
-            dfs_showinfo(hw_currenthead, disktracks, sectorspertrack==-1?DFS_SECTORSPERTRACK:sectorspertrack);
-            info++;
-            printf("\n");
-          }
-          else
-          if ((i==0) && (side==0))
-          {
-            int adfs_format;
-
-            adfs_format=adfs_validate();
-
-            if (adfs_format!=ADFS_UNKNOWN)
-            {
-              printf("\nDetected ADFS-");
-              switch (adfs_format)
-              {
-                case ADFS_S:
-                  printf("S");
-                  break;
-
-                case ADFS_M:
-                  printf("M");
-                  break;
-
-                case ADFS_L:
-                  printf("L");
-                  break;
-
-                case ADFS_D:
-                  printf("D");
-                  break;
-
-                case ADFS_E:
-                  printf("E");
-                  break;
-
-                case ADFS_F:
-                  printf("F");
-                  break;
-
-                case ADFS_EX:
-                  printf("E+");
-                  break;
-
-                case ADFS_FX:
-                  printf("F+");
-                  break;
-
-                case ADFS_G:
-                  printf("G");
-                  break;
-
-                default:
-                  break;
-              }
-              printf("\n");
-              adfs_showinfo(adfs_format, disktracks, debug);
-              info++;
-              printf("\n");
-            }
-            else
-            {
-              if (dos_validate()!=DOS_UNKNOWN)
-              {
-                printf("\nDetected DOS\n\n");
-                dos_showinfo(disktracks, debug);
-                info++;
-              }
-              else
-              {
-                if (amigados_validate()!=AMIGADOS_UNKNOWN)
-                {
-                  printf("\nDetected Amiga DOS\n\n");
-                  amigados_showinfo(disktracks, debug);
-                  info++;
-                }
-                else
-                  if (appledos_validate()!=APPLEDOS_UNKNOWN)
-                  {
-                    printf("\nDetected Apple DOS\n\n");
-                    appledos_showinfo(debug);
-                    info++;
-                  }
-                  else
-                  {
-                    if (atarist_validate()!=ATARIST_UNKNOWN)
-                    {
-                      printf("\nDetected Atari ST format\n\n");
-                      atarist_showinfo(debug);
-                      info++;
-                    }
-                    else
-                      if (diskstore_countsectormod(MODAPPLEGCR)>0)
-                        printf("\nDetected Apple format\n\n");
-                      else
-                        printf("\nUnknown logical disk format\n\n");
-                  }
-              }
-            }
-          }
-        }
-
-        if (retry>=retries)
-          printf("I/O error reading head %d track %u\n", hw_currenthead, i);
-      }
-      else
-      {
-        // Write the raw sample data if required
-        if (rawdata!=NULL)
-        {
-          unsigned char *rawbuffer=samplebuffer;
-
-          // Handle flippy data
-          if ((flippy==1) && (side==1))
-          {
-            fillflippybuffer(samplebuffer, samplebuffsize);
-
-            if (flippybuffer!=NULL)
-              rawbuffer=flippybuffer;
-          }
-
-          switch (outputtype)
-          {
-            case IMAGERAW:
-              rfi_writetrack(rawdata, i, side, hw_rpm, "rle", samplebuffer, samplebuffsize);
-              break;
-
-            case IMAGEDFI:
-              dfi_writetrack(rawdata, i, side, rawbuffer, samplebuffsize, ROTATIONS);
-              break;
-
-            case IMAGESCP:
-              scp_writetrack(rawdata, ((i/hw_stepping)*sides)+side, rawbuffer, samplebuffsize, ROTATIONS, hw_rpm);
-              break;
-
-            default:
-              break;
-          }
-        }
-
-        // Flush raw track data before moving on to any further tracks
-        fflush(rawdata);
-      }
-    } // side loop
-
-    // If we're only doing a catalogue, then don't read any more tracks
-    if (capturetype==DISKCAT)
-      break;
-
-    // If this is an 80 track disk in a 40 track drive, then don't go any further
-    if ((drivetracks==40) && (disktracks==80))
-      break;
-  } // track loop
+    fprintf(stderr, "Unable to start capture\n");
+    return 3;
+  }
 
   // Return the disk head to track 0 following disk imaging
   hw_seektotrackzero();
 
   printf("Finished\n");
 
+  // Report how far the flux image writer fell behind
+  if (pipeline_writes>0)
+    printf("Flux writer queue depth : average %.1f, most %u of %u buffers\n", (float)pipeline_writedepthtotal/pipeline_writes, pipeline_writedepthmax, PIPELINE_BUFFERS);
+
+  // Report how long the drive took to settle
+  if (hw_settlecount>0)
+    printf("Drive settle time : average %.1fms, longest %.1fms over %u waits\n", ((float)hw_settletotal/hw_settlecount)/1000, (float)hw_settlemax/1000, hw_settlecount);
+
   // Stop the drive motor
   hw_stopmotor();
 
   // Determine how many tracks we actually had data on
-  if ((disktracks==80) && (diskstore_maxtrack<79))
-    disktracks=(diskstore_maxtrack+1);
+  if ((disktracks==80) && (store.maxtrack<79))
+    disktracks=(store.maxtrack+1);
 
   // Check if sectors have been requested to be sorted logically by track/head/sectorid
   if (sortsectors)
-    diskstore_sortsectors(SORTBYID, ROTATIONS);
+    diskstore_sortsectors(&store, SORTBYID, ROTATIONS);
   else
-    diskstore_sortsectors(SORTBYPOS, ROTATIONS);
+    diskstore_sortsectors(&store, SORTBYPOS, ROTATIONS);
 
   // Write the data to disk image file (if required)
   if (diskimage!=NULL)
   {
-    if (outputtype==IMAGETD0)
-    {
-      // When no title set, try to use title from source disk
-      if (title[0]==0)
-      {
-        // If they were found and they appear to be DFS catalogue then extract title
-        if (dfs_validcatalogue(0, &sectorspertrack))
-        {
-          dfs_gettitle(0, title, sizeof(title));
-        }
-        else
-        if (dos_validate()!=DOS_UNKNOWN)
-        {
-          dos_gettitle(title, sizeof(title));
-        }
-        else
-        if (adfs_validate()!=ADFS_UNKNOWN)
-        {
-          adfs_gettitle(adfs_validate(), title, sizeof(title));
-        }
-        else
-        if (amigados_validate()!=AMIGADOS_UNKNOWN)
-        {
-          amigados_gettitle(disktracks, title, sizeof(title));
-        }
-      }
-
-      // If no title or blank title, then use default
-      if (title[0]==0)
-        strcpy(title, "NO TITLE");
+    int written;
 
-      td0_write(diskimage, disktracks, title, sides, sidetoread==AUTODETECT?0:sidetoread);
-    }
-    else
-    if (outputtype==IMAGEFSD)
-    {
-      // When no title set, try to use title from source disk
-      if (title[0]==0)
-      {
-        // If they were found and they appear to be DFS catalogue then extract title
-        if (dfs_validcatalogue(0, &sectorspertrack))
-        {
-          dfs_gettitle(0, title, sizeof(title));
-        }
-        else
-        if (dos_validate()!=DOS_UNKNOWN)
-        {
-          dos_gettitle(title, sizeof(title));
-        }
-        else
-        if (adfs_validate()!=ADFS_UNKNOWN)
-        {
-          adfs_gettitle(adfs_validate(), title, sizeof(title));
-        }
-        else
-        if (amigados_validate()!=AMIGADOS_UNKNOWN)
-        {
-          amigados_gettitle(disktracks, title, sizeof(title));
-        }
-      }
+    written=image_write(&store, diskimage, outputtype, disktracks, hw_maxtracks, sides, sidetoread, sectorspertrack, title, sizeof(title));
 
-      // If no title or blank title, then use default
-      if (title[0]==0)
-        strcpy(title, "NO TITLE");
-
-      fsd_write(diskimage, disktracks, title, sides, sidetoread==AUTODETECT?0:sidetoread);
-    }
-    else
-    if ((outputtype==IMAGEDSD) || (outputtype==IMAGESSD) ||
-        (outputtype==IMAGEDDD) || (outputtype==IMAGESDD))
-    {
-      Disk_Sector *sec;
-      unsigned char blanksector[DFS_SECTORSIZE];
-      int imgside;
-
-      // Prepare a blank sector when no sector is found in store
-      bzero(blanksector, sizeof(blanksector));
-
-      for (i=0; ((i<hw_maxtracks) && (i<disktracks)); i++)
-      {
-        for (imgside=0; imgside<sides; imgside++)
-        {
-          for (j=0; j<sectorspertrack; j++)
-          {
-            // Write
-            sec=diskstore_findhybridsector(i, sidetoread!=AUTODETECT?sidetoread:imgside, j);
-
-            if ((sec!=NULL) && (sec->data!=NULL))
-            {
-              fwrite(sec->data, 1, DFS_SECTORSIZE, diskimage);
-            }
-            else
-            {
-              fwrite(blanksector, 1, DFS_SECTORSIZE, diskimage);
-              missingsectors++;
-            }
-          }
-        }
-      }
-    }
-    else
-    if (outputtype==IMAGEIMG)
-    {
-      unsigned char blanksector[16384];
-
-      // Prepare a blank sector when no sector is found in store
-      bzero(blanksector, sizeof(blanksector));
-
-      if ((diskstore_minsectorid!=-1) && (diskstore_maxsectorid!=-1))
-      {
-        int sectorsize;
-        int imgside;
-
-        if ((diskstore_minsectorsize!=-1) && (diskstore_maxsectorsize!=-1) && (diskstore_minsectorsize==diskstore_maxsectorsize))
-          sectorsize=diskstore_minsectorsize;
-
-        for (i=0; ((i<hw_maxtracks) && (i<disktracks)); i++)
-        {
-          for (imgside=0; imgside<sides; imgside++)
-          {
-            // Write sectors for this side
-            for (j=(unsigned int)diskstore_minsectorid; j<=(unsigned int)diskstore_maxsectorid; j++)
-            {
-              Disk_Sector *sec;
-
-              sec=diskstore_findhybridsector(i, imgside, j);
-
-              if ((sec!=NULL) && (sec->data!=NULL))
-              {
-                fwrite(sec->data, 1, sec->datasize, diskimage);
-              }
-              else
-              {
-                fwrite(blanksector, 1, sectorsize, diskimage);
-                missingsectors++;
-              }
-            }
-          }
-        }
-      }
-      else
-        printf("No sectors found to save\n");
-    }
+    if (written==IMAGE_NOSECTORS)
+      printf("No sectors found to save\n");
     else
+    if (written==IMAGE_UNKNOWNFORMAT)
       printf("Unknown output format\n");
+    else
+      missingsectors=written;
   }
 
-  // Finalise disk images
-  if (rawdata!=NULL)
+  // Finalise and close flux images
+  for (i=0; (int)i<rawoutputs; i++)
   {
-    if (outputtype==IMAGESCP)
-      scp_finalise(rawdata, (drivetracks/hw_stepping)*sides);
+    if (rawtype[i]==IMAGESCP)
+      scp_finalise(rawdata[i], (drivetracks/hw_stepping)*sides);
+
+    if (rawtype[i]==IMAGERAW)
+      rfi_finalise(rawdata[i]);
+
+    fclose(rawdata[i]);
   }
+  rawoutputs=0;
 
-  // Close disk image files (if open)
+  // Close disk image file (if open)
   if (diskimage!=NULL) fclose(diskimage);
-  if (rawdata!=NULL) fclose(rawdata);
 
   // Free memory allocated to SPI buffer
   if (samplebuffer!=NULL)
@@ -1351,24 +1502,24 @@ int main(int argc,char **argv)
   // When writing csv, close file (if open)
   if((csv) && (csvhandle!=NULL))
   {
-    diskstore_dumpbadsectors(csvhandle);
+    diskstore_dumpbadsectors(&store, csvhandle);
     fclose(csvhandle);
   }
 
   // Dump a list of valid sectors
   if ((debug) || (summary))
   {
-    unsigned int fmsectors=diskstore_countsectormod(MODFM);
-    unsigned int mfmsectors=diskstore_countsectormod(MODMFM);
-    unsigned int gcrsectors=diskstore_countsectormod(MODGCR);
-    unsigned int applegcrsectors=diskstore_countsectormod(MODAPPLEGCR);
+    unsigned int fmsectors=diskstore_countsectormod(&store, MODFM);
+    unsigned int mfmsectors=diskstore_countsectormod(&store, MODMFM);
+    unsigned int gcrsectors=diskstore_countsectormod(&store, MODGCR);
+    unsigned int applegcrsectors=diskstore_countsectormod(&store, MODAPPLEGCR);
 
-    diskstore_dumpsectorlist();
+    diskstore_dumpsectorlist(&store);
 
     printf("\nSummary: \n");
 
-    if ((diskstore_mintrack!=AUTODETECT) && (diskstore_maxtrack!=AUTODETECT))
-      printf("Disk tracks with data range from %d to %d\n", diskstore_mintrack, diskstore_maxtrack);
+    if ((store.mintrack!=AUTODETECT) && (store.maxtrack!=AUTODETECT))
+      printf("Disk tracks with data range from %d to %d\n", store.mintrack, store.maxtrack);
 
     printf("Drive tracks %d\n", drivetracks);
 
@@ -1383,25 +1534,25 @@ int main(int argc,char **argv)
     if (applegcrsectors!=0) printf("Apple GCR sectors found %u\n", applegcrsectors);
 
     printf("Detected density : ");
-    if ((mod_density&MOD_DENSITYFMSD)!=0) printf("SD ");
-    if ((mod_density&MOD_DENSITYMFMDD)!=0) printf("DD ");
-    if ((mod_density&MOD_DENSITYMFMHD)!=0) printf("HD ");
-    if ((mod_density&MOD_DENSITYMFMED)!=0) printf("ED ");
-    if ((mod_density&MOD_DENSITYAPPLEGCR)!=0) printf("APPLEGCR ");
-    if (mod_density==MOD_DENSITYAUTO) printf("Unknown density ");
+    if ((mod.density&MOD_DENSITYFMSD)!=0) printf("SD ");
+    if ((mod.density&MOD_DENSITYMFMDD)!=0) printf("DD ");
+    if ((mod.density&MOD_DENSITYMFMHD)!=0) printf("HD ");
+    if ((mod.density&MOD_DENSITYMFMED)!=0) printf("ED ");
+    if ((mod.density&MOD_DENSITYAPPLEGCR)!=0) printf("APPLEGCR ");
+    if (mod.density==MOD_DENSITYAUTO) printf("Unknown density ");
     printf("\n");
 
-    if ((diskstore_minsectorsize!=-1) && (diskstore_maxsectorsize!=-1))
-      printf("Sector sizes range from %d to %d bytes\n", diskstore_minsectorsize, diskstore_maxsectorsize);
+    if ((store.minsectorsize!=-1) && (store.maxsectorsize!=-1))
+      printf("Sector sizes range from %d to %d bytes\n", store.minsectorsize, store.maxsectorsize);
 
-    if ((diskstore_minsectorid!=-1) && (diskstore_maxsectorid!=-1))
-      printf("Sector ids range from %d to %d\n", diskstore_minsectorid, diskstore_maxsectorid);
+    if ((store.minsectorid!=-1) && (store.maxsectorid!=-1))
+      printf("Sector ids range from %d to %d\n", store.minsectorid, store.maxsectorid);
 
-    if ((diskstore_minsectorsize!=-1) && (diskstore_maxsectorsize!=-1) && (diskstore_minsectorid!=-1) && (diskstore_maxsectorid!=-1) && (diskstore_minsectorsize==diskstore_maxsectorsize))
+    if ((store.minsectorsize!=-1) && (store.maxsectorsize!=-1) && (store.minsectorid!=-1) && (store.maxsectorid!=-1) && (store.minsectorsize==store.maxsectorsize))
     {
       long totalstorage;
 
-      totalstorage=diskstore_maxsectorsize*((diskstore_maxsectorid-diskstore_minsectorid)+1);
+      totalstorage=store.maxsectorsize*((store.maxsectorid-store.minsectorid)+1);
       totalstorage*=disktracks;
       if (sides==2)
         totalstorage*=2;
@@ -1412,17 +1563,14 @@ int main(int argc,char **argv)
 
   // Show a layout map of where data was found on disk surface
   if (layout)
-    diskstore_dumplayoutmap(ROTATIONS);
+    diskstore_dumplayoutmap(&store, ROTATIONS, hw_maxtracks, hw_samplerate, hw_rpm);
 
   if (missingsectors>0)
     printf("Missing %d sectors\n", missingsectors);
 
   // Calculate whole disk CRC32
   if (capturetype==DISKIMG)
-  {
-    diskstore_sortsectors(SORTBYPOS, ROTATIONS);
-    printf("\nCRC32 %.8X\n", diskstore_calcdiskcrc((sides==1)?sidetoread:2));
-  }
+    printf("\nCRC32 %.8X\n", diskstore_calcdiskcrc(&store, (sides==1)?sidetoread:2, ROTATIONS));
 
   return 0;
 }
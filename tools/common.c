@@ -1,3 +1,4 @@
+#include <stdlib.h>
 #include <string.h>
 #include <strings.h>
 
@@ -14,3 +15,26 @@ int compare_extension(const char *filename, const char *ext)
   // Do comparision
   return (strcasecmp(dot, ext)==0);
 }
+
+// Used for reversing bit order within a byte
+static unsigned char revlookup[16] = {0x0, 0x8, 0x4, 0xc, 0x2, 0xa, 0x6, 0xe, 0x1, 0x9, 0x5, 0xd, 0x3, 0xb, 0x7, 0xf};
+unsigned char reverse(unsigned char n)
+{
+   // Reverse the top and bottom nibble then swap them.
+   return (revlookup[n&0x0f]<<4) | revlookup[n>>4];
+}
+
+// Used for flipping the bits in a raw sample buffer
+void flipsamples(unsigned char **flipped, const unsigned char *rawdata, const unsigned long rawlen)
+{
+  if (*flipped==NULL)
+    *flipped=malloc(rawlen);
+
+  if (*flipped!=NULL)
+  {
+    unsigned long em;
+
+    for (em=0; em<rawlen; em++)
+      (*flipped)[rawlen-em]=reverse(rawdata[em]);
+  }
+}
@@ -1,6 +1,15 @@
 #ifndef _COMMON_H_
 #define _COMMON_H_
 
+// Used for values which can be overriden
+#define AUTODETECT -1
+
+// Number of rotations to cature per track
+#define ROTATIONS 3
+
 extern int compare_extension(const char *filename, const char *ext);
 
+extern unsigned char reverse(unsigned char n);
+extern void flipsamples(unsigned char **flipped, const unsigned char *rawdata, const unsigned long rawlen);
+
 #endif
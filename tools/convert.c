@@ -0,0 +1,348 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "common.h"
+#include "crc.h"
+#include "crc32.h"
+#include "applegcr.h"
+#include "hardware.h"
+#include "diskstore.h"
+#include "dfs.h"
+#include "flux.h"
+#include "image.h"
+#include "mod.h"
+#include "reader.h"
+#include "convert.h"
+
+// Build the tables shared by all decoders, before any conversions run in parallel
+void convert_init()
+{
+  unsigned char dummy=0;
+
+  crc_init();
+  CRC32_Calc(&dummy, 1);
+  applegcr_buildgcrdecodemaps();
+}
+
+void convert_defaults(Convert_Options *options)
+{
+  options->sides=AUTODETECT;
+  options->sidetoread=AUTODETECT;
+  options->sectorspertrack=AUTODETECT;
+  options->doublestep=0;
+  options->sortsectors=0;
+  options->usepll=0;
+  options->maxtracks=HW_MAXTRACKS;
+  options->rpm=0;
+}
+
+// Use RPM recorded in sample file, unless overridden
+void convert_filerpm(Convert_Context *conv)
+{
+  if ((conv->forcedrpm==0.0) && (conv->samplefile->rpm!=0))
+    conv->rpm=conv->samplefile->rpm;
+}
+
+// Read a track into the sample buffer
+void convert_readtrack(Convert_Context *conv, const int physical_track, const int physical_head)
+{
+  reader_readtrack(conv->samplefile, physical_track, physical_head, conv->samplebuffer, conv->samplebuffsize);
+  convert_filerpm(conv);
+}
+
+// Decode a track, flipping it first when it's the second side of a flippy disk
+void convert_track(Convert_Context *conv, const int physical_track, const int physical_head, const int usepll)
+{
+  // Straight to intervals when the sample file allows it
+  if ((conv->flippy==0) || (physical_head==0))
+  {
+    if (reader_readintervals(conv->samplefile, physical_track, physical_head, &conv->flux, conv->samplebuffsize))
+    {
+      mod_processintervals(&conv->mod, &conv->flux, 0, usepll, physical_track, physical_head, conv->rpm);
+      return;
+    }
+
+    convert_readtrack(conv, physical_track, physical_head);
+    mod_processtrack(&conv->mod, conv->samplebuffer, conv->samplebuffsize, 0, usepll, physical_track, physical_head, conv->rpm);
+  }
+  else
+  {
+    convert_readtrack(conv, physical_track, physical_head);
+    flipsamples(&conv->flippybuffer, conv->samplebuffer, conv->samplebuffsize);
+
+    if (conv->flippybuffer!=NULL)
+      mod_processtrack(&conv->mod, conv->flippybuffer, conv->samplebuffsize, 0, usepll, physical_track, physical_head, conv->rpm);
+  }
+}
+
+// Work out sides and stepping from track 2, the same as bbcfdc does with a drive
+void convert_detect(Convert_Context *conv, const int usepll)
+{
+  int physical_track;
+  int othertrack=-1;
+
+  physical_track=2*conv->stepping;
+
+  convert_readtrack(conv, physical_track, (conv->sidetoread==AUTODETECT)?0:conv->sidetoread);
+  mod_processtrack(&conv->mod, conv->samplebuffer, conv->samplebuffsize, 99, usepll, physical_track, (conv->sidetoread==AUTODETECT)?0:conv->sidetoread, conv->rpm);
+
+  if (!mod_foundids(&conv->mod))
+    return;
+
+  if ((conv->mod.fm.lasttrack!=-1) && (conv->mod.fm.lasthead!=-1) && (conv->mod.fm.lastsector!=-1) && (conv->mod.fm.lastlength!=-1))
+    othertrack=conv->mod.fm.lasttrack;
+
+  if ((conv->mod.mfm.lasttrack!=-1) && (conv->mod.mfm.lasthead!=-1) && (conv->mod.mfm.lastsector!=-1) && (conv->mod.mfm.lastlength!=-1))
+    othertrack=conv->mod.mfm.lasttrack;
+
+  if ((conv->mod.gcr.lasttrack!=-1) && (conv->mod.gcr.lastsector!=-1))
+    othertrack=conv->mod.gcr.lasttrack;
+
+  if ((conv->mod.applegcr.lasttrack!=-1) && (conv->mod.applegcr.lastsector!=-1))
+    othertrack=conv->mod.applegcr.lasttrack;
+
+  // Only look for data on other side if number of sides wasn't given
+  if (conv->sides==AUTODETECT)
+  {
+    convert_readtrack(conv, physical_track, 1);
+    mod_processtrack(&conv->mod, conv->samplebuffer, conv->samplebuffsize, 99, usepll, physical_track, 1, conv->rpm);
+
+    // Check for flippy disk
+    if (!mod_foundids(&conv->mod))
+    {
+      flipsamples(&conv->flippybuffer, conv->samplebuffer, conv->samplebuffsize);
+
+      if (conv->flippybuffer!=NULL)
+        mod_processtrack(&conv->mod, conv->flippybuffer, conv->samplebuffsize, 99, usepll, physical_track, 1, conv->rpm);
+
+      if (mod_foundids(&conv->mod))
+        conv->flippy=1;
+    }
+
+    // Only mark as double-sided when found data on both sides, and not using single-sided output
+    if ((mod_foundids(&conv->mod)) && (conv->outputtype!=IMAGESSD) && (conv->outputtype!=IMAGESDD) && (conv->outputtype!=IMAGEFSD))
+      conv->sides=2;
+    else
+      conv->sides=1;
+  }
+
+  // Determine if double stepping is required, if not already forced
+  if (conv->stepping!=HW_DOUBLESTEPPING)
+  {
+    switch (othertrack)
+    {
+      case 1:
+        // 40 track disk in 80 track drive
+        conv->stepping=HW_DOUBLESTEPPING;
+        conv->store.stepping=conv->stepping;
+
+        conv->disktracks=40;
+        conv->drivetracks=80;
+        break;
+
+      case 4:
+        // 80 track disk in 40 track drive
+        conv->disktracks=80;
+        conv->drivetracks=40;
+        break;
+
+      default:
+        break;
+    }
+  }
+}
+
+// Apply options, then defaults for the type of disk image being written
+void convert_setup(Convert_Context *conv, const Convert_Options *options)
+{
+  conv->sides=options->sides;
+  conv->sidetoread=options->sidetoread;
+  conv->sectorspertrack=options->sectorspertrack;
+  conv->stepping=HW_NORMALSTEPPING;
+  conv->maxtracks=options->maxtracks;
+  conv->disktracks=AUTODETECT;
+  conv->drivetracks=AUTODETECT;
+  conv->flippy=0;
+  conv->forcedrpm=options->rpm;
+
+  if (options->doublestep)
+  {
+    conv->stepping=HW_DOUBLESTEPPING;
+
+    conv->disktracks=40;
+    conv->drivetracks=80;
+  }
+
+  switch (conv->outputtype)
+  {
+    case IMAGESSD:
+    case IMAGESDD:
+      // Single sided
+      conv->sides=1;
+      if (conv->sidetoread==AUTODETECT)
+        conv->sidetoread=0;
+
+      if (conv->sectorspertrack==AUTODETECT)
+        conv->sectorspertrack=(conv->outputtype==IMAGESSD)?DFS_SECTORSPERTRACK:DFS_DDSECTORSPERTRACK;
+      break;
+
+    case IMAGEDSD:
+    case IMAGEDDD:
+      if (conv->sectorspertrack==AUTODETECT)
+        conv->sectorspertrack=(conv->outputtype==IMAGEDSD)?DFS_SECTORSPERTRACK:DFS_DDSECTORSPERTRACK;
+      break;
+
+    case IMAGEFSD:
+      // Default to single sided when dual sided not specified
+      if (conv->sides==AUTODETECT)
+      {
+        conv->sides=1;
+
+        if (conv->sidetoread==AUTODETECT)
+          conv->sidetoread=0;
+      }
+      break;
+
+    default:
+      break;
+  }
+}
+
+int convert_image(Convert_Context *conv, const Convert_Options *options, const char *input, const char *output)
+{
+  FILE *diskimage;
+  char title[100];
+  unsigned int i;
+  int side;
+  int written;
+
+  conv->samplefile=NULL;
+  conv->samplebuffer=NULL;
+  conv->flippybuffer=NULL;
+  conv->missingsectors=0;
+  conv->crc=0;
+  conv->error=NULL;
+
+  diskstore_initstore(&conv->store);
+  flux_init(&conv->flux);
+
+  conv->outputtype=image_findtype(output);
+  if (conv->outputtype==IMAGENONE)
+  {
+    conv->error="Unknown output format";
+    return 0;
+  }
+
+  convert_setup(conv, options);
+
+  // Default to Pi2/Pi3 clock rate, for sample files without their own
+  conv->samplefile=reader_open(input, HW_400MHZ/HW_SPIDIV32, conv->maxtracks);
+  if (conv->samplefile==NULL)
+  {
+    conv->error="Unable to read sample file";
+    return 0;
+  }
+
+  conv->samplerate=conv->samplefile->samplerate;
+  conv->rpm=(conv->forcedrpm!=0.0)?conv->forcedrpm:HW_DEFAULTRPM;
+  convert_filerpm(conv);
+
+  conv->samplebuffsize=((conv->samplerate/(conv->rpm/SECONDSINMINUTE))/BITSPERBYTE)*ROTATIONS;
+  conv->samplebuffer=malloc(conv->samplebuffsize);
+  if (conv->samplebuffer==NULL)
+  {
+    conv->error="Unable to allocate sample buffer";
+    return 0;
+  }
+
+  conv->store.stepping=conv->stepping;
+  conv->store.samplesize=conv->samplebuffsize;
+
+  // No worker pool, as there's a conversion running on each core already
+  mod_init(&conv->mod, 0, 0, conv->samplerate, &conv->store);
+
+  if (conv->disktracks==AUTODETECT)
+    conv->disktracks=conv->maxtracks;
+
+  if (conv->drivetracks==AUTODETECT)
+    conv->drivetracks=conv->maxtracks;
+
+  convert_detect(conv, options->usepll);
+
+  // Number of sides failed to autodetect and was not forced, so assume 2
+  if (conv->sides==AUTODETECT)
+    conv->sides=2;
+
+  // Decoding of each track can stop once all the sectors are found
+  mod_setexpectedsectors(&conv->mod, conv->sectorspertrack);
+
+  for (i=0; i<(unsigned int)(conv->drivetracks/conv->stepping); i++)
+  {
+    for (side=0; side<conv->sides; side++)
+    {
+      // Read the specified side if in single side read mode
+      if ((conv->sides==1) && (conv->sidetoread!=AUTODETECT))
+        side=conv->sidetoread;
+
+      convert_track(conv, i*conv->stepping, side, options->usepll);
+    }
+
+    // If this is an 80 track disk in a 40 track drive, then don't go any further
+    if ((conv->drivetracks==40) && (conv->disktracks==80))
+      break;
+  }
+
+  mod_done(&conv->mod);
+
+  reader_close(conv->samplefile);
+  conv->samplefile=NULL;
+
+  // Determine how many tracks we actually had data on
+  if ((conv->disktracks==80) && (conv->store.maxtrack<79))
+    conv->disktracks=(conv->store.maxtrack+1);
+
+  diskstore_sortsectors(&conv->store, options->sortsectors?SORTBYID:SORTBYPOS, ROTATIONS);
+
+  diskimage=fopen(output, "w+");
+  if (diskimage==NULL)
+  {
+    conv->error="Unable to save disk image";
+    return 0;
+  }
+
+  title[0]=0;
+  written=image_write(&conv->store, diskimage, conv->outputtype, conv->disktracks, conv->maxtracks, conv->sides, conv->sidetoread, conv->sectorspertrack, title, sizeof(title));
+
+  fclose(diskimage);
+
+  if (written==IMAGE_NOSECTORS)
+  {
+    conv->error="No sectors found to save";
+    return 0;
+  }
+
+  conv->missingsectors=written;
+  conv->crc=diskstore_calcdiskcrc(&conv->store, (conv->sides==1)?conv->sidetoread:2, ROTATIONS);
+
+  return 1;
+}
+
+// Release the store and anything left over from the conversion
+void convert_free(Convert_Context *conv)
+{
+  if (conv->samplefile!=NULL)
+  {
+    reader_close(conv->samplefile);
+    conv->samplefile=NULL;
+  }
+
+  free(conv->samplebuffer);
+  conv->samplebuffer=NULL;
+
+  free(conv->flippybuffer);
+  conv->flippybuffer=NULL;
+
+  flux_free(&conv->flux);
+
+  diskstore_freestore(&conv->store);
+}
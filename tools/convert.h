@@ -0,0 +1,69 @@
+#ifndef _CONVERT_H_
+#define _CONVERT_H_
+
+#include <stdint.h>
+
+#include "flux.h"
+#include "diskstore.h"
+#include "mod.h"
+#include "reader.h"
+
+// Settings for converting a sample file, as the equivalent bbcfdc options
+typedef struct ConvertOptions
+{
+  int sides;
+  int sidetoread;
+  int sectorspertrack;
+  int doublestep;
+  int sortsectors;
+  int usepll;
+  int maxtracks;
+  float rpm; // 0 to use RPM from sample file
+} Convert_Options;
+
+// Everything needed to convert one sample file, so many can be converted at once
+typedef struct ConvertContext
+{
+  // Disk layout, starting from the options and then detected from the sample file
+  int sides;
+  int sidetoread;
+  int sectorspertrack;
+  int stepping;
+  unsigned int maxtracks;
+  int disktracks;
+  int drivetracks;
+  int flippy;
+  int outputtype;
+
+  // Sample file being read from
+  Reader_File *samplefile;
+  unsigned long samplerate;
+  float forcedrpm;
+  float rpm;
+
+  unsigned char *samplebuffer;
+  unsigned char *flippybuffer;
+  unsigned long samplebuffsize;
+  Flux_Intervals flux;
+
+  // Results, error is NULL unless conversion failed
+  int missingsectors;
+  uint32_t crc;
+  const char *error;
+
+  Disk_Store store;
+  Mod_Context mod;
+} Convert_Context;
+
+// Build shared lookup tables, call once before starting conversion threads
+extern void convert_init();
+
+// Set options to the bbcfdc defaults
+extern void convert_defaults(Convert_Options *options);
+
+// Decode sample file and write disk image, store is kept for examining until convert_free, which is needed even on failure
+extern int convert_image(Convert_Context *conv, const Convert_Options *options, const char *input, const char *output);
+
+extern void convert_free(Convert_Context *conv);
+
+#endif
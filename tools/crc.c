@@ -1,8 +1,11 @@
 #include <stdint.h>
 #include "crc.h"
 
-// Configurable CRC16 stream algorithm
-uint16_t calc_crc_stream(const unsigned char *data, const int datalen, const uint16_t initial, const uint16_t polynomial)
+uint16_t crc_table[CRC_SLICES][256];
+int crc_tableready=0;
+
+// Configurable CRC16 algorithm, one bit at a time
+uint16_t crc_bitwise(const unsigned char *data, const int datalen, const uint16_t initial, const uint16_t polynomial)
 {
   uint16_t crc=initial;
   int i, j;
@@ -17,8 +20,60 @@ uint16_t calc_crc_stream(const unsigned char *data, const int datalen, const uin
   return (crc & 0xffff);
 }
 
+// Build CCITT lookup tables, table n gives the effect of a byte followed by n zero bytes
+void crc_init()
+{
+  unsigned char byte;
+  int i, n;
+
+  if (crc_tableready) return;
+
+  for (i=0; i<256; i++)
+  {
+    byte=i;
+    crc_table[0][i]=crc_bitwise(&byte, 1, 0x0000, CRC_CCITT_POLYNOMIAL);
+  }
+
+  for (n=1; n<CRC_SLICES; n++)
+    for (i=0; i<256; i++)
+      crc_table[n][i]=(crc_table[n-1][i]<<8) ^ crc_table[0][crc_table[n-1][i]>>8];
+
+  crc_tableready=1;
+}
+
+// CCITT CRC16 using lookup tables, 8 bytes at a time
+uint16_t crc_sliced(const unsigned char *data, const int datalen, const uint16_t initial)
+{
+  uint16_t crc=initial;
+  int i=0;
+
+  for (; (i+CRC_SLICES)<=datalen; i+=CRC_SLICES)
+  {
+    crc=crc_table[7][data[i]^(crc>>8)] ^ crc_table[6][data[i+1]^(crc&0xff)] ^
+        crc_table[5][data[i+2]] ^ crc_table[4][data[i+3]] ^
+        crc_table[3][data[i+4]] ^ crc_table[2][data[i+5]] ^
+        crc_table[1][data[i+6]] ^ crc_table[0][data[i+7]];
+  }
+
+  // Remaining bytes one at a time
+  for (; i<datalen; i++)
+    crc=crc_update(crc, data[i]);
+
+  return crc;
+}
+
+// Configurable CRC16 stream algorithm
+uint16_t calc_crc_stream(const unsigned char *data, const int datalen, const uint16_t initial, const uint16_t polynomial)
+{
+  // Use tables when they've been built for this polynomial
+  if ((polynomial==CRC_CCITT_POLYNOMIAL) && (crc_tableready))
+    return crc_sliced(data, datalen, initial);
+
+  return crc_bitwise(data, datalen, initial, polynomial);
+}
+
 // CCITT CRC16 (Floppy Disk Data)
 uint16_t calc_crc(const unsigned char *data, const int datalen)
 {
-  return (calc_crc_stream(data, datalen, 0xffff, 0x1021));
+  return (calc_crc_stream(data, datalen, CRC_CCITT_INITIAL, CRC_CCITT_POLYNOMIAL));
 }
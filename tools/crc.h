@@ -3,6 +3,24 @@
 
 #include <stdint.h>
 
+// CCITT CRC16 as used for floppy disk ID and data blocks
+#define CRC_CCITT_INITIAL 0xffff
+#define CRC_CCITT_POLYNOMIAL 0x1021
+
+// Tables for processing 8 bytes at a time, table 0 is also used for single bytes
+#define CRC_SLICES 8
+
+extern uint16_t crc_table[CRC_SLICES][256];
+
+// Build lookup tables, must be done before using crc_update()
+extern void crc_init();
+
+// Add a byte to a running CCITT CRC16
+static inline uint16_t crc_update(const uint16_t crc, const unsigned char data)
+{
+  return (uint16_t)((crc<<8) ^ crc_table[0][(crc>>8) ^ data]);
+}
+
 extern uint16_t calc_crc_stream(const unsigned char *data, const int datalen, const uint16_t initial, const uint16_t polynomial);
 extern uint16_t calc_crc(const unsigned char *data, const int datalen);
 
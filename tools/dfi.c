@@ -2,6 +2,7 @@
 #include <strings.h>
 
 #include "dfi.h"
+#include "flux.h"
 
 /*
 
@@ -81,53 +82,47 @@ void dfi_writeheader(FILE *dfifile)
 // DFE2 encode raw binary sample data
 unsigned long dfi_encodedata(unsigned char *buffer, const unsigned long maxdfilen, const unsigned char *rawtrackdata, const unsigned long rawdatalength, const unsigned int rotations)
 {
+  Flux_Intervals flux;
   unsigned long dfilen=0;
-  char state=0;
-  unsigned int i, j;
-  unsigned char carry=0;
+  unsigned long i, carry;
 
-  // Determine starting sample level
-  state=(rawtrackdata[0]&0x80)>>7;
+  // Having seen an "original" .dfi file, it looks like it only stores READ pin rising edge deltas
+  flux_init(&flux);
+  flux_extract(&flux, rawtrackdata, rawdatalength, FLUX_RISINGEDGES);
 
-  for (i=0; i<rawdatalength; i++)
+  for (i=0; i<=flux.count; i++)
   {
-    unsigned char c;
+    // Samples after the last rising edge only generate carries
+    carry=(i<flux.count)?flux.interval[i]:flux.trailing;
 
-    c=rawtrackdata[i];
-
-    // Process each of the 8 sample bits looking for state change
-    for (j=0; j<8; j++)
+    while (carry>=DFI_CARRY)
     {
-      carry++;
-
-      if (carry==DFI_CARRY)
+      // Check for buffer overflow
+      if ((dfilen+1)>=maxdfilen)
       {
-        // Check for buffer overflow
-        if ((dfilen+1)>=maxdfilen) return 0;
-
-        buffer[dfilen++]=DFI_CARRY;
-        carry=0;
+        flux_free(&flux);
+        return 0;
       }
 
-      if (((c&0x80)>>7)!=state)
-      {
-        state=1-state;
-
-        // Having seen an "original" .dfi file, it looks like it only stores READ pin rising edge deltas
-        if (state==1)
-        {
-          // Check for buffer overflow
-          if ((dfilen+1)>=maxdfilen) return 0;
+      buffer[dfilen++]=DFI_CARRY;
+      carry-=DFI_CARRY;
+    }
 
-          buffer[dfilen++]=carry;
-          carry=0;
-        }
+    if (i<flux.count)
+    {
+      // Check for buffer overflow
+      if ((dfilen+1)>=maxdfilen)
+      {
+        flux_free(&flux);
+        return 0;
       }
 
-      c=c<<1;
+      buffer[dfilen++]=carry;
     }
   }
 
+  flux_free(&flux);
+
   // Simulate an index pulse for each rotation
   for (i=0; i<rotations; i++)
     buffer[(dfilen/(rotations+1))*i]|=0x80;
@@ -84,15 +84,15 @@ unsigned long dfs_getstartsector(Disk_Sector *sector1, const int entry)
 }
 
 // Return the disk title
-void dfs_gettitle(const int head, char *title, const int titlelen)
+void dfs_gettitle(Disk_Store *store, const int head, char *title, const int titlelen)
 {
   int i, j;
   Disk_Sector *sector0;
   Disk_Sector *sector1;
 
   // Search for sectors
-  sector0=diskstore_findhybridsector(0, head, 0);
-  sector1=diskstore_findhybridsector(0, head, 1);
+  sector0=diskstore_findhybridsector(store, 0, head, 0);
+  sector1=diskstore_findhybridsector(store, 0, head, 1);
 
   // Blank out title
   title[0]=0;
@@ -124,7 +124,7 @@ void dfs_gettitle(const int head, char *title, const int titlelen)
   }
 }
 
-void dfs_showinfo(const int head, const unsigned int disktracks, const int sectorspertrack)
+void dfs_showinfo(Disk_Store *store, const int head, const unsigned int disktracks, const int sectorspertrack)
 {
   int i;
   int numfiles;
@@ -135,8 +135,8 @@ void dfs_showinfo(const int head, const unsigned int disktracks, const int secto
   Disk_Sector *sector1;
 
   // Search for sectors
-  sector0=diskstore_findhybridsector(0, head, 0);
-  sector1=diskstore_findhybridsector(0, head, 1);
+  sector0=diskstore_findhybridsector(store, 0, head, 0);
+  sector1=diskstore_findhybridsector(store, 0, head, 1);
 
   // Check we have both DFS catalogue sectors
   if ((sector0==NULL) || (sector1==NULL))
@@ -249,14 +249,14 @@ void dfs_showinfo(const int head, const unsigned int disktracks, const int secto
 }
 
 // Test for valid DFS catalogue, checks from http://beebwiki.mdfs.net/Acorn_DFS_disc_format
-int dfs_validcatalogue(const int head, int *totalsectors)
+int dfs_validcatalogue(Disk_Store *store, const int head, int *totalsectors)
 {
   Disk_Sector *sector0;
   Disk_Sector *sector1;
 
   // Search for sectors
-  sector0=diskstore_findhybridsector(0, head, 0);
-  sector1=diskstore_findhybridsector(0, head, 1);
+  sector0=diskstore_findhybridsector(store, 0, head, 0);
+  sector1=diskstore_findhybridsector(store, 0, head, 1);
 
   // Check we have both DFS catalogue sectors
   if ((sector0==NULL) || (sector1==NULL))
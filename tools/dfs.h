@@ -1,6 +1,8 @@
 #ifndef _DFS_H_
 #define _DFS_H_
 
+#include "diskstore.h"
+
 // Acorn DFS geometry and layout
 #define DFS_SECTORSIZE 256
 #define DFS_SECTORSPERTRACK 10
@@ -14,8 +16,8 @@
 
 #define DFS_MAXFILES 31
 
-extern void dfs_gettitle(const int head, char *title, const int titlelen);
-extern void dfs_showinfo(const int head, const unsigned int disktracks, const int sectorspertrack);
-extern int dfs_validcatalogue(const int head, int *sectorspertrack);
+extern void dfs_gettitle(Disk_Store *store, const int head, char *title, const int titlelen);
+extern void dfs_showinfo(Disk_Store *store, const int head, const unsigned int disktracks, const int sectorspertrack);
+extern int dfs_validcatalogue(Disk_Store *store, const int head, int *sectorspertrack);
 
 #endif
@@ -5,37 +5,236 @@
 
 #include "diskstore.h"
 #include "hardware.h"
-#include "mod.h"
 #include "crc32.h"
 
-Disk_Sector *Disk_SectorsRoot;
-
-// For stats
-int diskstore_mintrack=-1;
-int diskstore_maxtrack=-1;
-int diskstore_minhead=-1;
-int diskstore_maxhead=-1;
-int diskstore_minsectorsize=-1;
-int diskstore_maxsectorsize=-1;
-int diskstore_minsectorid=-1;
-int diskstore_maxsectorid=-1;
-
-// For absolute disk access
-int diskstore_abstrack=-1;
-int diskstore_abshead=-1;
-int diskstore_abssector=-1;
-int diskstore_abssecoffs=-1;
-unsigned long diskstore_absoffset=0;
-
-int diskstore_usepll=0;
 int diskstore_debug=0;
 
+// Hash of logical position for logical sector index
+#define DISKSTORE_LOGICALKEY(t, h, s) ((((t)*31)+((h)*7)+(s))%DISKSTORE_LOGICALHASH)
+
+// Initialise an empty arena
+void diskstore_initarena(Disk_Arena *arena, const unsigned long chunksize)
+{
+  arena->first=NULL;
+  arena->current=NULL;
+  arena->last=NULL;
+  arena->chunksize=chunksize;
+}
+
+// Allocate memory from an arena, moving on to the next chunk when current one is full
+void *diskstore_arenaalloc(Disk_Arena *arena, const unsigned long size)
+{
+  Disk_ArenaChunk *chunk;
+  unsigned long alignedsize;
+  void *ptr;
+
+  // Keep allocations aligned
+  alignedsize=(size+(sizeof(void *)-1))&~(sizeof(void *)-1);
+
+  chunk=arena->current;
+
+  while ((chunk!=NULL) && ((chunk->used+alignedsize)>chunk->size))
+  {
+    chunk=chunk->next;
+
+    if (chunk!=NULL)
+      chunk->used=0;
+  }
+
+  // Add a new chunk when none of the existing ones have room
+  if (chunk==NULL)
+  {
+    chunk=malloc(sizeof(Disk_ArenaChunk));
+    if (chunk==NULL) return NULL;
+
+    chunk->size=(alignedsize>arena->chunksize)?alignedsize:arena->chunksize;
+    chunk->used=0;
+    chunk->next=NULL;
+
+    chunk->data=malloc(chunk->size);
+    if (chunk->data==NULL)
+    {
+      free(chunk);
+      return NULL;
+    }
+
+    if (arena->last==NULL)
+      arena->first=chunk;
+    else
+      arena->last->next=chunk;
+
+    arena->last=chunk;
+  }
+
+  arena->current=chunk;
+
+  ptr=&chunk->data[chunk->used];
+  chunk->used+=alignedsize;
+
+  return ptr;
+}
+
+// Empty an arena, keeping its chunks for reuse
+void diskstore_resetarena(Disk_Arena *arena)
+{
+  arena->current=arena->first;
+
+  if (arena->current!=NULL)
+    arena->current->used=0;
+}
+
+// Release all the memory held by an arena
+void diskstore_freearena(Disk_Arena *arena)
+{
+  Disk_ArenaChunk *chunk;
+
+  while (arena->first!=NULL)
+  {
+    chunk=arena->first;
+    arena->first=chunk->next;
+
+    free(chunk->data);
+    free(chunk);
+  }
+
+  diskstore_initarena(arena, arena->chunksize);
+}
+
+// Hash of position, ID and CRCs for finding exact duplicates
+unsigned int diskstore_exactkey(const uint8_t physical_track, const uint8_t physical_head, const uint8_t logical_track, const uint8_t logical_head, const uint8_t logical_sector, const uint8_t logical_size, const unsigned int idcrc, const unsigned int datatype, const unsigned int datasize, const unsigned int datacrc)
+{
+  uint32_t key;
+
+  key=physical_track;
+  key=(key*31)+physical_head;
+  key=(key*31)+logical_track;
+  key=(key*31)+logical_head;
+  key=(key*31)+logical_sector;
+  key=(key*31)+logical_size;
+  key=(key*31)+idcrc;
+  key=(key*31)+datatype;
+  key=(key*31)+datasize;
+  key=(key*31)+datacrc;
+
+  return (key^(key>>16))%DISKSTORE_EXACTHASH;
+}
+
+// Find index for a physical track/head, optionally creating it
+Disk_Track *diskstore_findtrack(Disk_Store *store, const uint8_t physical_track, const uint8_t physical_head, const int create)
+{
+  Disk_Track *track;
+
+  if (physical_head>=DISKSTORE_HEADS)
+    return NULL;
+
+  track=store->tracks[physical_track][physical_head];
+
+  if ((track==NULL) && (create))
+  {
+    track=calloc(1, sizeof(Disk_Track));
+    store->tracks[physical_track][physical_head]=track;
+  }
+
+  return track;
+}
+
+// Add a sector to the indexes of a store
+int diskstore_indexsector(Disk_Store *store, Disk_Sector *sector)
+{
+  Disk_Track *track;
+  Disk_Sector **chain;
+
+  track=diskstore_findtrack(store, sector->physical_track, sector->physical_head, 1);
+  if (track==NULL)
+    return 0;
+
+  // Grow list of sectors for this track as required
+  if (track->count==track->allocated)
+  {
+    Disk_Sector **sectors;
+    unsigned int allocated;
+
+    allocated=(track->allocated==0)?32:track->allocated*2;
+
+    sectors=realloc(track->sectors, allocated*sizeof(Disk_Sector *));
+    if (sectors==NULL)
+      return 0;
+
+    track->sectors=sectors;
+    track->allocated=allocated;
+  }
+
+  track->sectors[track->count++]=sector;
+
+  if (track->byid[sector->logical_sector]==NULL)
+  {
+    track->byid[sector->logical_sector]=sector;
+    track->found[sector->logical_sector/32]|=(1U<<(sector->logical_sector%32));
+  }
+
+  // Add to end of logical hash chain, to keep store order
+  sector->nextlogical=NULL;
+  chain=&store->logical[DISKSTORE_LOGICALKEY(sector->logical_track, sector->logical_head, sector->logical_sector)];
+
+  while (*chain!=NULL)
+    chain=&(*chain)->nextlogical;
+
+  *chain=sector;
+
+  // Add to content hash chain
+  chain=&store->exact[diskstore_exactkey(sector->physical_track, sector->physical_head, sector->logical_track, sector->logical_head, sector->logical_sector, sector->logical_size, sector->idcrc, sector->datatype, sector->datasize, sector->datacrc)];
+  sector->nextexact=*chain;
+  *chain=sector;
+
+  return 1;
+}
+
+// Free the indexes of a store, leaving the sectors
+void diskstore_clearindex(Disk_Store *store)
+{
+  int dtrack, dhead;
+
+  for (dtrack=0; dtrack<DISKSTORE_TRACKS; dtrack++)
+    for (dhead=0; dhead<DISKSTORE_HEADS; dhead++)
+    {
+      if (store->tracks[dtrack][dhead]!=NULL)
+      {
+        free(store->tracks[dtrack][dhead]->sectors);
+        free(store->tracks[dtrack][dhead]->bypos);
+        free(store->tracks[dtrack][dhead]);
+        store->tracks[dtrack][dhead]=NULL;
+      }
+    }
+
+  bzero(store->logical, sizeof(store->logical));
+  bzero(store->exact, sizeof(store->exact));
+}
+
+// Rebuild the indexes of a store following a change in sector order
+void diskstore_reindex(Disk_Store *store)
+{
+  Disk_Sector *curr;
+
+  diskstore_clearindex(store);
+
+  store->tail=NULL;
+  curr=store->root;
+
+  while (curr!=NULL)
+  {
+    diskstore_indexsector(store, curr);
+
+    store->tail=curr;
+    curr=curr->next;
+  }
+}
+
 // Find sector in store to make sure there is no exact match when adding
-Disk_Sector *diskstore_findexactsector(const uint8_t physical_track, const uint8_t physical_head, const uint8_t logical_track, const uint8_t logical_head, const uint8_t logical_sector, const uint8_t logical_size, const unsigned int idcrc, const unsigned int datatype, const unsigned int datasize, const unsigned int datacrc)
+Disk_Sector *diskstore_findexactsector(Disk_Store *store, const uint8_t physical_track, const uint8_t physical_head, const uint8_t logical_track, const uint8_t logical_head, const uint8_t logical_sector, const uint8_t logical_size, const unsigned int idcrc, const unsigned int datatype, const unsigned int datasize, const unsigned int datacrc)
 {
   Disk_Sector *curr;
 
-  curr=Disk_SectorsRoot;
+  curr=store->exact[diskstore_exactkey(physical_track, physical_head, logical_track, logical_head, logical_sector, logical_size, idcrc, datatype, datasize, datacrc)];
 
   while (curr!=NULL)
   {
@@ -51,18 +250,18 @@ Disk_Sector *diskstore_findexactsector(const uint8_t physical_track, const uint8
         (curr->datacrc==datacrc))
       return curr;
 
-    curr=curr->next;
+    curr=curr->nextexact;
   }
 
   return NULL;
 }
 
 // Find sector by logical position
-Disk_Sector *diskstore_findlogicalsector(const uint8_t logical_track, const uint8_t logical_head, const uint8_t logical_sector)
+Disk_Sector *diskstore_findlogicalsector(Disk_Store *store, const uint8_t logical_track, const uint8_t logical_head, const uint8_t logical_sector)
 {
   Disk_Sector *curr;
 
-  curr=Disk_SectorsRoot;
+  curr=store->logical[DISKSTORE_LOGICALKEY(logical_track, logical_head, logical_sector)];
 
   while (curr!=NULL)
   {
@@ -71,83 +270,143 @@ Disk_Sector *diskstore_findlogicalsector(const uint8_t logical_track, const uint
         (curr->logical_sector==logical_sector))
       return curr;
 
-    curr=curr->next;
+    curr=curr->nextlogical;
   }
 
   return NULL;
 }
 
 // Find sector by hybrid physical/logical position
-Disk_Sector *diskstore_findhybridsector(const uint8_t physical_track, const uint8_t physical_head, const uint8_t logical_sector)
+Disk_Sector *diskstore_findhybridsector(Disk_Store *store, const uint8_t physical_track, const uint8_t physical_head, const uint8_t logical_sector)
 {
-  Disk_Sector *curr;
+  Disk_Track *track;
 
-  curr=Disk_SectorsRoot;
+  track=diskstore_findtrack(store, physical_track, physical_head, 0);
+  if (track==NULL)
+    return NULL;
 
-  while (curr!=NULL)
-  {
-    if ((curr->physical_track==physical_track) &&
-        (curr->physical_head==physical_head) &&
-        (curr->logical_sector==logical_sector))
-      return curr;
+  return track->byid[logical_sector];
+}
 
-    curr=curr->next;
-  }
+// Find nth sector for given physical track/head
+Disk_Sector *diskstore_findnthsector(Disk_Store *store, const uint8_t physical_track, const uint8_t physical_head, const uint8_t nth_sector)
+{
+  Disk_Track *track;
 
-  return NULL;
+  track=diskstore_findtrack(store, physical_track, physical_head, 0);
+  if ((track==NULL) || (nth_sector>=track->count))
+    return NULL;
+
+  return track->sectors[nth_sector];
 }
 
-// Find nth sector for given physical track/head
-Disk_Sector *diskstore_findnthsector(const uint8_t physical_track, const uint8_t physical_head, const uint8_t nth_sector)
+// Count how many sectors we have for given physical track/head
+unsigned char diskstore_countsectors(Disk_Store *store, const uint8_t physical_track, const uint8_t physical_head)
 {
-  Disk_Sector *curr;
-  int n;
+  Disk_Track *track;
 
-  curr=Disk_SectorsRoot;
-  n=0;
+  track=diskstore_findtrack(store, physical_track, physical_head, 0);
+  if (track==NULL)
+    return 0;
 
-  while (curr!=NULL)
+  return track->count;
+}
+
+// Count how many different sector ids have been found on a physical track/head, and confirmed at least a number of times
+unsigned int diskstore_countids(Disk_Store *store, const uint8_t physical_track, const uint8_t physical_head, const unsigned int minconfirmations)
+{
+  Disk_Track *track;
+  unsigned int ids;
+  int id;
+
+  track=diskstore_findtrack(store, physical_track, physical_head, 0);
+  if (track==NULL)
+    return 0;
+
+  ids=0;
+  for (id=0; id<DISKSTORE_SECTORIDS; id++)
+    if ((track->byid[id]!=NULL) && (track->byid[id]->confirmations>=minconfirmations))
+      ids++;
+
+  return ids;
+}
+
+// Check if sector ids from 0 up to a count have all been found on a physical track/head
+int diskstore_trackcomplete(Disk_Store *store, const uint8_t physical_track, const uint8_t physical_head, const int sectors)
+{
+  Disk_Track *track;
+  uint32_t mask;
+  int id;
+
+  track=diskstore_findtrack(store, physical_track, physical_head, 0);
+
+  for (id=0; (id<sectors) && (id<DISKSTORE_SECTORIDS); id+=32)
   {
-    if ((curr->physical_track==physical_track) && (curr->physical_head==physical_head))
-    {
-      if (n==nth_sector)
-        return curr;
-      n++;
-    }
+    if (track==NULL)
+      return 0;
 
-    curr=curr->next;
+    mask=((sectors-id)>=32)?0xffffffff:((1U<<(sectors-id))-1);
+
+    if ((track->found[id/32]&mask)!=mask)
+      return 0;
   }
 
-  return NULL;
+  return 1;
 }
 
-// Count how many sectors we have for given physical track/head
-unsigned char diskstore_countsectors(const uint8_t physical_track, const uint8_t physical_head)
+// Determine how far from the index, in samples, the missing sectors of a physical track/head extend
+unsigned long diskstore_missingextent(Disk_Store *store, const uint8_t physical_track, const uint8_t physical_head, const int sectors, const unsigned long samplesperrotation)
 {
-  Disk_Sector *curr;
-  int n;
+  Disk_Track *track;
+  Disk_Sector *prev;
+  Disk_Sector *next;
+  unsigned long extent, nextpos;
+  int id, j;
 
-  curr=Disk_SectorsRoot;
-  n=0;
+  track=diskstore_findtrack(store, physical_track, physical_head, 0);
+  if ((track==NULL) || (samplesperrotation==0))
+    return samplesperrotation;
 
-  while (curr!=NULL)
+  extent=0;
+
+  for (id=0; (id<sectors) && (id<DISKSTORE_SECTORIDS); id++)
   {
-    if ((curr->physical_track==physical_track) && (curr->physical_head==physical_head))
-      n++;
+    if (track->byid[id]!=NULL)
+      continue;
 
-    curr=curr->next;
+    // Find the sectors found either side of the missing one
+    prev=NULL;
+    for (j=id-1; (j>=0) && (prev==NULL); j--)
+      prev=track->byid[j];
+
+    next=NULL;
+    for (j=id+1; (j<DISKSTORE_SECTORIDS) && (next==NULL); j++)
+      next=track->byid[j];
+
+    // Without a following sector, or when they wrap around the index, it could be anywhere
+    if (next==NULL)
+      return samplesperrotation;
+
+    nextpos=next->id_pos%samplesperrotation;
+
+    if ((prev!=NULL) && ((prev->id_pos%samplesperrotation)>=nextpos))
+      return samplesperrotation;
+
+    // Missing sector will have finished by the time the following one starts
+    if (nextpos>extent)
+      extent=nextpos;
   }
 
-  return n;
+  return extent;
 }
 
 // Count how many sectors were found with given modulation
-unsigned int diskstore_countsectormod(const unsigned char modulation)
+unsigned int diskstore_countsectormod(Disk_Store *store, const unsigned char modulation)
 {
   Disk_Sector *curr;
   unsigned int n;
 
-  curr=Disk_SectorsRoot;
+  curr=store->root;
   n=0;
 
   while (curr!=NULL)
@@ -162,7 +421,7 @@ unsigned int diskstore_countsectormod(const unsigned char modulation)
 }
 
 // Compare two sectors to determine if they should be swapped
-int diskstore_comparesectors(Disk_Sector *item1, Disk_Sector *item2, const int sortmethod, const int rotations)
+int diskstore_comparesectors(Disk_Sector *item1, Disk_Sector *item2, const int sortmethod, const unsigned long samplesize, const int rotations)
 {
   if ((item1==NULL) || (item2==NULL))
     return 0;
@@ -197,7 +456,7 @@ int diskstore_comparesectors(Disk_Sector *item1, Disk_Sector *item2, const int s
     int item1dpos;
     int item2dpos;
 
-    samplesperrotation=(mod_samplesize/rotations);
+    samplesperrotation=(samplesize/rotations);
 
     item1dpos=((item1->data_pos%samplesperrotation)*100)/samplesperrotation;
     item2dpos=((item2->data_pos%samplesperrotation)*100)/samplesperrotation;
@@ -213,63 +472,163 @@ int diskstore_comparesectors(Disk_Sector *item1, Disk_Sector *item2, const int s
   return 0;
 }
 
-// Bubble sort the sectors to one of the sort methods
-void diskstore_sortsectors(const int sortmethod, const int rotations)
+// Stable merge sort of a list of sectors to one of the sort methods
+int diskstore_mergesort(Disk_Sector **sectors, const unsigned int count, const int sortmethod, const unsigned long samplesize, const int rotations)
 {
-  int swaps;
-  Disk_Sector *curr;
-  Disk_Sector *swap;
+  Disk_Sector **work;
+  unsigned int width, left, mid, right, l, r, o;
 
-  // Check for empty diskstore
-  if (Disk_SectorsRoot==NULL)
-    return;
+  if (count<2)
+    return 1;
 
-  do
+  work=malloc(count*sizeof(Disk_Sector *));
+  if (work==NULL)
+    return 0;
+
+  for (width=1; width<count; width*=2)
   {
-    Disk_Sector *prev;
+    for (left=0; left<count; left+=(width*2))
+    {
+      mid=((left+width)<count)?(left+width):count;
+      right=((left+(width*2))<count)?(left+(width*2)):count;
 
-    swaps=0;
-    curr=Disk_SectorsRoot;
-    prev=NULL;
+      l=left; r=mid; o=left;
 
-    while ((curr!=NULL) && (curr->next!=NULL))
-    {
-      // Check if these two sectors need swapping
-      if (diskstore_comparesectors(curr, curr->next, sortmethod, rotations)==1)
+      // Only take from the right when strictly less, to keep equal sectors in order
+      while ((l<mid) && (r<right))
       {
-        // Swap the pointers over in the linked list
-        swap=curr->next;
-        curr->next=swap->next;
-        swap->next=curr;
+        if (diskstore_comparesectors(sectors[r], sectors[l], sortmethod, samplesize, rotations)<0)
+          work[o++]=sectors[r++];
+        else
+          work[o++]=sectors[l++];
+      }
+
+      while (l<mid) work[o++]=sectors[l++];
+      while (r<right) work[o++]=sectors[r++];
+    }
+
+    memcpy(sectors, work, count*sizeof(Disk_Sector *));
+  }
+
+  free(work);
 
-        if (prev==NULL)
-          Disk_SectorsRoot=swap;
+  return 1;
+}
+
+// Sort the sectors of each track to one of the sort methods
+void diskstore_sortsectors(Disk_Store *store, const int sortmethod, const int rotations)
+{
+  Disk_Track *track;
+  Disk_Sector *tail;
+  int dtrack, dhead;
+  unsigned int n;
+
+  // Check for empty diskstore
+  if (store->root==NULL)
+    return;
+
+  // Sorting is by track then head first, so sort within each track and relink in track order
+  tail=NULL;
+
+  for (dtrack=0; dtrack<DISKSTORE_TRACKS; dtrack++)
+    for (dhead=0; dhead<DISKSTORE_HEADS; dhead++)
+    {
+      track=store->tracks[dtrack][dhead];
+      if (track==NULL)
+        continue;
+
+      diskstore_mergesort(track->sectors, track->count, sortmethod, store->samplesize, rotations);
+
+      for (n=0; n<track->count; n++)
+      {
+        if (tail==NULL)
+          store->root=track->sectors[n];
         else
-          prev->next=swap;
+          tail->next=track->sectors[n];
 
-        swaps++;
+        tail=track->sectors[n];
       }
-
-      // Move on to the next pair of sectors
-      prev=curr;
-      curr=curr->next;
     }
-  } while (swaps>0);
+
+  tail->next=NULL;
+
+  // Indexes follow store order
+  diskstore_reindex(store);
+}
+
+// Find nth sector by position within a rotation for given physical track/head, without changing store order
+Disk_Sector *diskstore_findnthsectorbypos(Disk_Store *store, const uint8_t physical_track, const uint8_t physical_head, const uint8_t nth_sector, const int rotations)
+{
+  Disk_Track *track;
+
+  track=diskstore_findtrack(store, physical_track, physical_head, 0);
+  if ((track==NULL) || (nth_sector>=track->count))
+    return NULL;
+
+  // Build position view when out of date
+  if ((track->byposcount!=track->count) || (track->byposrotations!=rotations))
+  {
+    Disk_Sector **bypos;
+
+    bypos=realloc(track->bypos, track->count*sizeof(Disk_Sector *));
+    if (bypos==NULL)
+      return NULL;
+
+    memcpy(bypos, track->sectors, track->count*sizeof(Disk_Sector *));
+    diskstore_mergesort(bypos, track->count, SORTBYPOS, store->samplesize, rotations);
+
+    track->bypos=bypos;
+    track->byposcount=track->count;
+    track->byposrotations=rotations;
+  }
+
+  return track->bypos[nth_sector];
+}
+
+// Update summary information for a sector being added to a store
+void diskstore_updatestats(Disk_Store *store, const Disk_Sector *sector)
+{
+  if ((store->mintrack==-1) || (sector->physical_track<store->mintrack))
+    store->mintrack=sector->physical_track;
+
+  if ((store->maxtrack==-1) || (sector->physical_track>store->maxtrack))
+    store->maxtrack=sector->physical_track;
+
+  if ((store->minhead==-1) || (sector->physical_head<store->minhead))
+    store->minhead=sector->physical_head;
+
+  if ((store->maxhead==-1) || (sector->physical_head>store->maxhead))
+    store->maxhead=sector->physical_head;
+
+  if ((store->minsectorsize==-1) || (sector->datasize<(unsigned int)store->minsectorsize))
+    store->minsectorsize=sector->datasize;
+
+  if ((store->maxsectorsize==-1) || (sector->datasize>(unsigned int)store->maxsectorsize))
+    store->maxsectorsize=sector->datasize;
+
+  if ((store->maxsectorid==-1) || (sector->logical_sector>store->maxsectorid))
+    store->maxsectorid=sector->logical_sector;
+
+  if ((store->minsectorid==-1) || (sector->logical_sector<store->minsectorid))
+    store->minsectorid=sector->logical_sector;
 }
 
 // Add a sector to linked list
-int diskstore_addsector(const unsigned char modulation, const uint8_t physical_track, const uint8_t physical_head, const uint8_t logical_track, const uint8_t logical_head, const uint8_t logical_sector, const uint8_t logical_size, const long id_pos, const unsigned int idcrc, const long data_pos, const unsigned int datatype, const unsigned int datasize, const unsigned char *data, const unsigned int datacrc)
+int diskstore_addsector(Disk_Store *store, const unsigned char modulation, const uint8_t physical_track, const uint8_t physical_head, const uint8_t logical_track, const uint8_t logical_head, const uint8_t logical_sector, const uint8_t logical_size, const long id_pos, const unsigned int idcrc, const long data_pos, const unsigned int datatype, const unsigned int datasize, const unsigned char *data, const unsigned int datacrc, const unsigned long data_endpos)
 {
-  Disk_Sector *curr;
   Disk_Sector *newitem;
 
-  // First check if we already have this sector
-  if (diskstore_findexactsector(physical_track, physical_head, logical_track, logical_head, logical_sector, logical_size, idcrc, datatype, datasize, datacrc)!=NULL)
+  // First check if we already have this sector, if so count it as confirmed
+  newitem=diskstore_findexactsector(store, physical_track, physical_head, logical_track, logical_head, logical_sector, logical_size, idcrc, datatype, datasize, datacrc);
+  if (newitem!=NULL)
+  {
+    newitem->confirmations++;
     return 0;
+  }
 
 //  fprintf(stderr, "Adding physical T:%d H:%d  |  logical C:%d H:%d R:%d N:%d (%.4x) [%.2x] %d data bytes (%.4x)\n", physical_track, physical_head, logical_track, logical_head, logical_sector, logical_size, idcrc, datatype, datasize, datacrc);
 
-  newitem=malloc(sizeof(Disk_Sector));
+  newitem=diskstore_arenaalloc(&store->headers, sizeof(Disk_Sector));
   if (newitem==NULL) return 0;
 
   newitem->physical_track=physical_track;
@@ -282,105 +641,148 @@ int diskstore_addsector(const unsigned char modulation, const uint8_t physical_t
   newitem->idcrc=idcrc;
   newitem->id_pos=id_pos;
   newitem->data_pos=data_pos;
-  newitem->data_endpos=mod_datapos;
+  newitem->data_endpos=data_endpos;
 
   newitem->modulation=modulation;
 
   newitem->datatype=datatype;
   newitem->datasize=datasize;
 
-  newitem->data=malloc(datasize);
+  newitem->data=(data==NULL)?NULL:diskstore_arenaalloc(&store->payloads, datasize);
   if (newitem->data!=NULL)
     memcpy(newitem->data, data, datasize);
 
   newitem->datacrc=datacrc;
+  newitem->confirmations=0;
 
   newitem->next=NULL;
 
-  if ((diskstore_mintrack==-1) || (physical_track<diskstore_mintrack))
-    diskstore_mintrack=physical_track;
+  // Arena memory is reclaimed when the store is next emptied
+  if (!diskstore_indexsector(store, newitem))
+    return 0;
 
-  if ((diskstore_maxtrack==-1) || (physical_track>diskstore_maxtrack))
-    diskstore_maxtrack=physical_track;
+  diskstore_updatestats(store, newitem);
 
-  if ((diskstore_minhead==-1) || (physical_head<diskstore_minhead))
-    diskstore_minhead=physical_head;
+  // Add the new sector to the end of the dynamic linked list
+  if (store->tail==NULL)
+    store->root=newitem;
+  else
+    store->tail->next=newitem;
 
-  if ((diskstore_maxhead==-1) || (physical_head>diskstore_maxhead))
-    diskstore_maxhead=physical_head;
+  store->tail=newitem;
 
-  if ((diskstore_minsectorsize==-1) || (datasize<(unsigned int)diskstore_minsectorsize))
-    diskstore_minsectorsize=datasize;
+  return 1;
+}
 
-  if ((diskstore_maxsectorsize==-1) || (datasize>(unsigned int)diskstore_maxsectorsize))
-    diskstore_maxsectorsize=datasize;
+// Reset a store to having no sectors
+void diskstore_emptystore(Disk_Store *store)
+{
+  store->root=NULL;
+  store->tail=NULL;
+
+  bzero(store->logical, sizeof(store->logical));
+  bzero(store->exact, sizeof(store->exact));
+
+  store->mintrack=-1;
+  store->maxtrack=-1;
+  store->minhead=-1;
+  store->maxhead=-1;
+  store->minsectorsize=-1;
+  store->maxsectorsize=-1;
+  store->minsectorid=-1;
+  store->maxsectorid=-1;
+}
 
-  if ((diskstore_maxsectorid==-1) || (logical_sector>diskstore_maxsectorid))
-    diskstore_maxsectorid=logical_sector;
+// Initialise an empty sector store
+void diskstore_initstore(Disk_Store *store)
+{
+  bzero(store->tracks, sizeof(store->tracks));
 
-  if ((diskstore_minsectorid==-1) || (logical_sector<diskstore_minsectorid))
-    diskstore_minsectorid=logical_sector;
+  diskstore_initarena(&store->headers, DISKSTORE_SLABSECTORS*sizeof(Disk_Sector));
+  diskstore_initarena(&store->payloads, DISKSTORE_PAYLOADCHUNK);
 
-  // Add the new sector to the dynamic linked list
-  if (Disk_SectorsRoot==NULL)
-  {
-    Disk_SectorsRoot=newitem;
-  }
-  else
-  {
-    curr=Disk_SectorsRoot;
+  diskstore_emptystore(store);
 
-    while (curr->next!=NULL)
-      curr=curr->next;
+  store->stepping=1;
+  store->samplesize=0;
 
-    curr->next=newitem;
-  }
+  store->fetchtrack=NULL;
+  store->fetchdata=NULL;
 
-  return 1;
+  store->abstrack=-1;
+  store->abshead=-1;
+  store->abssector=-1;
+  store->abssecoffs=-1;
+  store->absoffset=0;
 }
 
-// Delete all saved sectors
-void diskstore_clearallsectors()
+// Delete all sectors held in a store, keeping its memory for reuse
+void diskstore_clearstore(Disk_Store *store)
 {
-  Disk_Sector *curr;
+  diskstore_clearindex(store);
 
-  curr=Disk_SectorsRoot;
+  diskstore_resetarena(&store->headers);
+  diskstore_resetarena(&store->payloads);
 
-  while (curr!=NULL)
-  {
-    void *prev;
+  diskstore_emptystore(store);
+}
+
+// Delete all sectors held in a store and release its memory
+void diskstore_freestore(Disk_Store *store)
+{
+  diskstore_clearindex(store);
 
-    if (curr->data!=NULL)
-      free(curr->data);
+  diskstore_freearena(&store->headers);
+  diskstore_freearena(&store->payloads);
 
-    prev=curr;
-    curr=curr->next;
+  diskstore_emptystore(store);
+}
+
+// Copy sectors from one store to the end of another, dropping exact duplicates
+unsigned int diskstore_mergestore(Disk_Store *store, Disk_Store *from)
+{
+  Disk_Sector *curr;
+  Disk_Sector *existing;
+  unsigned int merged=0;
+
+  for (curr=from->root; curr!=NULL; curr=curr->next)
+  {
+    existing=diskstore_findexactsector(store, curr->physical_track, curr->physical_head, curr->logical_track, curr->logical_head, curr->logical_sector, curr->logical_size, curr->idcrc, curr->datatype, curr->datasize, curr->datacrc);
 
-    if (prev!=NULL)
-      free(prev);
+    // Keep confirmations from both stores
+    if (existing!=NULL)
+      existing->confirmations+=(curr->confirmations+1);
+    else
+    if (diskstore_addsector(store, curr->modulation, curr->physical_track, curr->physical_head, curr->logical_track, curr->logical_head, curr->logical_sector, curr->logical_size, curr->id_pos, curr->idcrc, curr->data_pos, curr->datatype, curr->datasize, curr->data, curr->datacrc, curr->data_endpos))
+    {
+      store->tail->confirmations=curr->confirmations;
+      merged++;
+    }
   }
 
-  Disk_SectorsRoot=NULL;
+  diskstore_clearstore(from);
+
+  return merged;
 }
 
 // Dump a list of all sectors found
-void diskstore_dumpsectorlist()
+void diskstore_dumpsectorlist(Disk_Store *store)
 {
   Disk_Sector *curr;
   int dtrack, dhead;
   int n;
   int totalsectors=0;
 
-  for (dtrack=0; dtrack<(diskstore_maxtrack+1); dtrack+=hw_stepping)
+  for (dtrack=0; dtrack<(store->maxtrack+1); dtrack+=store->stepping)
   {
-    fprintf(stderr, "TRACK %.2d: ", dtrack/hw_stepping);
+    fprintf(stderr, "TRACK %.2d: ", dtrack/store->stepping);
 
-    for (dhead=(diskstore_minhead==-1?0:diskstore_minhead); dhead<(diskstore_maxhead==-1?2:diskstore_maxhead+1); dhead++)
+    for (dhead=(store->minhead==-1?0:store->minhead); dhead<(store->maxhead==-1?2:store->maxhead+1); dhead++)
     {
       n=0;
       do
       {
-        curr=diskstore_findnthsector(dtrack, dhead, n++);
+        curr=diskstore_findnthsector(store, dtrack, dhead, n++);
 
         if (curr!=NULL)
         {
@@ -396,21 +798,21 @@ void diskstore_dumpsectorlist()
 }
 
 // Dump a list of all sectors found
-void diskstore_dumpbadsectors(FILE* fh)
+void diskstore_dumpbadsectors(Disk_Store *store, FILE* fh)
 {
   int dtrack, dhead,dsector;
 
   fprintf(fh, "Head, Track, Sector\n");
 
-  for (dhead=0; dhead<(diskstore_maxhead+1); dhead++)
-    for (dtrack=0; dtrack<(diskstore_maxtrack+1); dtrack+=hw_stepping)
-      for(dsector=0; dsector<(diskstore_maxsectorid+1); dsector++)
-         if(diskstore_findhybridsector(dtrack, dhead, dsector)==NULL)
+  for (dhead=0; dhead<(store->maxhead+1); dhead++)
+    for (dtrack=0; dtrack<(store->maxtrack+1); dtrack+=store->stepping)
+      for(dsector=0; dsector<(store->maxsectorid+1); dsector++)
+         if(diskstore_findhybridsector(store, dtrack, dhead, dsector)==NULL)
             fprintf(fh, "%.2X, %.2X, %.2X\n", dhead, dtrack, dsector);
 }
 
 // Dump a layout map of where data was found on the disk surface
-void diskstore_dumplayoutmap(const int rotations)
+void diskstore_dumplayoutmap(Disk_Store *store, const int rotations, const unsigned int maxtracks, const unsigned long samplerate, const float rpm)
 {
   Disk_Sector *curr;
   int dtrack, dhead;
@@ -419,32 +821,32 @@ void diskstore_dumplayoutmap(const int rotations)
   unsigned long samplesperrotation;
   int mtrack;
 
-  if ((diskstore_maxtrack>-1) && (diskstore_maxtrack<(int)hw_maxtracks))
-    mtrack=diskstore_maxtrack+1;
+  if ((store->maxtrack>-1) && (store->maxtrack<(int)maxtracks))
+    mtrack=store->maxtrack+1;
   else
-    mtrack=hw_maxtracks+1;
+    mtrack=maxtracks+1;
 
-  fprintf(stderr, "Buffer size : %lu  Rotations : %d  Bytes per rotation : %ld\n", mod_samplesize, rotations, mod_samplesize/rotations);
-  samplesperrotation=(mod_samplesize/rotations);
+  fprintf(stderr, "Buffer size : %lu  Rotations : %d  Bytes per rotation : %ld\n", store->samplesize, rotations, store->samplesize/rotations);
+  samplesperrotation=(store->samplesize/rotations);
 
-  fprintf(stderr, "Sample rate : %ld/sec  RPM : %.2f  Samples per rotation : %.2f  Bytes per rotation : %.0f\n", hw_samplerate, hw_rpm, hw_samplerate/(hw_rpm/SECONDSINMINUTE), (hw_samplerate/(hw_rpm/SECONDSINMINUTE))/BITSPERBYTE);
+  fprintf(stderr, "Sample rate : %ld/sec  RPM : %.2f  Samples per rotation : %.2f  Bytes per rotation : %.0f\n", samplerate, rpm, samplerate/(rpm/SECONDSINMINUTE), (samplerate/(rpm/SECONDSINMINUTE))/BITSPERBYTE);
 
   fprintf(stderr, "TRACK[HEAD]\n");
-  for (dtrack=0; ((dtrack<mtrack) && (dtrack<(int)hw_maxtracks)); dtrack+=hw_stepping)
+  for (dtrack=0; ((dtrack<mtrack) && (dtrack<(int)maxtracks)); dtrack+=store->stepping)
   {
-    for (dhead=(diskstore_minhead==-1?0:diskstore_minhead); dhead<(diskstore_maxhead==-1?2:diskstore_maxhead+1); dhead++)
+    for (dhead=(store->minhead==-1?0:store->minhead); dhead<(store->maxhead==-1?2:store->maxhead+1); dhead++)
     {
       // Clear cylinder data
       for (i=0; i<(100+1); i++)
         cyldata[i]='.';
       cyldata[100]=0;
 
-      fprintf(stderr, "%.2d[%.1d]: ", dtrack/hw_stepping, dhead);
+      fprintf(stderr, "%.2d[%.1d]: ", dtrack/store->stepping, dhead);
 
       n=0;
       do
       {
-        curr=diskstore_findnthsector(dtrack, dhead, n++);
+        curr=diskstore_findnthsector(store, dtrack, dhead, n++);
 
         if (curr!=NULL)
         {
@@ -474,66 +876,66 @@ void diskstore_dumplayoutmap(const int rotations)
 }
 
 // Absolute seek
-void diskstore_absoluteseek(const unsigned long offset, const int interlacing, const int maxtracks)
+void diskstore_absoluteseek(Disk_Store *store, const unsigned long offset, const int interlacing, const int maxtracks)
 {
   unsigned long diskoffs;
 
   // Validate track range
-  if ((diskstore_maxtrack==-1) || (diskstore_mintrack==-1))
+  if ((store->maxtrack==-1) || (store->mintrack==-1))
     return;
 
   // Validate head range
-  if ((diskstore_maxhead==-1) || (diskstore_minhead==-1) || (diskstore_maxhead>1))
+  if ((store->maxhead==-1) || (store->minhead==-1) || (store->maxhead>1))
     return;
 
   // Validate sector size
-  if ((diskstore_maxsectorsize==-1) || (diskstore_minsectorsize==-1) || (diskstore_minsectorsize!=diskstore_maxsectorsize))
+  if ((store->maxsectorsize==-1) || (store->minsectorsize==-1) || (store->minsectorsize!=store->maxsectorsize))
     return;
 
   // Initialise to start of disk
-  diskstore_abstrack=diskstore_mintrack;
-  diskstore_abshead=diskstore_minhead;
-  diskstore_abssector=diskstore_minsectorid;
-  diskstore_abssecoffs=0;
+  store->abstrack=store->mintrack;
+  store->abshead=store->minhead;
+  store->abssector=store->minsectorid;
+  store->abssecoffs=0;
 
   diskoffs=offset;
 
   // Convert absolute offset to C/H/S/sector offset
-  while (diskoffs>=(unsigned int)diskstore_minsectorsize)
+  while (diskoffs>=(unsigned int)store->minsectorsize)
   {
-    diskstore_abssecoffs+=diskstore_minsectorsize;
-    diskoffs-=diskstore_minsectorsize;
+    store->abssecoffs+=store->minsectorsize;
+    diskoffs-=store->minsectorsize;
 
     // Check for pointer going to next sector
-    if (diskstore_abssecoffs>=diskstore_minsectorsize)
+    if (store->abssecoffs>=store->minsectorsize)
     {
-      diskstore_abssecoffs-=diskstore_minsectorsize;
-      diskstore_abssector++;
+      store->abssecoffs-=store->minsectorsize;
+      store->abssector++;
 
       // Check for pointer going to next track or head
-      if (diskstore_abssector>diskstore_maxsectorid)
+      if (store->abssector>store->maxsectorid)
       {
-        diskstore_abssector=diskstore_minsectorid;
+        store->abssector=store->minsectorid;
 
         switch (interlacing)
         {
           case SEQUENCED: // All of head 0, then all of head 1 (if head 1 exists)
-            diskstore_abstrack++;
+            store->abstrack++;
 
-            if (diskstore_abstrack>maxtracks)
+            if (store->abstrack>maxtracks)
             {
-              diskstore_abstrack=diskstore_mintrack;
-              diskstore_abshead++;
+              store->abstrack=store->mintrack;
+              store->abshead++;
             }
             break;
 
           case INTERLEAVED: // For each track, head 0 then head 1 (most common for double sided)
-            diskstore_abshead++;
+            store->abshead++;
 
-            if (diskstore_abshead>diskstore_maxhead)
+            if (store->abshead>store->maxhead)
             {
-              diskstore_abshead=diskstore_minhead;
-              diskstore_abstrack++;
+              store->abshead=store->minhead;
+              store->abstrack++;
             }
             break;
 
@@ -544,22 +946,22 @@ void diskstore_absoluteseek(const unsigned long offset, const int interlacing, c
     }
 
     // Check for seeking past end of disk, to wrap around back to start
-    if ((diskstore_abshead>diskstore_maxhead) || (diskstore_abstrack>maxtracks))
+    if ((store->abshead>store->maxhead) || (store->abstrack>maxtracks))
     {
 //printf("DS wrap around\n");
-      diskstore_abstrack=diskstore_mintrack;
-      diskstore_abshead=diskstore_minhead;
-      diskstore_abssector=diskstore_minsectorid;
+      store->abstrack=store->mintrack;
+      store->abshead=store->minhead;
+      store->abssector=store->minsectorid;
     }
   }
 
   // Store new offsets
-  diskstore_abssecoffs=diskoffs;
-  diskstore_absoffset=offset;
+  store->abssecoffs=diskoffs;
+  store->absoffset=offset;
 }
 
 // Absolute read
-unsigned long diskstore_absoluteread(char *buffer, const unsigned long bufflen, const int interlacing, const int maxtracks)
+unsigned long diskstore_absoluteread(Disk_Store *store, char *buffer, const unsigned long bufflen, const int interlacing, const int maxtracks)
 {
   Disk_Sector *curr;
   unsigned long numread=0; // Total bytes returned so far
@@ -573,50 +975,32 @@ unsigned long diskstore_absoluteread(char *buffer, const unsigned long bufflen,
     unsigned long toread=0; // Number of bytes to read from current sector
 
     // Determine how much to read from this sector
-    toread=diskstore_minsectorsize-diskstore_abssecoffs;
+    toread=store->minsectorsize-store->abssecoffs;
     if ((numread+toread)>bufflen)
       toread=bufflen-numread;
 
     // Find this sector
-    curr=diskstore_findhybridsector(diskstore_abstrack, diskstore_abshead, diskstore_abssector);
+    curr=diskstore_findhybridsector(store, store->abstrack, store->abshead, store->abssector);
 
     // If sector not found in the store, maybe it hasn't been read yet
     if ((curr==NULL) || (curr->data==NULL))
     {
-      unsigned char *samplebuffer;
-      unsigned long samplebuffsize;
-
-      samplebuffsize=((hw_samplerate/HW_ROTATIONSPERSEC)/BITSPERBYTE)*3;
-      samplebuffer=malloc(samplebuffsize);
-
-      if (samplebuffer!=NULL)
-      {
-        hw_seektotrack(diskstore_abstrack);
-        hw_sideselect(diskstore_abshead);
-        hw_sleep(1);
-        hw_samplerawtrackdata(samplebuffer, samplebuffsize);
-        mod_process(samplebuffer, samplebuffsize, 99, 0);
-
-        if (diskstore_usepll)
-          mod_process(samplebuffer, samplebuffsize, 99, diskstore_usepll);
-
-        free(samplebuffer);
-        samplebuffer=NULL;
-      }
-      else
+      if (store->fetchtrack==NULL)
         return numread;
 
+      store->fetchtrack(store->fetchdata, store->abstrack, store->abshead);
+
       // Look again
-      curr=diskstore_findhybridsector(diskstore_abstrack, diskstore_abshead, diskstore_abssector);
+      curr=diskstore_findhybridsector(store, store->abstrack, store->abshead, store->abssector);
     }
 
     if ((curr!=NULL) && (curr->data!=NULL))
     {
       // Prevent reads beyond current sector memory
-      if ((diskstore_abssecoffs+toread)>curr->datasize)
-        toread=curr->datasize-diskstore_abssecoffs;
+      if ((store->abssecoffs+toread)>curr->datasize)
+        toread=curr->datasize-store->abssecoffs;
 
-      memcpy(&buffer[numread], &curr->data[diskstore_abssecoffs], toread);
+      memcpy(&buffer[numread], &curr->data[store->abssecoffs], toread);
     }
     else
       return numread;
@@ -624,16 +1008,16 @@ unsigned long diskstore_absoluteread(char *buffer, const unsigned long bufflen,
     numread+=toread;
 
     // Move absolute position forward
-    diskstore_absoffset+=toread;
+    store->absoffset+=toread;
 
     // Seek to next sector
-    diskstore_absoluteseek(diskstore_absoffset, interlacing, maxtracks);
+    diskstore_absoluteseek(store, store->absoffset, interlacing, maxtracks);
   }
 
   return numread;
 }
 
-uint32_t diskstore_calctrackcrc(const uint32_t initial, const uint8_t physical_track, const uint8_t physical_head)
+uint32_t diskstore_calctrackcrc(Disk_Store *store, const uint32_t initial, const uint8_t physical_track, const uint8_t physical_head, const int rotations)
 {
   Disk_Sector *curr;
   uint32_t crc=initial;
@@ -642,7 +1026,7 @@ uint32_t diskstore_calctrackcrc(const uint32_t initial, const uint8_t physical_t
   n=0;
   do
   {
-    curr=diskstore_findnthsector(physical_track, physical_head, n++);
+    curr=diskstore_findnthsectorbypos(store, physical_track, physical_head, n++, rotations);
 
     if (curr!=NULL)
       if (curr->data!=NULL)
@@ -657,25 +1041,25 @@ uint32_t diskstore_calctrackcrc(const uint32_t initial, const uint8_t physical_t
   return crc;
 }
 
-uint32_t diskstore_calcdiskcrc(const uint8_t physical_head)
+uint32_t diskstore_calcdiskcrc(Disk_Store *store, const uint8_t physical_head, const int rotations)
 {
   int dtracks, dtrack, dhead;
   uint32_t diskcrc=0x0;
 
-  if (diskstore_maxtrack>60)
+  if (store->maxtrack>60)
     dtracks=80;
   else
     dtracks=40;
 
-  for (dtrack=0; dtrack<(dtracks+1); dtrack+=hw_stepping)
+  for (dtrack=0; dtrack<(dtracks+1); dtrack+=store->stepping)
     for (dhead=((physical_head!=1)?0:1); dhead<((physical_head==0)?1:2); dhead++)
     {
       uint32_t trackcrc=0x0;
 
       // Get track CRC32
-      trackcrc=diskstore_calctrackcrc(0, dtrack, dhead);
+      trackcrc=diskstore_calctrackcrc(store, 0, dtrack, dhead, rotations);
       if (diskstore_debug)
-        fprintf(stderr, "T%d.%d : CRC32 %.8X\n", dtrack/hw_stepping, dhead, trackcrc);
+        fprintf(stderr, "T%d.%d : CRC32 %.8X\n", dtrack/store->stepping, dhead, trackcrc);
 
       // Update disk CRC32
       diskcrc=CRC32_CalcStream(diskcrc, (unsigned char *)&trackcrc, sizeof(uint32_t));
@@ -684,27 +1068,7 @@ uint32_t diskstore_calcdiskcrc(const uint8_t physical_head)
   return diskcrc;
 }
 
-void diskstore_init(const int debug, const int usepll)
+void diskstore_init(const int debug)
 {
-  Disk_SectorsRoot=NULL;
-
   diskstore_debug=debug;
-  diskstore_usepll=usepll;
-
-  diskstore_mintrack=-1;
-  diskstore_maxtrack=-1;
-  diskstore_minhead=-1;
-  diskstore_maxhead=-1;
-  diskstore_minsectorsize=-1;
-  diskstore_maxsectorsize=-1;
-  diskstore_minsectorid=-1;
-  diskstore_maxsectorid=-1;
-
-  diskstore_abstrack=-1;
-  diskstore_abshead=-1;
-  diskstore_abssector=-1;
-  diskstore_abssecoffs=-1;
-  diskstore_absoffset=0;
-
-  atexit(diskstore_clearallsectors);
 }
@@ -18,6 +18,17 @@
 #define SEQUENCED 0
 #define INTERLEAVED 1
 
+// Size of sector store indexes
+#define DISKSTORE_TRACKS 256
+#define DISKSTORE_HEADS 2
+#define DISKSTORE_SECTORIDS 256
+#define DISKSTORE_LOGICALHASH 1024
+#define DISKSTORE_EXACTHASH 4096
+
+// Arena chunk sizes, in sectors for headers and in bytes for sector data
+#define DISKSTORE_SLABSECTORS 256
+#define DISKSTORE_PAYLOADCHUNK (256*1024)
+
 // Sector sorting criteria
 #define SORTBYID 0
 #define SORTBYPOS 1
@@ -47,56 +58,134 @@ typedef struct DiskSector
   unsigned int datacrc;
 
   struct DiskSector *next;
+
+  // Number of times the exact same sector was found again
+  unsigned int confirmations;
+
+  // Next sector with the same logical position hash
+  struct DiskSector *nextlogical;
+
+  // Next sector with the same content hash
+  struct DiskSector *nextexact;
 } Disk_Sector;
 
-// Linked list
-extern Disk_Sector *Disk_SectorsRoot;
-
-// Summary information
-extern int diskstore_mintrack;
-extern int diskstore_maxtrack;
-extern int diskstore_minhead;
-extern int diskstore_maxhead;
-extern int diskstore_minsectorsize;
-extern int diskstore_maxsectorsize;
-extern int diskstore_minsectorid;
-extern int diskstore_maxsectorid;
-
-// For absolute disk access
-extern int diskstore_abstrack;
-extern int diskstore_abshead;
-extern int diskstore_abssector;
-extern int diskstore_abssecoffs;
-extern unsigned long diskstore_absoffset;
+// Index of sectors found on a single physical track/head, in store order
+typedef struct DiskTrack
+{
+  Disk_Sector **sectors;
+  unsigned int count;
+  unsigned int allocated;
+
+  // First sector found with each logical sector id, and a bitmap of ids found
+  Disk_Sector *byid[DISKSTORE_SECTORIDS];
+  uint32_t found[DISKSTORE_SECTORIDS/32];
+
+  // Sectors by position within a rotation, built when needed
+  Disk_Sector **bypos;
+  unsigned int byposcount;
+  int byposrotations;
+} Disk_Track;
+
+// Chunk of memory for an arena to allocate from
+typedef struct DiskArenaChunk
+{
+  struct DiskArenaChunk *next;
+  unsigned long size;
+  unsigned long used;
+  unsigned char *data;
+} Disk_ArenaChunk;
+
+// Chunked allocator which is emptied in one go, chunks are kept for reuse
+typedef struct DiskArena
+{
+  Disk_ArenaChunk *first;
+  Disk_ArenaChunk *current;
+  Disk_ArenaChunk *last;
+  unsigned long chunksize;
+} Disk_Arena;
+
+typedef struct DiskStore
+{
+  // Linked list
+  Disk_Sector *root;
+  Disk_Sector *tail;
+
+  // Indexes by physical and logical position
+  Disk_Track *tracks[DISKSTORE_TRACKS][DISKSTORE_HEADS];
+  Disk_Sector *logical[DISKSTORE_LOGICALHASH];
+  Disk_Sector *exact[DISKSTORE_EXACTHASH];
+
+  // Memory for sector headers and sector data
+  Disk_Arena headers;
+  Disk_Arena payloads;
+
+  // Summary information
+  int mintrack;
+  int maxtrack;
+  int minhead;
+  int maxhead;
+  int minsectorsize;
+  int maxsectorsize;
+  int minsectorid;
+  int maxsectorid;
+
+  // Physical tracks per disk track, 2 when double stepping
+  int stepping;
+
+  // Size of the sample buffer each track was decoded from, for positions within a rotation
+  unsigned long samplesize;
+
+  // Called when an absolute read finds a sector missing, to try reading the track again, NULL if not possible
+  void (*fetchtrack)(void *fetchdata, const int physical_track, const int physical_head);
+  void *fetchdata;
+
+  // For absolute disk access
+  int abstrack;
+  int abshead;
+  int abssector;
+  int abssecoffs;
+  unsigned long absoffset;
+} Disk_Store;
 
 // Initialise disk storage
-extern void diskstore_init(const int debug, const int usepll);
+extern void diskstore_init(const int debug);
+
+// Initialise / empty / release a sector store
+extern void diskstore_initstore(Disk_Store *store);
+extern void diskstore_clearstore(Disk_Store *store);
+extern void diskstore_freestore(Disk_Store *store);
+
+// Copy all the sectors from one store into another, then empty it
+extern unsigned int diskstore_mergestore(Disk_Store *store, Disk_Store *from);
 
-// Add a sector to the disk storage
-extern int diskstore_addsector(const unsigned char modulation, const uint8_t physical_track, const uint8_t physical_head, const uint8_t logical_track, const uint8_t logical_head, const uint8_t logical_sector, const uint8_t logical_size, const long id_pos, const unsigned int idcrc, const long data_pos, const unsigned int datatype, const unsigned int datasize, const unsigned char *data, const unsigned int datacrc);
+// Add a sector to a sector store
+extern int diskstore_addsector(Disk_Store *store, const unsigned char modulation, const uint8_t physical_track, const uint8_t physical_head, const uint8_t logical_track, const uint8_t logical_head, const uint8_t logical_sector, const uint8_t logical_size, const long id_pos, const unsigned int idcrc, const long data_pos, const unsigned int datatype, const unsigned int datasize, const unsigned char *data, const unsigned int datacrc, const unsigned long data_endpos);
 
 // Search for a sector within the disk storage
-extern Disk_Sector *diskstore_findexactsector(const uint8_t physical_track, const uint8_t physical_head, const uint8_t logical_track, const uint8_t logical_head, const uint8_t logical_sector, const uint8_t logical_size, const unsigned int idcrc, const unsigned int datatype, const unsigned int datasize, const unsigned int datacrc);
-extern Disk_Sector *diskstore_findlogicalsector(const uint8_t logical_track, const uint8_t logical_head, const uint8_t logical_sector);
-extern Disk_Sector *diskstore_findhybridsector(const uint8_t physical_track, const uint8_t physical_head, const uint8_t logical_sector);
-extern Disk_Sector *diskstore_findnthsector(const uint8_t physical_track, const uint8_t physical_head, const unsigned char nth_sector);
+extern Disk_Sector *diskstore_findexactsector(Disk_Store *store, const uint8_t physical_track, const uint8_t physical_head, const uint8_t logical_track, const uint8_t logical_head, const uint8_t logical_sector, const uint8_t logical_size, const unsigned int idcrc, const unsigned int datatype, const unsigned int datasize, const unsigned int datacrc);
+extern Disk_Sector *diskstore_findlogicalsector(Disk_Store *store, const uint8_t logical_track, const uint8_t logical_head, const uint8_t logical_sector);
+extern Disk_Sector *diskstore_findhybridsector(Disk_Store *store, const uint8_t physical_track, const uint8_t physical_head, const uint8_t logical_sector);
+extern Disk_Sector *diskstore_findnthsector(Disk_Store *store, const uint8_t physical_track, const uint8_t physical_head, const unsigned char nth_sector);
+extern Disk_Sector *diskstore_findnthsectorbypos(Disk_Store *store, const uint8_t physical_track, const uint8_t physical_head, const uint8_t nth_sector, const int rotations);
 
 // Processing of sectors
-extern unsigned char diskstore_countsectors(const uint8_t physical_track, const uint8_t physical_head);
-extern unsigned int diskstore_countsectormod(const unsigned char modulation);
-extern void diskstore_sortsectors(const int sortmethod, const int rotations);
+extern unsigned char diskstore_countsectors(Disk_Store *store, const uint8_t physical_track, const uint8_t physical_head);
+extern int diskstore_trackcomplete(Disk_Store *store, const uint8_t physical_track, const uint8_t physical_head, const int sectors);
+extern unsigned int diskstore_countids(Disk_Store *store, const uint8_t physical_track, const uint8_t physical_head, const unsigned int minconfirmations);
+extern unsigned long diskstore_missingextent(Disk_Store *store, const uint8_t physical_track, const uint8_t physical_head, const int sectors, const unsigned long samplesperrotation);
+extern unsigned int diskstore_countsectormod(Disk_Store *store, const unsigned char modulation);
+extern void diskstore_sortsectors(Disk_Store *store, const int sortmethod, const int rotations);
 
 // Dump the contents of the disk storage for debug purposes
-extern void diskstore_dumpsectorlist();
-extern void diskstore_dumpbadsectors(FILE* fh);
-extern void diskstore_dumplayoutmap(const int rotations);
+extern void diskstore_dumpsectorlist(Disk_Store *store);
+extern void diskstore_dumpbadsectors(Disk_Store *store, FILE* fh);
+extern void diskstore_dumplayoutmap(Disk_Store *store, const int rotations, const unsigned int maxtracks, const unsigned long samplerate, const float rpm);
 
 // Absolute data access
-extern unsigned long diskstore_absoffset;
-extern void diskstore_absoluteseek(const unsigned long offset, const int interlacing, const int maxtracks);
-extern unsigned long diskstore_absoluteread(char *buffer, const unsigned long bufflen, const int interlacing, const int maxtracks);
+extern void diskstore_absoluteseek(Disk_Store *store, const unsigned long offset, const int interlacing, const int maxtracks);
+extern unsigned long diskstore_absoluteread(Disk_Store *store, char *buffer, const unsigned long bufflen, const int interlacing, const int maxtracks);
 
 // Calculate disk CRCs
-extern uint32_t diskstore_calcdiskcrc(const uint8_t physical_head);
+extern uint32_t diskstore_calcdiskcrc(Disk_Store *store, const uint8_t physical_head, const int rotations);
 
 #endif
@@ -85,7 +85,7 @@ uint8_t dos_lfnchecksum(const unsigned char *shortname, const unsigned char *sho
   return sum;
 }
 
-void dos_readdir(const int level, const unsigned long offset, const unsigned int entries, const unsigned long sectorspercluster, const unsigned long bytespersector, const unsigned long dataregion, const unsigned long parent, unsigned int disktracks)
+void dos_readdir(Disk_Store *store, const int level, const unsigned long offset, const unsigned int entries, const unsigned long sectorspercluster, const unsigned long bytespersector, const unsigned long dataregion, const unsigned long parent, unsigned int disktracks)
 {
   struct dos_direntry de;
   unsigned int i;
@@ -95,13 +95,13 @@ void dos_readdir(const int level, const unsigned long offset, const unsigned int
   uint8_t longchksum; // VFAT checksum of matching short name
   uint8_t lfnblocks; // VFAT LFN blocks used
 
-  diskstore_absoluteseek(offset, INTERLEAVED, disktracks);
+  diskstore_absoluteseek(store, offset, INTERLEAVED, disktracks);
 
   for (i=0; i<entries; i++)
   {
     unsigned char shortlen;
 
-    if (diskstore_absoluteread((char *)&de, sizeof(de), INTERLEAVED, disktracks)<sizeof(de))
+    if (diskstore_absoluteread(store, (char *)&de, sizeof(de), INTERLEAVED, disktracks)<sizeof(de))
       return;
 
     // Check for end of directory
@@ -236,16 +236,16 @@ void dos_readdir(const int level, const unsigned long offset, const unsigned int
       // Don't recurse into "." and ".."
       if ((subdir!=parent) && (subdir!=offset))
       {
-        unsigned long curdiskoffs=diskstore_absoffset;
-        dos_readdir(level+1, subdir, entries, sectorspercluster, bytespersector, dataregion, offset, disktracks);
+        unsigned long curdiskoffs=store->absoffset;
+        dos_readdir(store, level+1, subdir, entries, sectorspercluster, bytespersector, dataregion, offset, disktracks);
 
-        diskstore_absoluteseek(curdiskoffs, INTERLEAVED, disktracks);
+        diskstore_absoluteseek(store, curdiskoffs, INTERLEAVED, disktracks);
       }
     }
   }
 }
 
-void dos_readfat(const unsigned long offset, const unsigned long length, const unsigned char fatformat, const unsigned int disktracks)
+void dos_readfat(Disk_Store *store, const unsigned long offset, const unsigned long length, const unsigned char fatformat, const unsigned int disktracks)
 {
   char *wholefat;
   unsigned long i;
@@ -255,8 +255,8 @@ void dos_readfat(const unsigned long offset, const unsigned long length, const u
   wholefat=malloc(length);
   if (wholefat==NULL) return;
 
-  diskstore_absoluteseek(offset, INTERLEAVED, disktracks);
-  if (diskstore_absoluteread(wholefat, length, INTERLEAVED, disktracks)<length)
+  diskstore_absoluteseek(store, offset, INTERLEAVED, disktracks);
+  if (diskstore_absoluteread(store, wholefat, length, INTERLEAVED, disktracks)<length)
   {
     free(wholefat);
     return;
@@ -299,7 +299,7 @@ void dos_readfat(const unsigned long offset, const unsigned long length, const u
   free(wholefat);
 }
 
-void dos_showinfo(const unsigned int disktracks, const unsigned int debug)
+void dos_showinfo(Disk_Store *store, const unsigned int disktracks, const unsigned int debug)
 {
   Disk_Sector *sector1;
   struct dos_biosparams *biosparams;
@@ -312,7 +312,7 @@ void dos_showinfo(const unsigned int disktracks, const unsigned int debug)
   dos_debug=debug;
 
   // Search for sector
-  sector1=diskstore_findhybridsector(0, 0, 1);
+  sector1=diskstore_findhybridsector(store, 0, 0, 1);
 
   if (sector1==NULL)
     return;
@@ -450,7 +450,7 @@ void dos_showinfo(const unsigned int disktracks, const unsigned int debug)
   }
 
   // Read first FAT
-  dos_readfat(biosparams->reservedsectors*biosparams->bytespersector, biosparams->sectorsperfat*biosparams->bytespersector, fatformat, disktracks);
+  dos_readfat(store, biosparams->reservedsectors*biosparams->bytespersector, biosparams->sectorsperfat*biosparams->bytespersector, fatformat, disktracks);
 
   rootdir=(biosparams->reservedsectors+(biosparams->sectorsperfat*biosparams->fatcopies))*biosparams->bytespersector;
 
@@ -465,19 +465,19 @@ void dos_showinfo(const unsigned int disktracks, const unsigned int debug)
   printf("\n");
 
   // Do recursive directory listing
-  dos_readdir(0, rootdir, biosparams->rootentries, biosparams->sectorspercluster, biosparams->bytespersector, dataregion, 0, disktracks);
+  dos_readdir(store, 0, rootdir, biosparams->rootentries, biosparams->sectorspercluster, biosparams->bytespersector, dataregion, 0, disktracks);
 
   printf("\n");
 }
 
-int dos_validate()
+int dos_validate(Disk_Store *store)
 {
   Disk_Sector *sector1;
   struct dos_biosparams *biosparams;
   unsigned long tmpval;
 
   // Search for sector
-  sector1=diskstore_findhybridsector(0, 0, 1);
+  sector1=diskstore_findhybridsector(store, 0, 0, 1);
 
   if (sector1==NULL)
     return DOS_UNKNOWN;
@@ -539,13 +539,13 @@ int dos_validate()
   return dos_fatformat(sector1);
 }
 
-void dos_gettitle(char *title, const int titlelen)
+void dos_gettitle(Disk_Store *store, char *title, const int titlelen)
 {
   Disk_Sector *sector1;
   struct dos_extendedbiosparams *exbiosparams;
 
   // Search for sector
-  sector1=diskstore_findhybridsector(0, 0, 1);
+  sector1=diskstore_findhybridsector(store, 0, 0, 1);
 
   if (sector1==NULL)
     return;
@@ -1,6 +1,8 @@
 #ifndef _DOS_H_
 #define _DOS_H_
 
+#include "diskstore.h"
+
 #define DOS_SECTORSIZE 512
 
 // For FAT cluster id ranges
@@ -143,8 +145,8 @@ struct dos_lfnentry
 
 #pragma pack(pop)
 
-extern void dos_gettitle(char *title, const int titlelen);
-extern void dos_showinfo(const unsigned int disktracks, const unsigned int debug);
-extern int dos_validate();
+extern void dos_gettitle(Disk_Store *store, char *title, const int titlelen);
+extern void dos_showinfo(Disk_Store *store, const unsigned int disktracks, const unsigned int debug);
+extern int dos_validate(Disk_Store *store);
 
 #endif
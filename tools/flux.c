@@ -0,0 +1,166 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "hardware.h"
+#include "flux.h"
+
+// Initialise an empty set of intervals
+void flux_init(Flux_Intervals *flux)
+{
+  flux->interval=NULL;
+  flux->count=0;
+  flux->allocated=0;
+  flux->samplesize=0;
+  flux->trailing=0;
+  flux->startlevel=0;
+}
+
+// Add an interval to the list, growing it as required
+int flux_addinterval(Flux_Intervals *flux, const unsigned long samples)
+{
+  if (flux->count>=flux->allocated)
+  {
+    unsigned long newsize;
+    uint32_t *newinterval;
+
+    newsize=(flux->allocated==0)?(64*1024):(flux->allocated*2);
+    newinterval=realloc(flux->interval, newsize*sizeof(uint32_t));
+    if (newinterval==NULL)
+      return 0;
+
+    flux->interval=newinterval;
+    flux->allocated=newsize;
+  }
+
+  flux->interval[flux->count++]=samples;
+
+  return 1;
+}
+
+// Load 64 samples with the first sample in the most significant bit
+static inline uint64_t flux_load64(const unsigned char *sampledata)
+{
+  return (((uint64_t)sampledata[0])<<56) |
+         (((uint64_t)sampledata[1])<<48) |
+         (((uint64_t)sampledata[2])<<40) |
+         (((uint64_t)sampledata[3])<<32) |
+         (((uint64_t)sampledata[4])<<24) |
+         (((uint64_t)sampledata[5])<<16) |
+         (((uint64_t)sampledata[6])<<8) |
+         ((uint64_t)sampledata[7]);
+}
+
+// Count leading zero bits of a non-zero word
+static inline int flux_clz64(const uint64_t word)
+{
+#if defined(__GNUC__)
+  return __builtin_clzll(word);
+#else
+  int bits=0;
+  uint64_t w=word;
+
+  if ((w&0xffffffff00000000ULL)==0) { bits+=32; w<<=32; }
+  if ((w&0xffff000000000000ULL)==0) { bits+=16; w<<=16; }
+  if ((w&0xff00000000000000ULL)==0) { bits+=8; w<<=8; }
+  if ((w&0xf000000000000000ULL)==0) { bits+=4; w<<=4; }
+  if ((w&0xc000000000000000ULL)==0) { bits+=2; w<<=2; }
+  if ((w&0x8000000000000000ULL)==0) { bits+=1; }
+
+  return bits;
+#endif
+}
+
+// Convert a packed sample buffer into edge intervals
+//
+// Samples are processed 64 at a time, a word is XORed with itself shifted by
+// one sample to mark every level change, then the changes are picked off in
+// order using count leading zeros.
+//
+// The first interval is measured from the start of the buffer, so the sum of
+// the intervals up to and including a given edge is the sample number of that
+// edge plus one.
+unsigned long flux_extract(Flux_Intervals *flux, const unsigned char *sampledata, const unsigned long samplesize, const int edges)
+{
+  unsigned long datapos;
+  unsigned long lastedge;
+  uint64_t prev;
+
+  flux->count=0;
+  flux->samplesize=samplesize;
+  flux->trailing=0;
+  flux->startlevel=0;
+
+  if ((sampledata==NULL) || (samplesize==0))
+    return 0;
+
+  // Set up the sampler, there is no edge on the very first sample
+  flux->startlevel=(sampledata[0]&0x80)>>7;
+  prev=flux->startlevel;
+  lastedge=0;
+
+  for (datapos=0; datapos<samplesize; datapos+=sizeof(uint64_t))
+  {
+    uint64_t word, changes;
+    unsigned long remaining;
+
+    remaining=samplesize-datapos;
+
+    if (remaining>=sizeof(uint64_t))
+    {
+      word=flux_load64(&sampledata[datapos]);
+    }
+    else
+    {
+      unsigned long i;
+
+      // Pad the final partial word
+      word=0;
+      for (i=0; i<remaining; i++)
+        word|=((uint64_t)sampledata[datapos+i])<<(56-(i*BITSPERBYTE));
+    }
+
+    // Mark each sample which differs from the one before it
+    changes=word^((word>>1)|(prev<<63));
+    prev=word&1;
+
+    if (edges==FLUX_RISINGEDGES)
+      changes&=word;
+
+    // Ignore padding
+    if (remaining<sizeof(uint64_t))
+      changes&=~(UINT64_MAX>>(remaining*BITSPERBYTE));
+
+    while (changes!=0)
+    {
+      int bit;
+      unsigned long edge;
+
+      bit=flux_clz64(changes);
+      edge=(datapos*BITSPERBYTE)+bit+1;
+
+      if (flux_addinterval(flux, edge-lastedge)==0)
+      {
+        fprintf(stderr, "Unable to allocate flux interval storage\n");
+        return flux->count;
+      }
+
+      lastedge=edge;
+
+      // Clear this change
+      changes&=~((((uint64_t)1)<<63)>>bit);
+    }
+  }
+
+  flux->trailing=(samplesize*BITSPERBYTE)-lastedge;
+
+  return flux->count;
+}
+
+// Release storage held by a set of intervals
+void flux_free(Flux_Intervals *flux)
+{
+  free(flux->interval);
+
+  flux_init(flux);
+}
@@ -0,0 +1,35 @@
+#ifndef _FLUX_H_
+#define _FLUX_H_
+
+#include <stdint.h>
+
+// Which level changes to extract intervals for
+#define FLUX_RISINGEDGES 0
+#define FLUX_ALLEDGES 1
+
+// Transition intervals extracted from a packed sample buffer
+typedef struct FluxIntervals
+{
+  uint32_t *interval; // Samples between successive rising edges
+  unsigned long count; // Number of intervals held
+  unsigned long allocated; // Number of intervals there is space for
+
+  unsigned long samplesize; // Size of sample buffer the intervals came from (in bytes)
+  unsigned long trailing; // Samples following the last edge
+  char startlevel; // Level of the first sample
+
+} Flux_Intervals;
+
+// Initialise an empty set of intervals
+extern void flux_init(Flux_Intervals *flux);
+
+// Add an interval to the list, growing it as required
+extern int flux_addinterval(Flux_Intervals *flux, const unsigned long samples);
+
+// Convert a packed sample buffer into edge intervals
+extern unsigned long flux_extract(Flux_Intervals *flux, const unsigned char *sampledata, const unsigned long samplesize, const int edges);
+
+// Release storage held by a set of intervals
+extern void flux_free(Flux_Intervals *flux);
+
+#endif
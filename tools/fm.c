@@ -8,139 +8,127 @@
 #include "hardware.h"
 #include "pll.h"
 
-int fm_state=FM_SYNC; // state machine
-unsigned int fm_datacells=0; // 16 bit sliding buffer
-int fm_bits=0; // Number of used bits within sliding buffer
-unsigned int fm_p1, fm_p2, fm_p3=0;
-
-// Most recent address mark
-unsigned long fm_idpos, fm_blockpos;
-int fm_idamtrack, fm_idamhead, fm_idamsector, fm_idamlength; // IDAM values
-int fm_lasttrack, fm_lasthead, fm_lastsector, fm_lastlength;
-unsigned char fm_blocktype;
-unsigned int fm_blocksize;
-unsigned int fm_idblockcrc, fm_datablockcrc, fm_bitstreamcrc;
-
-// Output block data buffer, for a single sector
-unsigned char fm_bitstream[FM_BLOCKSIZE];
-unsigned int fm_bitlen=0;
-
-// FM timings
-float fm_defaultwindow;
-float fm_bucket1, fm_bucket01;
-
-struct PLL *fm_pll;
-
-int fm_debug=0;
-
 // Validate clock bits
 int fm_validateclock(const unsigned char clock)
 {
   return (clock==0xff);
 }
 
+// Append a byte to the current block, the running CRC lags two bytes behind so
+// it excludes the block's own CRC, and is ready as soon as the last byte arrives
+static inline void fm_addbyte(FM_Context *fm, const unsigned char data)
+{
+  if (fm->bitlen==0)
+    fm->blockcrc=CRC_CCITT_INITIAL;
+  else
+  if (fm->bitlen>=2)
+    fm->blockcrc=crc_update(fm->blockcrc, fm->bitstream[fm->bitlen-2]);
+
+  fm->bitstream[fm->bitlen++]=data;
+}
+
 // Add a bit to the 16-bit accumulator, when full - attempt to process (clock + data)
-void fm_addbit(const unsigned char bit, const unsigned long datapos)
+void fm_addbit(FM_Context *fm, const unsigned char bit, const unsigned long datapos)
 {
   // Maintain previous 48 bits of data
-  fm_p1=(fm_p1<<1)|((fm_p2&0x8000)>>15);
-  fm_p2=(fm_p2<<1)|((fm_p3&0x8000)>>15);
-  fm_p3=(fm_p3<<1)|((fm_datacells&0x8000)>>15);
+  fm->p1=(fm->p1<<1)|((fm->p2&0x8000)>>15);
+  fm->p2=(fm->p2<<1)|((fm->p3&0x8000)>>15);
+  fm->p3=(fm->p3<<1)|((fm->datacells&0x8000)>>15);
 
-  fm_datacells=((fm_datacells<<1)&0xffff);
-  fm_datacells|=bit;
-  fm_bits++;
+  fm->datacells=((fm->datacells<<1)&0xffff);
+  fm->datacells|=bit;
+  fm->bits++;
 
   // Keep processing until we have 8 clock bits + 8 data bits
-  if (fm_bits>=16)
+  if (fm->bits>=16)
   {
     unsigned char clock, data;
 
     // Extract clock byte, for data this should be 0xff
-    clock=mod_getclock(fm_datacells);
+    clock=mod_getclock(fm->datacells);
 
     // Extract data byte
-    data=mod_getdata(fm_datacells);
+    data=mod_getdata(fm->datacells);
 
-    switch (fm_state)
+    switch (fm->state)
     {
       unsigned char dataCRC; // EDC
 
       case FM_SYNC:
         // Detect standard FM address marks
-        switch (fm_datacells)
+        switch (fm->datacells)
         {
           case 0xf77a: // clock=d7 data=fc
-            if (fm_debug)
+            if (fm->debug)
               fprintf(stderr, "\n[%lx] FM Index Address Mark\n", datapos);
-            fm_blocktype=data;
-            fm_bitlen=0;
-            fm_state=FM_SYNC;
+            fm->blocktype=data;
+            fm->bitlen=0;
+            fm->state=FM_SYNC;
 
             // Clear IDAM cache, although I've not seen IAM on Acorn DFS
-            fm_idpos=0;
-            fm_idamtrack=-1;
-            fm_idamhead=-1;
-            fm_idamsector=-1;
-            fm_idamlength=-1;
+            fm->idpos=0;
+            fm->idamtrack=-1;
+            fm->idamhead=-1;
+            fm->idamsector=-1;
+            fm->idamlength=-1;
             break;
 
           case 0xf57e: // clock=c7 data=fe
-            if (fm_debug)
+            if (fm->debug)
               fprintf(stderr, "\n[%lx] FM ID Address Mark\n", datapos);
-            fm_blocktype=data;
-            fm_blocksize=6+1;
-            fm_bitlen=0;
-            fm_bitstream[fm_bitlen++]=data;
-            fm_idpos=datapos;
-            fm_state=FM_ADDR;
+            fm->blocktype=data;
+            fm->blocksize=6+1;
+            fm->bitlen=0;
+            fm_addbyte(fm, data);
+            fm->idpos=datapos;
+            fm->state=FM_ADDR;
 
             // Clear IDAM cache incase previous was good and this one is bad
-            fm_idamtrack=-1;
-            fm_idamhead=-1;
-            fm_idamsector=-1;
-            fm_idamlength=-1;
+            fm->idamtrack=-1;
+            fm->idamhead=-1;
+            fm->idamsector=-1;
+            fm->idamlength=-1;
             break;
 
           case 0xf56f: // clock=c7 data=fb
-            if (fm_debug)
-              fprintf(stderr, "\n[%lx] FM Data Address Mark, distance from ID %lx\n", datapos, datapos-fm_idpos);
+            if (fm->debug)
+              fprintf(stderr, "\n[%lx] FM Data Address Mark, distance from ID %lx\n", datapos, datapos-fm->idpos);
 
             // Don't process if don't have a valid preceding IDAM
-            if ((fm_idamtrack!=-1) && (fm_idamhead!=-1) && (fm_idamsector!=-1) && (fm_idamlength!=-1))
+            if ((fm->idamtrack!=-1) && (fm->idamhead!=-1) && (fm->idamsector!=-1) && (fm->idamlength!=-1))
             {
-              fm_blocktype=data;
-              fm_bitlen=0;
-              fm_bitstream[fm_bitlen++]=data;
-              fm_blockpos=datapos;
-              fm_state=FM_DATA;
+              fm->blocktype=data;
+              fm->bitlen=0;
+              fm_addbyte(fm, data);
+              fm->blockpos=datapos;
+              fm->state=FM_DATA;
             }
             else
             {
-              fm_blocktype=FM_BLOCKNULL;
-              fm_bitlen=0;
-              fm_state=FM_SYNC;
+              fm->blocktype=FM_BLOCKNULL;
+              fm->bitlen=0;
+              fm->state=FM_SYNC;
             }
             break;
 
           case 0xf56a: // clock=c7 data=f8
-            if (fm_debug)
-              fprintf(stderr, "\n[%lx] FM Deleted Data Address Mark, distance from ID %lx\n", datapos, datapos-fm_idpos);
+            if (fm->debug)
+              fprintf(stderr, "\n[%lx] FM Deleted Data Address Mark, distance from ID %lx\n", datapos, datapos-fm->idpos);
 
             // Don't process if don't have a valid preceding IDAM
-            if ((fm_idamtrack!=-1) && (fm_idamhead!=-1) && (fm_idamsector!=-1) && (fm_idamlength!=-1))
+            if ((fm->idamtrack!=-1) && (fm->idamhead!=-1) && (fm->idamsector!=-1) && (fm->idamlength!=-1))
             {
-              fm_blocktype=data;
-              fm_bitlen=0;
-              fm_bitstream[fm_bitlen++]=data;
-              fm_blockpos=datapos;
-              fm_state=FM_DATA;
+              fm->blocktype=data;
+              fm->bitlen=0;
+              fm_addbyte(fm, data);
+              fm->blockpos=datapos;
+              fm->state=FM_DATA;
             }
             else
             {
-              fm_blocktype=FM_BLOCKNULL;
-              fm_bitlen=0;
-              fm_state=FM_SYNC;
+              fm->blocktype=FM_BLOCKNULL;
+              fm->bitlen=0;
+              fm->state=FM_SYNC;
             }
             break;
 
@@ -151,19 +139,19 @@ void fm_addbit(const unsigned char bit, const unsigned long datapos)
         break;
 
       case FM_ADDR:
-        // Keep reading until we have the whole block in fm_bitstream[]
-        fm_bitstream[fm_bitlen++]=data;
+        // Keep reading until we have the whole block in fm->bitstream[]
+        fm_addbyte(fm, data);
 
-        if (fm_bitlen==fm_blocksize)
+        if (fm->bitlen==fm->blocksize)
         {
-          fm_idblockcrc=calc_crc(&fm_bitstream[0], fm_bitlen-2);
-          fm_bitstreamcrc=(((unsigned int)fm_bitstream[fm_bitlen-2]<<8)|fm_bitstream[fm_bitlen-1]);
-          dataCRC=(fm_idblockcrc==fm_bitstreamcrc)?GOODDATA:BADDATA;
+          fm->idblockcrc=fm->blockcrc;
+          fm->bitstreamcrc=(((unsigned int)fm->bitstream[fm->bitlen-2]<<8)|fm->bitstream[fm->bitlen-1]);
+          dataCRC=(fm->idblockcrc==fm->bitstreamcrc)?GOODDATA:BADDATA;
 
           // Check for duplicator mark
-          if ((dataCRC!=GOODDATA) && (hw_currenthead==0) && ((hw_currenttrack==40) || (hw_currenttrack==80)))
+          if ((dataCRC!=GOODDATA) && (fm->physical_head==0) && ((fm->physical_track==40) || (fm->physical_track==80)))
           {
-            if (calc_crc_stream(&fm_bitstream[0], fm_bitlen-2, 0xffff, 0x2352)==fm_bitstreamcrc)
+            if (calc_crc_stream(&fm->bitstream[0], fm->bitlen-2, 0xffff, 0x2352)==fm->bitstreamcrc)
             {
               dataCRC=GOODDATA;
             }
@@ -174,8 +162,8 @@ void fm_addbit(const unsigned char bit, const unsigned long datapos)
 
               for (crcs=0; crcs<0xffff; crcs++)
               {
-                crcout=calc_crc_stream(&fm_bitstream[0], fm_bitlen-2, 0xffff, crcs);
-                if (crcout==fm_bitstreamcrc)
+                crcout=calc_crc_stream(&fm->bitstream[0], fm->bitlen-2, 0xffff, crcs);
+                if (crcout==fm->bitstreamcrc)
                 {
                   fprintf(stderr, "CRC poly = %.4x\n", crcs);
                   break;
@@ -184,36 +172,36 @@ void fm_addbit(const unsigned char bit, const unsigned long datapos)
             }
           }
 
-          if (fm_debug)
+          if (fm->debug)
           {
-            fprintf(stderr, "[%lx] FM Track %d (%d) ", datapos, fm_bitstream[1], hw_currenttrack);
-            fprintf(stderr, "Head %d (%d) ", fm_bitstream[2], hw_currenthead);
-            fprintf(stderr, "Sector %d ", fm_bitstream[3]);
-            fprintf(stderr, "Data size %d ", fm_bitstream[4]);
-            fprintf(stderr, "CRC %.2x%.2x", fm_bitstream[5], fm_bitstream[6]);
+            fprintf(stderr, "[%lx] FM Track %d (%d) ", datapos, fm->bitstream[1], fm->physical_track);
+            fprintf(stderr, "Head %d (%d) ", fm->bitstream[2], fm->physical_head);
+            fprintf(stderr, "Sector %d ", fm->bitstream[3]);
+            fprintf(stderr, "Data size %d ", fm->bitstream[4]);
+            fprintf(stderr, "CRC %.2x%.2x", fm->bitstream[5], fm->bitstream[6]);
 
             if (dataCRC==GOODDATA)
               fprintf(stderr, " OK\n");
             else
-              fprintf(stderr, " BAD (%.4x)\n", fm_idblockcrc);
+              fprintf(stderr, " BAD (%.4x)\n", fm->idblockcrc);
           }
 
           if (dataCRC==GOODDATA)
           {
             // Record IDAM values
-            fm_idamtrack=fm_bitstream[1];
-            fm_idamhead=fm_bitstream[2];
-            fm_idamsector=fm_bitstream[3];
-            fm_idamlength=fm_bitstream[4];
+            fm->idamtrack=fm->bitstream[1];
+            fm->idamhead=fm->bitstream[2];
+            fm->idamsector=fm->bitstream[3];
+            fm->idamlength=fm->bitstream[4];
 
             // Record last known good IDAM values for this track
-            fm_lasttrack=fm_idamtrack;
-            fm_lasthead=fm_idamhead;
-            fm_lastsector=fm_idamsector;
-            fm_lastlength=fm_idamlength;
+            fm->lasttrack=fm->idamtrack;
+            fm->lasthead=fm->idamhead;
+            fm->lastsector=fm->idamsector;
+            fm->lastlength=fm->idamlength;
 
             // Sanitise data block length
-            switch(fm_idamlength)
+            switch(fm->idamlength)
             {
               case 0x00: // 128
               case 0x01: // 256
@@ -223,72 +211,72 @@ void fm_addbit(const unsigned char bit, const unsigned long datapos)
               case 0x05: // 4096
               case 0x06: // 8192
               case 0x07: // 16384
-                fm_blocksize=(128<<fm_idamlength)+3;
+                fm->blocksize=(128<<fm->idamlength)+3;
                 break;
 
               default:
-                if (fm_debug)
-                  fprintf(stderr, "Invalid record length %.2x\n", fm_idamlength);
+                if (fm->debug)
+                  fprintf(stderr, "Invalid record length %.2x\n", fm->idamlength);
 
-                // Default to DFS standard sector size + (fm_blocktype + (2 x crc))
-                fm_blocksize=DFS_SECTORSIZE+3;
+                // Default to DFS standard sector size + (fm->blocktype + (2 x crc))
+                fm->blocksize=DFS_SECTORSIZE+3;
                 break;
             }
           }
           else
           {
             // IDAM failed CRC, ignore following data block (for now)
-            fm_blocksize=0;
+            fm->blocksize=0;
 
             // Clear IDAM cache
-            fm_idpos=0;
-            fm_idamtrack=-1;
-            fm_idamhead=-1;
-            fm_idamsector=-1;
-            fm_idamlength=-1;
+            fm->idpos=0;
+            fm->idamtrack=-1;
+            fm->idamhead=-1;
+            fm->idamsector=-1;
+            fm->idamlength=-1;
           }
 
-          fm_state=FM_SYNC;
-          fm_blocktype=FM_BLOCKNULL;
+          fm->state=FM_SYNC;
+          fm->blocktype=FM_BLOCKNULL;
         }
         break;
 
       case FM_DATA:
         // Validate clock bits
-        if (fm_debug)
+        if (fm->debug)
           fm_validateclock(clock);
 
-        // Keep reading until we have the whole block in fm_bitstream[]
-        fm_bitstream[fm_bitlen++]=data;
+        // Keep reading until we have the whole block in fm->bitstream[]
+        fm_addbyte(fm, data);
 
-        if (fm_bitlen==fm_blocksize)
+        if (fm->bitlen==fm->blocksize)
         {
           // All the bytes for this "data" block have been read, so process them
 
           // Calculate CRC (EDC)
-          fm_datablockcrc=calc_crc(&fm_bitstream[0], fm_bitlen-2);
-          fm_bitstreamcrc=(((unsigned int)fm_bitstream[fm_bitlen-2]<<8)|fm_bitstream[fm_bitlen-1]);
+          fm->datablockcrc=fm->blockcrc;
+          fm->bitstreamcrc=(((unsigned int)fm->bitstream[fm->bitlen-2]<<8)|fm->bitstream[fm->bitlen-1]);
 
-          if (fm_debug)
-            fprintf(stderr, "  %.2x CRC %.4x", fm_blocktype, fm_bitstreamcrc);
+          if (fm->debug)
+            fprintf(stderr, "  %.2x CRC %.4x", fm->blocktype, fm->bitstreamcrc);
 
-          dataCRC=(fm_datablockcrc==fm_bitstreamcrc)?GOODDATA:BADDATA;
+          dataCRC=(fm->datablockcrc==fm->bitstreamcrc)?GOODDATA:BADDATA;
 
-          if ((fm_bitstreamcrc==0x0000) && (fm_bitstream[1]=1) && (fm_bitstream[2]=2) && (fm_bitstream[3]=3) && (fm_bitstream[4]=4) && (fm_bitstream[5]=5))
+          if ((fm->bitstreamcrc==0x0000) && (fm->bitstream[1]=1) && (fm->bitstream[2]=2) && (fm->bitstream[3]=3) && (fm->bitstream[4]=4) && (fm->bitstream[5]=5))
           {
             int j;
 
             fprintf(stderr, "\nDUPLICATOR MARK\n");
 
-            fprintf(stderr, "Disc birthday (YY/MM/DD) : %.2x/%.2x/%.2x\n", fm_bitstream[15], fm_bitstream[16], fm_bitstream[17]);
+            fprintf(stderr, "Disc birthday (YY/MM/DD) : %.2x/%.2x/%.2x\n", fm->bitstream[15], fm->bitstream[16], fm->bitstream[17]);
 
-            for (j=0; j<fm_blocksize; j++)
-              fprintf(stderr, "%c", fm_bitstream[j]);
+            for (j=0; j<fm->blocksize; j++)
+              fprintf(stderr, "%c", fm->bitstream[j]);
 
             fprintf(stderr, "\n");
 
-            for (j=0; j<fm_blocksize; j++)
-              fprintf(stderr, "%.2x ", fm_bitstream[j]);
+            for (j=0; j<fm->blocksize; j++)
+              fprintf(stderr, "%.2x ", fm->bitstream[j]);
 
             fprintf(stderr, "\n");
           }
@@ -296,85 +284,98 @@ void fm_addbit(const unsigned char bit, const unsigned long datapos)
           // Report and save if the CRC matches
           if (dataCRC==GOODDATA)
           {
-            if (fm_debug)
+            if (fm->debug)
               fprintf(stderr, " OK [%lx]\n", datapos);
 
-            if (diskstore_addsector(MODFM, hw_currenttrack, hw_currenthead, fm_idamtrack, fm_idamhead, fm_idamsector, fm_idamlength, fm_idpos, fm_idblockcrc, fm_blockpos, fm_blocktype, fm_blocksize-3, &fm_bitstream[1], fm_datablockcrc)==1)
+            if (diskstore_addsector(fm->store, MODFM, fm->physical_track, fm->physical_head, fm->idamtrack, fm->idamhead, fm->idamsector, fm->idamlength, fm->idpos, fm->idblockcrc, fm->blockpos, fm->blocktype, fm->blocksize-3, &fm->bitstream[1], fm->datablockcrc, datapos)==1)
             {
-              if (fm_debug)
-                fprintf(stderr, "** FM new sector T%d H%d - C%d H%d R%d N%d - IDCRC %.4x DATACRC %.4x **\n", hw_currenttrack, hw_currenthead, fm_idamtrack, fm_idamhead, fm_idamsector, fm_idamlength, fm_idblockcrc, fm_datablockcrc);
+              fm->sectorsfound++;
+
+              if (fm->debug)
+                fprintf(stderr, "** FM new sector T%d H%d - C%d H%d R%d N%d - IDCRC %.4x DATACRC %.4x **\n", fm->physical_track, fm->physical_head, fm->idamtrack, fm->idamhead, fm->idamsector, fm->idamlength, fm->idblockcrc, fm->datablockcrc);
             }
           }
           else
           {
-            if (fm_debug)
-              fprintf(stderr, " BAD (%.4x)\n", fm_datablockcrc);
+            if (fm->debug)
+              fprintf(stderr, " BAD (%.4x)\n", fm->datablockcrc);
           }
 
           // Require subsequent data blocks to have a valid ID block first
-          fm_idpos=0;
-          fm_idamtrack=-1;
-          fm_idamhead=-1;
-          fm_idamsector=-1;
-          fm_idamlength=-1;
-
-          fm_blocktype=FM_BLOCKNULL;
-          fm_blocksize=0;
-          fm_state=FM_SYNC;
+          fm->idpos=0;
+          fm->idamtrack=-1;
+          fm->idamhead=-1;
+          fm->idamsector=-1;
+          fm->idamlength=-1;
+
+          fm->blocktype=FM_BLOCKNULL;
+          fm->blocksize=0;
+          fm->state=FM_SYNC;
         }
         break;
 
       default:
         // Unknown state, should never happen
-        fm_blocktype=FM_BLOCKNULL;
-        fm_blocksize=0;
-        fm_state=FM_SYNC;
+        fm->blocktype=FM_BLOCKNULL;
+        fm->blocksize=0;
+        fm->state=FM_SYNC;
         break;
     }
 
     // If waiting for sync, then keep width at 16 bits and continue shifting/adding new bits
-    if (fm_state==FM_SYNC)
-      fm_bits=16;
+    if (fm->state==FM_SYNC)
+      fm->bits=16;
     else
-      fm_bits=0;
+      fm->bits=0;
   }
 }
 
-void fm_addsample(const unsigned long samples, const unsigned long datapos, const int usepll)
+// Receive a bit recovered by the PLL
+static void fm_pllbit(void *context, const unsigned char bit, const unsigned long datapos)
+{
+  fm_addbit((FM_Context *)context, bit, datapos);
+}
+
+void fm_addsample(FM_Context *fm, const unsigned long samples, const unsigned long datapos, const int usepll)
 {
   if (usepll)
   {
-    PLL_addsample(fm_pll, samples, datapos);
+    PLL_addsample(&fm->pll, samples, datapos);
 
     return;
   }
 
   // Does number of samples fit within "1" bucket ..
-  if (samples<=fm_bucket1)
+  if (samples<=fm->bucket1)
   {
-    fm_addbit(1, datapos);
+    fm_addbit(fm, 1, datapos);
   }
   else // .. does number of samples fit within "01" bucket
-  if (samples<=fm_bucket01)
+  if (samples<=fm->bucket01)
   {
-   fm_addbit(0, datapos);
-   fm_addbit(1, datapos);
+   fm_addbit(fm, 0, datapos);
+   fm_addbit(fm, 1, datapos);
   }
   else
   {
     // TODO This shouldn't happen in single-density FM encoding
-   fm_addbit(0, datapos);
-   fm_addbit(0, datapos);
-   fm_addbit(1, datapos);
+   fm_addbit(fm, 0, datapos);
+   fm_addbit(fm, 0, datapos);
+   fm_addbit(fm, 1, datapos);
   }
 }
 
 // Initialise the FM parser
-void fm_init(const int debug, const char density)
+void fm_init(FM_Context *fm, const int debug, const char density, Disk_Store *store, const uint8_t physical_track, const uint8_t physical_head, const float rpm, const unsigned long samplerate)
 {
   float bitcell=FM_BITCELL;
 
-  fm_debug=debug;
+  fm->debug=debug;
+
+  fm->store=store;
+  fm->physical_track=physical_track;
+  fm->physical_head=physical_head;
+  fm->sectorsfound=0;
 
   if ((density&MOD_DENSITYFMSD)==0)
   {
@@ -382,51 +383,54 @@ void fm_init(const int debug, const char density)
   }
 
   // Adjust bitcell for RPM
-  bitcell=(bitcell/hw_rpm)*(float)HW_DEFAULTRPM;
+  bitcell=(bitcell/rpm)*(float)HW_DEFAULTRPM;
 
   // Determine number of samples between "1" pulses (default window)
-  fm_defaultwindow=((float)hw_samplerate/(float)USINSECOND)*bitcell;
+  fm->defaultwindow=((float)samplerate/(float)USINSECOND)*bitcell;
 
-  if (fm_pll!=NULL)
-    PLL_reset(fm_pll, fm_defaultwindow);
-  else
-    fm_pll=PLL_create(fm_defaultwindow, fm_addbit);
+  PLL_init(&fm->pll, fm->defaultwindow, fm_pllbit, fm);
 
   // From default window, determine bucket sizes for assigning bits "1" or "01"
-  fm_bucket1=fm_defaultwindow+(fm_defaultwindow/2);
-  fm_bucket01=(fm_defaultwindow*2)+(fm_defaultwindow/2);
+  fm->bucket1=fm->defaultwindow+(fm->defaultwindow/2);
+  fm->bucket01=(fm->defaultwindow*2)+(fm->defaultwindow/2);
 
   // Set up FM parser
-  fm_state=FM_SYNC;
-  fm_datacells=0;
-  fm_bits=0;
+  fm->state=FM_SYNC;
+  fm->datacells=0;
+  fm->bits=0;
 
-  fm_idpos=0;
-  fm_blockpos=0;
+  fm->idpos=0;
+  fm->blockpos=0;
 
-  fm_blocktype=FM_BLOCKNULL;
-  fm_blocksize=0;
+  fm->blocktype=FM_BLOCKNULL;
+  fm->blocksize=0;
 
-  fm_idblockcrc=0;
-  fm_datablockcrc=0;
-  fm_bitstreamcrc=0;
+  fm->idblockcrc=0;
+  fm->datablockcrc=0;
+  fm->bitstreamcrc=0;
 
-  fm_bitlen=0;
+  fm->bitlen=0;
 
   // Initialise previous data cache
-  fm_p1=0;
-  fm_p2=0;
-  fm_p3=0;
+  fm->p1=0;
+  fm->p2=0;
+  fm->p3=0;
 
   // Initialise last found sector IDAM to invalid
-  fm_idamtrack=-1;
-  fm_idamhead=-1;
-  fm_idamsector=-1;
-  fm_idamlength=-1;
+  fm->idamtrack=-1;
+  fm->idamhead=-1;
+  fm->idamsector=-1;
+  fm->idamlength=-1;
 
   // Initialise last known good sector IDAM to invalid
-  fm_lasttrack=-1;
-  fm_lasthead=-1;
-  fm_lastsector=-1;
-  fm_lastlength=-1;
+  fm->lasttrack=-1;
+  fm->lasthead=-1;
+  fm->lastsector=-1;
+  fm->lastlength=-1;
+}
+
+// Finish processing, returning how many new sectors were stored
+unsigned int fm_finish(FM_Context *fm)
+{
+  return fm->sectorsfound;
 }
@@ -1,6 +1,9 @@
 #ifndef _FM_H_
 #define _FM_H_
 
+#include "diskstore.h"
+#include "pll.h"
+
 // Microseconds in a bitcell window for single-density FM at 300 RPM
 #define FM_BITCELL 4
 
@@ -23,11 +26,44 @@
 #define FM_ADDR 2
 #define FM_DATA 3
 
-extern int fm_idamtrack, fm_idamhead, fm_idamsector, fm_idamlength;
-extern int fm_lasttrack, fm_lasthead, fm_lastsector, fm_lastlength;
+typedef struct FMContext
+{
+  int debug;
+
+  // Where to store found sectors, and which track they came from
+  Disk_Store *store;
+  uint8_t physical_track;
+  uint8_t physical_head;
+  unsigned int sectorsfound;
+
+  int state; // state machine
+  unsigned int datacells; // 16 bit sliding buffer
+  int bits; // Number of used bits within sliding buffer
+  unsigned int p1, p2, p3;
+
+  // Most recent address mark
+  unsigned long idpos, blockpos;
+  int idamtrack, idamhead, idamsector, idamlength; // IDAM values
+  int lasttrack, lasthead, lastsector, lastlength;
+  unsigned char blocktype;
+  unsigned int blocksize;
+  unsigned int idblockcrc, datablockcrc, bitstreamcrc;
+
+  // Output block data buffer, for a single sector
+  unsigned char bitstream[FM_BLOCKSIZE];
+  unsigned int bitlen;
+  uint16_t blockcrc; // CRC of all but the last two bytes of bitstream
+
+  // FM timings
+  float defaultwindow;
+  float bucket1, bucket01;
+
+  struct PLL pll;
+} FM_Context;
 
-extern void fm_addsample(const unsigned long samples, const unsigned long datapos, const int usepll);
+extern void fm_addsample(FM_Context *fm, const unsigned long samples, const unsigned long datapos, const int usepll);
 
-extern void fm_init(const int debug, const char density);
+extern void fm_init(FM_Context *fm, const int debug, const char density, Disk_Store *store, const uint8_t physical_track, const uint8_t physical_head, const float rpm, const unsigned long samplerate);
+extern unsigned int fm_finish(FM_Context *fm);
 
 #endif
@@ -57,7 +57,7 @@ Notes
 The &E1 error code represents a sector that is really &100 bytes long but declares itself as something longer, for example &200 bytes.  The FSD format stores the over-read data so both the reported and real sizes are &200 bytes, but the CRC is only correct for a read of &100 bytes.  The E0 and E2 codes work similarly.
 */
 
-void fsd_write(FILE *fsdfile, const unsigned char tracks, const char *title, const uint8_t sides, const int sidetoread)
+void fsd_write(Disk_Store *store, FILE *fsdfile, const unsigned char tracks, const char *title, const uint8_t sides, const int sidetoread)
 {
   unsigned char buffer[10];
   unsigned char curtrack, curhead, cursector;
@@ -92,10 +92,10 @@ void fsd_write(FILE *fsdfile, const unsigned char tracks, const char *title, con
   {
     unsigned char totalsectors;
 
-    totalsectors=diskstore_countsectors(curtrack*hw_stepping, sidetoread);
+    totalsectors=diskstore_countsectors(store, curtrack*store->stepping, sidetoread);
 
     if (sides==2)
-      totalsectors+=diskstore_countsectors(curtrack*hw_stepping, 1-sidetoread);
+      totalsectors+=diskstore_countsectors(store, curtrack*store->stepping, 1-sidetoread);
 
     // Track header
     buffer[0]=curtrack;
@@ -113,10 +113,10 @@ void fsd_write(FILE *fsdfile, const unsigned char tracks, const char *title, con
       {
         if (sides==1) curhead=sidetoread;
 
-        numsectors=diskstore_countsectors(curtrack*hw_stepping, curhead);
+        numsectors=diskstore_countsectors(store, curtrack*store->stepping, curhead);
         for (cursector=0; cursector<numsectors; cursector++)
         {
-          sec=diskstore_findnthsector(curtrack*hw_stepping, curhead, cursector);
+          sec=diskstore_findnthsector(store, curtrack*store->stepping, curhead, cursector);
 
           if (sec!=NULL)
           {
@@ -3,6 +3,8 @@
 
 #include <stdint.h>
 
+#include "diskstore.h"
+
 #define FSD_UNFORMATTED 0x00
 #define FSD_UNREADABLE 0x00
 #define FSD_READABLE 0xff
@@ -21,6 +23,6 @@
 
 #define FSD_CREATORID 0x0a
 
-extern void fsd_write(FILE *fsdfile, const unsigned char tracks, const char *title, const uint8_t sides, const int sidetoread);
+extern void fsd_write(Disk_Store *store, FILE *fsdfile, const unsigned char tracks, const char *title, const uint8_t sides, const int sidetoread);
 
 #endif
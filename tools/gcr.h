@@ -1,6 +1,9 @@
 #ifndef _GCR_H_
 #define _GCR_H_
 
+#include "diskstore.h"
+#include "pll.h"
+
 // State machine
 #define GCR_IDLE 0
 #define GCR_ID 1
@@ -8,11 +11,44 @@
 
 #define GCR_SECTORLEN 256
 
-extern int gcr_idamtrack, gcr_idamsector;
-extern int gcr_lasttrack, gcr_lastsector;
+// Largest encoded block (data block)
+#define GCR_BLOCKSIZE 325
+
+typedef struct GCRContext
+{
+  int debug;
+
+  // Where to store found sectors, and which track they came from
+  Disk_Store *store;
+  uint8_t physical_track;
+  uint8_t physical_head;
+  unsigned int sectorsfound;
+
+  unsigned long bucket1;
+  unsigned long bucket01;
+
+  unsigned char gcrbuffer[GCR_BLOCKSIZE];
+  int gcrlen;
+
+  unsigned char bytebuffer[GCR_BLOCKSIZE];
+  int bytelen;
+
+  int state; // state machine
+  unsigned int datacells; // 16 bit sliding buffer
+  int bits; // Number of used bits within sliding buffer
+
+  // Most recent address mark
+  unsigned long idpos, blockpos;
+  int idamtrack, idamsector; // IDAM values
+  int lasttrack, lastsector; // last known good IDAM values
+  unsigned int idblockcrc, datablockcrc;
+
+  struct PLL pll;
+} GCR_Context;
 
-extern void gcr_addsample(const unsigned long samples, const unsigned long datapos, const int usepll);
+extern void gcr_addsample(GCR_Context *gcr, const unsigned long samples, const unsigned long datapos, const int usepll);
 
-extern void gcr_init(const int debug, const char density);
+extern void gcr_init(GCR_Context *gcr, const int debug, const char density, Disk_Store *store, const uint8_t physical_track, const uint8_t physical_head, const float rpm);
+extern unsigned int gcr_finish(GCR_Context *gcr);
 
 #endif
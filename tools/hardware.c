@@ -3,13 +3,21 @@
 #include <unistd.h>
 #include <bcm2835.h>
 #include <sys/time.h>
+#include <sys/ioctl.h>
 #include <sched.h>
 #include <strings.h>
+#include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <linux/gpio.h>
 
 #include "hardware.h"
 #include "pins.h"
+#include "spi.h"
 
 unsigned int hw_maxtracks = HW_MAXTRACKS;
 uint8_t hw_currenttrack = 0;
@@ -20,6 +28,20 @@ float hw_forcedrpm = 0.0;
 
 int hw_stepping = HW_NORMALSTEPPING;
 
+unsigned int hw_settlecount = 0;
+unsigned long long hw_settletotal = 0;
+unsigned long hw_settlemax = 0;
+
+// GPIO character device line for index pulse events, -1 when polling the pin
+int hw_indexfd = -1;
+
+// Time of the most recent index pulse in nanoseconds
+unsigned long long hw_indextime = 0;
+
+// Buffer for raw SPI samples, kept between calls
+char *hw_rawbuf = NULL;
+uint32_t hw_rawbuflen = 0;
+
 void hw_setscaling(const char *scale)
 {
   const char governor_policy[]="/sys/devices/system/cpu/cpufreq/policy0/scaling_governor";
@@ -48,6 +70,32 @@ void hw_setscaling(const char *scale)
   hw_sleep(2);
 }
 
+// Request index pulse rising edge events from the GPIO character device
+void hw_initindexevents()
+{
+  struct gpioevent_request req;
+  int chipfd;
+
+  chipfd=open(HW_GPIOCHIP, O_RDONLY);
+  if (chipfd<0) return;
+
+  memset(&req, 0, sizeof(req));
+  req.lineoffset=INDEX_PULSE;
+  req.handleflags=GPIOHANDLE_REQUEST_INPUT;
+  req.eventflags=GPIOEVENT_REQUEST_RISING_EDGE;
+  strncpy(req.consumer_label, "bbcfdc index", sizeof(req.consumer_label)-1);
+
+  if (ioctl(chipfd, GPIO_GET_LINEEVENT_IOCTL, &req)==0)
+  {
+    hw_indexfd=req.fd;
+
+    // Non-blocking, so that stale events can be discarded
+    fcntl(hw_indexfd, F_SETFL, fcntl(hw_indexfd, F_GETFL)|O_NONBLOCK);
+  }
+
+  close(chipfd);
+}
+
 // Initialise GPIO and SPI
 int hw_init(const int spiclockdivider)
 {
@@ -117,6 +165,9 @@ int hw_init(const int spiclockdivider)
   bcm2835_gpio_fsel(INDEX_PULSE, GPIO_IN);
   bcm2835_gpio_set_pud(INDEX_PULSE, PULL_UP);
 
+  // Wait on index pulse edges rather than polling, when kernel supports it
+  hw_initindexevents();
+
   //bcm2835_gpio_fsel(READ_DATA, GPIO_IN);
   //bcm2835_gpio_set_pud(READ_DATA, PULL_UP);
 
@@ -206,6 +257,16 @@ void hw_done()
   bcm2835_spi_end();
   bcm2835_close();
 
+  if (hw_indexfd!=-1)
+  {
+    close(hw_indexfd);
+    hw_indexfd=-1;
+  }
+
+  free(hw_rawbuf);
+  hw_rawbuf=NULL;
+  hw_rawbuflen=0;
+
   hw_setscaling("ondemand");
 }
 
@@ -398,11 +459,37 @@ int hw_writeprotected()
 // Wait for next rising edge on index pin
 void hw_waitforindex()
 {
+  struct gpioevent_data event;
+  struct pollfd pfd;
+  struct timespec ts;
+
+  if (hw_indexfd!=-1)
+  {
+    // Discard edges from before we started waiting
+    while (read(hw_indexfd, &event, sizeof(event))==sizeof(event)) { }
+
+    pfd.fd=hw_indexfd;
+    pfd.events=POLLIN|POLLPRI;
+
+    // Sleep until the next rising edge, using the kernel timestamp of the edge
+    while ((poll(&pfd, 1, -1)>=0) || (errno==EINTR))
+    {
+      if (read(hw_indexfd, &event, sizeof(event))==sizeof(event))
+      {
+        hw_indextime=event.timestamp;
+        return;
+      }
+    }
+  }
+
   // If index is already high, wait for it to go low
   while (bcm2835_gpio_lev(INDEX_PULSE)!=LOW) { }
 
   // Wait for next rising edge
   while (bcm2835_gpio_lev(INDEX_PULSE)==LOW) { }
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  hw_indextime=(((unsigned long long)ts.tv_sec)*NSINSECOND)+ts.tv_nsec;
 }
 
 // Request data from side 0 = upper (label), or side 1 = lower side of disk
@@ -420,53 +507,6 @@ void hw_sideselect(const int side)
   }
 }
 
-// Fix SPI sample buffer timings
-void hw_fixspisamples(unsigned char *inbuf, long inlen, unsigned char *outbuf, long outlen)
-{
-  long inpos, outpos;
-  unsigned char o, olen, bitpos;
-
-  outpos=0; o=0; olen=0;
-
-  for (inpos=0; inpos<inlen; inpos++)
-  {
-    unsigned char c;
-
-    c=inbuf[inpos];
-
-    // Insert extra sample, this is due to SPI sampling leaving a 1 sample gap between each group of 8 samples
-    o=(o<<1)|((c&0x80)>>7);
-    olen++;
-    if (olen==BITSPERBYTE)
-    {
-      if (outpos<outlen)
-        outbuf[outpos++]=o;
-
-      olen=0; o=0;
-    }
-
-    // Process the 8 valid samples we did get
-    for (bitpos=0; bitpos<BITSPERBYTE; bitpos++)
-    {
-      o=(o<<1)|((c&0x80)>>7);
-      olen++;
-
-      if (olen==BITSPERBYTE)
-      {
-        if (outpos<outlen)
-          outbuf[outpos++]=o;
-
-        olen=0; o=0;
-      }
-
-      c=c<<1;
-    }
-
-    // Stop on output buffer overflow
-    if (outpos>=outlen) return;
-  }
-}
-
 // Sample raw track data
 void hw_samplerawtrackdata(unsigned char* buf, uint32_t len)
 {
@@ -475,17 +515,33 @@ void hw_samplerawtrackdata(unsigned char* buf, uint32_t len)
   // Clear output buffer to prevent failed reads potentially returning previous data
   bzero(buf, len);
 
-  rawbuf=malloc(len);
-  if (rawbuf==NULL) return;
+  // Only allocate a new SPI buffer if the existing one is too small
+  if (len>hw_rawbuflen)
+  {
+    rawbuf=realloc(hw_rawbuf, len);
+    if (rawbuf==NULL) return;
+
+    hw_rawbuf=rawbuf;
+    hw_rawbuflen=len;
+  }
+
+  rawbuf=hw_rawbuf;
 
   // Sample using SPI
   hw_waitforindex();
   bcm2835_spi_transfern(rawbuf, len);
 
   // Fix SPI timings
-  hw_fixspisamples(rawbuf, len, buf, len);
+  spi_fixsamples((unsigned char *)rawbuf, len, buf, len);
+}
+
+// Sampling produces raw track data, intervals are extracted from that later
+int hw_samplerawintervals(Flux_Intervals *flux, const uint32_t len)
+{
+  (void) flux;
+  (void) len;
 
-  free(rawbuf);
+  return 0;
 }
 
 void hw_sleep(const unsigned int seconds)
@@ -500,11 +556,20 @@ void hw_setrpm(const float rpm)
   hw_forcedrpm=rpm;
 }
 
+// Current time in microseconds
+unsigned long long hw_gettime()
+{
+  struct timeval tv;
+
+  gettimeofday(&tv, NULL);
+
+  return (((unsigned long long)tv.tv_sec)*USINSECOND)+tv.tv_usec;
+}
+
 // Measure time between index pulses to determine RPM
 float hw_measurerpm()
 {
   unsigned long long starttime, endtime;
-  struct timeval tv;
 
   // Check for RPM override
   if (hw_forcedrpm!=0.0)
@@ -512,18 +577,65 @@ float hw_measurerpm()
 
   // Wait for next index rising edge
   hw_waitforindex();
+  starttime=hw_indextime;
 
-  // Get time
-  gettimeofday(&tv, NULL);
-  starttime=(((unsigned long long)tv.tv_sec)*USINSECOND)+tv.tv_usec;
+  // Wait for next index rising edge
+  hw_waitforindex();
+  endtime=hw_indextime;
+
+  hw_rpm=((NSINSECOND/(float)(endtime-starttime))*SECONDSINMINUTE);
+
+  return hw_rpm;
+}
+
+// Wait for rotation speed to settle after a seek or head select, returns time taken in microseconds
+unsigned long hw_waitforsettle()
+{
+  unsigned long long starttime, lastindex, now;
+  unsigned long period, lastperiod, settletime;
+  int matches;
+
+  starttime=hw_gettime();
 
   // Wait for next index rising edge
   hw_waitforindex();
+  lastindex=hw_indextime/NSINUS;
 
-  gettimeofday(&tv, NULL);
-  endtime=(((unsigned long long)tv.tv_sec)*USINSECOND)+tv.tv_usec;
+  lastperiod=0;
+  matches=0;
 
-  hw_rpm=((USINSECOND/(float)(endtime-starttime))*SECONDSINMINUTE);
+  do
+  {
+    // Time a full rotation
+    hw_waitforindex();
+    now=hw_gettime();
 
-  return hw_rpm;
+    period=(hw_indextime/NSINUS)-lastindex;
+    lastindex=hw_indextime/NSINUS;
+
+    // Compare against the previous rotation
+    if ((lastperiod!=0) && (labs((long)period-(long)lastperiod)<=(lastperiod*HW_SETTLETOLERANCE)))
+      matches++;
+    else
+      matches=0;
+
+    lastperiod=period;
+
+    // Don't wait any longer than a fixed delay would have
+    if ((now-starttime)>=HW_SETTLETIMEOUT)
+      break;
+  } while (matches<HW_SETTLEMATCHES);
+
+  // Last rotation gives the RPM for this track, unless overridden
+  if ((hw_forcedrpm==0.0) && (period!=0))
+    hw_rpm=((USINSECOND/(float)period)*SECONDSINMINUTE);
+
+  // Record settle times for this drive
+  settletime=now-starttime;
+  hw_settlecount++;
+  hw_settletotal+=settletime;
+  if (settletime>hw_settlemax)
+    hw_settlemax=settletime;
+
+  return settletime;
 }
@@ -3,6 +3,8 @@
 
 #include <stdint.h>
 
+#include "flux.h"
+
 // For disk/drive status
 #define HW_NODRIVE 0
 #define HW_NODISK 1
@@ -27,6 +29,14 @@
 // Nanoseconds in a microsecond
 #define NSINUS 1000
 
+// Head settle detection, rotation is stable once successive index periods agree within tolerance
+#define HW_SETTLEMATCHES 1
+#define HW_SETTLETOLERANCE 0.01
+#define HW_SETTLETIMEOUT USINSECOND
+
+// GPIO character device used for index pulse events
+#define HW_GPIOCHIP "/dev/gpiochip0"
+
 // For buffer calculations
 #define BITSPERBYTE 8
 #define HW_DEFAULTRPM 300
@@ -56,6 +66,11 @@ extern float hw_forcedrpm;
 
 extern int hw_stepping;
 
+// Observed head settle times, in microseconds
+extern unsigned int hw_settlecount;
+extern unsigned long long hw_settletotal;
+extern unsigned long hw_settlemax;
+
 // Initialisation
 #ifdef NOPI
 extern int hw_init(const char *rawfile, const int spiclockdivider);
@@ -82,10 +97,11 @@ extern void hw_seekout();
 extern void hw_waitforindex();
 extern int hw_writeprotected();
 extern void hw_samplerawtrackdata(unsigned char *buf, uint32_t len);
+extern int hw_samplerawintervals(Flux_Intervals *flux, const uint32_t len);
 extern void hw_sleep(const unsigned int seconds);
 extern float hw_measurerpm();
+extern unsigned long hw_waitforsettle();
 extern void hw_setrpm(const float rpm);
-extern void hw_fixspisamples(unsigned char *inbuf, long inlen, unsigned char *outbuf, long outlen);
 
 // Clean up
 extern void hw_done();
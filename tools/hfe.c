@@ -7,28 +7,23 @@
 #include "hardware.h"
 #include "hfe.h"
 
-struct hfe_header hfeheader;
-int hfe_isv3=0;
-uint32_t hfe_bitrate;
-
-int hfe_readheader(FILE *hfefile)
+int hfe_readheader(FILE *hfefile, HFE_Reader *hfe)
 {
   if (hfefile==NULL) return -1;
 
-  if (fread(&hfeheader, sizeof(hfeheader), 1, hfefile)==0) return -1;
+  if (fread(&hfe->header, sizeof(hfe->header), 1, hfefile)==0) return -1;
 
-  if (strncmp((char *)&hfeheader.HEADERSIGNATURE, HFE_MAGIC1, strlen(HFE_MAGIC1))!=0)
+  if (strncmp((char *)&hfe->header.HEADERSIGNATURE, HFE_MAGIC1, strlen(HFE_MAGIC1))!=0)
   {
-    if (strncmp((char *)&hfeheader.HEADERSIGNATURE, HFE_MAGIC3, strlen(HFE_MAGIC3))!=0)
+    if (strncmp((char *)&hfe->header.HEADERSIGNATURE, HFE_MAGIC3, strlen(HFE_MAGIC3))!=0)
       return -1;
     else
-      hfe_isv3=1;
+      hfe->isv3=1;
   }
 
-  hfe_bitrate=hfeheader.bitRate;
+  hfe->bitrate=hfe->header.bitRate;
 
-  if ((hfeheader.floppyRPM!=0) && (hw_forcedrpm==0.0))
-    hw_rpm=hfeheader.floppyRPM;
+  hfe->rpm=hfe->header.floppyRPM;
 
   return 0;
 }
@@ -49,7 +44,7 @@ uint8_t hfe_byteflip(uint8_t val)
   return ret;
 }
 
-void hfe_gettrackdata(FILE *hfefile, struct hfe_track *curtrack, const int side, unsigned char *buf, const uint32_t buflen)
+void hfe_gettrackdata(FILE *hfefile, HFE_Reader *hfe, const unsigned long samplerate, struct hfe_track *curtrack, const int side, unsigned char *buf, const uint32_t buflen)
 {
   uint8_t data[HFE_BLOCKSIZE];
   uint8_t fluxdata;
@@ -60,13 +55,13 @@ void hfe_gettrackdata(FILE *hfefile, struct hfe_track *curtrack, const int side,
   int skipbits_len=0;
   int setbitrate=0;
   uint32_t num_bits=8;
-  uint32_t bitrate=hfeheader.bitRate;
+  uint32_t bitrate=hfe->header.bitRate;
 
   uint32_t bitgap=0;
   int i;
   uint8_t b;
 
-  double scalar=(double)(bitrate*1000)/(double)hw_samplerate;
+  double scalar=(double)(bitrate*1000)/(double)samplerate;
 
   uint32_t bufpos=0;
   uint8_t outb=0;
@@ -92,13 +87,13 @@ void hfe_gettrackdata(FILE *hfefile, struct hfe_track *curtrack, const int side,
       fluxdata=hfe_byteflip(data[(side*(HFE_BLOCKSIZE/2))+pos]);
 
       // When read v3 files, process opcodes
-      if (hfe_isv3==1)
+      if (hfe->isv3==1)
       {
         if (setbitrate)
         {
           setbitrate=0;
           bitrate=((float)HFE_FLOPPY_EMU_FREQ/((float)fluxdata*2)/1000);
-          scalar=(double)(bitrate*1000)/(double)hw_samplerate;
+          scalar=(double)(bitrate*1000)/(double)samplerate;
           continue;
         }
         else
@@ -184,22 +179,22 @@ void hfe_gettrackdata(FILE *hfefile, struct hfe_track *curtrack, const int side,
   }
 }
 
-long hfe_readtrack(FILE *hfefile, const int track, const int side, unsigned char *buf, const uint32_t buflen)
+long hfe_readtrack(FILE *hfefile, HFE_Reader *hfe, const unsigned long samplerate, const int track, const int side, unsigned char *buf, const uint32_t buflen)
 {
   struct hfe_track curtrack;
 
   if (hfefile==NULL) return 0;
 
   // Ensure requested track is in range
-  if ((track<0) || (track>=hfeheader.number_of_track)) return 0;
+  if ((track<0) || (track>=hfe->header.number_of_track)) return 0;
 
   // Seek to the offset for this track
-  fseek(hfefile, (hfeheader.track_list_offset*HFE_BLOCKSIZE)+(track*(sizeof(curtrack))), SEEK_SET);
+  fseek(hfefile, (hfe->header.track_list_offset*HFE_BLOCKSIZE)+(track*(sizeof(curtrack))), SEEK_SET);
   if (fread(&curtrack, sizeof(curtrack), 1, hfefile)==0)
     return 0;
 
   // Fetch flux data
-  hfe_gettrackdata(hfefile, &curtrack, side, buf, buflen);
+  hfe_gettrackdata(hfefile, hfe, samplerate, &curtrack, side, buf, buflen);
 
   return 0;
 }
@@ -54,10 +54,17 @@ struct hfe_track
 
 #pragma pack(pop)
 
-extern struct hfe_header hfeheader;
+// State for reading an HFE file
+typedef struct HFEReader
+{
+  struct hfe_header header;
+  int isv3;
+  uint32_t bitrate;
+  float rpm; // 0 when not recorded
+} HFE_Reader;
 
-extern long hfe_readtrack(FILE *hfefile, const int track, const int side, unsigned char *buf, const uint32_t buflen);
+extern long hfe_readtrack(FILE *hfefile, HFE_Reader *hfe, const unsigned long samplerate, const int track, const int side, unsigned char *buf, const uint32_t buflen);
 
-extern int hfe_readheader(FILE *hfefile);
+extern int hfe_readheader(FILE *hfefile, HFE_Reader *hfe);
 
 #endif
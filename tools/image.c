@@ -0,0 +1,162 @@
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+
+#include "common.h"
+#include "diskstore.h"
+#include "adfs.h"
+#include "amigados.h"
+#include "dfs.h"
+#include "dos.h"
+#include "fsd.h"
+#include "teledisk.h"
+#include "image.h"
+
+int image_findtype(const char *filename)
+{
+  if (compare_extension(filename, ".ssd")) return IMAGESSD;
+  if (compare_extension(filename, ".sdd")) return IMAGESDD;
+  if (compare_extension(filename, ".dsd")) return IMAGEDSD;
+  if (compare_extension(filename, ".ddd")) return IMAGEDDD;
+  if (compare_extension(filename, ".fsd")) return IMAGEFSD;
+  if (compare_extension(filename, ".td0")) return IMAGETD0;
+
+  if ((compare_extension(filename, ".img")) || (compare_extension(filename, ".adf")) || (compare_extension(filename, ".st")))
+    return IMAGEIMG;
+
+  return IMAGENONE;
+}
+
+void image_gettitle(Disk_Store *store, const unsigned int disktracks, char *title, const int titlelen)
+{
+  int totalsectors;
+
+  // When no title set, try to use title from source disk
+  if (title[0]==0)
+  {
+    // If they were found and they appear to be DFS catalogue then extract title
+    if (dfs_validcatalogue(store, 0, &totalsectors))
+    {
+      dfs_gettitle(store, 0, title, titlelen);
+    }
+    else
+    if (dos_validate(store)!=DOS_UNKNOWN)
+    {
+      dos_gettitle(store, title, titlelen);
+    }
+    else
+    if (adfs_validate(store)!=ADFS_UNKNOWN)
+    {
+      adfs_gettitle(store, adfs_validate(store), title, titlelen);
+    }
+    else
+    if (amigados_validate(store)!=AMIGADOS_UNKNOWN)
+    {
+      amigados_gettitle(store, disktracks, title, titlelen);
+    }
+  }
+
+  // If no title or blank title, then use default
+  if (title[0]==0)
+    strcpy(title, "NO TITLE");
+}
+
+int image_write(Disk_Store *store, FILE *diskimage, const int outputtype, const unsigned int disktracks, const unsigned int maxtracks, const int sides, const int sidetoread, const int sectorspertrack, char *title, const int titlelen)
+{
+  unsigned int i, j;
+  int missingsectors=0;
+
+  if (outputtype==IMAGETD0)
+  {
+    image_gettitle(store, disktracks, title, titlelen);
+
+    td0_write(store, diskimage, disktracks, title, sides, sidetoread==AUTODETECT?0:sidetoread);
+  }
+  else
+  if (outputtype==IMAGEFSD)
+  {
+    image_gettitle(store, disktracks, title, titlelen);
+
+    fsd_write(store, diskimage, disktracks, title, sides, sidetoread==AUTODETECT?0:sidetoread);
+  }
+  else
+  if ((outputtype==IMAGEDSD) || (outputtype==IMAGESSD) ||
+      (outputtype==IMAGEDDD) || (outputtype==IMAGESDD))
+  {
+    Disk_Sector *sec;
+    unsigned char blanksector[DFS_SECTORSIZE];
+    int imgside;
+
+    // Prepare a blank sector when no sector is found in store
+    bzero(blanksector, sizeof(blanksector));
+
+    for (i=0; ((i<maxtracks) && (i<disktracks)); i++)
+    {
+      for (imgside=0; imgside<sides; imgside++)
+      {
+        for (j=0; (int)j<sectorspertrack; j++)
+        {
+          // Write
+          sec=diskstore_findhybridsector(store, i, sidetoread!=AUTODETECT?sidetoread:imgside, j);
+
+          if ((sec!=NULL) && (sec->data!=NULL))
+          {
+            fwrite(sec->data, 1, DFS_SECTORSIZE, diskimage);
+          }
+          else
+          {
+            fwrite(blanksector, 1, DFS_SECTORSIZE, diskimage);
+            missingsectors++;
+          }
+        }
+      }
+    }
+  }
+  else
+  if (outputtype==IMAGEIMG)
+  {
+    unsigned char blanksector[16384];
+
+    // Prepare a blank sector when no sector is found in store
+    bzero(blanksector, sizeof(blanksector));
+
+    if ((store->minsectorid!=-1) && (store->maxsectorid!=-1))
+    {
+      int sectorsize;
+      int imgside;
+
+      if ((store->minsectorsize!=-1) && (store->maxsectorsize!=-1) && (store->minsectorsize==store->maxsectorsize))
+        sectorsize=store->minsectorsize;
+
+      for (i=0; ((i<maxtracks) && (i<disktracks)); i++)
+      {
+        for (imgside=0; imgside<sides; imgside++)
+        {
+          // Write sectors for this side
+          for (j=(unsigned int)store->minsectorid; j<=(unsigned int)store->maxsectorid; j++)
+          {
+            Disk_Sector *sec;
+
+            sec=diskstore_findhybridsector(store, i, imgside, j);
+
+            if ((sec!=NULL) && (sec->data!=NULL))
+            {
+              fwrite(sec->data, 1, sec->datasize, diskimage);
+            }
+            else
+            {
+              fwrite(blanksector, 1, sectorsize, diskimage);
+              missingsectors++;
+            }
+          }
+        }
+      }
+    }
+    else
+      return IMAGE_NOSECTORS;
+  }
+  else
+    return IMAGE_UNKNOWNFORMAT;
+
+  return missingsectors;
+}
@@ -0,0 +1,34 @@
+#ifndef _IMAGE_H_
+#define _IMAGE_H_
+
+#include <stdio.h>
+
+#include "diskstore.h"
+
+// For type of output
+#define IMAGENONE 0
+#define IMAGERAW 1
+#define IMAGESSD 2
+#define IMAGEDSD 3
+#define IMAGEFSD 4
+#define IMAGEDFI 5
+#define IMAGEIMG 6
+#define IMAGETD0 7
+#define IMAGESCP 8
+#define IMAGESDD 9
+#define IMAGEDDD 10
+
+// Reasons for a disk image not being written
+#define IMAGE_NOSECTORS -1
+#define IMAGE_UNKNOWNFORMAT -2
+
+// Find type of disk image from filename extension, IMAGENONE if not a disk image
+extern int image_findtype(const char *filename);
+
+// Use title from a recognised filesystem when none was given, falling back to "NO TITLE"
+extern void image_gettitle(Disk_Store *store, const unsigned int disktracks, char *title, const int titlelen);
+
+// Write sectors from the store as a disk image, returns number of missing sectors or one of the above
+extern int image_write(Disk_Store *store, FILE *diskimage, const int outputtype, const unsigned int disktracks, const unsigned int maxtracks, const int sides, const int sidetoread, const int sectorspertrack, char *title, const int titlelen);
+
+#endif
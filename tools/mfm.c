@@ -7,31 +7,6 @@
 #include "mfm.h"
 #include "pll.h"
 
-int mfm_state=MFM_SYNC; // state machine
-unsigned int mfm_datacells=0; // 16 bit sliding buffer
-int mfm_bits=0; // Number of used bits within sliding buffer
-unsigned int mfm_p1, mfm_p2, mfm_p3=0; // bit history
-
-// Most recent address mark
-unsigned long mfm_idpos, mfm_blockpos;
-int mfm_idamtrack, mfm_idamhead, mfm_idamsector, mfm_idamlength; // IDAM values
-int mfm_lasttrack, mfm_lasthead, mfm_lastsector, mfm_lastlength;
-unsigned char mfm_blocktype;
-unsigned int mfm_blocksize;
-unsigned int mfm_idblockcrc, mfm_datablockcrc, mfm_bitstreamcrc;
-
-// Output block data buffer, for a single sector
-unsigned char mfm_bitstream[MFM_BLOCKSIZE];
-unsigned int mfm_bitlen=0;
-
-// MFM timings
-float mfm_defaultwindow;
-float mfm_bucket01, mfm_bucket001, mfm_bucket0001;
-
-struct PLL *mfm_pll;
-
-int mfm_debug=0;
-
 // Validate clock bits against data bits
 void mfm_validateclock(const unsigned char clock, const unsigned char data)
 {
@@ -41,59 +16,72 @@ void mfm_validateclock(const unsigned char clock, const unsigned char data)
   // TODO
 }
 
+// Append a byte to the current block, the running CRC lags two bytes behind so
+// it excludes the block's own CRC, and is ready as soon as the last byte arrives
+static inline void mfm_addbyte(MFM_Context *mfm, const unsigned char data)
+{
+  if (mfm->bitlen==0)
+    mfm->blockcrc=CRC_CCITT_INITIAL;
+  else
+  if (mfm->bitlen>=2)
+    mfm->blockcrc=crc_update(mfm->blockcrc, mfm->bitstream[mfm->bitlen-2]);
+
+  mfm->bitstream[mfm->bitlen++]=data;
+}
+
 // Add a bit to the 16-bit accumulator, when full - attempt to process (clock + data)
-void mfm_addbit(const unsigned char bit, const unsigned long datapos)
+void mfm_addbit(MFM_Context *mfm, const unsigned char bit, const unsigned long datapos)
 {
   // Maintain previous 48 bits of data
-  mfm_p1=((mfm_p1<<1)|((mfm_p2&0x8000)>>15))&0xffff;
-  mfm_p2=((mfm_p2<<1)|((mfm_p3&0x8000)>>15))&0xffff;
-  mfm_p3=((mfm_p3<<1)|((mfm_datacells&0x8000)>>15))&0xffff;
+  mfm->p1=((mfm->p1<<1)|((mfm->p2&0x8000)>>15))&0xffff;
+  mfm->p2=((mfm->p2<<1)|((mfm->p3&0x8000)>>15))&0xffff;
+  mfm->p3=((mfm->p3<<1)|((mfm->datacells&0x8000)>>15))&0xffff;
 
-  mfm_datacells=((mfm_datacells<<1)&0xffff);
-  mfm_datacells|=bit;
-  mfm_bits++;
+  mfm->datacells=((mfm->datacells<<1)&0xffff);
+  mfm->datacells|=bit;
+  mfm->bits++;
 
-  if (mfm_bits>=16)
+  if (mfm->bits>=16)
   {
     unsigned char clock, data;
     unsigned char dataCRC; // EDC
 
     // Extract clock byte
-    clock=mod_getclock(mfm_datacells);
+    clock=mod_getclock(mfm->datacells);
 
     // Extract data byte
-    data=mod_getdata(mfm_datacells);
+    data=mod_getdata(mfm->datacells);
 
-    switch (mfm_state)
+    switch (mfm->state)
     {
       case MFM_SYNC:
-        if ((mfm_datacells==0x5224) && (mod_getdata(mfm_p1)==MFM_ACCESS_SYNC) && (mod_getdata(mfm_p2)==MFM_ACCESS_INDEX) && (mod_getdata(mfm_p3)==MFM_ACCESS_INDEX))
+        if ((mfm->datacells==0x5224) && (mod_getdata(mfm->p1)==MFM_ACCESS_SYNC) && (mod_getdata(mfm->p2)==MFM_ACCESS_INDEX) && (mod_getdata(mfm->p3)==MFM_ACCESS_INDEX))
         {
-          if (mfm_debug)
+          if (mfm->debug)
           {
-            fprintf(stderr, "[%lx] ==MFM IAM SYNC [%x %x %x] %x==\n", datapos, mfm_p1, mfm_p2, mfm_p3, mfm_datacells);
+            fprintf(stderr, "[%lx] ==MFM IAM SYNC [%x %x %x] %x==\n", datapos, mfm->p1, mfm->p2, mfm->p3, mfm->datacells);
 
-            fprintf(stderr, "[%lx] ==  MFM access marks [%.2x %.2x %.2x] %.2x==\n", datapos, mod_getdata(mfm_p1), mod_getdata(mfm_p2), mod_getdata(mfm_p3), data);
+            fprintf(stderr, "[%lx] ==  MFM access marks [%.2x %.2x %.2x] %.2x==\n", datapos, mod_getdata(mfm->p1), mod_getdata(mfm->p2), mod_getdata(mfm->p3), data);
           }
 
-          mfm_bits=16; // Keep looking for sync (preventing overflow)
+          mfm->bits=16; // Keep looking for sync (preventing overflow)
         }
         else
-        if ((mfm_datacells==0x4489) && (mod_getdata(mfm_p1)==MFM_ACCESS_SYNC) && (mod_getdata(mfm_p2)==MFM_ACCESS_SECTOR) && (mod_getdata(mfm_p3)==MFM_ACCESS_SECTOR))
+        if ((mfm->datacells==0x4489) && (mod_getdata(mfm->p1)==MFM_ACCESS_SYNC) && (mod_getdata(mfm->p2)==MFM_ACCESS_SECTOR) && (mod_getdata(mfm->p3)==MFM_ACCESS_SECTOR))
         {
-          if (mfm_debug)
-            fprintf(stderr, "[%lx] ==MFM IDAM/DAM SYNC [%x %x %x] %x==\n", datapos, mfm_p1, mfm_p2, mfm_p3, mfm_datacells);
+          if (mfm->debug)
+            fprintf(stderr, "[%lx] ==MFM IDAM/DAM SYNC [%x %x %x] %x==\n", datapos, mfm->p1, mfm->p2, mfm->p3, mfm->datacells);
 
-          mfm_bits=0;
-          mfm_bitlen=0; // Clear output buffer
+          mfm->bits=0;
+          mfm->bitlen=0; // Clear output buffer
 
-          if (mfm_debug)
-            fprintf(stderr, "[%lx] ==  MFM access marks [%.2x %.2x %.2x] %.2x==\n", datapos, mod_getdata(mfm_p1), mod_getdata(mfm_p2), mod_getdata(mfm_p3), data);
+          if (mfm->debug)
+            fprintf(stderr, "[%lx] ==  MFM access marks [%.2x %.2x %.2x] %.2x==\n", datapos, mod_getdata(mfm->p1), mod_getdata(mfm->p2), mod_getdata(mfm->p3), data);
 
-          mfm_state=MFM_MARK; // Move on to look for MFM address mark
+          mfm->state=MFM_MARK; // Move on to look for MFM address mark
         }
         else
-          mfm_bits=16; // Keep looking for sync (preventing overflow)
+          mfm->bits=16; // Keep looking for sync (preventing overflow)
         break;
 
       case MFM_MARK:
@@ -103,28 +91,28 @@ void mfm_addbit(const unsigned char bit, const unsigned long datapos)
           case MFM_ALTBLOCKADDR: // ff - Alternative IDAM
           case M2FM_BLOCKADDR: // 0e - Intel M2FM IDAM
           case M2FM_HPBLOCKADDR: // 70 - HP M2FM IDAM
-            if (mfm_debug)
-              fprintf(stderr, "[%lx] MFM ID Address Mark [%.2x %.2x %.2x] %.2x\n", datapos, mod_getdata(mfm_p1), mod_getdata(mfm_p2), mod_getdata(mfm_p3), data);
+            if (mfm->debug)
+              fprintf(stderr, "[%lx] MFM ID Address Mark [%.2x %.2x %.2x] %.2x\n", datapos, mod_getdata(mfm->p1), mod_getdata(mfm->p2), mod_getdata(mfm->p3), data);
 
-            mfm_bits=0;
-            mfm_blocktype=data;
+            mfm->bits=0;
+            mfm->blocktype=data;
 
-            mfm_bitlen=0;
-            mfm_bitstream[mfm_bitlen++]=mod_getdata(mfm_p1);
-            mfm_bitstream[mfm_bitlen++]=mod_getdata(mfm_p2);
-            mfm_bitstream[mfm_bitlen++]=mod_getdata(mfm_p3);
-            mfm_bitstream[mfm_bitlen++]=data;
+            mfm->bitlen=0;
+            mfm_addbyte(mfm, mod_getdata(mfm->p1));
+            mfm_addbyte(mfm, mod_getdata(mfm->p2));
+            mfm_addbyte(mfm, mod_getdata(mfm->p3));
+            mfm_addbyte(mfm, data);
 
-            mfm_blocksize=3+1+4+2;
+            mfm->blocksize=3+1+4+2;
 
             // Clear IDAM cache incase previous was good and this one is bad
-            mfm_idamtrack=-1;
-            mfm_idamhead=-1;
-            mfm_idamsector=-1;
-            mfm_idamlength=-1;
+            mfm->idamtrack=-1;
+            mfm->idamhead=-1;
+            mfm->idamsector=-1;
+            mfm->idamlength=-1;
 
-            mfm_idpos=datapos;
-            mfm_state=MFM_ADDR;
+            mfm->idpos=datapos;
+            mfm->state=MFM_ADDR;
             break;
 
           case MFM_BLOCKDATA: // fb - DAM
@@ -132,109 +120,109 @@ void mfm_addbit(const unsigned char bit, const unsigned long datapos)
           case MFM_RX02BLOCKDATA: // fd - RX02 M2FM DAM
           case M2FM_BLOCKDATA: // 0b - Intel M2FM DAM
           case M2FM_HPBLOCKDATA: // 50 - HP M2FM DAM
-            if (mfm_debug)
-              fprintf(stderr, "[%lx] MFM Data Address Mark [%.2x %.2x %.2x] %.2x\n", datapos, mod_getdata(mfm_p1), mod_getdata(mfm_p2), mod_getdata(mfm_p3), data);
+            if (mfm->debug)
+              fprintf(stderr, "[%lx] MFM Data Address Mark [%.2x %.2x %.2x] %.2x\n", datapos, mod_getdata(mfm->p1), mod_getdata(mfm->p2), mod_getdata(mfm->p3), data);
 
             // Don't process if don't have a valid preceding IDAM
-            if ((mfm_idamtrack!=-1) && (mfm_idamhead!=-1) && (mfm_idamsector!=-1) && (mfm_idamlength!=-1))
+            if ((mfm->idamtrack!=-1) && (mfm->idamhead!=-1) && (mfm->idamsector!=-1) && (mfm->idamlength!=-1))
             {
-              mfm_bits=0;
-              mfm_blocktype=data;
+              mfm->bits=0;
+              mfm->blocktype=data;
 
-              mfm_bitlen=0;
-              mfm_bitstream[mfm_bitlen++]=mod_getdata(mfm_p1);
-              mfm_bitstream[mfm_bitlen++]=mod_getdata(mfm_p2);
-              mfm_bitstream[mfm_bitlen++]=mod_getdata(mfm_p3);
-              mfm_bitstream[mfm_bitlen++]=data;
+              mfm->bitlen=0;
+              mfm_addbyte(mfm, mod_getdata(mfm->p1));
+              mfm_addbyte(mfm, mod_getdata(mfm->p2));
+              mfm_addbyte(mfm, mod_getdata(mfm->p3));
+              mfm_addbyte(mfm, data);
 
-              mfm_blockpos=datapos;
-              mfm_state=MFM_DATA;
+              mfm->blockpos=datapos;
+              mfm->state=MFM_DATA;
             }
             else
             {
-              mfm_blocktype=MFM_BLOCKNULL;
-              mfm_bitlen=0;
-              mfm_state=MFM_SYNC;
+              mfm->blocktype=MFM_BLOCKNULL;
+              mfm->bitlen=0;
+              mfm->state=MFM_SYNC;
             }
             break;
 
           case MFM_BLOCKDELDATA: // f8 - DDAM
           case MFM_ALTBLOCKDELDATA: // f9 - Alternative DDAM
           case M2FM_BLOCKDELDATA: // 08 - Intel M2FM DDAM
-            if (mfm_debug)
-              fprintf(stderr, "[%lx] MFM Deleted Data Address Mark [%.2x %.2x %.2x] %.2x\n", datapos, mod_getdata(mfm_p1), mod_getdata(mfm_p2), mod_getdata(mfm_p3), data);
+            if (mfm->debug)
+              fprintf(stderr, "[%lx] MFM Deleted Data Address Mark [%.2x %.2x %.2x] %.2x\n", datapos, mod_getdata(mfm->p1), mod_getdata(mfm->p2), mod_getdata(mfm->p3), data);
 
             // Don't process if don't have a valid preceding IDAM
-            if ((mfm_idamtrack!=-1) && (mfm_idamhead!=-1) && (mfm_idamsector!=-1) && (mfm_idamlength!=-1))
+            if ((mfm->idamtrack!=-1) && (mfm->idamhead!=-1) && (mfm->idamsector!=-1) && (mfm->idamlength!=-1))
             {
-              mfm_bits=0;
-              mfm_blocktype=data;
+              mfm->bits=0;
+              mfm->blocktype=data;
 
-              mfm_bitlen=0;
-              mfm_bitstream[mfm_bitlen++]=mod_getdata(mfm_p1);
-              mfm_bitstream[mfm_bitlen++]=mod_getdata(mfm_p2);
-              mfm_bitstream[mfm_bitlen++]=mod_getdata(mfm_p3);
-              mfm_bitstream[mfm_bitlen++]=data;
+              mfm->bitlen=0;
+              mfm_addbyte(mfm, mod_getdata(mfm->p1));
+              mfm_addbyte(mfm, mod_getdata(mfm->p2));
+              mfm_addbyte(mfm, mod_getdata(mfm->p3));
+              mfm_addbyte(mfm, data);
 
-              mfm_blockpos=datapos;
-              mfm_state=MFM_DATA;
+              mfm->blockpos=datapos;
+              mfm->state=MFM_DATA;
             }
             else
             {
-              mfm_blocktype=MFM_BLOCKNULL;
-              mfm_bitlen=0;
-              mfm_state=MFM_SYNC;
+              mfm->blocktype=MFM_BLOCKNULL;
+              mfm->bitlen=0;
+              mfm->state=MFM_SYNC;
             }
             break;
 
           default:
             break;
         }
-        mfm_bits=0;
+        mfm->bits=0;
         break;
 
       case MFM_ADDR:
-        if (mfm_bitlen<mfm_blocksize)
+        if (mfm->bitlen<mfm->blocksize)
         {
-          mfm_bitstream[mfm_bitlen++]=data;
-          mfm_bits=0;
+          mfm_addbyte(mfm, data);
+          mfm->bits=0;
         }
         else
         {
-          mfm_idblockcrc=calc_crc(&mfm_bitstream[0], mfm_bitlen-2);
-          mfm_bitstreamcrc=(((unsigned int)mfm_bitstream[mfm_bitlen-2]<<8)|mfm_bitstream[mfm_bitlen-1]);
-          dataCRC=(mfm_idblockcrc==mfm_bitstreamcrc)?GOODDATA:BADDATA;
+          mfm->idblockcrc=mfm->blockcrc;
+          mfm->bitstreamcrc=(((unsigned int)mfm->bitstream[mfm->bitlen-2]<<8)|mfm->bitstream[mfm->bitlen-1]);
+          dataCRC=(mfm->idblockcrc==mfm->bitstreamcrc)?GOODDATA:BADDATA;
 
-          if (mfm_debug)
+          if (mfm->debug)
           {
-            fprintf(stderr, "[%lx] MFM Track %.02d ", datapos, mfm_bitstream[4]);
-            fprintf(stderr, "Head %d ", mfm_bitstream[5]);
-            fprintf(stderr, "Sector %.02d ", mfm_bitstream[6]);
-            fprintf(stderr, "Data size %d ", mfm_bitstream[7]);
-            fprintf(stderr, "CRC %.2x%.2x ", mfm_bitstream[mfm_bitlen-2], mfm_bitstream[mfm_bitlen-1]);
+            fprintf(stderr, "[%lx] MFM Track %.02d ", datapos, mfm->bitstream[4]);
+            fprintf(stderr, "Head %d ", mfm->bitstream[5]);
+            fprintf(stderr, "Sector %.02d ", mfm->bitstream[6]);
+            fprintf(stderr, "Data size %d ", mfm->bitstream[7]);
+            fprintf(stderr, "CRC %.2x%.2x ", mfm->bitstream[mfm->bitlen-2], mfm->bitstream[mfm->bitlen-1]);
 
             if (dataCRC==GOODDATA)
               fprintf(stderr, "OK\n");
             else
-              fprintf(stderr, "BAD (%.4x)\n", mfm_idblockcrc);
+              fprintf(stderr, "BAD (%.4x)\n", mfm->idblockcrc);
           }
 
           if (dataCRC==GOODDATA)
           {
             // Record IDAM values
-            mfm_idamtrack=mfm_bitstream[4];
-            mfm_idamhead=mfm_bitstream[5];
-            mfm_idamsector=mfm_bitstream[6];
-            mfm_idamlength=mfm_bitstream[7];
+            mfm->idamtrack=mfm->bitstream[4];
+            mfm->idamhead=mfm->bitstream[5];
+            mfm->idamsector=mfm->bitstream[6];
+            mfm->idamlength=mfm->bitstream[7];
 
             // Record last known good IDAM values for this track
-            mfm_lasttrack=mfm_idamtrack;
-            mfm_lasthead=mfm_idamhead;
-            mfm_lastsector=mfm_idamsector;
-            mfm_lastlength=mfm_idamlength;
+            mfm->lasttrack=mfm->idamtrack;
+            mfm->lasthead=mfm->idamhead;
+            mfm->lastsector=mfm->idamsector;
+            mfm->lastlength=mfm->idamlength;
 
             // Sanitise data block length
-            switch(mfm_idamlength)
+            switch(mfm->idamlength)
             {
               case 0x00: // 128
               case 0x01: // 256
@@ -244,136 +232,149 @@ void mfm_addbit(const unsigned char bit, const unsigned long datapos)
               case 0x05: // 4096
               case 0x06: // 8192
               case 0x07: // 16384
-                mfm_blocksize=3+1+(128<<mfm_idamlength)+2;
+                mfm->blocksize=3+1+(128<<mfm->idamlength)+2;
                 break;
 
               default:
-                if (mfm_debug)
-                  fprintf(stderr, "Invalid record length %.2x\n", mfm_idamlength);
+                if (mfm->debug)
+                  fprintf(stderr, "Invalid record length %.2x\n", mfm->idamlength);
                 break;
             }
           }
           else
           {
             // IDAM failed CRC, ignore following data block (for now)
-            mfm_idpos=0;
-            mfm_idamtrack=-1;
-            mfm_idamhead=-1;
-            mfm_idamsector=-1;
-            mfm_idamlength=-1;
+            mfm->idpos=0;
+            mfm->idamtrack=-1;
+            mfm->idamhead=-1;
+            mfm->idamsector=-1;
+            mfm->idamlength=-1;
           }
 
-          mfm_state=MFM_SYNC;
+          mfm->state=MFM_SYNC;
         }
         break;
 
       case MFM_DATA:
         // Validate clock bits against this data byte
-        if (mfm_debug)
+        if (mfm->debug)
           mfm_validateclock(data, clock);
 
-        if (mfm_bitlen<mfm_blocksize)
+        if (mfm->bitlen<mfm->blocksize)
         {
-          mfm_bitstream[mfm_bitlen++]=data;
-          mfm_bits=0;
+          mfm_addbyte(mfm, data);
+          mfm->bits=0;
         }
         else
         {
-          mfm_datablockcrc=calc_crc(&mfm_bitstream[0], mfm_bitlen-2);
-          mfm_bitstreamcrc=(((unsigned int)mfm_bitstream[mfm_bitlen-2]<<8)|mfm_bitstream[mfm_bitlen-1]);
-          dataCRC=(mfm_datablockcrc==mfm_bitstreamcrc)?GOODDATA:BADDATA;
+          mfm->datablockcrc=mfm->blockcrc;
+          mfm->bitstreamcrc=(((unsigned int)mfm->bitstream[mfm->bitlen-2]<<8)|mfm->bitstream[mfm->bitlen-1]);
+          dataCRC=(mfm->datablockcrc==mfm->bitstreamcrc)?GOODDATA:BADDATA;
 
-          if (mfm_debug)
+          if (mfm->debug)
           {
-            fprintf(stderr, "[%lx] MFM DATA block %.2x ", datapos, mfm_blocktype);
-            fprintf(stderr, "CRC %.2x%.2x ", mfm_bitstream[mfm_bitlen-2], mfm_bitstream[mfm_bitlen-1]);
+            fprintf(stderr, "[%lx] MFM DATA block %.2x ", datapos, mfm->blocktype);
+            fprintf(stderr, "CRC %.2x%.2x ", mfm->bitstream[mfm->bitlen-2], mfm->bitstream[mfm->bitlen-1]);
 
             if (dataCRC==GOODDATA)
               fprintf(stderr, "OK\n");
             else
-              fprintf(stderr, "BAD (%.4x)\n", mfm_datablockcrc);
+              fprintf(stderr, "BAD (%.4x)\n", mfm->datablockcrc);
           }
 
           if (dataCRC==GOODDATA)
           {
-            if (diskstore_addsector(MODMFM, hw_currenttrack, hw_currenthead, mfm_idamtrack, mfm_idamhead, mfm_idamsector, mfm_idamlength, mfm_idpos, mfm_idblockcrc, mfm_blockpos, mfm_blocktype, mfm_blocksize-3-1-2, &mfm_bitstream[4], mfm_datablockcrc)==1)
+            if (diskstore_addsector(mfm->store, MODMFM, mfm->physical_track, mfm->physical_head, mfm->idamtrack, mfm->idamhead, mfm->idamsector, mfm->idamlength, mfm->idpos, mfm->idblockcrc, mfm->blockpos, mfm->blocktype, mfm->blocksize-3-1-2, &mfm->bitstream[4], mfm->datablockcrc, datapos)==1)
             {
-              if (mfm_debug)
-                fprintf(stderr, "** MFM new sector T%d H%d - C%d H%d R%d N%d - IDCRC %.4x DATACRC %.4x **\n", hw_currenttrack, hw_currenthead, mfm_idamtrack, mfm_idamhead, mfm_idamsector, mfm_idamlength, mfm_idblockcrc, mfm_datablockcrc);
+              mfm->sectorsfound++;
+
+              if (mfm->debug)
+                fprintf(stderr, "** MFM new sector T%d H%d - C%d H%d R%d N%d - IDCRC %.4x DATACRC %.4x **\n", mfm->physical_track, mfm->physical_head, mfm->idamtrack, mfm->idamhead, mfm->idamsector, mfm->idamlength, mfm->idblockcrc, mfm->datablockcrc);
             }
           }
 
           // Require subsequent data blocks to have a valid ID block first
-          mfm_idpos=0;
-          mfm_idamtrack=-1;
-          mfm_idamhead=-1;
-          mfm_idamsector=-1;
-          mfm_idamlength=-1;
+          mfm->idpos=0;
+          mfm->idamtrack=-1;
+          mfm->idamhead=-1;
+          mfm->idamsector=-1;
+          mfm->idamlength=-1;
 
-          mfm_state=MFM_SYNC;
+          mfm->state=MFM_SYNC;
         }
         break;
 
       default:
         // Unknown state, put it back to SYNC
-        mfm_p1=0;
-        mfm_p2=0;
-        mfm_p3=0;
-        mfm_bits=0;
+        mfm->p1=0;
+        mfm->p2=0;
+        mfm->p3=0;
+        mfm->bits=0;
 
-        mfm_state=MFM_SYNC;
+        mfm->state=MFM_SYNC;
         break;
     }
   }
 }
 
-void mfm_addsample(const unsigned long samples, const unsigned long datapos, const int usepll)
+// Receive a bit recovered by the PLL
+static void mfm_pllbit(void *context, const unsigned char bit, const unsigned long datapos)
+{
+  mfm_addbit((MFM_Context *)context, bit, datapos);
+}
+
+void mfm_addsample(MFM_Context *mfm, const unsigned long samples, const unsigned long datapos, const int usepll)
 {
   if (usepll)
   {
-    PLL_addsample(mfm_pll, samples, datapos);
+    PLL_addsample(&mfm->pll, samples, datapos);
 
     return;
   }
 
   // Does number of samples fit within "01" bucket ..
-  if (samples<=mfm_bucket01)
+  if (samples<=mfm->bucket01)
   {
-    mfm_addbit(0, datapos);
-    mfm_addbit(1, datapos);
+    mfm_addbit(mfm, 0, datapos);
+    mfm_addbit(mfm, 1, datapos);
   }
   else // .. does number of samples fit within "001" bucket ..
-  if (samples<=mfm_bucket001)
+  if (samples<=mfm->bucket001)
   {
-    mfm_addbit(0, datapos);
-    mfm_addbit(0, datapos);
-    mfm_addbit(1, datapos);
+    mfm_addbit(mfm, 0, datapos);
+    mfm_addbit(mfm, 0, datapos);
+    mfm_addbit(mfm, 1, datapos);
   }
   else // .. does number of samples fit within "0001" bucket ..
-  if (samples<=mfm_bucket0001)
+  if (samples<=mfm->bucket0001)
   {
-    mfm_addbit(0, datapos);
-    mfm_addbit(0, datapos);
-    mfm_addbit(0, datapos);
-    mfm_addbit(1, datapos);
+    mfm_addbit(mfm, 0, datapos);
+    mfm_addbit(mfm, 0, datapos);
+    mfm_addbit(mfm, 0, datapos);
+    mfm_addbit(mfm, 1, datapos);
   }
   else
   {
     // TODO This shouldn't happen in MFM encoding
-    mfm_addbit(0, datapos);
-    mfm_addbit(0, datapos);
-    mfm_addbit(0, datapos);
-    mfm_addbit(0, datapos);
-    mfm_addbit(1, datapos);
+    mfm_addbit(mfm, 0, datapos);
+    mfm_addbit(mfm, 0, datapos);
+    mfm_addbit(mfm, 0, datapos);
+    mfm_addbit(mfm, 0, datapos);
+    mfm_addbit(mfm, 1, datapos);
   }
 }
 
-void mfm_init(const int debug, const char density)
+void mfm_init(MFM_Context *mfm, const int debug, const char density, Disk_Store *store, const uint8_t physical_track, const uint8_t physical_head, const float rpm, const unsigned long samplerate)
 {
   float bitcell=MFM_BITCELLDD;
   float diff;
 
-  mfm_debug=debug;
+  mfm->debug=debug;
+
+  mfm->store=store;
+  mfm->physical_track=physical_track;
+  mfm->physical_head=physical_head;
+  mfm->sectorsfound=0;
 
   if ((density&MOD_DENSITYMFMED)!=0)
     bitcell=MFM_BITCELLED;
@@ -382,58 +383,61 @@ void mfm_init(const int debug, const char density)
     bitcell=MFM_BITCELLHD;
 
   // Adjust bitcell for RPM
-  bitcell=(bitcell/hw_rpm)*(float)HW_DEFAULTRPM;
+  bitcell=(bitcell/rpm)*(float)HW_DEFAULTRPM;
 
   // Determine number of samples between "1" pulses (default window)
-  mfm_defaultwindow=((float)hw_samplerate/(float)USINSECOND)*bitcell;
+  mfm->defaultwindow=((float)samplerate/(float)USINSECOND)*bitcell;
 
-  if (mfm_pll!=NULL)
-    PLL_reset(mfm_pll, mfm_defaultwindow);
-  else
-    mfm_pll=PLL_create(mfm_defaultwindow, mfm_addbit);
+  PLL_init(&mfm->pll, mfm->defaultwindow, mfm_pllbit, mfm);
 
   // From default window, determine ideal sample times for assigning bits "01", "001" or "0001"
-  mfm_bucket01=mfm_defaultwindow;
-  mfm_bucket001=(mfm_defaultwindow/2)*3;
-  mfm_bucket0001=(mfm_defaultwindow/2)*4;
+  mfm->bucket01=mfm->defaultwindow;
+  mfm->bucket001=(mfm->defaultwindow/2)*3;
+  mfm->bucket0001=(mfm->defaultwindow/2)*4;
 
   // Increase bucket sizes to halfway between peaks
-  diff=mfm_bucket001-mfm_bucket01;
-  mfm_bucket01+=(diff/2);
-  mfm_bucket001+=(diff/2);
-  mfm_bucket0001+=(diff/2);
+  diff=mfm->bucket001-mfm->bucket01;
+  mfm->bucket01+=(diff/2);
+  mfm->bucket001+=(diff/2);
+  mfm->bucket0001+=(diff/2);
 
   // Set up MFM parser
-  mfm_state=MFM_SYNC;
-  mfm_datacells=0;
-  mfm_bits=0;
+  mfm->state=MFM_SYNC;
+  mfm->datacells=0;
+  mfm->bits=0;
 
-  mfm_idpos=0;
-  mfm_blockpos=0;
+  mfm->idpos=0;
+  mfm->blockpos=0;
 
-  mfm_blocktype=MFM_BLOCKNULL;
-  mfm_blocksize=0;
+  mfm->blocktype=MFM_BLOCKNULL;
+  mfm->blocksize=0;
 
-  mfm_idblockcrc=0;
-  mfm_datablockcrc=0;
-  mfm_bitstreamcrc=0;
+  mfm->idblockcrc=0;
+  mfm->datablockcrc=0;
+  mfm->bitstreamcrc=0;
 
-  mfm_bitlen=0;
+  mfm->bitlen=0;
 
   // Initialise previous data cache
-  mfm_p1=0;
-  mfm_p2=0;
-  mfm_p3=0;
+  mfm->p1=0;
+  mfm->p2=0;
+  mfm->p3=0;
 
   // Initialise last found sector IDAM to invalid
-  mfm_idamtrack=-1;
-  mfm_idamhead=-1;
-  mfm_idamsector=-1;
-  mfm_idamlength=-1;
+  mfm->idamtrack=-1;
+  mfm->idamhead=-1;
+  mfm->idamsector=-1;
+  mfm->idamlength=-1;
 
   // Initialise last known good sector IDAM to invalid
-  mfm_lasttrack=-1;
-  mfm_lasthead=-1;
-  mfm_lastsector=-1;
-  mfm_lastlength=-1;
+  mfm->lasttrack=-1;
+  mfm->lasthead=-1;
+  mfm->lastsector=-1;
+  mfm->lastlength=-1;
+}
+
+// Finish processing, returning how many new sectors were stored
+unsigned int mfm_finish(MFM_Context *mfm)
+{
+  return mfm->sectorsfound;
 }
@@ -1,6 +1,9 @@
 #ifndef _MFM_H_
 #define _MFM_H_
 
+#include "diskstore.h"
+#include "pll.h"
+
 // Microseconds in a bitcell window for double density MFM at 300 RPM
 #define MFM_BITCELLDD 4
 // Microseconds in a bitcell window for high density MFM at 300 RPM
@@ -46,11 +49,44 @@
 #define MFM_ADDR 3
 #define MFM_DATA 4
 
-extern int mfm_idamtrack, mfm_idamhead, mfm_idamsector, mfm_idamlength;
-extern int mfm_lasttrack, mfm_lasthead, mfm_lastsector, mfm_lastlength;
+typedef struct MFMContext
+{
+  int debug;
+
+  // Where to store found sectors, and which track they came from
+  Disk_Store *store;
+  uint8_t physical_track;
+  uint8_t physical_head;
+  unsigned int sectorsfound;
+
+  int state; // state machine
+  unsigned int datacells; // 16 bit sliding buffer
+  int bits; // Number of used bits within sliding buffer
+  unsigned int p1, p2, p3; // bit history
+
+  // Most recent address mark
+  unsigned long idpos, blockpos;
+  int idamtrack, idamhead, idamsector, idamlength; // IDAM values
+  int lasttrack, lasthead, lastsector, lastlength;
+  unsigned char blocktype;
+  unsigned int blocksize;
+  unsigned int idblockcrc, datablockcrc, bitstreamcrc;
+
+  // Output block data buffer, for a single sector
+  unsigned char bitstream[MFM_BLOCKSIZE];
+  unsigned int bitlen;
+  uint16_t blockcrc; // CRC of all but the last two bytes of bitstream
+
+  // MFM timings
+  float defaultwindow;
+  float bucket01, bucket001, bucket0001;
+
+  struct PLL pll;
+} MFM_Context;
 
-extern void mfm_addsample(const unsigned long samples, const unsigned long datapos, const int usepll);
+extern void mfm_addsample(MFM_Context *mfm, const unsigned long samples, const unsigned long datapos, const int usepll);
 
-extern void mfm_init(const int debug, const char density);
+extern void mfm_init(MFM_Context *mfm, const int debug, const char density, Disk_Store *store, const uint8_t physical_track, const uint8_t physical_head, const float rpm, const unsigned long samplerate);
+extern unsigned int mfm_finish(MFM_Context *mfm);
 
 #endif
@@ -1,6 +1,11 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
 
+#include "crc.h"
 #include "hardware.h"
+#include "diskstore.h"
+#include "flux.h"
 #include "fm.h"
 #include "mfm.h"
 #include "amigamfm.h"
@@ -8,113 +13,72 @@
 #include "gcr.h"
 #include "mod.h"
 
-int mod_debug=0;
-unsigned long mod_datapos;
-unsigned long mod_samplesize;
-
-unsigned long mod_hist[MOD_HISTOGRAMSIZE];
-int mod_peak[MOD_PEAKSIZE];
-int mod_peaks;
-char mod_density=MOD_DENSITYAUTO;
-
-float mod_samplestous(const long samples)
+float mod_samplestous(const unsigned long samplerate, const long samples)
 {
-  return ((float)1/(((float)hw_samplerate)/(float)USINSECOND))*(float)samples;
+  return ((float)1/(((float)samplerate)/(float)USINSECOND))*(float)samples;
 }
 
-long mod_mstosamples(const float ms)
+long mod_mstosamples(const unsigned long samplerate, const float ms)
 {
-  return (ms/((float)1/(((float)hw_samplerate)/(float)USINSECOND)));
+  return (ms/((float)1/(((float)samplerate)/(float)USINSECOND)));
 }
 
-void mod_buildhistogram(const unsigned char *sampledata, const unsigned long samplesize)
+void mod_buildhistogram(Mod_Context *mod, const Flux_Intervals *flux)
 {
+  unsigned long i;
   int j;
-  char level,bi=0;
-  int count;
-  unsigned long datapos;
 
-  if (mod_debug)
-    fprintf(stderr, "Creating histogram for track %d, head %d data sampled at %lu with %.2f rpm\n", hw_currenttrack, hw_currenthead, hw_samplerate, hw_rpm);
+  if (mod->debug)
+    fprintf(stderr, "Creating histogram for track %d, head %d data sampled at %lu with %.2f rpm\n", mod->track, mod->head, mod->samplerate, mod->rpm);
 
   // Clear histogram
-  for (j=0; j<MOD_HISTOGRAMSIZE; j++) mod_hist[j]=0;
+  for (j=0; j<MOD_HISTOGRAMSIZE; j++) mod->hist[j]=0;
 
   // Build histogram
-  level=(sampledata[0]&0x80)>>7;
-  bi=level;
-  count=0;
-
-  for (datapos=0; datapos<samplesize; datapos++)
-  {
-    unsigned char c;
-
-    c=sampledata[datapos];
-
-    for (j=0; j<BITSPERBYTE; j++)
-    {
-      bi=((c&0x80)>>7);
-
-      count++;
-
-      if (bi!=level)
-      {
-        level=1-level;
-
-        // Look for rising edge
-        if (level==1)
-        {
-          if (count<MOD_HISTOGRAMSIZE)
-            mod_hist[count]++;
-
-          count=0;
-        }
-      }
-
-      c=c<<1;
-    }
-  }
+  for (i=0; i<flux->count; i++)
+    if (flux->interval[i]<MOD_HISTOGRAMSIZE)
+      mod->hist[flux->interval[i]]++;
 }
 
-int mod_findpeaks(const unsigned char *sampledata, const unsigned long samplesize)
+int mod_findpeaks(Mod_Context *mod, const Flux_Intervals *flux)
 {
   int j;
   long localmaxima;
   unsigned long threshold;
   int inpeak;
 
-  mod_buildhistogram(sampledata, samplesize);
+  mod_buildhistogram(mod, flux);
 
   // Find largest histogram value
   localmaxima=0;
   for (j=0; j<MOD_HISTOGRAMSIZE; j++)
-    if (mod_hist[j]>mod_hist[localmaxima])
+    if (mod->hist[j]>mod->hist[localmaxima])
       localmaxima=j;
 
-  if (mod_debug)
-    fprintf(stderr, "Maximum peak on track %d, head %d at %ld samples, %.3fms\n", hw_currenttrack, hw_currenthead, localmaxima, mod_samplestous(localmaxima));
+  if (mod->debug)
+    fprintf(stderr, "Maximum peak on track %d, head %d at %ld samples, %.3fms\n", mod->track, mod->head, localmaxima, mod_samplestous(mod->samplerate, localmaxima));
 
   // Set noise threshold at 5% of maximum
-  threshold=mod_hist[localmaxima]/20;
+  threshold=mod->hist[localmaxima]/20;
 
   // Decimate histogram to remove values below threshold
   for (j=0; j<MOD_HISTOGRAMSIZE; j++)
-    if (mod_hist[j]<=threshold)
-      mod_hist[j]=0;
+    if (mod->hist[j]<=threshold)
+      mod->hist[j]=0;
 
   // Find peaks
-  inpeak=0; mod_peaks=0; localmaxima=0;
+  inpeak=0; mod->peaks=0; localmaxima=0;
   for (j=0; j<MOD_HISTOGRAMSIZE; j++)
   {
-    if (mod_hist[j]!=0)
+    if (mod->hist[j]!=0)
     {
-      if (mod_hist[j]>mod_hist[localmaxima])
+      if (mod->hist[j]>mod->hist[localmaxima])
         localmaxima=j;
 
       // Mark the start of a new peak
       if (inpeak==0)
       {
-        mod_peaks++;
+        mod->peaks++;
         inpeak=1;
       }
     }
@@ -122,11 +86,11 @@ int mod_findpeaks(const unsigned char *sampledata, const unsigned long samplesiz
     {
       if (inpeak==1)
       {
-        if (mod_debug)
-          fprintf(stderr, "  Peak at %ld %.3fms\n", localmaxima, mod_samplestous(localmaxima));
+        if (mod->debug)
+          fprintf(stderr, "  Peak at %ld %.3fms\n", localmaxima, mod_samplestous(mod->samplerate, localmaxima));
 
-        if (mod_peaks<MOD_PEAKSIZE)
-          mod_peak[mod_peaks-1]=localmaxima;
+        if (mod->peaks<MOD_PEAKSIZE)
+          mod->peak[mod->peaks-1]=localmaxima;
 
         localmaxima=0;
       }
@@ -135,21 +99,21 @@ int mod_findpeaks(const unsigned char *sampledata, const unsigned long samplesiz
     }
   }
 
-  if (mod_debug)
-    fprintf(stderr, "Found %d peaks\n", mod_peaks);
+  if (mod->debug)
+    fprintf(stderr, "Found %d peaks\n", mod->peaks);
 
-  return mod_peaks;
+  return mod->peaks;
 }
 
-int mod_haspeak(const float ms)
+int mod_haspeak(const Mod_Context *mod, const float ms)
 {
   int i;
 
-  for (i=0; i<mod_peaks; i++)
+  for (i=0; i<mod->peaks; i++)
   {
     float peakms;
 
-    peakms=mod_samplestous(mod_peak[i]);
+    peakms=mod_samplestous(mod->samplerate, mod->peak[i]);
 
     // Look within 10% of nominal
     if ((ms>=(peakms*0.90)) && (ms<=(peakms*1.1)))
@@ -159,51 +123,59 @@ int mod_haspeak(const float ms)
   return 0;
 }
 
-void mod_checkdensity()
+// Classify this track from the histogram peaks, returning the density found
+char mod_checkdensity(Mod_Context *mod)
 {
+  char density=MOD_DENSITYAUTO;
+
   // APPLE GCR
   // 1=4ms, 01=8ms, 001=12ms
-  if ((mod_haspeak(4)+mod_haspeak(8)+mod_haspeak(12))==3)
-  {
-    mod_density|=MOD_DENSITYAPPLEGCR;
-
-    return;
-  }
-
+  if ((mod_haspeak(mod, 4)+mod_haspeak(mod, 8)+mod_haspeak(mod, 12))==3)
+    density=MOD_DENSITYAPPLEGCR;
+  else
   // MFM ED
   // 01=1ms, 001=1.5ms, 0001=2ms
-  if ((mod_haspeak(1)+mod_haspeak(1.5)+mod_haspeak(2))==3)
-  {
-    mod_density|=MOD_DENSITYMFMED;
-
-    return;
-  }
-
+  if ((mod_haspeak(mod, 1)+mod_haspeak(mod, 1.5)+mod_haspeak(mod, 2))==3)
+    density=MOD_DENSITYMFMED;
+  else
   // MFM HD
   // 01=2ms, 001=3ms, 0001=4ms
-  if ((mod_haspeak(2)+mod_haspeak(3)+mod_haspeak(4))==3)
-  {
-    mod_density|=MOD_DENSITYMFMHD;
-
-    return;
-  }
-
+  if ((mod_haspeak(mod, 2)+mod_haspeak(mod, 3)+mod_haspeak(mod, 4))==3)
+    density=MOD_DENSITYMFMHD;
+  else
   // MFM DD
   // 01=4ms, 001=6ms, 0001=8ms
-  if ((mod_haspeak(4)+mod_haspeak(6)+mod_haspeak(8))==3)
-  {
-    mod_density|=MOD_DENSITYMFMDD;
-
-    return;
-  }
-
+  if ((mod_haspeak(mod, 4)+mod_haspeak(mod, 6)+mod_haspeak(mod, 8))==3)
+    density=MOD_DENSITYMFMDD;
+  else
   // FM SD
   // 1=4ms, 01=8ms
-  if ((mod_haspeak(4)+mod_haspeak(8))==2)
+  if ((mod_haspeak(mod, 4)+mod_haspeak(mod, 8))==2)
+    density=MOD_DENSITYFMSD;
+
+  mod->density|=density;
+
+  return density;
+}
+
+// Determine which decoders could work with the density of this track
+unsigned int mod_densitydecoders(const char density)
+{
+  switch (density)
   {
-    mod_density|=MOD_DENSITYFMSD;
+    case MOD_DENSITYFMSD:
+      return MOD_DECODERBIT(MOD_DECODERFM);
 
-    return;
+    case MOD_DENSITYMFMDD:
+    case MOD_DENSITYMFMHD:
+    case MOD_DENSITYMFMED:
+      return MOD_DECODERBIT(MOD_DECODERMFM)|MOD_DECODERBIT(MOD_DECODERAMIGAMFM);
+
+    case MOD_DENSITYAPPLEGCR:
+      return MOD_DECODERBIT(MOD_DECODERAPPLEGCR);
+
+    default:
+      return MOD_ALLDECODERS;
   }
 }
 
@@ -239,79 +211,376 @@ unsigned char mod_getdata(const unsigned int datacells)
   return data;
 }
 
-void mod_process(const unsigned char *sampledata, const unsigned long samplesize, const int attempt, const int usepll)
+// Set up a decoder ready for a track
+void mod_initdecoder(const Mod_Job *job)
 {
-  unsigned char c, j;
-  int run;
-  (void) attempt;
+  Mod_Context *mod=job->mod;
+  Disk_Store *store=&mod->decoded[job->decoder];
 
-  for (run=0; run<(usepll==0?1:2); run++)
+  switch (job->decoder)
   {
-    unsigned long count;
-    char level,bi=0;
+    case MOD_DECODERFM:
+      fm_init(&mod->fm, mod->debug, mod->density, store, job->physical_track, job->physical_head, job->rpm, mod->samplerate);
+      break;
+
+    case MOD_DECODERAMIGAMFM:
+      amigamfm_init(&mod->amigamfm, mod->debug, mod->density, store, job->physical_track, job->physical_head, job->rpm, mod->samplerate);
+      break;
+
+    case MOD_DECODERMFM:
+      mfm_init(&mod->mfm, mod->debug, mod->density, store, job->physical_track, job->physical_head, job->rpm, mod->samplerate);
+      break;
 
-    mod_samplesize=samplesize;
+    case MOD_DECODERGCR:
+      gcr_init(&mod->gcr, mod->debug, mod->density, store, job->physical_track, job->physical_head, job->rpm);
+      break;
 
-    mod_findpeaks(sampledata, samplesize);
-    mod_checkdensity();
+    case MOD_DECODERAPPLEGCR:
+      applegcr_init(&mod->applegcr, mod->debug, mod->density, store, job->physical_track, job->physical_head, job->rpm, mod->samplerate);
+      break;
+
+    default:
+      break;
+  }
+}
+
+// See if a decoder has found everything on this track, so can stop early
+int mod_trackcomplete(const Mod_Job *job)
+{
+  Mod_Context *mod=job->mod;
+  Disk_Store *store=&mod->decoded[job->decoder];
+  unsigned int ids;
 
-    fm_init(mod_debug, mod_density);
-    amigamfm_init(mod_debug, mod_density);
-    mfm_init(mod_debug, mod_density);
-    gcr_init(mod_debug, mod_density);
-    applegcr_init(mod_debug, mod_density);
+  ids=diskstore_countids(store, job->physical_track, job->physical_head, 0);
+  if (ids==0)
+    return 0;
+
+  if (mod->expectedsectors>0)
+    return (ids>=mod->expectedsectors);
+
+  // Without knowing the format, wait until there are no gaps in the ids and each one has been seen twice
+  if (ids!=(unsigned int)(store->maxsectorid-store->minsectorid+1))
+    return 0;
+
+  return (diskstore_countids(store, job->physical_track, job->physical_head, 1)==ids);
+}
+
+// Run a single decoder over the intervals for this track
+void mod_rundecoder(Mod_Job *job)
+{
+  Mod_Context *mod=job->mod;
+  unsigned long i;
+  unsigned long samplepos;
+  int run;
+
+  job->found=0;
+  job->completedpos=0;
+
+  for (run=0; ((run<(job->usepll==0?1:2)) && (job->completedpos==0)); run++)
+  {
+    mod_initdecoder(job);
 
-    // Set up the sampler
-    level=(sampledata[0]&0x80)>>7;
-    bi=level;
-    count=0;
+    samplepos=0;
 
-    // Process each byte of the raw flux data
-    for (mod_datapos=0; mod_datapos<samplesize; mod_datapos++)
+    // Process each interval between rising edges
+    for (i=0; i<mod->intervals->count; i++)
     {
-      // Extract byte from buffer
-      c=sampledata[mod_datapos];
+      unsigned long count;
+      unsigned long datapos;
 
-      // Process each bit of the extracted byte
-      for (j=0; j<BITSPERBYTE; j++)
+      count=mod->intervals->interval[i];
+
+      // Track which byte of the sample buffer this edge was found in
+      samplepos+=count;
+      datapos=(samplepos-1)/BITSPERBYTE;
+
+      switch (job->decoder)
+      {
+        case MOD_DECODERFM: fm_addsample(&mod->fm, count, datapos, run); break;
+        case MOD_DECODERAMIGAMFM: amigamfm_addsample(&mod->amigamfm, count, datapos, run); break;
+        case MOD_DECODERMFM: mfm_addsample(&mod->mfm, count, datapos, run); break;
+        case MOD_DECODERGCR: gcr_addsample(&mod->gcr, count, datapos, run); break;
+        case MOD_DECODERAPPLEGCR: applegcr_addsample(&mod->applegcr, count, datapos, run); break;
+        default: break;
+      }
+
+      // Periodically check if there is any point carrying on
+      if (((i%MOD_COMPLETECHECK)==(MOD_COMPLETECHECK-1)) && (mod_trackcomplete(job)))
       {
-        // Determine next level
-        bi=((c&0x80)>>7);
-
-        // Increment samples counter
-        count++;
-
-        // Look for level changes
-        if (bi!=level)
-        {
-          // Flip level cache
-          level=1-level;
-
-          // Look for rising edge
-          if (level==1)
-          {
-            fm_addsample(count, mod_datapos, run);
-            amigamfm_addsample(count, mod_datapos, run);
-            mfm_addsample(count, mod_datapos, run);
-            gcr_addsample(count, mod_datapos, run);
-            applegcr_addsample(count, mod_datapos, run);
-
-            // Reset samples counter
-            count=0;
-          }
-        }
-
-        // Move on to next sample level (bit)
-        c=c<<1;
+        job->completedpos=datapos;
+        break;
       }
     }
+
+    switch (job->decoder)
+    {
+      case MOD_DECODERFM: job->found+=fm_finish(&mod->fm); break;
+      case MOD_DECODERAMIGAMFM: job->found+=amigamfm_finish(&mod->amigamfm); break;
+      case MOD_DECODERMFM: job->found+=mfm_finish(&mod->mfm); break;
+      case MOD_DECODERGCR: job->found+=gcr_finish(&mod->gcr); break;
+      case MOD_DECODERAPPLEGCR: job->found+=applegcr_finish(&mod->applegcr); break;
+      default: break;
+    }
   }
 }
 
-// Initialise modulation
-void mod_init(const int debug)
+// Pool worker, takes decoder jobs until told to stop
+void *mod_worker(void *arg)
 {
-  mod_debug=debug;
+  Mod_Context *mod=arg;
+
+  pthread_mutex_lock(&mod->poollock);
+
+  while (1)
+  {
+    Mod_Job *job;
 
-  mod_peaks=0;
+    while ((!mod->poolstop) && (mod->nextjob>=mod->numjobs))
+      pthread_cond_wait(&mod->jobready, &mod->poollock);
+
+    if (mod->poolstop)
+      break;
+
+    job=&mod->jobs[mod->nextjob++];
+
+    pthread_mutex_unlock(&mod->poollock);
+    mod_rundecoder(job);
+    pthread_mutex_lock(&mod->poollock);
+
+    if (--mod->jobsleft==0)
+      pthread_cond_signal(&mod->jobsdone);
+  }
+
+  pthread_mutex_unlock(&mod->poollock);
+
+  return NULL;
+}
+
+// Hand the jobs to the pool and wait for them all to complete
+void mod_runjobs(Mod_Context *mod, const int numjobs)
+{
+  int i;
+
+  if (mod->poolsize==0)
+  {
+    for (i=0; i<numjobs; i++)
+      mod_rundecoder(&mod->jobs[i]);
+
+    return;
+  }
+
+  pthread_mutex_lock(&mod->poollock);
+
+  mod->numjobs=numjobs;
+  mod->nextjob=0;
+  mod->jobsleft=numjobs;
+  pthread_cond_broadcast(&mod->jobready);
+
+  while (mod->jobsleft>0)
+    pthread_cond_wait(&mod->jobsdone, &mod->poollock);
+
+  mod->numjobs=0;
+  mod->nextjob=0;
+
+  pthread_mutex_unlock(&mod->poollock);
+}
+
+// Run the selected decoders, returning which of them found sectors
+unsigned int mod_decode(Mod_Context *mod, const unsigned int decoders, const int usepll)
+{
+  unsigned int found=0;
+  int numjobs=0;
+  int decoder;
+  int i;
+
+  for (decoder=0; decoder<MOD_DECODERS; decoder++)
+  {
+    if ((decoders&MOD_DECODERBIT(decoder))==0)
+      continue;
+
+    mod->jobs[numjobs].mod=mod;
+    mod->jobs[numjobs].decoder=decoder;
+    mod->jobs[numjobs].physical_track=mod->track;
+    mod->jobs[numjobs].physical_head=mod->head;
+    mod->jobs[numjobs].rpm=mod->rpm;
+    mod->jobs[numjobs].usepll=usepll;
+    mod->jobs[numjobs].found=0;
+    mod->jobs[numjobs].completedpos=0;
+    numjobs++;
+  }
+
+  mod_runjobs(mod, numjobs);
+
+  for (i=0; i<numjobs; i++)
+  {
+    if (mod->jobs[i].found>0)
+      found|=MOD_DECODERBIT(mod->jobs[i].decoder);
+
+    if (mod->jobs[i].completedpos>mod->completedpos)
+      mod->completedpos=mod->jobs[i].completedpos;
+  }
+
+  return found;
+}
+
+// Process intervals between rising edges for a given physical track, head and rotation speed
+void mod_processintervals(Mod_Context *mod, const Flux_Intervals *flux, const int attempt, const int usepll, const uint8_t physical_track, const uint8_t physical_head, const float rpm)
+{
+  Mod_Job job;
+  unsigned int decoders;
+  unsigned int found;
+  int decoder;
+  (void) attempt;
+
+  mod->track=physical_track;
+  mod->head=physical_head;
+  mod->rpm=rpm;
+  mod->completedpos=0;
+  mod->intervals=flux;
+
+  mod_findpeaks(mod, mod->intervals);
+
+  // Only try decoders suited to this density, and the format found on earlier tracks
+  decoders=mod_densitydecoders(mod_checkdensity(mod));
+  if ((decoders&mod->lockeddecoders)!=0)
+    decoders&=mod->lockeddecoders;
+
+  // Reset every decoder so those not run don't report stale IDs
+  for (decoder=0; decoder<MOD_DECODERS; decoder++)
+  {
+    job.mod=mod;
+    job.decoder=decoder;
+    job.physical_track=mod->track;
+    job.physical_head=mod->head;
+    job.rpm=mod->rpm;
+    job.usepll=usepll;
+
+    mod_initdecoder(&job);
+  }
+
+  found=mod_decode(mod, decoders, usepll);
+
+  // Nothing found, so fall back to trying the rest
+  if ((found==0) && (decoders!=MOD_ALLDECODERS))
+  {
+    if (mod->debug)
+      fprintf(stderr, "No sectors found with decoders %.2x, trying the rest\n", decoders);
+
+    found=mod_decode(mod, MOD_ALLDECODERS&~decoders, usepll);
+  }
+
+  mod->lockeddecoders|=found;
+
+  // Merge in a fixed order, so results don't depend on thread scheduling
+  for (decoder=0; decoder<MOD_DECODERS; decoder++)
+    diskstore_mergestore(mod->store, &mod->decoded[decoder]);
+
+  // Amiga sectors are reported as MFM
+  if (mod->amigamfm.lasttrack!=-1)
+  {
+    mod->mfm.lasttrack=mod->amigamfm.lasttrack;
+    mod->mfm.lasthead=mod->amigamfm.lasthead;
+    mod->mfm.lastsector=mod->amigamfm.lastsector;
+    mod->mfm.lastlength=mod->amigamfm.lastlength;
+  }
+}
+
+// Process samples for a given physical track, head and rotation speed
+void mod_processtrack(Mod_Context *mod, const unsigned char *sampledata, const unsigned long samplesize, const int attempt, const int usepll, const uint8_t physical_track, const uint8_t physical_head, const float rpm)
+{
+  // Find all the flux transitions once, then share them between each decoder
+  flux_extract(&mod->flux, sampledata, samplesize, FLUX_RISINGEDGES);
+
+  mod_processintervals(mod, &mod->flux, attempt, usepll, physical_track, physical_head, rpm);
+}
+
+// Check if any decoder found a sector ID on the last track processed
+int mod_foundids(const Mod_Context *mod)
+{
+  return (!((mod->fm.lasttrack==-1) && (mod->fm.lasthead==-1) && (mod->fm.lastsector==-1) && (mod->fm.lastlength==-1)
+         && (mod->mfm.lasttrack==-1) && (mod->mfm.lasthead==-1) && (mod->mfm.lastsector==-1) && (mod->mfm.lastlength==-1)
+         && (mod->gcr.lasttrack==-1) && (mod->gcr.lastsector==-1)
+         && (mod->applegcr.lasttrack==-1) && (mod->applegcr.lastsector==-1)));
+}
+
+// Set how many sectors each track should have, 0 if unknown
+void mod_setexpectedsectors(Mod_Context *mod, const int sectors)
+{
+  mod->expectedsectors=(sectors>0)?sectors:0;
+}
+
+// Stop the worker pool and release decoder storage
+void mod_done(Mod_Context *mod)
+{
+  int i;
+
+  if (mod->poolsize>0)
+  {
+    pthread_mutex_lock(&mod->poollock);
+    mod->poolstop=1;
+    pthread_cond_broadcast(&mod->jobready);
+    pthread_mutex_unlock(&mod->poollock);
+
+    for (i=0; i<mod->poolsize; i++)
+      pthread_join(mod->pool[i], NULL);
+
+    mod->poolsize=0;
+  }
+
+  for (i=0; i<MOD_DECODERS; i++)
+    diskstore_freestore(&mod->decoded[i]);
+
+  flux_free(&mod->flux);
+
+  pthread_mutex_destroy(&mod->poollock);
+  pthread_cond_destroy(&mod->jobready);
+  pthread_cond_destroy(&mod->jobsdone);
+}
+
+// Initialise modulation, decoding into the given store
+void mod_init(Mod_Context *mod, const int debug, const int threads, const unsigned long samplerate, Disk_Store *store)
+{
+  int i;
+
+  mod->debug=debug;
+  mod->samplerate=samplerate;
+  mod->store=store;
+
+  mod->peaks=0;
+  mod->density=MOD_DENSITYAUTO;
+
+  // Build CRC tables before any decoders can use them
+  crc_init();
+
+  flux_init(&mod->flux);
+  mod->intervals=&mod->flux;
+
+  for (i=0; i<MOD_DECODERS; i++)
+    diskstore_initstore(&mod->decoded[i]);
+
+  mod->lockeddecoders=0;
+  mod->expectedsectors=0;
+  mod->completedpos=0;
+
+  // Start worker pool, no point in having more workers than decoders
+  mod->poolsize=0;
+  mod->poolstop=0;
+  mod->numjobs=0;
+  mod->nextjob=0;
+  mod->jobsleft=0;
+
+  pthread_mutex_init(&mod->poollock, NULL);
+  pthread_cond_init(&mod->jobready, NULL);
+  pthread_cond_init(&mod->jobsdone, NULL);
+
+  if (threads>1)
+  {
+    for (i=0; ((i<threads) && (i<MOD_DECODERS)); i++)
+    {
+      if (pthread_create(&mod->pool[i], NULL, mod_worker, mod)!=0)
+        break;
+
+      mod->poolsize++;
+    }
+  }
 }
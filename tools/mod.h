@@ -1,6 +1,16 @@
 #ifndef _MOD_H_
 #define _MOD_H_
 
+#include <pthread.h>
+
+#include "flux.h"
+#include "diskstore.h"
+#include "fm.h"
+#include "mfm.h"
+#include "amigamfm.h"
+#include "gcr.h"
+#include "applegcr.h"
+
 #define MOD_HISTOGRAMSIZE 512
 #define MOD_PEAKSIZE 5
 
@@ -11,20 +21,105 @@
 #define MOD_DENSITYMFMED 8
 #define MOD_DENSITYAPPLEGCR 16
 
-extern unsigned long mod_datapos;
-extern unsigned long mod_samplesize;
+// Decoders which can be run independently of each other
+#define MOD_DECODERFM 0
+#define MOD_DECODERAMIGAMFM 1
+#define MOD_DECODERMFM 2
+#define MOD_DECODERGCR 3
+#define MOD_DECODERAPPLEGCR 4
+#define MOD_DECODERS 5
+
+// Number of intervals between checks for a track having been fully decoded
+#define MOD_COMPLETECHECK 2048
+
+#define MOD_DECODERBIT(decoder) (1<<(decoder))
+#define MOD_ALLDECODERS ((1<<MOD_DECODERS)-1)
+
+struct ModContext;
+
+// Decoder job for the worker pool
+typedef struct ModJob
+{
+  struct ModContext *mod;
+  int decoder;
+  uint8_t physical_track;
+  uint8_t physical_head;
+  float rpm;
+  int usepll;
+  unsigned int found; // Sectors stored by this decoder
+  unsigned long completedpos; // Where decoding stopped early, 0 if it didn't
+} Mod_Job;
+
+// Everything needed to decode tracks into one store
+typedef struct ModContext
+{
+  int debug;
+  unsigned long samplerate;
+
+  // Store sectors are merged into once each track is done
+  Disk_Store *store;
+
+  // Track being processed
+  uint8_t track;
+  uint8_t head;
+  float rpm;
 
-extern int mod_peak[MOD_PEAKSIZE];
-extern int mod_peaks;
-extern char mod_density;
+  unsigned long hist[MOD_HISTOGRAMSIZE];
+  int peak[MOD_PEAKSIZE];
+  int peaks;
+  char density;
+
+  // Intervals between rising edges of the current sample buffer
+  Flux_Intervals flux;
+
+  // Intervals being decoded, either extracted into flux or supplied directly
+  const Flux_Intervals *intervals;
+
+  // Decoder state for the track being processed
+  FM_Context fm;
+  MFM_Context mfm;
+  AmigaMFM_Context amigamfm;
+  GCR_Context gcr;
+  AppleGCR_Context applegcr;
+
+  // Sectors found by each decoder, merged into the store once the track is done
+  Disk_Store decoded[MOD_DECODERS];
+
+  // Worker pool for running decoders in parallel
+  int poolsize;
+  pthread_t pool[MOD_DECODERS];
+  pthread_mutex_t poollock;
+  pthread_cond_t jobready;
+  pthread_cond_t jobsdone;
+  Mod_Job jobs[MOD_DECODERS];
+  int numjobs;
+  int nextjob;
+  int jobsleft;
+  int poolstop;
+
+  // Decoders which have found sectors on previous tracks
+  unsigned int lockeddecoders;
+
+  // Number of sectors expected per track, 0 if unknown
+  unsigned int expectedsectors;
+
+  // Position in sample buffer by which the last track had been fully decoded, 0 if it needed it all
+  unsigned long completedpos;
+} Mod_Context;
 
 unsigned char mod_getclock(const unsigned int datacells);
 unsigned char mod_getdata(const unsigned int datacells);
 
-extern float mod_samplestous(const long samples);
+extern float mod_samplestous(const unsigned long samplerate, const long samples);
+
+// Check if any decoder found a sector ID on the last track processed
+extern int mod_foundids(const Mod_Context *mod);
 
-extern void mod_process(const unsigned char *sampledata, const unsigned long samplesize, const int attempt, const int usepll);
+extern void mod_processintervals(Mod_Context *mod, const Flux_Intervals *flux, const int attempt, const int usepll, const uint8_t physical_track, const uint8_t physical_head, const float rpm);
+extern void mod_processtrack(Mod_Context *mod, const unsigned char *sampledata, const unsigned long samplesize, const int attempt, const int usepll, const uint8_t physical_track, const uint8_t physical_head, const float rpm);
+extern void mod_setexpectedsectors(Mod_Context *mod, const int sectors);
 
-extern void mod_init(const int debug);
+extern void mod_init(Mod_Context *mod, const int debug, const int threads, const unsigned long samplerate, Disk_Store *store);
+extern void mod_done(Mod_Context *mod);
 
 #endif
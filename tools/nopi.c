@@ -6,15 +6,8 @@
 #include <string.h>
 #include <strings.h>
 
-#include "common.h"
 #include "hardware.h"
-#include "rfi.h"
-#include "scp.h"
-#include "hfe.h"
-#include "a2r.h"
-#include "woz.h"
-
-#define HW_OLDRAWTRACKSIZE (1024*1024)
+#include "reader.h"
 
 unsigned int hw_maxtracks = HW_MAXTRACKS;
 uint8_t hw_currenttrack = 0;
@@ -25,9 +18,15 @@ float hw_forcedrpm = 0.0;
 
 int hw_stepping = HW_NORMALSTEPPING;
 
-FILE *hw_samplefile = NULL;
+unsigned int hw_settlecount = 0;
+unsigned long long hw_settletotal = 0;
+unsigned long hw_settlemax = 0;
+
 char hw_samplefilename[1024];
 
+// Sample file being read from
+Reader_File *hw_samplefile = NULL;
+
 // Drive control
 unsigned char hw_detectdisk()
 {
@@ -79,6 +78,9 @@ void hw_seektotrack(const int track)
 void hw_setmaxtracks(const int maxtracks)
 {
   hw_maxtracks=maxtracks;
+
+  if (hw_samplefile!=NULL)
+    hw_samplefile->maxtracks=maxtracks;
 }
 
 // Seek head in by 1 track
@@ -117,99 +119,33 @@ int hw_writeprotected()
   return 0;
 }
 
-// Fix SPI sample buffer timings
-void hw_fixspisamples(unsigned char *inbuf, long inlen, unsigned char *outbuf, long outlen)
+// Use RPM recorded in sample file, unless overridden
+void hw_filerpm()
 {
-  long inpos, outpos;
-  unsigned char o, olen, bitpos;
-
-  outpos=0; o=0; olen=0;
-
-  for (inpos=0; inpos<inlen; inpos++)
-  {
-    unsigned char c;
-
-    c=inbuf[inpos];
-
-    // Insert extra sample, this is due to SPI sampling leaving a 1 sample gap between each group of 8 samples
-    o=(o<<1)|((c&0x80)>>7);
-    olen++;
-    if (olen==BITSPERBYTE)
-    {
-      if (outpos<outlen)
-        outbuf[outpos++]=o;
-
-      olen=0; o=0;
-    }
-
-    // Process the 8 valid samples we did get
-    for (bitpos=0; bitpos<BITSPERBYTE; bitpos++)
-    {
-      o=(o<<1)|((c&0x80)>>7);
-      olen++;
-
-      if (olen==BITSPERBYTE)
-      {
-        if (outpos<outlen)
-          outbuf[outpos++]=o;
-
-        olen=0; o=0;
-      }
-
-      c=c<<1;
-    }
-
-    // Stop on output buffer overflow
-    if (outpos>=outlen) return;
-  }
+  if ((hw_forcedrpm==0.0) && (hw_samplefile->rpm!=0))
+    hw_rpm=hw_samplefile->rpm;
 }
 
 // Read raw flux data for current track/head
 void hw_samplerawtrackdata(unsigned char* buf, uint32_t len)
 {
-  // Clear output buffer to prevent failed reads potentially returning previous data
-  bzero(buf, len);
-
-  // Find/Read track data into buffer
-  if (hw_samplefile!=NULL)
+  if (hw_samplefile==NULL)
   {
-    // Obsolete .raw files were 8 megabits per track, sampled at 12.5Mhz, either 40 or 80 tracks, with second side (if any) folowing the whole of the first
-    if (compare_extension(hw_samplefilename, ".raw"))
-    {
-      if (fseek(hw_samplefile, ((hw_maxtracks*hw_currenthead)+hw_currenttrack)*HW_OLDRAWTRACKSIZE, SEEK_SET)==0)
-      {
-        unsigned char *rawbuf;
-
-        rawbuf=malloc(HW_OLDRAWTRACKSIZE);
-        if (rawbuf==NULL) return;
-
-        if (fread(rawbuf, HW_OLDRAWTRACKSIZE, 1, hw_samplefile)==0)
-        {
-          free(rawbuf);
-          return;
-        }
-
-        hw_fixspisamples(rawbuf, HW_OLDRAWTRACKSIZE, buf, len);
-
-        free(rawbuf);
-      }
-    }
-    else
-    if (compare_extension(hw_samplefilename, ".rfi"))
-      rfi_readtrack(hw_samplefile, hw_currenttrack, hw_currenthead, buf, len);
-    else
-    if (compare_extension(hw_samplefilename, ".scp"))
-      scp_readtrack(hw_samplefile, hw_currenttrack, hw_currenthead, buf, len);
-    else
-    if (compare_extension(hw_samplefilename, ".hfe"))
-      hfe_readtrack(hw_samplefile, hw_currenttrack, hw_currenthead, buf, len);
-    else
-    if (compare_extension(hw_samplefilename, ".a2r"))
-      a2r_readtrack(hw_samplefile, hw_currenttrack, hw_currenthead, buf, len);
-    else
-    if (compare_extension(hw_samplefilename, ".woz"))
-      woz_readtrack(hw_samplefile, hw_currenttrack, hw_currenthead, buf, len);
+    bzero(buf, len);
+    return;
   }
+
+  // Find/Read track data into buffer
+  reader_readtrack(hw_samplefile, hw_currenttrack, hw_currenthead, buf, len);
+  hw_filerpm();
+}
+
+// Read flux intervals for current track/head directly, when the sample file format allows it
+int hw_samplerawintervals(Flux_Intervals *flux, const uint32_t len)
+{
+  if (hw_samplefile==NULL) return 0;
+
+  return reader_readintervals(hw_samplefile, hw_currenttrack, hw_currenthead, flux, len);
 }
 
 // Clean up
@@ -218,7 +154,7 @@ void hw_done()
   // Close sample file if open
   if (hw_samplefile!=NULL)
   {
-    fclose(hw_samplefile);
+    reader_close(hw_samplefile);
 
     hw_samplefile=NULL;
   }
@@ -238,46 +174,14 @@ int hw_init(const char *rawfile, const int spiclockdivider)
   // Default to Pi2/Pi3 clock rate
   hw_samplerate=HW_400MHZ/spiclockdivider;
 
-  // Open sample file
-  hw_samplefile=fopen(rawfile, "rb");
+  // Open sample file, reading header values to determine capture settings
+  hw_samplefile=reader_open(rawfile, hw_samplerate, hw_maxtracks);
 
-  if (hw_samplefile!=NULL)
-  {
-    // If RFI opened and valid, read header values to determine capture settings
-    if (compare_extension(hw_samplefilename, ".rfi"))
-    {
-      if (rfi_readheader(hw_samplefile)==-1)
-        return 0;
-    }
-
-    // If SCP opened and valid, read header values to determine capture settings
-    if (compare_extension(hw_samplefilename, ".scp"))
-    {
-      if (scp_readheader(hw_samplefile)==-1)
-        return 0;
-    }
-
-    // If HFE opened and valid, read header values to determine capture settings
-    if (compare_extension(hw_samplefilename, ".hfe"))
-    {
-      if (hfe_readheader(hw_samplefile)==-1)
-        return 0;
-    }
-
-    // If A2R opened and valid, read header values to determine capture settings
-    if (compare_extension(hw_samplefilename, ".a2r"))
-    {
-      if (a2r_readheader(hw_samplefile)==-1)
-        return 0;
-    }
-
-    // If WOZ opened and valid, read header values to determine capture settings
-    if (compare_extension(hw_samplefilename, ".woz"))
-    {
-      if (woz_readheader(hw_samplefile)==-1)
-        return 0;
-    }
-  }
+  if (hw_samplefile==NULL)
+    return 0;
+
+  hw_samplerate=hw_samplefile->samplerate;
+  hw_filerpm();
 
   return (hw_detectdisk()==HW_HAVEDISK);
 }
@@ -298,6 +202,12 @@ void hw_setrpm(const float rpm)
   hw_forcedrpm=rpm;
 }
 
+// Wait for drive to settle, not needed as this is not using real hardware
+unsigned long hw_waitforsettle()
+{
+  return 0;
+}
+
 // Measure RPM, defaults to 300RPM
 float hw_measurerpm()
 {
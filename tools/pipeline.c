@@ -0,0 +1,288 @@
+#include <stdlib.h>
+#include <pthread.h>
+
+#include "pipeline.h"
+
+// Buffers pass from free, to writing (captured, when writing flux images), to queued (captured),
+// to completed (decoded), then back to free. When only writing, they go straight back to free
+typedef struct PipelineList
+{
+  Pipeline_Buffer *head;
+  Pipeline_Buffer *tail;
+} Pipeline_List;
+
+Pipeline_Buffer *pipeline_pool=NULL;
+unsigned int pipeline_poolsize=0;
+
+Pipeline_List pipeline_free;
+Pipeline_List pipeline_towrite;
+Pipeline_List pipeline_queued;
+Pipeline_List pipeline_completed;
+unsigned int pipeline_writing=0;
+unsigned int pipeline_decoding=0;
+int pipeline_stopped=0;
+
+// Writer queue depth seen each time a buffer is handed over for writing
+unsigned int pipeline_writes=0;
+unsigned long pipeline_writedepthtotal=0;
+unsigned int pipeline_writedepthmax=0;
+
+pthread_mutex_t pipeline_lock=PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t pipeline_changed=PTHREAD_COND_INITIALIZER;
+
+// Add buffer to end of list
+void pipeline_push(Pipeline_List *list, Pipeline_Buffer *buffer)
+{
+  buffer->next=NULL;
+
+  if (list->tail==NULL)
+    list->head=buffer;
+  else
+    list->tail->next=buffer;
+
+  list->tail=buffer;
+}
+
+// Remove buffer from start of list
+Pipeline_Buffer *pipeline_pop(Pipeline_List *list)
+{
+  Pipeline_Buffer *buffer;
+
+  buffer=list->head;
+
+  if (buffer!=NULL)
+  {
+    list->head=buffer->next;
+
+    if (list->head==NULL)
+      list->tail=NULL;
+
+    buffer->next=NULL;
+  }
+
+  return buffer;
+}
+
+// Get an unused buffer to capture into, NULL if they are all in use
+Pipeline_Buffer *pipeline_getfree()
+{
+  Pipeline_Buffer *buffer;
+
+  pthread_mutex_lock(&pipeline_lock);
+  buffer=pipeline_pop(&pipeline_free);
+  pthread_mutex_unlock(&pipeline_lock);
+
+  return buffer;
+}
+
+// Pass a captured buffer on for decoding
+void pipeline_queue(Pipeline_Buffer *buffer)
+{
+  pthread_mutex_lock(&pipeline_lock);
+  pipeline_push(&pipeline_queued, buffer);
+  pthread_cond_broadcast(&pipeline_changed);
+  pthread_mutex_unlock(&pipeline_lock);
+}
+
+// Check if any buffers are still being written or decoded, must hold lock
+int pipeline_busy()
+{
+  return ((pipeline_towrite.head!=NULL) || (pipeline_writing>0) || (pipeline_queued.head!=NULL) || (pipeline_decoding>0));
+}
+
+// Pass a captured buffer on to be written out, then decoded if required
+void pipeline_write(Pipeline_Buffer *buffer)
+{
+  Pipeline_Buffer *queued;
+  unsigned int depth;
+
+  pthread_mutex_lock(&pipeline_lock);
+  pipeline_push(&pipeline_towrite, buffer);
+
+  depth=pipeline_writing;
+  for (queued=pipeline_towrite.head; queued!=NULL; queued=queued->next)
+    depth++;
+
+  pipeline_writes++;
+  pipeline_writedepthtotal+=depth;
+  if (depth>pipeline_writedepthmax)
+    pipeline_writedepthmax=depth;
+
+  pthread_cond_broadcast(&pipeline_changed);
+  pthread_mutex_unlock(&pipeline_lock);
+}
+
+// Get the next decoded buffer, optionally waiting while any are still being written or decoded
+Pipeline_Buffer *pipeline_getcompleted(const int wait)
+{
+  Pipeline_Buffer *buffer;
+
+  pthread_mutex_lock(&pipeline_lock);
+
+  if (wait!=PIPELINE_NOWAIT)
+  {
+    while ((pipeline_completed.head==NULL) && (pipeline_busy()) &&
+           ((wait!=PIPELINE_WAITFREE) || (pipeline_free.head==NULL)))
+      pthread_cond_wait(&pipeline_changed, &pipeline_lock);
+  }
+
+  buffer=pipeline_pop(&pipeline_completed);
+
+  pthread_mutex_unlock(&pipeline_lock);
+
+  return buffer;
+}
+
+// Return a buffer to the pool once finished with
+void pipeline_release(Pipeline_Buffer *buffer)
+{
+  pthread_mutex_lock(&pipeline_lock);
+  pipeline_push(&pipeline_free, buffer);
+  pthread_mutex_unlock(&pipeline_lock);
+}
+
+// Wait until everything captured so far has been written and decoded
+void pipeline_waitidle()
+{
+  pthread_mutex_lock(&pipeline_lock);
+
+  while (pipeline_busy())
+    pthread_cond_wait(&pipeline_changed, &pipeline_lock);
+
+  pthread_mutex_unlock(&pipeline_lock);
+}
+
+// Tell the writer and decoder no more buffers will be queued
+void pipeline_stop()
+{
+  pthread_mutex_lock(&pipeline_lock);
+  pipeline_stopped=1;
+  pthread_cond_broadcast(&pipeline_changed);
+  pthread_mutex_unlock(&pipeline_lock);
+}
+
+// Wait for a captured buffer to write, NULL once stopped and drained
+Pipeline_Buffer *pipeline_getwrite()
+{
+  Pipeline_Buffer *buffer;
+
+  pthread_mutex_lock(&pipeline_lock);
+
+  while ((pipeline_towrite.head==NULL) && (!pipeline_stopped))
+    pthread_cond_wait(&pipeline_changed, &pipeline_lock);
+
+  buffer=pipeline_pop(&pipeline_towrite);
+
+  if (buffer!=NULL)
+    pipeline_writing++;
+
+  pthread_mutex_unlock(&pipeline_lock);
+
+  return buffer;
+}
+
+// Hand a written buffer on for decoding, or back to the pool if it's not needed
+void pipeline_written(Pipeline_Buffer *buffer)
+{
+  pthread_mutex_lock(&pipeline_lock);
+  pipeline_writing--;
+
+  if (buffer->decode)
+    pipeline_push(&pipeline_queued, buffer);
+  else
+    pipeline_push(&pipeline_free, buffer);
+
+  pthread_cond_broadcast(&pipeline_changed);
+  pthread_mutex_unlock(&pipeline_lock);
+}
+
+// Wait for a captured buffer to decode, NULL once stopped and drained
+Pipeline_Buffer *pipeline_getqueued()
+{
+  Pipeline_Buffer *buffer;
+
+  pthread_mutex_lock(&pipeline_lock);
+
+  // Buffers still being written may yet be queued
+  while ((pipeline_queued.head==NULL) && ((!pipeline_stopped) || (pipeline_towrite.head!=NULL) || (pipeline_writing>0)))
+    pthread_cond_wait(&pipeline_changed, &pipeline_lock);
+
+  buffer=pipeline_pop(&pipeline_queued);
+
+  if (buffer!=NULL)
+    pipeline_decoding++;
+
+  pthread_mutex_unlock(&pipeline_lock);
+
+  return buffer;
+}
+
+// Hand a decoded buffer back to the capture side
+void pipeline_complete(Pipeline_Buffer *buffer)
+{
+  pthread_mutex_lock(&pipeline_lock);
+  pipeline_decoding--;
+  pipeline_push(&pipeline_completed, buffer);
+  pthread_cond_broadcast(&pipeline_changed);
+  pthread_mutex_unlock(&pipeline_lock);
+}
+
+// Allocate the buffer pool
+int pipeline_init(const unsigned int count, const unsigned long len)
+{
+  unsigned int i;
+
+  pipeline_free.head=pipeline_free.tail=NULL;
+  pipeline_towrite.head=pipeline_towrite.tail=NULL;
+  pipeline_queued.head=pipeline_queued.tail=NULL;
+  pipeline_completed.head=pipeline_completed.tail=NULL;
+  pipeline_writing=0;
+  pipeline_decoding=0;
+  pipeline_stopped=0;
+  pipeline_writes=0;
+  pipeline_writedepthtotal=0;
+  pipeline_writedepthmax=0;
+
+  pipeline_pool=calloc(count, sizeof(Pipeline_Buffer));
+  if (pipeline_pool==NULL)
+    return 0;
+
+  pipeline_poolsize=count;
+
+  for (i=0; i<count; i++)
+  {
+    pipeline_pool[i].data=malloc(len);
+    if (pipeline_pool[i].data==NULL)
+    {
+      pipeline_done();
+      return 0;
+    }
+
+    pipeline_pool[i].len=len;
+    flux_init(&pipeline_pool[i].flux);
+    pipeline_push(&pipeline_free, &pipeline_pool[i]);
+  }
+
+  return 1;
+}
+
+// Free the buffer pool
+void pipeline_done()
+{
+  unsigned int i;
+
+  if (pipeline_pool==NULL)
+    return;
+
+  for (i=0; i<pipeline_poolsize; i++)
+  {
+    if (pipeline_pool[i].data!=NULL)
+      free(pipeline_pool[i].data);
+
+    flux_free(&pipeline_pool[i].flux);
+  }
+
+  free(pipeline_pool);
+  pipeline_pool=NULL;
+  pipeline_poolsize=0;
+}
@@ -0,0 +1,77 @@
+#ifndef _PIPELINE_H_
+#define _PIPELINE_H_
+
+#include <stdint.h>
+
+#include "flux.h"
+
+// Number of sample buffers shared between capture, writing and decode
+#define PIPELINE_BUFFERS 4
+
+// How long to wait for decoded buffers
+#define PIPELINE_NOWAIT 0
+#define PIPELINE_WAITIDLE 1
+#define PIPELINE_WAITFREE 2
+
+typedef struct PipelineBuffer
+{
+  unsigned char *data;
+  unsigned long len;
+
+  // Intervals read directly from the source, used instead of data when set
+  Flux_Intervals flux;
+  int intervals;
+
+  // Amount of buffer sampled into, and how much to sample if retrying
+  unsigned long samplelen;
+  unsigned long retrylen;
+
+  // Where and how the samples were captured
+  unsigned int track;
+  unsigned char side;
+  uint8_t physical_track;
+  uint8_t physical_head;
+  float rpm;
+  unsigned char retry;
+
+  // Whether to decode once written out
+  int decode;
+
+  // Set by decoder, non-zero when no further attempts are needed
+  int complete;
+
+  // Set by decoder, position by which everything had been decoded, 0 if it needed it all
+  unsigned long completedpos;
+
+  struct PipelineBuffer *next;
+} Pipeline_Buffer;
+
+// Allocate the buffer pool
+extern int pipeline_init(const unsigned int count, const unsigned long len);
+
+// Capture side
+extern Pipeline_Buffer *pipeline_getfree();
+extern void pipeline_queue(Pipeline_Buffer *buffer);
+extern void pipeline_write(Pipeline_Buffer *buffer);
+extern Pipeline_Buffer *pipeline_getcompleted(const int wait);
+extern void pipeline_release(Pipeline_Buffer *buffer);
+extern void pipeline_waitidle();
+extern void pipeline_stop();
+
+// Write side
+extern Pipeline_Buffer *pipeline_getwrite();
+extern void pipeline_written(Pipeline_Buffer *buffer);
+
+// Decode side
+extern Pipeline_Buffer *pipeline_getqueued();
+extern void pipeline_complete(Pipeline_Buffer *buffer);
+
+// Writer queue depth statistics
+extern unsigned int pipeline_writes;
+extern unsigned long pipeline_writedepthtotal;
+extern unsigned int pipeline_writedepthmax;
+
+// Free the buffer pool
+extern void pipeline_done();
+
+#endif
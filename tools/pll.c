@@ -12,8 +12,21 @@ float pll_phaseadjust=(65.0/100.0);
 float pll_minperiod=(75.0/100.0);
 float pll_maxperiod=(125.0/100.0);
 
-// Linked list of all the assigned PLLs
-struct PLL *PLL_root=NULL;
+// Convert to 16.16 fixed point
+static int32_t PLL_tofixed(const float value)
+{
+  return (int32_t)((value*PLL_FIXEDONE)+0.5);
+}
+
+// Distance between bit cells when free running
+static inline uint32_t PLL_step(const struct PLL *pll)
+{
+  int32_t step;
+
+  step=(pll->period>>PLL_FIXEDBITS)+pll->phase_adjust;
+
+  return (step<1)?1:step;
+}
 
 // Reset a PLL entry
 void PLL_reset(struct PLL *pll, const float bitcell)
@@ -21,146 +34,125 @@ void PLL_reset(struct PLL *pll, const float bitcell)
   if (pll==NULL) return;
 
   pll->cellsize=bitcell;
-  pll->period=bitcell;
+  pll->period=PLL_tofixed(bitcell);
   pll->cur_pos=0;
-  pll->period_adjust_base=(bitcell*pll_periodadjust);
-  pll->min_period=(bitcell*pll_minperiod);
-  pll->max_period=(bitcell*pll_maxperiod);
+  pll->period_adjust_base=PLL_tofixed(bitcell*pll_periodadjust);
+  pll->min_period=PLL_tofixed(bitcell*pll_minperiod);
+  pll->max_period=PLL_tofixed(bitcell*pll_maxperiod);
+  pll->phase_gain=PLL_tofixed(pll_phaseadjust);
   pll->phase_adjust=0;
   pll->freq_hist=0;
-  pll->next=(pll->cur_pos+pll->period+pll->phase_adjust);
+  pll->next=(pll->cur_pos+PLL_step(pll));
   pll->num_bits=0;
 }
 
-// Create a new PLL entity
-struct PLL *PLL_create(const float bitcell, void (*callback))
+// Set up a PLL to send recovered bits to a decoder
+void PLL_init(struct PLL *pll, const float bitcell, void (*callback)(void *context, const unsigned char bit, const unsigned long datapos), void *context)
 {
-  struct PLL *newpll;
-
-  newpll=malloc(sizeof(struct PLL));
-
-  if (newpll!=NULL)
-  {
-    PLL_reset(newpll, bitcell);
-
-    newpll->callback=callback;
-    newpll->nextpll=NULL;
-
-    // Store this PLL instance for later cleanup
-    if (PLL_root!=NULL)
-    {
-      struct PLL *rover;
+  if (pll==NULL) return;
 
-      rover=PLL_root;
-      while (rover->nextpll!=NULL)
-        rover=rover->nextpll;
+  PLL_reset(pll, bitcell);
 
-      rover->nextpll=newpll;
-    }
-    else
-      PLL_root=newpll;
-  }
-
-  return newpll;
+  pll->callback=callback;
+  pll->context=context;
 }
 
 // Add a sample to the PLL processor
+//
+// Rather than stepping through every sample, jump straight to the transition
+// emitting any bit cells which end before it, then adjust the PLL
 void PLL_addsample(struct PLL *pll, const unsigned long samples, const unsigned long datapos)
 {
-  unsigned long i=samples;
+  uint32_t transition;
 
   if (pll==NULL) return;
+  if (samples==0) return;
+
+  // Position in stream of this transition
+  transition=pll->cur_pos+(samples-1);
+
+  // Free run through bit cells which end before the transition, only the first can contain a 1
+  if (pll->next<=transition)
+  {
+    uint32_t step, cells;
+
+    step=PLL_step(pll);
+    cells=((transition-pll->next)/step)+1;
+    pll->next+=(cells*step);
+
+    (pll->callback)(pll->context, (pll->num_bits>0?1:0), datapos);
+    pll->num_bits=0;
+
+    while (--cells>0)
+      (pll->callback)(pll->context, 0, datapos);
+  }
+
+  pll->cur_pos=transition;
 
-  while (i>0)
+  // Processing for rising edge
+  if (pll->cur_pos>=pll->next)
   {
-    i--;
+    // No transition in the window means 0 and pll in free run mode
+    pll->phase_adjust=0;
+  }
+  else
+  {
+    // Transition in the window means 1, and the pll is adjusted
+    int64_t delta=((((int64_t)pll->cur_pos)-pll->next)*PLL_FIXEDONE)+(pll->period/2);
+    pll->phase_adjust=(delta*pll->phase_gain)/((int64_t)PLL_FIXEDONE*PLL_FIXEDONE);
 
-    // Processing for rising edge
-    if (i==0)
+    pll->num_bits++;
+
+    // Adjust frequency based on error
+    if (delta<0)
     {
-      if (pll->cur_pos>=pll->next)
-      {
-        // No transition in the window means 0 and pll in free run mode
-        pll->phase_adjust=0;
-      }
+      if (pll->freq_hist<0)
+        pll->freq_hist--;
       else
-      {
-        // Transition in the window means 1, and the pll is adjusted
-        float delta=pll->cur_pos-(pll->next-(pll->period/2));
-        pll->phase_adjust=pll_phaseadjust*delta;
-
-        pll->num_bits++;
-
-        // Adjust frequency based on error
-        if (delta<0)
-        {
-          if (pll->freq_hist<0)
-            pll->freq_hist--;
-          else
-            pll->freq_hist=-1;
-        }
-        else
-        if (delta>0)
-        {
-          if (pll->freq_hist>0)
-            pll->freq_hist++;
-          else
-            pll->freq_hist=1;
-        }
-        else
-          pll->freq_hist=0;
-
-        // Update the reference clock?
-        if (pll->freq_hist)
-        {
-          int afh=pll->freq_hist<0?-pll->freq_hist:pll->freq_hist;
-
-          if (afh>1)
-          {
-            float aper=pll->period_adjust_base*delta/pll->period;
-
-            if (!aper)
-              aper=pll->freq_hist<0?-1:1;
-
-            pll->period+=aper;
-
-            // Keep within bounds
-            if (pll->period<pll->min_period)
-              pll->period=pll->min_period;
-            else
-            if (pll->period>pll->max_period)
-              pll->period=pll->max_period;
-          }
-        }
-      }
+        pll->freq_hist=-1;
     }
+    else
+    if (delta>0)
+    {
+      if (pll->freq_hist>0)
+        pll->freq_hist++;
+      else
+        pll->freq_hist=1;
+    }
+    else
+      pll->freq_hist=0;
 
-    pll->cur_pos++;
-
-    if (pll->cur_pos>=pll->next)
+    // Update the reference clock?
+    if (pll->freq_hist)
     {
-      pll->next=(pll->cur_pos+pll->period+pll->phase_adjust);
-      (pll->callback)((pll->num_bits>0?1:0), datapos);
+      int afh=pll->freq_hist<0?-pll->freq_hist:pll->freq_hist;
+
+      if (afh>1)
+      {
+        int32_t aper=(pll->period_adjust_base*delta)/pll->period;
 
-      pll->num_bits=0;
+        if (!aper)
+          aper=pll->freq_hist<0?-1:1;
+
+        pll->period+=aper;
+
+        // Keep within bounds
+        if (pll->period<pll->min_period)
+          pll->period=pll->min_period;
+        else
+        if (pll->period>pll->max_period)
+          pll->period=pll->max_period;
+      }
     }
   }
-}
 
-void PLL_done()
-{
-  struct PLL *cont;
+  pll->cur_pos++;
 
-  while (PLL_root!=NULL)
+  if (pll->cur_pos>=pll->next)
   {
-    cont=PLL_root->nextpll;
+    pll->next=(pll->cur_pos+PLL_step(pll));
+    (pll->callback)(pll->context, (pll->num_bits>0?1:0), datapos);
 
-    free(PLL_root);
-    PLL_root=cont;
+    pll->num_bits=0;
   }
 }
-
-void PLL_init()
-{
-  atexit(PLL_done);
-}
@@ -1,6 +1,12 @@
 #ifndef _PLL_H_
 #define _PLL_H_
 
+#include <stdint.h>
+
+// Period and gain values are held as 16.16 fixed point
+#define PLL_FIXEDBITS 16
+#define PLL_FIXEDONE (1<<PLL_FIXEDBITS)
+
 struct PLL
 {
   float cellsize;
@@ -8,20 +14,21 @@ struct PLL
   uint32_t cur_pos; // Position in stream
   uint32_t next; // Expected next transition
 
-  float period;
-  float period_adjust_base;
+  int32_t period; // Current bit cell width
+  int32_t period_adjust_base;
 
-  float min_period; // Minimum accepted bit cell width
-  float max_period; // Maximum accepted bit cell width
+  int32_t min_period; // Minimum accepted bit cell width
+  int32_t max_period; // Maximum accepted bit cell width
 
-  int32_t phase_adjust;
+  int32_t phase_gain; // Proportion of phase error to correct
+
+  int32_t phase_adjust; // Whole samples
   int32_t freq_hist;
 
   uint32_t num_bits; // Number of bits observed within current bit cell
 
-  void (*callback)(const unsigned long samples, const unsigned long datapos); // Function to send recovered bits to
-
-  void *nextpll; // Pointer to the next PLL for cleanup purposes
+  void (*callback)(void *context, const unsigned char bit, const unsigned long datapos); // Function to send recovered bits to
+  void *context; // Decoder state passed back to callback
 };
 
 extern float pll_periodadjust;
@@ -29,8 +36,7 @@ extern float pll_phaseadjust;
 extern float pll_minperiod;
 extern float pll_maxperiod;
 
-extern void PLL_init();
-extern struct PLL *PLL_create(const float bitcell, void *callback);
+extern void PLL_init(struct PLL *pll, const float bitcell, void (*callback)(void *context, const unsigned char bit, const unsigned long datapos), void *context);
 extern void PLL_reset(struct PLL *pll, const float bitcell);
 extern void PLL_addsample(struct PLL *pll, const unsigned long samples, const unsigned long datapos);
 
@@ -0,0 +1,292 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>
+
+#include "common.h"
+#include "hardware.h"
+#include "reader.h"
+#include "rfi.h"
+#include "scp.h"
+#include "spi.h"
+#include "hfe.h"
+#include "a2r.h"
+#include "woz.h"
+
+#define READER_OLDRAWTRACKSIZE (1024*1024)
+
+// Check header starts with given magic
+int reader_hasmagic(const unsigned char *header, const size_t len, const char *magic)
+{
+  size_t magiclen=strlen(magic);
+
+  return ((len>=magiclen) && (memcmp(header, magic, magiclen)==0));
+}
+
+int reader_proberfi(const unsigned char *header, const size_t len)
+{
+  return ((reader_hasmagic(header, len, RFI_MAGIC)) && (len>strlen(RFI_MAGIC)) && (header[strlen(RFI_MAGIC)]=='{'));
+}
+
+int reader_probescp(const unsigned char *header, const size_t len)
+{
+  return reader_hasmagic(header, len, SCP_MAGIC);
+}
+
+int reader_probehfe(const unsigned char *header, const size_t len)
+{
+  return ((reader_hasmagic(header, len, HFE_MAGIC1)) || (reader_hasmagic(header, len, HFE_MAGIC3)));
+}
+
+// A2R and WOZ both follow their magic with 0xff to detect 7-bit transfers
+int reader_probea2r(const unsigned char *header, const size_t len)
+{
+  return (((reader_hasmagic(header, len, A2R_MAGIC2)) || (reader_hasmagic(header, len, A2R_MAGIC3))) && (len>4) && (header[4]==0xff));
+}
+
+int reader_probewoz(const unsigned char *header, const size_t len)
+{
+  return (((reader_hasmagic(header, len, WOZ_MAGIC1)) || (reader_hasmagic(header, len, WOZ_MAGIC2))) && (len>4) && (header[4]==0xff));
+}
+
+// Allocate zeroed state for a file being opened
+int reader_newstate(Reader_File *file, const size_t size)
+{
+  file->state=calloc(1, size);
+
+  return (file->state==NULL)?-1:0;
+}
+
+// Free state of a file, for formats without anything else to release
+void reader_freestate(Reader_File *file)
+{
+  free(file->state);
+  file->state=NULL;
+}
+
+int reader_rfiopen(Reader_File *file)
+{
+  RFI_Reader *rfi;
+
+  if (reader_newstate(file, sizeof(RFI_Reader))!=0) return -1;
+  rfi=file->state;
+
+  if (rfi_readheader(file->fh, rfi)!=0) return -1;
+
+  if (rfi->rate>0)
+    file->samplerate=rfi->rate;
+
+  return 0;
+}
+
+long reader_rfireadtrack(Reader_File *file, const int track, const int side, unsigned char *buf, const uint32_t buflen)
+{
+  RFI_Reader *rfi=file->state;
+  long len;
+
+  len=rfi_readtrack(file->fh, rfi, track, side, buf, buflen);
+  file->rpm=rfi->rpm;
+
+  return len;
+}
+
+int reader_scpopen(Reader_File *file)
+{
+  SCP_Reader *scp;
+
+  if (reader_newstate(file, sizeof(SCP_Reader))!=0) return -1;
+  scp=file->state;
+
+  if (scp_readheader(file->fh, scp)!=0) return -1;
+
+  file->rpm=scp->rpm;
+
+  return 0;
+}
+
+// SCP tracks come from the mapped file rather than the stream
+long reader_scpreadtrack(Reader_File *file, const int track, const int side, unsigned char *buf, const uint32_t buflen)
+{
+  return scp_readtrack(file->state, file->samplerate, track, side, buf, buflen);
+}
+
+int reader_scpintervals(Reader_File *file, const int track, const int side, Flux_Intervals *flux, const uint32_t buflen)
+{
+  return scp_readintervals(file->state, file->samplerate, track, side, flux, buflen);
+}
+
+void reader_scpclose(Reader_File *file)
+{
+  if (file->state!=NULL)
+    scp_close(file->state);
+
+  reader_freestate(file);
+}
+
+int reader_hfeopen(Reader_File *file)
+{
+  HFE_Reader *hfe;
+
+  if (reader_newstate(file, sizeof(HFE_Reader))!=0) return -1;
+  hfe=file->state;
+
+  if (hfe_readheader(file->fh, hfe)!=0) return -1;
+
+  file->rpm=hfe->rpm;
+
+  return 0;
+}
+
+long reader_hfereadtrack(Reader_File *file, const int track, const int side, unsigned char *buf, const uint32_t buflen)
+{
+  return hfe_readtrack(file->fh, file->state, file->samplerate, track, side, buf, buflen);
+}
+
+int reader_a2ropen(Reader_File *file)
+{
+  if (reader_newstate(file, sizeof(A2R_Reader))!=0) return -1;
+
+  if (a2r_readheader(file->fh, file->state)!=0) return -1;
+
+  file->samplerate=A2R_SAMPLE_RATE;
+
+  return 0;
+}
+
+long reader_a2rreadtrack(Reader_File *file, const int track, const int side, unsigned char *buf, const uint32_t buflen)
+{
+  return a2r_readtrack(file->fh, file->state, track, side, buf, buflen);
+}
+
+int reader_wozopen(Reader_File *file)
+{
+  WOZ_Reader *woz;
+
+  if (reader_newstate(file, sizeof(WOZ_Reader))!=0) return -1;
+  woz=file->state;
+
+  if (woz_readheader(file->fh, woz)!=0) return -1;
+
+  file->samplerate=woz->rate;
+
+  return 0;
+}
+
+long reader_wozreadtrack(Reader_File *file, const int track, const int side, unsigned char *buf, const uint32_t buflen)
+{
+  return woz_readtrack(file->fh, file->state, track, side, buf, buflen);
+}
+
+// Obsolete .raw files have no header, state is just the buffer each track is read into
+int reader_rawopen(Reader_File *file)
+{
+  return reader_newstate(file, READER_OLDRAWTRACKSIZE);
+}
+
+// Obsolete .raw files were 8 megabits per track, sampled at 12.5Mhz, either 40 or 80 tracks, with second side (if any) folowing the whole of the first
+long reader_rawreadtrack(Reader_File *file, const int track, const int side, unsigned char *buf, const uint32_t buflen)
+{
+  if (fseek(file->fh, ((file->maxtracks*side)+track)*READER_OLDRAWTRACKSIZE, SEEK_SET)!=0)
+    return 0;
+
+  if (fread(file->state, READER_OLDRAWTRACKSIZE, 1, file->fh)==0)
+    return 0;
+
+  spi_fixsamples(file->state, READER_OLDRAWTRACKSIZE, buf, buflen);
+
+  return buflen;
+}
+
+// Supported sample file formats
+const Flux_Reader reader_formats[] = {
+  {"RFI", ".rfi", reader_proberfi, reader_rfiopen, reader_rfireadtrack, NULL, reader_freestate},
+  {"SCP", ".scp", reader_probescp, reader_scpopen, reader_scpreadtrack, reader_scpintervals, reader_scpclose},
+  {"HFE", ".hfe", reader_probehfe, reader_hfeopen, reader_hfereadtrack, NULL, reader_freestate},
+  {"A2R", ".a2r", reader_probea2r, reader_a2ropen, reader_a2rreadtrack, NULL, reader_freestate},
+  {"WOZ", ".woz", reader_probewoz, reader_wozopen, reader_wozreadtrack, NULL, reader_freestate},
+  {"RAW", ".raw", NULL, reader_rawopen, reader_rawreadtrack, NULL, reader_freestate}
+};
+
+#define READER_FORMATS (sizeof(reader_formats)/sizeof(reader_formats[0]))
+
+const Flux_Reader *reader_find(FILE *samplefile, const char *filename)
+{
+  unsigned char header[READER_PROBESIZE];
+  size_t len;
+  unsigned int i;
+
+  if (samplefile==NULL) return NULL;
+
+  // Identify by magic, leaving file positioned at the start for the reader to open
+  len=fread(header, 1, sizeof(header), samplefile);
+  fseek(samplefile, 0, SEEK_SET);
+
+  for (i=0; i<READER_FORMATS; i++)
+    if ((reader_formats[i].probe!=NULL) && (reader_formats[i].probe(header, len)))
+      return &reader_formats[i];
+
+  // Otherwise go by extension, for formats without magic
+  for (i=0; i<READER_FORMATS; i++)
+    if (compare_extension(filename, reader_formats[i].extension))
+      return &reader_formats[i];
+
+  return NULL;
+}
+
+Reader_File *reader_open(const char *filename, const unsigned long samplerate, const unsigned int maxtracks)
+{
+  Reader_File *file;
+
+  file=calloc(1, sizeof(Reader_File));
+  if (file==NULL) return NULL;
+
+  file->samplerate=samplerate;
+  file->maxtracks=maxtracks;
+
+  file->fh=fopen(filename, "rb");
+  if (file->fh==NULL)
+  {
+    free(file);
+    return NULL;
+  }
+
+  // Identify the format, then read header values to determine capture settings
+  file->format=reader_find(file->fh, filename);
+
+  if ((file->format==NULL) || (file->format->open(file)==-1))
+  {
+    reader_close(file);
+    return NULL;
+  }
+
+  return file;
+}
+
+void reader_readtrack(Reader_File *file, const int track, const int side, unsigned char *buf, const uint32_t buflen)
+{
+  // Clear output buffer to prevent failed reads potentially returning previous data
+  bzero(buf, buflen);
+
+  file->format->readtrack(file, track, side, buf, buflen);
+}
+
+int reader_readintervals(Reader_File *file, const int track, const int side, Flux_Intervals *flux, const uint32_t buflen)
+{
+  if (file->format->readintervals==NULL) return 0;
+
+  return file->format->readintervals(file, track, side, flux, buflen);
+}
+
+void reader_close(Reader_File *file)
+{
+  if (file==NULL) return;
+
+  if (file->format!=NULL)
+    file->format->close(file);
+
+  if (file->fh!=NULL)
+    fclose(file->fh);
+
+  free(file);
+}
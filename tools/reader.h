@@ -0,0 +1,61 @@
+#ifndef _READER_H_
+#define _READER_H_
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "flux.h"
+
+// Number of bytes from the start of a sample file used to identify its format
+#define READER_PROBESIZE 16
+
+struct FluxReader;
+
+// An open sample file, everything needed to read from it is kept here
+typedef struct ReaderFile
+{
+  FILE *fh;
+  const struct FluxReader *format;
+  void *state; // Format specific
+
+  unsigned long samplerate; // Rate tracks are read at, formats with a fixed rate set their own
+  unsigned int maxtracks; // Tracks per side, for formats which don't record it
+  float rpm; // From the file for the last track read, 0 when not known
+} Reader_File;
+
+typedef struct FluxReader
+{
+  const char *name;
+  const char *extension;
+
+  // Non-zero if file starts with this format's magic, NULL for formats without any
+  int (*probe)(const unsigned char *header, const size_t len);
+
+  // Read header values into new state for this file, -1 if not valid
+  int (*open)(Reader_File *file);
+
+  // Read track into sample bitmap
+  long (*readtrack)(Reader_File *file, const int track, const int side, unsigned char *buf, const uint32_t buflen);
+
+  // Read track as flux intervals, returns 0 if not possible, NULL if format doesn't support it
+  int (*readintervals)(Reader_File *file, const int track, const int side, Flux_Intervals *flux, const uint32_t buflen);
+
+  // Free the state kept since open
+  void (*close)(Reader_File *file);
+} Flux_Reader;
+
+// Find reader for sample file by its magic, falling back to file extension, NULL if unknown
+extern const Flux_Reader *reader_find(FILE *samplefile, const char *filename);
+
+// Open sample file and read its header, NULL if it can't be opened or isn't valid
+extern Reader_File *reader_open(const char *filename, const unsigned long samplerate, const unsigned int maxtracks);
+
+// Read track into sample bitmap, which is cleared first
+extern void reader_readtrack(Reader_File *file, const int track, const int side, unsigned char *buf, const uint32_t buflen);
+
+// Read track as flux intervals, returns 0 if the format doesn't allow it
+extern int reader_readintervals(Reader_File *file, const int track, const int side, Flux_Intervals *flux, const uint32_t buflen);
+
+extern void reader_close(Reader_File *file);
+
+#endif
@@ -6,17 +6,13 @@
 #include <sys/time.h>
 
 #include "hardware.h"
+#include "flux.h"
 #include "rfi.h"
 #include "jsmn.h"
 
-char *rfi_headerstring = NULL;
-unsigned int rfi_headerlen = 0;
-
-// Header metadata
-int rfi_tracks = 0;
-int rfi_sides = 0;
-long rfi_rate = 0;
-unsigned char rfi_writeable = 0;
+// Where each track was put in the file being written
+RFI_Track rfi_written[RFI_MAXTRACKS*RFI_MAXSIDES];
+unsigned int rfi_writtencount = 0;
 
 // Write file metadata
 void rfi_writeheader(FILE *rfifile, const int tracks, const int sides, const long rate, const unsigned char writeable)
@@ -29,14 +25,304 @@ void rfi_writeheader(FILE *rfifile, const int tracks, const int sides, const lon
   gettimeofday(&tv, NULL);
   localtime_r(&tv.tv_sec, &tim);
 
+  rfi_writtencount=0;
+
   fprintf(rfifile, "%s", RFI_MAGIC);
 
   fprintf(rfifile, "{date:\"%02d/%02d/%d\",time:\"%02d:%02d:%02d\",tracks:%d,sides:%d,rate:%ld,writeable:%d}", tim.tm_mday, tim.tm_mon+1, tim.tm_year+1900, tim.tm_hour, tim.tm_min, tim.tm_sec, tracks, sides, rate, writeable);
 }
 
-int rfi_readheader(FILE *rfifile)
+// Parse track metadata at the current file position, leaving the file at the start of the track data
+int rfi_readtrackheader(FILE *rfifile, RFI_Track *entry)
+{
+  jsmn_parser parser;
+  jsmntok_t *tokens;
+  int numtokens;
+  long metapos;
+  size_t metalen;
+  int i;
+
+  char metabuffer[1024];
+
+  // Initialise track metadata
+  entry->track=-1;
+  entry->side=-1;
+  entry->rpm=-1;
+  entry->encoding[0]=0;
+  entry->datalen=0;
+  entry->datapos=0;
+
+  // Read track metadata
+  metapos=ftell(rfifile);
+
+  if (metapos==-1)
+    return -1;
+
+  metalen=fread(metabuffer, 1, sizeof(metabuffer)-1, rfifile);
+  if (metalen==0)
+    return -1;
+
+  metabuffer[metalen]=0;
+
+  for (i=0; i<(int)metalen; i++)
+  {
+    if (metabuffer[i]=='}')
+    {
+      metabuffer[i+1]=0;
+      break;
+    }
+  }
+
+  // Quick check for validty and to count the tokens
+  jsmn_init(&parser);
+  numtokens=jsmn_parse(&parser, metabuffer, sizeof(metabuffer), NULL, 0);
+
+  if (numtokens<=0)
+    return -1;
+
+  tokens=malloc(numtokens*sizeof(jsmntok_t));
+
+  if (tokens==NULL) return -1;
+
+  jsmn_init(&parser);
+  numtokens=jsmn_parse(&parser, metabuffer, sizeof(metabuffer), tokens, numtokens);
+
+  // Move file pointer to first byte after track header
+  if (fseek(rfifile, metapos+tokens[0].end, SEEK_SET)!=0)
+  {
+    free(tokens);
+    return -1;
+  }
+
+  entry->datapos=metapos+tokens[0].end;
+
+  for (i=0; i<numtokens; i++)
+  {
+    if ((tokens[i].type==JSMN_PRIMITIVE) && (tokens[i].size==1) && ((i+1)<=numtokens))
+    {
+      char rfic;
+
+      if (strncmp(&metabuffer[tokens[i].start], "enc", tokens[i].end-tokens[i].start)==0)
+      {
+        rfic=metabuffer[tokens[i+1].end];
+        metabuffer[tokens[i+1].end]=0;
+
+        if (strlen(&metabuffer[tokens[i+1].start])<sizeof(entry->encoding))
+          strcpy(entry->encoding, &metabuffer[tokens[i+1].start]);
+
+        metabuffer[tokens[i+1].end]=rfic;
+      }
+      else
+      if (strncmp(&metabuffer[tokens[i].start], "track", tokens[i].end-tokens[i].start)==0)
+      {
+        rfic=metabuffer[tokens[i+1].end];
+        metabuffer[tokens[i+1].end]=0;
+
+        sscanf(&metabuffer[tokens[i+1].start], "%3d", &entry->track);
+
+        metabuffer[tokens[i+1].end]=rfic;
+      }
+      else
+      if (strncmp(&metabuffer[tokens[i].start], "side", tokens[i].end-tokens[i].start)==0)
+      {
+        rfic=metabuffer[tokens[i+1].end];
+        metabuffer[tokens[i+1].end]=0;
+
+        sscanf(&metabuffer[tokens[i+1].start], "%1d", &entry->side);
+
+        metabuffer[tokens[i+1].end]=rfic;
+      }
+      else
+      if (strncmp(&metabuffer[tokens[i].start], "len", tokens[i].end-tokens[i].start)==0)
+      {
+        rfic=metabuffer[tokens[i+1].end];
+        metabuffer[tokens[i+1].end]=0;
+
+        sscanf(&metabuffer[tokens[i+1].start], "%8lu", &entry->datalen);
+
+        metabuffer[tokens[i+1].end]=rfic;
+      }
+      else
+      if (strncmp(&metabuffer[tokens[i].start], "rpm", tokens[i].end-tokens[i].start)==0)
+      {
+        rfic=metabuffer[tokens[i+1].end];
+        metabuffer[tokens[i+1].end]=0;
+
+        sscanf(&metabuffer[tokens[i+1].start], "%f", &entry->rpm);
+
+        metabuffer[tokens[i+1].end]=rfic;
+      }
+    }
+  }
+
+  free(tokens);
+
+  return 0;
+}
+
+// Add a track to the index, only the first copy of each track is used
+void rfi_indextrack(RFI_Reader *rfi, const int track, const int side, const long headerpos)
+{
+  if ((track<0) || (track>=RFI_MAXTRACKS) || (side<0) || (side>=RFI_MAXSIDES)) return;
+
+  if (rfi->index[track][side].headerpos!=0) return;
+
+  rfi->index[track][side].headerpos=headerpos;
+  rfi->index[track][side].datapos=0;
+}
+
+// Load the track index from the footer, if there is one
+int rfi_readfooter(FILE *rfifile, RFI_Reader *rfi)
+{
+  char trailer[RFI_TRAILERLEN+1];
+  char *footer;
+  unsigned long footerpos;
+  long footerlen;
+  long filelen;
+  jsmn_parser parser;
+  jsmntok_t *tokens;
+  int numtokens;
+  int i;
+
+  // Find where the footer starts from the fixed size trailer at the very end
+  if (fseek(rfifile, 0, SEEK_END)!=0) return -1;
+  filelen=ftell(rfifile);
+
+  if (filelen<(long)(rfi->headerlen+3+RFI_TRAILERLEN)) return -1;
+  if (fseek(rfifile, filelen-RFI_TRAILERLEN, SEEK_SET)!=0) return -1;
+  if (fread(trailer, RFI_TRAILERLEN, 1, rfifile)==0) return -1;
+  trailer[RFI_TRAILERLEN]=0;
+
+  if (strncmp(trailer, RFI_TRAILER, strlen(RFI_TRAILER))!=0) return -1;
+  if (sscanf(&trailer[strlen(RFI_TRAILER)], "%10lu}", &footerpos)!=1) return -1;
+
+  footerlen=filelen-footerpos;
+  if ((footerpos<(rfi->headerlen+3)) || (footerlen<=RFI_TRAILERLEN)) return -1;
+
+  footer=malloc(footerlen+1);
+  if (footer==NULL) return -1;
+
+  if ((fseek(rfifile, footerpos, SEEK_SET)!=0) || (fread(footer, footerlen, 1, rfifile)==0))
+  {
+    free(footer);
+    return -1;
+  }
+  footer[footerlen]=0;
+
+  jsmn_init(&parser);
+  numtokens=jsmn_parse(&parser, footer, footerlen, NULL, 0);
+
+  if (numtokens<=0)
+  {
+    free(footer);
+    return -1;
+  }
+
+  tokens=malloc(numtokens*sizeof(jsmntok_t));
+  if (tokens==NULL)
+  {
+    free(footer);
+    return -1;
+  }
+
+  jsmn_init(&parser);
+  numtokens=jsmn_parse(&parser, footer, footerlen, tokens, numtokens);
+
+  // Look for the index, an array of [track,side,offset] entries
+  for (i=0; (i+2)<numtokens; i++)
+  {
+    if ((tokens[i].type==JSMN_PRIMITIVE) && (tokens[i].size==1) &&
+        (strncmp(&footer[tokens[i].start], "index", tokens[i].end-tokens[i].start)==0) &&
+        (tokens[i+1].type==JSMN_ARRAY))
+    {
+      int entries;
+      int j;
+
+      entries=tokens[i+1].size;
+
+      for (j=0; j<entries; j++)
+      {
+        int k=i+2+(j*4);
+        int track, side;
+        long headerpos;
+
+        if (((k+3)>=numtokens) || (tokens[k].type!=JSMN_ARRAY) || (tokens[k].size!=3)) break;
+
+        track=atoi(&footer[tokens[k+1].start]);
+        side=atoi(&footer[tokens[k+2].start]);
+        headerpos=atol(&footer[tokens[k+3].start]);
+
+        rfi_indextrack(rfi, track, side, headerpos);
+      }
+
+      free(tokens);
+      free(footer);
+
+      return 0;
+    }
+  }
+
+  free(tokens);
+  free(footer);
+
+  return -1;
+}
+
+// Build index of where each track is in the file by skipping through each track
+void rfi_scanindex(FILE *rfifile, RFI_Reader *rfi)
+{
+  bzero(rfi->index, sizeof(rfi->index));
+  rfi->indexscanned=1;
+
+  if (fseek(rfifile, rfi->headerlen+3, SEEK_SET)!=0)
+    return;
+
+  while (!feof(rfifile))
+  {
+    RFI_Track entry;
+    long headerpos;
+
+    headerpos=ftell(rfifile);
+
+    if (rfi_readtrackheader(rfifile, &entry)!=0)
+      break;
+
+    // Reached the footer
+    if (entry.track==-1)
+      break;
+
+    rfi_indextrack(rfi, entry.track, entry.side, headerpos);
+
+    // Save reparsing later
+    if ((entry.track>=0) && (entry.track<RFI_MAXTRACKS) && (entry.side>=0) && (entry.side<RFI_MAXSIDES) &&
+        (rfi->index[entry.track][entry.side].headerpos==headerpos))
+    {
+      entry.headerpos=headerpos;
+      rfi->index[entry.track][entry.side]=entry;
+    }
+
+    // Skip this track's data
+    if (fseek(rfifile, entry.datalen, SEEK_CUR)!=0)
+      break;
+  }
+}
+
+// Build index of where each track is in the file, from the footer when present
+void rfi_buildindex(FILE *rfifile, RFI_Reader *rfi)
+{
+  bzero(rfi->index, sizeof(rfi->index));
+  rfi->indexscanned=0;
+
+  if (rfi_readfooter(rfifile, rfi)==0)
+    return;
+
+  rfi_scanindex(rfifile, rfi);
+}
+
+int rfi_readheader(FILE *rfifile, RFI_Reader *rfi)
 {
   unsigned char buff[4];
+  char *headerstring;
 
   if (rfifile==NULL) return -1;
 
@@ -61,24 +347,24 @@ int rfi_readheader(FILE *rfifile)
       jsmn_parser parser;
       int numtokens;
 
-      rfi_headerlen=ftell(rfifile)-3;
+      rfi->headerlen=ftell(rfifile)-3;
 
-      rfi_headerstring=malloc(rfi_headerlen+1);
-      if (rfi_headerstring==NULL)
+      headerstring=malloc(rfi->headerlen+1);
+      if (headerstring==NULL)
         return -1;
 
       fseek(rfifile, 3, SEEK_SET);
-      if (fread(rfi_headerstring, rfi_headerlen, 1, rfifile)==0)
+      if (fread(headerstring, rfi->headerlen, 1, rfifile)==0)
       {
-        free(rfi_headerstring);
+        free(headerstring);
         return -1;
       }
-      rfi_headerstring[rfi_headerlen]=0;
+      headerstring[rfi->headerlen]=0;
 
       jsmn_init(&parser);
 
       // Quick check for validity and to count the tokens
-      numtokens=jsmn_parse(&parser, rfi_headerstring, rfi_headerlen, NULL, 0);
+      numtokens=jsmn_parse(&parser, headerstring, rfi->headerlen, NULL, 0);
 
       if (numtokens>0)
       {
@@ -89,12 +375,12 @@ int rfi_readheader(FILE *rfifile)
 
         if (tokens==0)
         {
-          free(rfi_headerstring);
+          free(headerstring);
           return -1;
         }
 
         jsmn_init(&parser);
-        numtokens=jsmn_parse(&parser, rfi_headerstring, rfi_headerlen, tokens, numtokens);
+        numtokens=jsmn_parse(&parser, headerstring, rfi->headerlen, tokens, numtokens);
 
         for (i=0; i<numtokens; i++)
         {
@@ -102,64 +388,67 @@ int rfi_readheader(FILE *rfifile)
           {
             char rfic;
 
-            if (strncmp(&rfi_headerstring[tokens[i].start], "tracks", tokens[i].end-tokens[i].start)==0)
+            if (strncmp(&headerstring[tokens[i].start], "tracks", tokens[i].end-tokens[i].start)==0)
             {
-              rfic=rfi_headerstring[tokens[i+1].end];
-              rfi_headerstring[tokens[i+1].end]=0;
+              rfic=headerstring[tokens[i+1].end];
+              headerstring[tokens[i+1].end]=0;
 
-              sscanf(&rfi_headerstring[tokens[i+1].start], "%3d", &rfi_tracks);
+              sscanf(&headerstring[tokens[i+1].start], "%3d", &rfi->tracks);
 
-              rfi_headerstring[tokens[i+1].end]=rfic;
+              headerstring[tokens[i+1].end]=rfic;
             }
             else
-            if (strncmp(&rfi_headerstring[tokens[i].start], "sides", tokens[i].end-tokens[i].start)==0)
+            if (strncmp(&headerstring[tokens[i].start], "sides", tokens[i].end-tokens[i].start)==0)
             {
-              rfic=rfi_headerstring[tokens[i+1].end];
-              rfi_headerstring[tokens[i+1].end]=0;
+              rfic=headerstring[tokens[i+1].end];
+              headerstring[tokens[i+1].end]=0;
 
-              sscanf(&rfi_headerstring[tokens[i+1].start], "%1d", &rfi_sides);
+              sscanf(&headerstring[tokens[i+1].start], "%1d", &rfi->sides);
 
-              rfi_headerstring[tokens[i+1].end]=rfic;
+              headerstring[tokens[i+1].end]=rfic;
             }
             else
-            if (strncmp(&rfi_headerstring[tokens[i].start], "rate", tokens[i].end-tokens[i].start)==0)
+            if (strncmp(&headerstring[tokens[i].start], "rate", tokens[i].end-tokens[i].start)==0)
             {
-              rfic=rfi_headerstring[tokens[i+1].end];
-              rfi_headerstring[tokens[i+1].end]=0;
+              rfic=headerstring[tokens[i+1].end];
+              headerstring[tokens[i+1].end]=0;
 
-              if (sscanf(&rfi_headerstring[tokens[i+1].start], "%10ld", &rfi_rate)==1)
-                hw_samplerate=rfi_rate;
+              sscanf(&headerstring[tokens[i+1].start], "%10ld", &rfi->rate);
 
-              rfi_headerstring[tokens[i+1].end]=rfic;
+              headerstring[tokens[i+1].end]=rfic;
             }
             else
-            if (strncmp(&rfi_headerstring[tokens[i].start], "writeable", tokens[i].end-tokens[i].start)==0)
+            if (strncmp(&headerstring[tokens[i].start], "writeable", tokens[i].end-tokens[i].start)==0)
             {
-              rfic=rfi_headerstring[tokens[i+1].end];
-              rfi_headerstring[tokens[i+1].end]=0;
+              rfic=headerstring[tokens[i+1].end];
+              headerstring[tokens[i+1].end]=0;
 
-              sscanf(&rfi_headerstring[tokens[i+1].start], "%1c", &rfi_writeable);
+              sscanf(&headerstring[tokens[i+1].start], "%1c", &rfi->writeable);
 
-              if (rfi_writeable=='1')
-                rfi_writeable=1;
+              if (rfi->writeable=='1')
+                rfi->writeable=1;
               else
-                rfi_writeable=0;
+                rfi->writeable=0;
 
-              rfi_headerstring[tokens[i+1].end]=rfic;
+              headerstring[tokens[i+1].end]=rfic;
             }
           }
         }
 
         free(tokens);
-        free(rfi_headerstring);
+        free(headerstring);
+
+        if (rfi->tracks>0)
+        {
+          rfi_buildindex(rfifile, rfi);
 
-        if (rfi_tracks>0)
           return 0;
+        }
         else
           return -1;
       }
 
-      free(rfi_headerstring);
+      free(headerstring);
     }
   }
 
@@ -170,62 +459,155 @@ int rfi_readheader(FILE *rfifile)
 // RLE encode raw binary sample data
 unsigned long rfi_rleencode(unsigned char *rlebuffer, const unsigned long maxrlelen, const unsigned char *rawtrackdata, const unsigned long rawdatalength)
 {
+  Flux_Intervals flux;
   unsigned long rlelen=0;
-  char state=0;
-  unsigned int i, j;
-  int count=0;
+  unsigned long i, count;
 
-  // Determine starting sample level
-  state=(rawtrackdata[0]&0x80)>>7;
+  // Find the length of every run between level changes
+  flux_init(&flux);
+  flux_extract(&flux, rawtrackdata, rawdatalength, FLUX_ALLEDGES);
 
   // If not starting at zero, then record a 0 count
-  if (state!=0)
+  if (flux.startlevel!=0)
     rlebuffer[rlelen++]=0;
 
-  for (i=0; i<rawdatalength; i++)
+  for (i=0; i<=flux.count; i++)
   {
-    unsigned char c;
-
-    c=rawtrackdata[i];
+    // Samples after the last level change are only recorded as whole overflows
+    count=(i<flux.count)?flux.interval[i]:flux.trailing;
 
-    // Process each of the 8 sample bits looking for state change
-    for (j=0; j<8; j++)
+    while (count>0xff)
     {
-      count++;
-
-      if (count>0xff)
+      // Check for RLE buffer overflow
+      if ((rlelen+2)>=maxrlelen)
       {
-        // Check for RLE buffer overflow
-        if ((rlelen+2)>=maxrlelen) return 0;
-
-        rlebuffer[rlelen++]=0xff;
-        rlebuffer[rlelen++]=0;
-        count=0;
+        flux_free(&flux);
+        return 0;
       }
 
-      if (((c&0x80)>>7)!=state)
-      {
-        state=1-state;
-
-        // Check for RLE buffer overflow
-        if ((rlelen+1)>=maxrlelen) return 0;
+      rlebuffer[rlelen++]=0xff;
+      rlebuffer[rlelen++]=0;
+      count-=0x100;
+    }
 
-        rlebuffer[rlelen++]=count;
-        count=0;
+    if (i<flux.count)
+    {
+      // Check for RLE buffer overflow
+      if ((rlelen+1)>=maxrlelen)
+      {
+        flux_free(&flux);
+        return 0;
       }
 
-      c=c<<1;
+      rlebuffer[rlelen++]=count;
     }
   }
 
+  flux_free(&flux);
+
   return rlelen;
 }
 
+// Append a varint, 7 bits per byte least significant first, with top bit set when more follow
+static inline unsigned long rfi_putvarint(unsigned char *buf, unsigned long pos, uint32_t value)
+{
+  while (value>=0x80)
+  {
+    buf[pos++]=(value&0x7f)|0x80;
+    value>>=7;
+  }
+
+  buf[pos++]=value;
+
+  return pos;
+}
+
+// Varint encode intervals between rising edges, optionally as zigzag coded change from the previous interval
+unsigned long rfi_varintencode(unsigned char *varbuffer, const Flux_Intervals *flux, const int deltas)
+{
+  unsigned long varlen=0;
+  unsigned long i;
+  int32_t previous=0;
+
+  for (i=0; i<flux->count; i++)
+  {
+    if (deltas)
+    {
+      int32_t delta;
+
+      delta=(int32_t)flux->interval[i]-previous;
+      previous=flux->interval[i];
+
+      varlen=rfi_putvarint(varbuffer, varlen, ((uint32_t)delta<<1)^(uint32_t)(delta>>31));
+    }
+    else
+      varlen=rfi_putvarint(varbuffer, varlen, flux->interval[i]);
+  }
+
+  return varlen;
+}
+
+// Rebuild sample data from varint coded intervals, marking each rising edge with a single high sample
+long rfi_varintdecode(unsigned char *buf, const uint32_t buflen, const unsigned char *varbuffer, const unsigned long varlen, const int deltas)
+{
+  unsigned long bitpos=0;
+  unsigned long maxbits=(unsigned long)buflen*BITSPERBYTE;
+  unsigned long i=0;
+  uint32_t interval=0;
+
+  bzero(buf, buflen);
+
+  while (i<varlen)
+  {
+    uint32_t value=0;
+    int shift=0;
+
+    // Extract next varint
+    while ((i<varlen) && (shift<32))
+    {
+      unsigned char c=varbuffer[i++];
+
+      value|=((uint32_t)(c&0x7f))<<shift;
+      shift+=7;
+
+      if ((c&0x80)==0)
+        break;
+    }
+
+    if (deltas)
+      interval+=(value>>1)^(-(value&1));
+    else
+      interval=value;
+
+    bitpos+=interval;
+
+    // Check for unpacking overflow
+    if ((bitpos==0) || (bitpos>maxbits))
+      break;
+
+    buf[(bitpos-1)/BITSPERBYTE]|=(0x80>>((bitpos-1)%BITSPERBYTE));
+  }
+
+  if (bitpos>maxbits)
+    bitpos=maxbits;
+
+  return (bitpos+(BITSPERBYTE-1))/BITSPERBYTE;
+}
+
 // Write track metadata and track sample data
 void rfi_writetrack(FILE *rfifile, const int track, const int side, const float rpm, const char *encoding, const unsigned char *rawtrackdata, const unsigned long rawdatalength)
 {
   if (rfifile==NULL) return;
 
+  // Note where the track starts, for the index in the footer
+  if (rfi_writtencount<RFI_MAXTRACKS*RFI_MAXSIDES)
+  {
+    rfi_written[rfi_writtencount].track=track;
+    rfi_written[rfi_writtencount].side=side;
+    rfi_written[rfi_writtencount].headerpos=ftell(rfifile);
+    rfi_writtencount++;
+  }
+
   fprintf(rfifile, "{track:%d,side:%d,rpm:%.2f,", track, side, rpm);
 
   if (strstr(encoding, "raw")!=NULL)
@@ -257,240 +639,219 @@ void rfi_writetrack(FILE *rfifile, const int track, const int side, const float
     }
   }
   else
+  if (strstr(encoding, "varint")!=NULL)
+  {
+    Flux_Intervals flux;
+    unsigned char *vardata;
+
+    flux_init(&flux);
+    flux_extract(&flux, rawtrackdata, rawdatalength, FLUX_RISINGEDGES);
+
+    // Room for both ways of coding, at worst 5 bytes per interval
+    vardata=malloc((flux.count*RFI_MAXVARINT*2)+1);
+
+    if (vardata!=NULL)
+    {
+      unsigned long intervallen, deltalen;
+      unsigned char *deltadata;
+
+      deltadata=&vardata[flux.count*RFI_MAXVARINT];
+
+      // Use whichever of intervals or changes in interval is smaller for this track
+      intervallen=rfi_varintencode(vardata, &flux, 0);
+      deltalen=rfi_varintencode(deltadata, &flux, 1);
+
+      if (deltalen<intervallen)
+      {
+        fprintf(rfifile, "enc:\"varintdd\",len:%lu}", deltalen);
+        fwrite(deltadata, 1, deltalen, rfifile);
+      }
+      else
+      {
+        fprintf(rfifile, "enc:\"varint\",len:%lu}", intervallen);
+        fwrite(vardata, 1, intervallen, rfifile);
+      }
+
+      free(vardata);
+    }
+    else
+    {
+      fprintf(rfifile, "enc:\"unknown\",len:0}");
+    }
+
+    flux_free(&flux);
+  }
+  else
   {
     // Don't write any track data for unknown encodings
     fprintf(rfifile, "enc:\"unknown\",len:0}");
   }
 }
 
-long rfi_readtrack(FILE *rfifile, const int track, const int side, unsigned char *buf, const uint32_t buflen)
+// Find the metadata for a given track in the index
+RFI_Track *rfi_findtrack(FILE *rfifile, RFI_Reader *rfi, const int track, const int side)
 {
-  int rfi_track = -1;
-  int rfi_side = -1;
-  float rfi_rpm = -1;
-  char rfi_trackencoding[10];
-  unsigned long rfi_trackdatalen = 0;
+  RFI_Track *entry;
 
-  char metabuffer[1024];
+  if ((track<0) || (track>=RFI_MAXTRACKS) || (side<0) || (side>=RFI_MAXSIDES)) return NULL;
 
-  if (rfifile==NULL) return 0;
-
-  // Make sure we have valid file JSON metadata
-  if (rfi_headerlen==0) return 0;
-
-  // Seek past file JSON metadata
-  if (fseek(rfifile, rfi_headerlen+3, SEEK_SET)!=0)
-    return 0;
+  entry=&rfi->index[track][side];
+  if (entry->headerpos==0) return NULL;
 
-  while (!feof(rfifile))
+  // Tracks indexed from the footer have their metadata read when first needed
+  if (entry->datapos==0)
   {
-    jsmn_parser parser;
-    int numtokens;
-    long metapos;
-    int i;
-
-    // Initialise track metadata
-    rfi_track=-1;
-    rfi_side=-1;
-    rfi_rpm=-1;
-    rfi_trackencoding[0]=0;
-    rfi_trackdatalen=0;
-
-    // Read track metadata
-    metapos=ftell(rfifile);
-
-    if (metapos==-1)
-      return 0;
+    long headerpos=entry->headerpos;
 
-    if (fread(metabuffer, sizeof(metabuffer), 1, rfifile)!=1)
-      return 0;
+    if (fseek(rfifile, headerpos, SEEK_SET)!=0) return NULL;
 
-    if (fseek(rfifile, metapos, SEEK_SET)!=0)
-      return 0;
-
-    for (i=0; i<(int)sizeof(metabuffer); i++)
+    // Footer doesn't match the tracks, so fall back to finding them the slow way
+    if ((rfi_readtrackheader(rfifile, entry)!=0) || (entry->track!=track) || (entry->side!=side))
     {
-      if ((metabuffer[i]=='}') && ((i+1)<(int)sizeof(metabuffer)))
+      if (rfi->indexscanned)
       {
-        metabuffer[i+1]=0;
-        break;
+        entry->headerpos=0;
+        return NULL;
       }
-    }
-
-    // Quick check for validty and to count the tokens
-    jsmn_init(&parser);
-    numtokens=jsmn_parse(&parser, metabuffer, sizeof(metabuffer), NULL, 0);
 
-    if (numtokens>0)
-    {
-      jsmntok_t *tokens;
-
-      tokens=malloc(numtokens*sizeof(jsmntok_t));
+      rfi_scanindex(rfifile, rfi);
 
-      if (tokens==NULL) return 0;
+      return rfi_findtrack(rfifile, rfi, track, side);
+    }
 
-      jsmn_init(&parser);
-      numtokens=jsmn_parse(&parser, metabuffer, sizeof(metabuffer), tokens, numtokens);
+    entry->headerpos=headerpos;
+  }
 
-      // Move file pointer to first byte after track header
-      if (fseek(rfifile, tokens[0].end, SEEK_CUR)!=0)
-      {
-        free(tokens);
-        return 0;
-      }
+  return entry;
+}
 
-      for (i=0; i<numtokens; i++)
-      {
-        if ((tokens[i].type==JSMN_PRIMITIVE) && (tokens[i].size==1) && ((i+1)<=numtokens))
-        {
-          char rfic;
+long rfi_readtrack(FILE *rfifile, RFI_Reader *rfi, const int track, const int side, unsigned char *buf, const uint32_t buflen)
+{
+  RFI_Track *entry;
+  int i;
 
-          if (strncmp(&metabuffer[tokens[i].start], "enc", tokens[i].end-tokens[i].start)==0)
-          {
-            rfic=metabuffer[tokens[i+1].end];
-            metabuffer[tokens[i+1].end]=0;
+  if (rfifile==NULL) return 0;
 
-            if (strlen(&metabuffer[tokens[i+1].start])<sizeof(rfi_trackencoding))
-              strcpy(rfi_trackencoding, &metabuffer[tokens[i+1].start]);
+  // Make sure we have valid file JSON metadata
+  if (rfi->headerlen==0) return 0;
 
-            metabuffer[tokens[i+1].end]=rfic;
-          }
-          else
-          if (strncmp(&metabuffer[tokens[i].start], "track", tokens[i].end-tokens[i].start)==0)
-          {
-            rfic=metabuffer[tokens[i+1].end];
-            metabuffer[tokens[i+1].end]=0;
+  entry=rfi_findtrack(rfifile, rfi, track, side);
+  if (entry==NULL) return 0;
 
-            sscanf(&metabuffer[tokens[i+1].start], "%3d", &rfi_track);
+  if ((entry->encoding[0]==0) || (entry->datalen==0)) return 0;
 
-            metabuffer[tokens[i+1].end]=rfic;
-          }
-          else
-          if (strncmp(&metabuffer[tokens[i].start], "side", tokens[i].end-tokens[i].start)==0)
-          {
-            rfic=metabuffer[tokens[i+1].end];
-            metabuffer[tokens[i+1].end]=0;
+  if (entry->rpm!=-1)
+    rfi->rpm=entry->rpm;
+  else
+    rfi->rpm=HW_DEFAULTRPM;
 
-            sscanf(&metabuffer[tokens[i+1].start], "%1d", &rfi_side);
+  if (fseek(rfifile, entry->datapos, SEEK_SET)!=0)
+    return 0;
 
-            metabuffer[tokens[i+1].end]=rfic;
-          }
-          else
-          if (strncmp(&metabuffer[tokens[i].start], "len", tokens[i].end-tokens[i].start)==0)
-          {
-            rfic=metabuffer[tokens[i+1].end];
-            metabuffer[tokens[i+1].end]=0;
+  if (strstr(entry->encoding, "raw")!=NULL)
+  {
+    if (entry->datalen<=buflen)
+      return fread(buf, entry->datalen, 1, rfifile);
+    else
+      return fread(buf, buflen, 1, rfifile);
+  }
+  else
+  if (strstr(entry->encoding, "rle")!=NULL)
+  {
+    unsigned char b, blen, s;
+    long rlen=0;
+    char *rlebuff;
 
-            sscanf(&metabuffer[tokens[i+1].start], "%8lu", &rfi_trackdatalen);
+    rlebuff=malloc(entry->datalen);
 
-            metabuffer[tokens[i+1].end]=rfic;
-          }
-          else
-          if (strncmp(&metabuffer[tokens[i].start], "rpm", tokens[i].end-tokens[i].start)==0)
-          {
-            rfic=metabuffer[tokens[i+1].end];
-            metabuffer[tokens[i+1].end]=0;
+    if (rlebuff==NULL) return 0;
 
-            sscanf(&metabuffer[tokens[i+1].start], "%f", &rfi_rpm);
+    blen=0; s=0; b=0;
+    if (fread(rlebuff, entry->datalen, 1, rfifile)==0)
+    {
+      free(rlebuff);
+      return 0;
+    }
 
-            metabuffer[tokens[i+1].end]=rfic;
-          }
-        }
-      }
+    for (i=0; (unsigned int)i<entry->datalen; i++)
+    {
+      unsigned char c;
 
-      free(tokens);
-      tokens=NULL;
+      // Extract next RLE value
+      c=rlebuff[i];
 
-      // Is this the track we want?
-      if ((rfi_track==track) && (rfi_side==side) && (rfi_trackencoding[0]!=0) && (rfi_trackdatalen!=0))
+      while (c>0)
       {
-        // Don't adjust RPM when override used
-        if (hw_forcedrpm==0.0)
-        {
-          if (rfi_rpm!=-1)
-            hw_rpm=rfi_rpm;
-          else
-            hw_rpm=HW_DEFAULTRPM;
-        }
+        b=(b<<1)|s;
+        blen++;
 
-        if (strstr(rfi_trackencoding, "raw")!=NULL)
+        if (blen==8)
         {
-          if (rfi_trackdatalen<=buflen)
-            return fread(buf, rfi_trackdatalen, 1, rfifile);
-          else
-            return fread(buf, buflen, 1, rfifile);
-        }
-        else
-        if (strstr(rfi_trackencoding, "rle")!=NULL)
-        {
-          unsigned char b, blen, s;
-          long rlen=0;
-          char *rlebuff;
-
-          rlebuff=malloc(rfi_trackdatalen);
+          buf[rlen++]=b;
 
-          if (rlebuff==NULL) return 0;
-
-          blen=0; s=0; b=0;
-          if (fread(rlebuff, rfi_trackdatalen, 1, rfifile)==0)
+          // Check for unpacking overflow
+          if (rlen>=buflen)
           {
             free(rlebuff);
-            return 0;
+            return rlen;
           }
 
-          for (i=0; (unsigned int)i<rfi_trackdatalen; i++)
-          {
-            unsigned char c;
+          b=0;
+          blen=0;
+        }
 
-            // Extract next RLE value
-            c=rlebuff[i];
+        c--;
+      }
 
-            while (c>0)
-            {
-              b=(b<<1)|s;
-              blen++;
+      // Switch states
+      s=1-s;
+    }
 
-              if (blen==8)
-              {
-                buf[rlen++]=b;
+    free(rlebuff);
 
-                // Check for unpacking overflow
-                if (rlen>=buflen)
-                {
-                  free(rlebuff);
-                  return rlen;
-                }
+    return rlen;
+  }
+  else
+  if (strstr(entry->encoding, "varint")!=NULL)
+  {
+    unsigned char *varbuff;
+    long varlen;
 
-                b=0;
-                blen=0;
-              }
+    varbuff=malloc(entry->datalen);
 
-              c--;
-            }
+    if (varbuff==NULL) return 0;
 
-            // Switch states
-            s=1-s;
-          }
+    if (fread(varbuff, entry->datalen, 1, rfifile)==0)
+    {
+      free(varbuff);
+      return 0;
+    }
 
-          free(rlebuff);
+    varlen=rfi_varintdecode(buf, buflen, varbuff, entry->datalen, (strstr(entry->encoding, "varintdd")!=NULL));
 
-          return rlen;
-        }
-      }
-      else
-      {
-        // If the currently read track is more than the one we want, then the track isn't here
-        if (rfi_track>track) return 0;
+    free(varbuff);
 
-        // Skip this track, it's not the one we want
-        if (fseek(rfifile, rfi_trackdatalen, SEEK_CUR)!=0)
-          return 0;
-      }
-    }
-    else // No tokens found, give up further processing
-      return 0;
+    return varlen;
   }
 
   return 0;
 }
 
+// Write the footer, giving where each track is so the file can be opened without reading through it
+void rfi_finalise(FILE *rfifile)
+{
+  unsigned int i;
+  long footerpos;
+
+  if (rfifile==NULL) return;
+
+  footerpos=ftell(rfifile);
+  if (footerpos<=0) return;
+
+  fprintf(rfifile, "{index:[");
+
+  for (i=0; i<rfi_writtencount; i++)
+    fprintf(rfifile, "%s[%d,%d,%ld]", (i==0)?"":",", rfi_written[i].track, rfi_written[i].side, rfi_written[i].headerpos);
+
+  fprintf(rfifile, "],%s%010lu}", RFI_TRAILER, (unsigned long)footerpos);
+}
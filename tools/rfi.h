@@ -25,7 +25,7 @@ JSON track metadata .. {track:0,side:0,rate:12500000,rpm:300,enc:"rle",len:48560
 * track is physical track
 * side is physical side (0 or 1)
 * rpm is optional as it may not be known
-* enc can be "raw", "rle", or possibly gz
+* enc can be "raw", "rle", "varint", "varintdd", or possibly gz
 * len refers to encoded data, to allow skipping tracks when seeking
 * when more than one side is used, tracks are interleaved, e.g. track 0 side 0, track 0 side 1, track 1 side 0 e.t.c
 
@@ -38,21 +38,69 @@ RLE encoding
 * runs more than 0xff are (e.g. 0x101) are encoded as [ 0xff 0x00 0x02 ]
 * runs are samples between level changes
 * multiple rotations should be stored incase of jacket slip or CAV fluctuations
+VARINT encoding
+* only rising edges are kept, as samples between each one, the first being from the start of the track
+* each value is stored 7 bits per byte, least significant first, with the top bit set when more bytes follow
+* "varintdd" stores the change from the previous value instead, zigzag coded so small changes either way fit in one byte
+* when read back each rising edge is a single high sample
+
+Footer (optional)
+=================
+JSON index metadata .. {index:[[0,0,106],[0,1,48710]],start:0000097354}
+* index lists track, side and file offset of each track header
+* start is the file offset of the footer, always 10 digits so it can be found from the end of the file
+* readers without the footer skip through every track header instead
 
 */
 
 #define RFI_MAGIC "RFI"
 
-// From RFI header JSON
-extern int rfi_tracks;
-extern int rfi_sides;
-extern long rfi_rate;
-extern unsigned char rfi_writeable;
+// Longest varint needed for a 32 bit value
+#define RFI_MAXVARINT 5
+
+// Limits for the track index
+#define RFI_MAXTRACKS 256
+#define RFI_MAXSIDES 2
+
+// Footer ends with fixed size offset to its start
+#define RFI_TRAILER "start:"
+#define RFI_TRAILERLEN (6+10+1)
+
+// Where a track is held in the file, and how
+typedef struct RFITrack
+{
+  int track;
+  int side;
+  float rpm;
+  char encoding[10];
+  long headerpos; // Offset of track metadata, 0 when not present
+  long datapos; // Offset of track data, 0 until metadata has been read
+  unsigned long datalen;
+} RFI_Track;
+
+// State for reading an RFI file
+typedef struct RFIReader
+{
+  unsigned int headerlen;
+
+  // From RFI header JSON
+  int tracks;
+  int sides;
+  long rate;
+  unsigned char writeable;
+
+  float rpm; // Of the last track read
+
+  // Where each track is in the file
+  RFI_Track index[RFI_MAXTRACKS][RFI_MAXSIDES];
+  int indexscanned;
+} RFI_Reader;
 
 // Library functions
-extern int rfi_readheader(FILE *rfifile);
+extern int rfi_readheader(FILE *rfifile, RFI_Reader *rfi);
 extern void rfi_writeheader(FILE *rfifile, const int tracks, const int sides, const long rate, const unsigned char writeable);
 extern void rfi_writetrack(FILE *rfifile, const int track, const int side, const float rpm, const char *encoding, const unsigned char *rawtrackdata, const unsigned long rawdatalength);
-extern long rfi_readtrack(FILE *rfifile, const int track, const int side, unsigned char *buf, const uint32_t buflen);
+extern long rfi_readtrack(FILE *rfifile, RFI_Reader *rfi, const int track, const int side, unsigned char *buf, const uint32_t buflen);
+extern void rfi_finalise(FILE *rfifile);
 
 #endif
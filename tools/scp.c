@@ -5,9 +5,12 @@
 #include <strings.h>
 #include <time.h>
 #include <sys/time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <math.h>
 
 #include "hardware.h"
+#include "flux.h"
 #include "scp.h"
 #include "mod.h"
 
@@ -267,185 +270,287 @@ From : https://www.cbmstuff.com/downloads/scp/scp_image_specs.txt
 struct scp_header scpheader;
 long scp_endofheader=0;
 uint32_t *scp_trackoffsets=NULL;
-long scprate=0;
 
-uint32_t scp_checksum(FILE *scpfile)
+// Reusable buffer each track is encoded into before writing
+uint8_t *scp_trackbuffer=NULL;
+unsigned long scp_tracksize=0;
+unsigned long scp_tracklen=0;
+
+// Checksum of everything written so far after the header
+uint32_t scp_writtensum=0;
+
+// Release mapping of the input file
+void scp_unmap(SCP_Reader *scp)
 {
-  uint32_t checksum;
-  uint8_t block[256];
-  size_t i;
+  if (scp->mapped!=NULL)
+    munmap(scp->mapped, scp->mappedsize);
 
-  if (scpfile==NULL) return 0;
-  if (scp_endofheader==0) return 0;
+  scp->mapped=NULL;
+  scp->mappedsize=0;
+}
 
-  fseek(scpfile, scp_endofheader, SEEK_SET);
+// Map the whole file into memory for reading
+int scp_map(FILE *scpfile, SCP_Reader *scp)
+{
+  struct stat st;
+  void *mapped;
 
-  checksum=0;
+  scp_unmap(scp);
 
-  while (!feof(scpfile))
-  {
-    size_t blocklen;
+  if (fstat(fileno(scpfile), &st)!=0) return -1;
+  if (st.st_size<=0) return -1;
 
-    blocklen=fread(block, 1, sizeof(block), scpfile);
-    if (blocklen>0)
-    {
-      for (i=0; i<blocklen; i++)
-        checksum+=block[i];
-    }
-    else
-      return 0;
-  }
+  mapped=mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fileno(scpfile), 0);
+  if (mapped==MAP_FAILED) return -1;
+
+  scp->mapped=mapped;
+  scp->mappedsize=st.st_size;
 
-  fseek(scpfile, scp_endofheader, SEEK_SET);
+  return 0;
+}
+
+// Release everything kept for reading a file
+void scp_close(SCP_Reader *scp)
+{
+  scp_unmap(scp);
+
+  free(scp->trackoffsets);
+  scp->trackoffsets=NULL;
+}
+
+uint32_t scp_checksum(SCP_Reader *scp)
+{
+  uint32_t checksum;
+  size_t i;
+
+  if (scp->mapped==NULL) return 0;
+  if (scp->endofheader==0) return 0;
+
+  checksum=0;
+
+  for (i=scp->endofheader; i<scp->mappedsize; i++)
+    checksum+=scp->mapped[i];
 
   return checksum;
 }
 
-int scp_readheader(FILE *scpfile)
+int scp_readheader(FILE *scpfile, SCP_Reader *scp)
 {
   if (scpfile==NULL) return -1;
 
-  if (fread(&scpheader, sizeof(scpheader), 1, scpfile)==0) return -1;
+  if (fread(&scp->header, sizeof(scp->header), 1, scpfile)==0) return -1;
 
-  if (strncmp((char *)&scpheader.magic, SCP_MAGIC, strlen(SCP_MAGIC))!=0)
+  if (strncmp((char *)&scp->header.magic, SCP_MAGIC, strlen(SCP_MAGIC))!=0)
   {
-    bzero(&scpheader, sizeof(scpheader));
+    bzero(&scp->header, sizeof(scp->header));
 
     return -1;
   }
 
   // Only support 16bit timings
-  if (scpheader.bitcellencoding!=0x00) return -1;
+  if (scp->header.bitcellencoding!=0x00) return -1;
 
   // Make a note of where the header ends
-  scp_endofheader=ftell(scpfile);
+  scp->endofheader=ftell(scpfile);
+
+  // Track data is read straight from memory
+  if (scp_map(scpfile, scp)!=0) return -1;
 
   // Verify checksum
-  if (scp_checksum(scpfile)!=scpheader.checksum) return -1;
+  if (scp_checksum(scp)!=scp->header.checksum) return -1;
 
-  // Set RPM, when no override set
-  if (hw_forcedrpm==0.0)
-  {
-    if ((scpheader.flags & SCP_FLAGS_360RPM)!=0)
-      hw_rpm=360;
-    else
-      hw_rpm=300;
-  }
+  // Set RPM from flags
+  if ((scp->header.flags & SCP_FLAGS_360RPM)!=0)
+    scp->rpm=360;
+  else
+    scp->rpm=300;
 
   // Determine sample rate in Hz
-  scprate=(NSINUS/((scpheader.resolution+1)*SCP_BASE_NS))*USINSECOND;
+  scp->rate=(NSINUS/((scp->header.resolution+1)*SCP_BASE_NS))*USINSECOND;
 
   // Skip over extended data if used
-  if ((scpheader.flags & SCP_FLAGS_EXTENDED)!=0)
+  if ((scp->header.flags & SCP_FLAGS_EXTENDED)!=0)
     fseek(scpfile, 0x80, SEEK_SET);
 
   // Allocate memory to store track data offsets
-  scp_trackoffsets=malloc(sizeof(uint32_t) * SCP_MAXTRACKS);
-  if (scp_trackoffsets!=NULL)
+  scp->trackoffsets=malloc(sizeof(uint32_t) * SCP_MAXTRACKS);
+  if (scp->trackoffsets!=NULL)
   {
-    if (fread(scp_trackoffsets, (scpheader.endtrack-scpheader.starttrack+1)*sizeof(uint32_t), 1, scpfile)==0)
+    if (fread(scp->trackoffsets, (scp->header.endtrack-scp->header.starttrack+1)*sizeof(uint32_t), 1, scpfile)==0)
     {
-      free(scp_trackoffsets);
-      bzero(&scpheader, sizeof(scpheader));
+      free(scp->trackoffsets);
+      scp->trackoffsets=NULL;
+      bzero(&scp->header, sizeof(scp->header));
 
       return -1;
     }
   }
   else
   {
-    bzero(&scpheader, sizeof(scpheader));
+    bzero(&scp->header, sizeof(scp->header));
 
     return -1;
   }
 
-  if ((scpheader.starttrack==0) && (scpheader.endtrack==0)) return -1;
+  if ((scp->header.starttrack==0) && (scp->header.endtrack==0)) return -1;
 
   return 0;
 }
 
-long scp_readtrack(FILE * scpfile, const int track, const int side, unsigned char *buf, const uint32_t buflen)
+// Find flux data for one rotation of a track in the mapped file, NULL if not present
+const uint8_t *scp_rotationdata(SCP_Reader *scp, const int track, const int side, const int rotation, uint32_t *fluxcount)
 {
-  struct scp_tdh thdr;
-  struct scp_timings timings;
-  double scalar=(double)scprate/(double)hw_samplerate;
+  const struct scp_tdh *thdr;
+  const struct scp_timings *timings;
+  uint32_t trackoffset;
 
-  if (scpfile==NULL) return 0;
+  if (scp->mapped==NULL) return NULL;
+  if (scp->trackoffsets==NULL) return NULL;
 
-  bzero(buf, buflen);
+  // Ensure requested track is in range
+  if ((track<0) || ((track*2)>=scp->header.endtrack)) return NULL;
 
   // Don't process empty tracks
-  if (scp_trackoffsets[(track*2)+side]==0) return 0;
+  trackoffset=scp->trackoffsets[(track*2)+side];
+  if (trackoffset==0) return NULL;
 
-  // Ensure requested track is in range
-  if ((track<0) || ((track*2)>=scpheader.endtrack)) return 0;
-
-  // Seek to data for this track
-  fseek(scpfile, scp_trackoffsets[(track*2)+side], SEEK_SET);
+  if ((trackoffset+sizeof(struct scp_tdh)+(sizeof(struct scp_timings)*(rotation+1)))>scp->mappedsize) return NULL;
 
   // Verify track header
-  if (fread(&thdr, sizeof(thdr), 1, scpfile)==0) return 0;
+  thdr=(const struct scp_tdh *)&scp->mapped[trackoffset];
+  if (strncmp((char *)&thdr->magic, SCP_TRACK, strlen(SCP_TRACK))!=0) return NULL;
+
+  timings=(const struct scp_timings *)&scp->mapped[trackoffset+sizeof(struct scp_tdh)+(sizeof(struct scp_timings)*rotation)];
+
+  if ((trackoffset+timings->dataoffset+((uint64_t)timings->tracklen*sizeof(uint16_t)))>scp->mappedsize) return NULL;
+
+  *fluxcount=timings->tracklen;
+
+  return &scp->mapped[trackoffset+timings->dataoffset];
+}
+
+long scp_readtrack(SCP_Reader *scp, const unsigned long samplerate, const int track, const int side, unsigned char *buf, const uint32_t buflen)
+{
+  double scalar=(double)scp->rate/(double)samplerate;
+  unsigned long bitpos=0;
+  uint8_t i;
+
+  bzero(buf, buflen);
 
-  if (strncmp((char *)&thdr.magic, SCP_TRACK, strlen(SCP_TRACK))==0)
+  for (i=0; i<scp->header.revolutions; i++)
   {
-    uint8_t i;
+    const uint8_t *fluxdata;
+    uint32_t fluxcount;
     uint32_t sample;
-    uint16_t bitcell;
-    uint32_t bufpos=0;
 
-    //printf("Track %d.%d -> %d.%d\n", track, side, thdr.track/2, thdr.track%2);
+    fluxdata=scp_rotationdata(scp, track, side, i, &fluxcount);
+    if (fluxdata==NULL) break;
 
-    for (i=0; i<scpheader.revolutions; i++)
+    for (sample=0; sample<fluxcount; sample++)
     {
-      unsigned char b, blen;
-      long trackpos;
+      uint16_t bitcell;
 
-      if (fread(&timings, sizeof(timings), 1, scpfile)==0) return 0;
+      // Big-endian, convert to requested samplerate
+      bitcell=(fluxdata[sample*2]<<8)|fluxdata[(sample*2)+1];
+      bitcell=((double)bitcell/scalar);
 
-      trackpos=ftell(scpfile);
+      if (bitcell==0) continue;
 
-      // Seek to start of flux data
-      fseek(scpfile, scp_trackoffsets[(track*2)+side]+timings.dataoffset, SEEK_SET);
+      // Mark the flux transition at the end of this bitcell
+      bitpos+=bitcell;
+      if (((bitpos-1)/BITSPERBYTE)>=buflen) return 0;
 
-      blen=0; b=0;
+      buf[(bitpos-1)/BITSPERBYTE]|=(0x80>>((bitpos-1)%BITSPERBYTE));
+    }
 
-      for (sample=0; sample<timings.tracklen; sample++)
-      {
-        if (fread(&bitcell, sizeof(bitcell), 1, scpfile)==0) return 0;
+    // Only whole bytes of samples are kept, each rotation starts on a new byte
+    if ((bitpos%BITSPERBYTE)!=0)
+    {
+      if ((bitpos/BITSPERBYTE)<buflen)
+        buf[bitpos/BITSPERBYTE]=0;
 
-        // Swap byte order (if required)
-        bitcell=be16toh(bitcell);
+      bitpos-=(bitpos%BITSPERBYTE);
+    }
+  }
 
-        // Convert to hardware samplerate
-        bitcell=((double)bitcell/scalar);
+  return 0;
+}
 
-        while (bitcell>0)
-        {
-          bitcell--;
+// Read flux for a track as intervals between rising edges at the given samplerate,
+// matching what would be extracted from scp_readtrack() with a buffer of buflen bytes
+int scp_readintervals(SCP_Reader *scp, const unsigned long samplerate, const int track, const int side, Flux_Intervals *flux, const uint32_t buflen)
+{
+  double scalar=(double)scp->rate/(double)samplerate;
+  unsigned long maxbits=(unsigned long)buflen*BITSPERBYTE;
+  unsigned long bitpos=0;
+  unsigned long lastedge=0;
+  uint8_t i;
 
-          b=(b<<1)|((bitcell==0)?1:0);
-          blen++;
+  if (scp->mapped==NULL) return 0;
 
-          if (blen==BITSPERBYTE)
-          {
-            if (bufpos<buflen)
-              buf[bufpos++]=b;
+  flux->count=0;
+  flux->startlevel=0;
 
-            b=0; blen=0;
-          }
-        }
+  for (i=0; i<scp->header.revolutions; i++)
+  {
+    const uint8_t *fluxdata;
+    uint32_t fluxcount;
+    uint32_t sample;
+
+    fluxdata=scp_rotationdata(scp, track, side, i, &fluxcount);
+    if (fluxdata==NULL) break;
+
+    for (sample=0; sample<fluxcount; sample++)
+    {
+      uint16_t bitcell;
+
+      // Big-endian, convert to requested samplerate
+      bitcell=(fluxdata[sample*2]<<8)|fluxdata[(sample*2)+1];
+      bitcell=((double)bitcell/scalar);
+
+      if (bitcell==0) continue;
+
+      bitpos+=bitcell;
+      if (bitpos>maxbits)
+      {
+        bitpos=maxbits;
+        break;
+      }
+
+      // A single sample bitcell follows another transition so isn't a rising edge
+      if (bitcell==1)
+      {
+        if (bitpos==1)
+          flux->startlevel=1;
+
+        continue;
       }
 
-      fseek(scpfile, trackpos, SEEK_SET);
+      if (flux_addinterval(flux, bitpos-lastedge)==0)
+      {
+        fprintf(stderr, "Unable to allocate flux interval storage\n");
+        return 0;
+      }
+
+      lastedge=bitpos;
     }
+
+    // Only whole bytes of samples are kept, so drop any edges from a trailing partial byte
+    bitpos-=(bitpos%BITSPERBYTE);
+    while ((flux->count>0) && (lastedge>bitpos))
+      lastedge-=flux->interval[--flux->count];
+
+    if (bitpos>=maxbits) break;
   }
 
-  return 0;
+  flux->samplesize=bitpos/BITSPERBYTE;
+  flux->trailing=bitpos-lastedge;
+
+  return 1;
 }
 
 void scp_writeheader(FILE *scpfile, const uint8_t rotations, const uint8_t starttrack, const uint8_t endtrack, const float rpm, const uint8_t sides, const int sidetoread)
 {
-  uint8_t i;
-
   if (scpfile==NULL) return;
 
   bzero(&scpheader, sizeof(scpheader));
@@ -493,29 +598,57 @@ void scp_writeheader(FILE *scpfile, const uint8_t rotations, const uint8_t start
   }
 
   // Prepare for storing track offsets, and created space to store them in file
-  scp_trackoffsets=malloc(sizeof(uint32_t) * SCP_MAXTRACKS);
+  scp_trackoffsets=calloc(SCP_MAXTRACKS, sizeof(uint32_t));
 
   if (scp_trackoffsets==NULL) return;
 
   // Cache file position after header
   scp_endofheader=ftell(scpfile);
+  scp_writtensum=0;
 
   // Blank offsets to tracks - to be filled in later
-  for (i=0; i<(endtrack-starttrack+1); i++)
-    fprintf(scpfile, "%c%c%c%c", 0, 0, 0, 0);
+  fwrite(scp_trackoffsets, sizeof(uint32_t), (endtrack-starttrack+1), scpfile);
 }
 
-void scp_writetrack(FILE *scpfile, const uint8_t track, const unsigned char *rawtrackdata, const unsigned long rawdatalength, const uint8_t rotations, const float rpm)
+// Make sure the track buffer can take len more bytes
+int scp_reservetrack(const unsigned long len)
+{
+  unsigned long newsize;
+  uint8_t *newbuffer;
+
+  if ((scp_tracklen+len)<=scp_tracksize) return 1;
+
+  newsize=(scp_tracksize==0)?SCP_TRACKBUFFER:scp_tracksize;
+  while (newsize<(scp_tracklen+len))
+    newsize*=2;
+
+  newbuffer=realloc(scp_trackbuffer, newsize);
+  if (newbuffer==NULL) return 0;
+
+  scp_trackbuffer=newbuffer;
+  scp_tracksize=newsize;
+
+  return 1;
+}
+
+// Add bytes to the running checksum of everything written after the header
+void scp_addchecksum(const uint8_t *data, const unsigned long len)
+{
+  unsigned long i;
+
+  for (i=0; i<len; i++)
+    scp_writtensum+=data[i];
+}
+
+void scp_writetrack(FILE *scpfile, const uint8_t track, const unsigned char *rawtrackdata, const unsigned long rawdatalength, const uint8_t rotations, const float rpm, const unsigned long samplerate)
 {
   long scppos;
   uint8_t i;
-  unsigned char c,j;
-  unsigned long fluxdatapos;
   float celltime;
-  uint32_t value;
   unsigned long rotpoint;
   struct scp_tdh tdh;
   struct scp_timings timings;
+  Flux_Intervals flux;
 
   if (scpfile==NULL) return;
   if (scp_trackoffsets==NULL) return;
@@ -524,123 +657,98 @@ void scp_writetrack(FILE *scpfile, const uint8_t track, const unsigned char *raw
   scppos=ftell(scpfile);
   scp_trackoffsets[track]=scppos;
 
+  // Build the whole track in memory, starting with the header and timings table
+  scp_tracklen=0;
+  if (!scp_reservetrack(sizeof(tdh)+(sizeof(timings)*rotations))) return;
+
   memcpy(tdh.magic, SCP_TRACK, sizeof(tdh.magic)); // Track ID
   tdh.track=track; // Track number
 
-  // Write the track header
-  fwrite(&tdh, 1, sizeof(tdh), scpfile);
+  memcpy(&scp_trackbuffer[scp_tracklen], &tdh, sizeof(tdh));
+
+  // Leave space for the timings, filled in as each rotation is encoded
+  scp_tracklen+=sizeof(tdh)+(sizeof(timings)*rotations);
 
   rotpoint=rawdatalength/rotations;
 
-  // Write track timings
+  flux_init(&flux);
+
+  // Split raw data into rotations
   for (i=0; i<rotations; i++)
   {
+    uint32_t fluxtime;
+    unsigned long fluxlength;
+    unsigned long fluxpos;
+
     // Index time - duration of first revolution between index pulses (in nanoseconds/25)
     timings.indextime=(1/(rpm/SECONDSINMINUTE))*(NSINSECOND/SCP_BASE_NS);
 
-    // Track length (in bitcells)
-    timings.tracklen=0;
-
     // Data offset for track flux (from start of track)
-    timings.dataoffset=0;
+    timings.dataoffset=scp_tracklen;
 
-    fwrite(&timings, 1, sizeof(timings), scpfile);
-  }
+    // Find the rising edges within this rotation
+    fluxlength=rotpoint;
+    if ((rotpoint*(i+1))>rawdatalength)
+      fluxlength=(rawdatalength>(rotpoint*i))?(rawdatalength-(rotpoint*i)):0;
 
-  // Split raw data into rotations
-  for (i=0; i<rotations; i++)
-  {
-    long scpdatapos;
-    long trackpos;
-    uint32_t fluxtime;
-    uint32_t numfluxes;
-    char level,bi=0;
+    flux_extract(&flux, &rawtrackdata[rotpoint*i], fluxlength, FLUX_RISINGEDGES);
 
     // 16 bit big-endian time in nanoseconds/25 between fluxes
-    level=(rawtrackdata[rotpoint*i]&0x80)>>7;
-    bi=level;
-    fluxtime=0;
-    numfluxes=0;
-
-    scpdatapos=ftell(scpfile);
+    timings.tracklen=0;
 
-    // Process each byte of the raw flux data
-    for (fluxdatapos=(rotpoint*i); ((fluxdatapos<rotpoint*(i+1)) && (fluxdatapos<rawdatalength)); fluxdatapos++)
+    for (fluxpos=0; fluxpos<flux.count; fluxpos++)
     {
-      // Extract byte from buffer
-      c=rawtrackdata[fluxdatapos];
+      uint8_t *fluxdata;
+
+      // Convert samples into nanoseconds/25
+      celltime=(mod_samplestous(samplerate, flux.interval[fluxpos])*NSINUS)/SCP_BASE_NS;
 
-      // Process each bit of the extracted byte
-      for (j=0; j<BITSPERBYTE; j++)
+      // Convert back from float to uint16_t
+      fluxtime=roundf(celltime);
+
+      // Room for any overflow words plus the sample itself
+      if (!scp_reservetrack(((fluxtime/65536)+1)*2))
       {
-        // Determine next level
-        bi=((c&0x80)>>7);
-
-        // Increment samples counter
-        fluxtime++;
-
-        // Look for level changes
-        if (bi!=level)
-        {
-          // Flip level cache
-          level=1-level;
-
-          // Look for rising edge
-          if (level==1)
-          {
-            // Increment total number of fluxes
-            numfluxes++;
-
-            // Convert samples into nanoseconds/25
-            celltime=(mod_samplestous(fluxtime)*NSINUS)/SCP_BASE_NS;
-
-            // Convert back from float to uint16_t
-            fluxtime=roundf(celltime);
-
-            // Check for time overflow
-            while (fluxtime>65536)
-            {
-              fprintf(scpfile, "%c%c", 0, 0);
-              fluxtime-=65536;
-            }
-
-            // Write sample between fluxes, big-endian
-            fprintf(scpfile, "%c%c", (fluxtime>>8)&0xff, fluxtime&0xff);
-
-            // Reset samples counter
-            fluxtime=0;
-          }
-        }
-
-        // Move on to next sample level (bit)
-        c=c<<1;
+        flux_free(&flux);
+        return;
       }
-    }
 
-    // Store where we are
-    trackpos=ftell(scpfile);
+      fluxdata=&scp_trackbuffer[scp_tracklen];
+
+      // Check for time overflow
+      while (fluxtime>65536)
+      {
+        *fluxdata++=0;
+        *fluxdata++=0;
+        fluxtime-=65536;
+      }
 
-    // Go back to update table for this rotation
-    fseek(scpfile, scppos+4+(sizeof(timings)*i)+4, SEEK_SET);
+      // Sample between fluxes, big-endian
+      *fluxdata++=(fluxtime>>8)&0xff;
+      *fluxdata++=fluxtime&0xff;
 
-    value=numfluxes;
-    fwrite(&value, 1, sizeof(uint32_t), scpfile);
+      scp_tracklen=fluxdata-scp_trackbuffer;
 
-    value=(uint32_t)(scpdatapos-scppos);
-    fwrite(&value, 1, sizeof(uint32_t), scpfile);
+      // Increment total number of fluxes
+      timings.tracklen++;
+    }
 
-    // Reset back to where we were
-    fseek(scpfile, trackpos, SEEK_SET);
+    // Fill in the timings table entry for this rotation
+    memcpy(&scp_trackbuffer[sizeof(tdh)+(sizeof(timings)*i)], &timings, sizeof(timings));
   }
+
+  flux_free(&flux);
+
+  scp_addchecksum(scp_trackbuffer, scp_tracklen);
+  fwrite(scp_trackbuffer, 1, scp_tracklen, scpfile);
 }
 
 void scp_finalise(FILE *scpfile, const uint8_t endtrack)
 {
   struct tm tim;
   struct timeval tv;
-  uint32_t checksum;
-  uint8_t block[256];
-  size_t i;
+  char timestamp[32];
+  int timestamplen;
 
   if (scpfile==NULL) return;
 
@@ -648,37 +756,33 @@ void scp_finalise(FILE *scpfile, const uint8_t endtrack)
   gettimeofday(&tv, NULL);
   localtime_r(&tv.tv_sec, &tim);
 
-  fprintf(scpfile, "%02d/%02d/%d %02d:%02d:%02d", tim.tm_mday, tim.tm_mon+1, tim.tm_year+1900, tim.tm_hour, tim.tm_min, tim.tm_sec);
+  timestamplen=snprintf(timestamp, sizeof(timestamp), "%02d/%02d/%d %02d:%02d:%02d", tim.tm_mday, tim.tm_mon+1, tim.tm_year+1900, tim.tm_hour, tim.tm_min, tim.tm_sec);
+  if (timestamplen>(int)sizeof(timestamp)-1)
+    timestamplen=sizeof(timestamp)-1;
+
+  scp_addchecksum((uint8_t *)timestamp, timestamplen);
+  fwrite(timestamp, 1, timestamplen, scpfile);
 
   // TODO write optional footer
 
-  // update track data offsets table
+  // update track data offsets table, the space for it was blank so only adds to checksum
   if (scp_trackoffsets!=NULL)
   {
     fseek(scpfile, scp_endofheader, SEEK_SET);
     fwrite(scp_trackoffsets, 1, endtrack*sizeof(uint32_t), scpfile);
+    scp_addchecksum((uint8_t *)scp_trackoffsets, endtrack*sizeof(uint32_t));
     free(scp_trackoffsets);
     scp_trackoffsets=NULL;
   }
 
-  // Calculate 32bit checksum
-  fseek(scpfile, scp_endofheader, SEEK_SET);
-  checksum=0;
-  while (!feof(scpfile))
+  if (scp_trackbuffer!=NULL)
   {
-    size_t blocklen;
-
-    blocklen=fread(block, 1, sizeof(block), scpfile);
-    if (blocklen>0)
-    {
-      for (i=0; i<blocklen; i++)
-        checksum+=block[i];
-    }
-    else
-      return;
+    free(scp_trackbuffer);
+    scp_trackbuffer=NULL;
+    scp_tracksize=0;
   }
 
   // Update checksum in header
   fseek(scpfile, scp_endofheader-(sizeof(uint32_t)), SEEK_SET);
-  fwrite(&checksum, 1, sizeof(uint32_t), scpfile);
+  fwrite(&scp_writtensum, 1, sizeof(uint32_t), scpfile);
 }
@@ -1,6 +1,8 @@
 #ifndef _SCP_H_
 #define _SCP_H_
 
+#include "flux.h"
+
 #define SCP_MAGIC "SCP"
 #define SCP_VERSION 0x22
 
@@ -10,6 +12,9 @@
 
 #define SCP_BASE_NS 25
 
+// Initial size of buffer used to encode each track before writing
+#define SCP_TRACKBUFFER (128*1024)
+
 #define SCP_EXTFOOTER_MAGIC "FPCS"
 
 // Flags
@@ -143,13 +148,30 @@ struct scp_extfooter
 extern struct scp_header scpheader;
 extern uint32_t *scp_trackoffsets;
 
-extern long scp_readtrack(FILE * scpfile, const int track, const int side, unsigned char *buf, const uint32_t buflen);
+// State for reading an SCP file
+typedef struct SCPReader
+{
+  struct scp_header header;
+  long endofheader;
+  uint32_t *trackoffsets;
+  long rate; // Sample rate in Hz
+  float rpm;
+
+  // Whole file, mapped into memory
+  uint8_t *mapped;
+  size_t mappedsize;
+} SCP_Reader;
+
+extern long scp_readtrack(SCP_Reader *scp, const unsigned long samplerate, const int track, const int side, unsigned char *buf, const uint32_t buflen);
+
+extern int scp_readintervals(SCP_Reader *scp, const unsigned long samplerate, const int track, const int side, Flux_Intervals *flux, const uint32_t buflen);
 
-extern int scp_readheader(FILE *scpfile);
+extern int scp_readheader(FILE *scpfile, SCP_Reader *scp);
+extern void scp_close(SCP_Reader *scp);
 
 extern void scp_writeheader(FILE *scpfile, const uint8_t rotations, const uint8_t starttrack, const uint8_t endtrack, const float rpm, const uint8_t sides, const int sidetoread);
 
-extern void scp_writetrack(FILE *scpfile, const uint8_t track, const unsigned char *rawtrackdata, const unsigned long rawdatalength, const uint8_t rotations, const float rpm);
+extern void scp_writetrack(FILE *scpfile, const uint8_t track, const unsigned char *rawtrackdata, const unsigned long rawdatalength, const uint8_t rotations, const float rpm, const unsigned long samplerate);
 
 extern void scp_finalise(FILE *scpfile, const uint8_t endtrack);
 
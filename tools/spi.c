@@ -0,0 +1,204 @@
+#include <stdint.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
+#include "hardware.h"
+#include "spi.h"
+
+/*
+
+SPI sampling leaves a 1 sample gap between each group of 8 samples, this is
+filled by repeating the first sample of the following group, so every input
+byte becomes 9 output bits.
+
+Every 8 input bytes therefore produce exactly 9 output bytes. Treating the 8
+input bytes as a big-endian 64 bit word W, the first 8 output bytes are formed
+from W shifted right by 0 to 7 places, each masked to keep just the bits which
+land in that place. The 9th output byte is always a copy of the 8th input byte.
+
+*/
+
+// Masks applied to the input word shifted right by 0..7 places
+#define SPI_MASK0 0x8000000000000000ULL
+#define SPI_MASK1 0x7fc0000000000000ULL
+#define SPI_MASK2 0x003fe00000000000ULL
+#define SPI_MASK3 0x00001ff000000000ULL
+#define SPI_MASK4 0x0000000ff8000000ULL
+#define SPI_MASK5 0x0000000007fc0000ULL
+#define SPI_MASK6 0x000000000003fe00ULL
+#define SPI_MASK7 0x00000000000001ffULL
+
+// Number of input/output bytes in a group
+#define SPI_INGROUP 8
+#define SPI_OUTGROUP 9
+
+// Expand one group of 8 input bytes into 9 output bytes
+static inline void spi_fixgroup(const unsigned char *inbuf, unsigned char *outbuf)
+{
+  uint64_t w, o;
+  int i;
+
+  w=0;
+  for (i=0; i<SPI_INGROUP; i++)
+    w=(w<<8)|inbuf[i];
+
+  o=(w&SPI_MASK0) |
+    ((w>>1)&SPI_MASK1) |
+    ((w>>2)&SPI_MASK2) |
+    ((w>>3)&SPI_MASK3) |
+    ((w>>4)&SPI_MASK4) |
+    ((w>>5)&SPI_MASK5) |
+    ((w>>6)&SPI_MASK6) |
+    ((w>>7)&SPI_MASK7);
+
+  for (i=SPI_INGROUP-1; i>=0; i--)
+  {
+    outbuf[i]=o&0xff;
+    o>>=8;
+  }
+
+  outbuf[SPI_INGROUP]=inbuf[SPI_INGROUP-1];
+}
+
+#if defined(__SSE2__)
+// Reverse the byte order of each 64 bit lane
+static inline __m128i spi_bswap64(__m128i v)
+{
+  v=_mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+  v=_mm_shufflelo_epi16(v, _MM_SHUFFLE(0, 1, 2, 3));
+
+  return _mm_shufflehi_epi16(v, _MM_SHUFFLE(0, 1, 2, 3));
+}
+
+// Expand two groups of 8 input bytes into 18 output bytes
+static inline void spi_fixgroups(const unsigned char *inbuf, unsigned char *outbuf)
+{
+  __m128i w, o;
+
+  w=spi_bswap64(_mm_loadu_si128((const __m128i *)inbuf));
+
+  o=_mm_and_si128(w, _mm_set1_epi64x(SPI_MASK0));
+  o=_mm_or_si128(o, _mm_and_si128(_mm_srli_epi64(w, 1), _mm_set1_epi64x(SPI_MASK1)));
+  o=_mm_or_si128(o, _mm_and_si128(_mm_srli_epi64(w, 2), _mm_set1_epi64x(SPI_MASK2)));
+  o=_mm_or_si128(o, _mm_and_si128(_mm_srli_epi64(w, 3), _mm_set1_epi64x(SPI_MASK3)));
+  o=_mm_or_si128(o, _mm_and_si128(_mm_srli_epi64(w, 4), _mm_set1_epi64x(SPI_MASK4)));
+  o=_mm_or_si128(o, _mm_and_si128(_mm_srli_epi64(w, 5), _mm_set1_epi64x(SPI_MASK5)));
+  o=_mm_or_si128(o, _mm_and_si128(_mm_srli_epi64(w, 6), _mm_set1_epi64x(SPI_MASK6)));
+  o=_mm_or_si128(o, _mm_and_si128(_mm_srli_epi64(w, 7), _mm_set1_epi64x(SPI_MASK7)));
+
+  o=spi_bswap64(o);
+
+  _mm_storel_epi64((__m128i *)outbuf, o);
+  outbuf[SPI_INGROUP]=inbuf[SPI_INGROUP-1];
+
+  _mm_storel_epi64((__m128i *)&outbuf[SPI_OUTGROUP], _mm_unpackhi_epi64(o, o));
+  outbuf[SPI_OUTGROUP+SPI_INGROUP]=inbuf[(SPI_INGROUP*2)-1];
+}
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+// Expand two groups of 8 input bytes into 18 output bytes
+static inline void spi_fixgroups(const unsigned char *inbuf, unsigned char *outbuf)
+{
+  uint64x2_t w, o;
+  uint8x16_t b;
+
+  w=vreinterpretq_u64_u8(vrev64q_u8(vld1q_u8(inbuf)));
+
+  o=vandq_u64(w, vdupq_n_u64(SPI_MASK0));
+  o=vorrq_u64(o, vandq_u64(vshrq_n_u64(w, 1), vdupq_n_u64(SPI_MASK1)));
+  o=vorrq_u64(o, vandq_u64(vshrq_n_u64(w, 2), vdupq_n_u64(SPI_MASK2)));
+  o=vorrq_u64(o, vandq_u64(vshrq_n_u64(w, 3), vdupq_n_u64(SPI_MASK3)));
+  o=vorrq_u64(o, vandq_u64(vshrq_n_u64(w, 4), vdupq_n_u64(SPI_MASK4)));
+  o=vorrq_u64(o, vandq_u64(vshrq_n_u64(w, 5), vdupq_n_u64(SPI_MASK5)));
+  o=vorrq_u64(o, vandq_u64(vshrq_n_u64(w, 6), vdupq_n_u64(SPI_MASK6)));
+  o=vorrq_u64(o, vandq_u64(vshrq_n_u64(w, 7), vdupq_n_u64(SPI_MASK7)));
+
+  b=vrev64q_u8(vreinterpretq_u8_u64(o));
+
+  vst1_u8(outbuf, vget_low_u8(b));
+  outbuf[SPI_INGROUP]=inbuf[SPI_INGROUP-1];
+
+  vst1_u8(&outbuf[SPI_OUTGROUP], vget_high_u8(b));
+  outbuf[SPI_OUTGROUP+SPI_INGROUP]=inbuf[(SPI_INGROUP*2)-1];
+}
+#else
+// Expand two groups of 8 input bytes into 18 output bytes
+static inline void spi_fixgroups(const unsigned char *inbuf, unsigned char *outbuf)
+{
+  spi_fixgroup(inbuf, outbuf);
+  spi_fixgroup(&inbuf[SPI_INGROUP], &outbuf[SPI_OUTGROUP]);
+}
+#endif
+
+// Fix SPI sample buffer timings
+void spi_fixsamples(const unsigned char *inbuf, const long inlen, unsigned char *outbuf, const long outlen)
+{
+  long inpos, outpos;
+  unsigned char o, olen, bitpos;
+
+  inpos=0; outpos=0;
+
+  // Process as many whole pairs of groups as will fit
+  while (((inpos+(SPI_INGROUP*2))<=inlen) && ((outpos+(SPI_OUTGROUP*2))<=outlen))
+  {
+    spi_fixgroups(&inbuf[inpos], &outbuf[outpos]);
+
+    inpos+=(SPI_INGROUP*2);
+    outpos+=(SPI_OUTGROUP*2);
+  }
+
+  // Then any remaining whole group
+  if (((inpos+SPI_INGROUP)<=inlen) && ((outpos+SPI_OUTGROUP)<=outlen))
+  {
+    spi_fixgroup(&inbuf[inpos], &outbuf[outpos]);
+
+    inpos+=SPI_INGROUP;
+    outpos+=SPI_OUTGROUP;
+  }
+
+  // Finish off a sample at a time
+  o=0; olen=0;
+
+  for (; inpos<inlen; inpos++)
+  {
+    unsigned char c;
+
+    // Stop on output buffer overflow
+    if (outpos>=outlen) return;
+
+    c=inbuf[inpos];
+
+    // Insert extra sample
+    o=(o<<1)|((c&0x80)>>7);
+    olen++;
+    if (olen==BITSPERBYTE)
+    {
+      if (outpos<outlen)
+        outbuf[outpos++]=o;
+
+      olen=0; o=0;
+    }
+
+    // Process the 8 valid samples we did get
+    for (bitpos=0; bitpos<BITSPERBYTE; bitpos++)
+    {
+      o=(o<<1)|((c&0x80)>>7);
+      olen++;
+
+      if (olen==BITSPERBYTE)
+      {
+        if (outpos<outlen)
+          outbuf[outpos++]=o;
+
+        olen=0; o=0;
+      }
+
+      c=c<<1;
+    }
+  }
+}
@@ -0,0 +1,7 @@
+#ifndef _SPI_H_
+#define _SPI_H_
+
+// Fix SPI sample buffer timings by inserting the sample missed between each group of 8
+extern void spi_fixsamples(const unsigned char *inbuf, const long inlen, unsigned char *outbuf, const long outlen);
+
+#endif
@@ -34,7 +34,7 @@ int td0_checkrepeats(uint8_t *buf, uint16_t buflen)
   return 0;
 }
 
-void td0_write(FILE *td0file, const unsigned char tracks, const char *title, const uint8_t sides, const int sidetoread)
+void td0_write(Disk_Store *store, FILE *td0file, const unsigned char tracks, const char *title, const uint8_t sides, const int sidetoread)
 {
   struct header_s header;
   struct comment_s comment;
@@ -62,7 +62,7 @@ void td0_write(FILE *td0file, const unsigned char tracks, const char *title, con
   header.sequence=0;
   header.checkseq=74;
   header.version=21;
-  header.datarate=0|(diskstore_countsectormod(MODFM)>0?(128|2):2); // TODO
+  header.datarate=0|(diskstore_countsectormod(store, MODFM)>0?(128|2):2); // TODO
   header.drivetype=4; // TODO
   header.stepping=0|0x80; // TODO
   header.dosflag=0;
@@ -90,10 +90,10 @@ void td0_write(FILE *td0file, const unsigned char tracks, const char *title, con
   {
     unsigned char totalsectors;
 
-    totalsectors=diskstore_countsectors(curtrack*hw_stepping, sidetoread);
+    totalsectors=diskstore_countsectors(store, curtrack*store->stepping, sidetoread);
 
     if (sides==2)
-      totalsectors+=diskstore_countsectors(curtrack*hw_stepping, 1-sidetoread);
+      totalsectors+=diskstore_countsectors(store, curtrack*store->stepping, 1-sidetoread);
 
     if (totalsectors>0)
     {
@@ -102,7 +102,7 @@ void td0_write(FILE *td0file, const unsigned char tracks, const char *title, con
       {
         if (sides==1) curhead=sidetoread;
 
-        numsectors=diskstore_countsectors(curtrack*hw_stepping, curhead);
+        numsectors=diskstore_countsectors(store, curtrack*store->stepping, curhead);
 
         // Track header
         track.track=curtrack;
@@ -116,7 +116,7 @@ void td0_write(FILE *td0file, const unsigned char tracks, const char *title, con
           // Loop through the sectors
           for (cursector=0; cursector<numsectors; cursector++)
           {
-            sec=diskstore_findnthsector(curtrack*hw_stepping, curhead, cursector);
+            sec=diskstore_findnthsector(store, curtrack*store->stepping, curhead, cursector);
 
             if (sec!=NULL)
             {
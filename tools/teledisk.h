@@ -3,6 +3,8 @@
 
 #include <stdint.h>
 
+#include "diskstore.h"
+
 #define TELEDISK_POLYNOMIAL 0xa097
 
 #define TELEDISK_LAST_TRACK 0xff
@@ -75,6 +77,6 @@ struct datarepeat_s
 
 #pragma pack(pop)
 
-extern void td0_write(FILE *td0file, const unsigned char tracks, const char *title, const uint8_t sides, const int sidetoread);
+extern void td0_write(Disk_Store *store, FILE *td0file, const unsigned char tracks, const char *title, const uint8_t sides, const int sidetoread);
 
 #endif
@@ -9,11 +9,7 @@
 #include "woz.h"
 #include "crc32.h"
 
-struct woz_header wozheader;
-int woz_is525=0; // Is the capture from a 5.25" disk in SS 40t 0.25 step
-uint8_t woz_trackmap[WOZ_MAXTRACKS]; // Index for track data within TRKS chunk
-
-long woz_readtrack(FILE *wozfile, const int track, const int side, unsigned char *buf, const uint32_t buflen)
+long woz_readtrack(FILE *wozfile, WOZ_Reader *woz, const int track, const int side, unsigned char *buf, const uint32_t buflen)
 {
   uint16_t toffset;
 
@@ -21,11 +17,11 @@ long woz_readtrack(FILE *wozfile, const int track, const int side, unsigned char
   bzero(buf, buflen);
 
   // If this is a 5.25" image then only process requests for side 0
-  if ((woz_is525) && (side!=0))
+  if ((woz->is525) && (side!=0))
     return 0;
 
   // Determine where data for this track should be
-  if (woz_is525)
+  if (woz->is525)
   {
     toffset=track*4;
   }
@@ -39,10 +35,10 @@ long woz_readtrack(FILE *wozfile, const int track, const int side, unsigned char
     return 1;
 
   // Make sure it's not a blank track
-  if (woz_trackmap[toffset]==WOZ_NOTRACK)
+  if (woz->trackmap[toffset]==WOZ_NOTRACK)
     return 0;
 
-  if (wozheader.id[3]=='1')
+  if (woz->header.id[3]=='1')
   {
     struct woz_trks1 trks;
     uint32_t i;
@@ -51,7 +47,7 @@ long woz_readtrack(FILE *wozfile, const int track, const int side, unsigned char
     uint8_t outb;
     uint8_t outblen;
 
-    fseek(wozfile, (woz_trackmap[toffset]*sizeof(trks))+WOZ_TRKS_OFFSET, SEEK_SET);
+    fseek(wozfile, (woz->trackmap[toffset]*sizeof(trks))+WOZ_TRKS_OFFSET, SEEK_SET);
     if (fread(&trks, sizeof(trks), 1, wozfile)==0)
       return -1;
 
@@ -100,7 +96,7 @@ long woz_readtrack(FILE *wozfile, const int track, const int side, unsigned char
     uint32_t done;
 
     // Read TRKS data for this track
-    fseek(wozfile, (woz_trackmap[toffset]*sizeof(trks))+WOZ_TRKS_OFFSET, SEEK_SET);
+    fseek(wozfile, (woz->trackmap[toffset]*sizeof(trks))+WOZ_TRKS_OFFSET, SEEK_SET);
     if (fread(&trks, sizeof(trks), 1, wozfile)==0)
       return -1;
 
@@ -159,7 +155,7 @@ long woz_readtrack(FILE *wozfile, const int track, const int side, unsigned char
   return 1;
 }
 
-int woz_processinfo(struct woz_chunkheader *chunkheader, FILE *wozfile)
+int woz_processinfo(WOZ_Reader *woz, struct woz_chunkheader *chunkheader, FILE *wozfile)
 {
   struct woz_info *info;
   info=malloc(chunkheader->chunksize);
@@ -175,25 +171,25 @@ int woz_processinfo(struct woz_chunkheader *chunkheader, FILE *wozfile)
   }
 
   if (info->disktype==1)
-    woz_is525=1;
+    woz->is525=1;
 
   free(info);
 
   return 0;
 }
 
-int woz_processtmap(struct woz_chunkheader *chunkheader, FILE *wozfile)
+int woz_processtmap(WOZ_Reader *woz, struct woz_chunkheader *chunkheader, FILE *wozfile)
 {
   if (chunkheader->chunksize!=WOZ_MAXTRACKS)
     return 1;
 
-  if (fread(woz_trackmap, sizeof(woz_trackmap), 1, wozfile)==0)
+  if (fread(woz->trackmap, sizeof(woz->trackmap), 1, wozfile)==0)
     return 1;
 
   return 0;
 }
 
-int woz_readheader(FILE *wozfile)
+int woz_readheader(FILE *wozfile, WOZ_Reader *woz)
 {
   long filepos;
   unsigned char buf;
@@ -201,19 +197,19 @@ int woz_readheader(FILE *wozfile)
 
   if (wozfile==NULL) return -1;
 
-  if (fread(&wozheader, sizeof(wozheader), 1, wozfile)==0)
+  if (fread(&woz->header, sizeof(woz->header), 1, wozfile)==0)
     return -1;
 
-  if (strncmp((char *)&wozheader.id, WOZ_MAGIC1, strlen(WOZ_MAGIC1))!=0)
+  if (strncmp((char *)&woz->header.id, WOZ_MAGIC1, strlen(WOZ_MAGIC1))!=0)
   {
-    if (strncmp((char *)&wozheader.id, WOZ_MAGIC2, strlen(WOZ_MAGIC2))!=0)
+    if (strncmp((char *)&woz->header.id, WOZ_MAGIC2, strlen(WOZ_MAGIC2))!=0)
       return -1;
   }
 
-  if (wozheader.ff!=0xff)
+  if (woz->header.ff!=0xff)
     return -1;
 
-  if ((wozheader.lfcrlf[0]!=0x0a) || (wozheader.lfcrlf[1]!=0x0d) || (wozheader.lfcrlf[2]!=0x0a))
+  if ((woz->header.lfcrlf[0]!=0x0a) || (woz->header.lfcrlf[1]!=0x0d) || (woz->header.lfcrlf[2]!=0x0a))
     return -1;
 
   // Check CRC32
@@ -227,7 +223,7 @@ int woz_readheader(FILE *wozfile)
       woz_calccrc=CRC32_CalcStream(woz_calccrc, &buf, 1);
   }
 
-  if (wozheader.crc!=woz_calccrc)
+  if (woz->header.crc!=woz_calccrc)
     return -1;
 
   // Looks ok so far, now look for and process INFO chunk
@@ -242,7 +238,7 @@ int woz_readheader(FILE *wozfile)
 
     if (strncmp((char *)&chunkheader.id, WOZ_CHUNK_INFO, 4)==0)
     {
-      if (woz_processinfo(&chunkheader, wozfile)!=0)
+      if (woz_processinfo(woz, &chunkheader, wozfile)!=0)
         return -1;
       else
         break;
@@ -263,7 +259,7 @@ int woz_readheader(FILE *wozfile)
 
     if (strncmp((char *)&chunkheader.id, WOZ_CHUNK_TMAP, 4)==0)
     {
-      if (woz_processtmap(&chunkheader, wozfile)!=0)
+      if (woz_processtmap(woz, &chunkheader, wozfile)!=0)
         return -1;
       else
         break;
@@ -272,7 +268,7 @@ int woz_readheader(FILE *wozfile)
       fseek(wozfile, chunkheader.chunksize, SEEK_CUR);
   }
 
-  hw_samplerate=(USINSECOND/APPLEGCR_BITCELL)*2;
+  woz->rate=(USINSECOND/APPLEGCR_BITCELL)*2;
 
   return 0;
 }
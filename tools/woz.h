@@ -95,8 +95,17 @@ struct woz_trks2
 
 #pragma pack(pop)
 
-extern long woz_readtrack(FILE *wozfile, const int track, const int side, unsigned char* buf, const uint32_t buflen);
+// State for reading a WOZ file
+typedef struct WOZReader
+{
+  struct woz_header header;
+  int is525; // Is the capture from a 5.25" disk in SS 40t 0.25 step
+  uint8_t trackmap[WOZ_MAXTRACKS]; // Index for track data within TRKS chunk
+  long rate; // Sample rate tracks are generated at
+} WOZ_Reader;
+
+extern long woz_readtrack(FILE *wozfile, WOZ_Reader *woz, const int track, const int side, unsigned char* buf, const uint32_t buflen);
 
-extern int woz_readheader(FILE *wozfile);
+extern int woz_readheader(FILE *wozfile, WOZ_Reader *woz);
 
 #endif